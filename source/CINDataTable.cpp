@@ -0,0 +1,563 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+#include <fstream>
+#include <iterator>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__LINUX__) || defined(__linux__)
+#include <endian.h>
+#else
+#include <sys/endian.h>
+#endif
+#include "CINDataTable.h"
+
+/* The compiled table format ************************************************
+// **************************************************************************
+*/
+
+// A compiled table is a sequence of big-endian 32-bit words:
+//  * the header: two magic words, flags, maximum conversion length, node count, range count, value count, and blob length;
+//  * the double-array trie base and check arrays, each node count long;
+//  * the ranges, pairs of first value and value count, one per distinct raw key sequence;
+//  * the values, pairs of blob offset and length, one per conversion;
+//  * the blob of UCS-32 characters that the values and engravings point into; and
+//  * 256 engravings, pairs of blob offset and length plus 1 (0 meaning no engraving), indexed by key character.
+// Trie labels are key characters plus 1, with label 0 being the terminator child that holds the range as -(range + 1) in its base.
+// A check word holds the parent node index plus 1, 0 marking an unused node.
+
+namespace {
+
+const uint32_t MAGIC0(0x6E6F7368U);	// "nosh"
+const uint32_t MAGIC1(0x43494E31U);	// "CIN1"
+const uint32_t FOLD_CASE_FLAG(0x00000001U);
+const std::size_t HEADER_WORDS(8U);
+const std::size_t ENGRAVINGS(256U);
+
+inline
+bool
+is_begin (
+	const CINDataTable::charvec & v
+) {
+	return 5 == v.size() && 'b' == v[0] && 'e' == v[1] && 'g' == v[2] && 'i' == v[3] && 'n' == v[4];
+}
+
+inline
+bool
+is_end (
+	const CINDataTable::charvec & v
+) {
+	return 3 == v.size() && 'e' == v[0] && 'n' == v[1] && 'd' == v[2];
+}
+
+inline
+unsigned
+label_for (
+	const std::string & key,
+	std::size_t depth
+) {
+	return depth < key.length() ? static_cast<unsigned char>(key[depth]) + 1U : 0U;
+}
+
+/// \brief Build a double-array trie over a sorted list of distinct keys.
+struct DoubleArrayBuilder
+{
+	DoubleArrayBuilder(const std::vector<std::string> & k) : keys(k), base(1U, 0), check(1U, ~0U), first_free(1U) {}
+
+	void build() { if (!keys.empty()) place(0U, 0U, keys.size(), 0U); }
+
+	const std::vector<std::string> & keys;
+	std::vector<int32_t> base;
+	std::vector<uint32_t> check;
+protected:
+	std::size_t first_free;
+
+	std::size_t find_base(const std::vector<unsigned> &);
+	void place(std::size_t node, std::size_t lo, std::size_t hi, std::size_t depth);
+};
+
+std::size_t
+DoubleArrayBuilder::find_base (
+	const std::vector<unsigned> & labels
+) {
+	while (first_free < check.size() && check[first_free]) ++first_free;
+	for (std::size_t b(first_free > labels.front() + 1U ? first_free - labels.front() : 1U); ; ++b) {
+		const std::size_t top(b + labels.back() + 1U);
+		if (check.size() < top) {
+			check.resize(top, 0U);
+			base.resize(top, 0);
+		}
+		bool fits(true);
+		for (std::vector<unsigned>::const_iterator i(labels.begin()), e(labels.end()); fits && i != e; ++i)
+			fits = !check[b + *i];
+		if (fits) return b;
+	}
+}
+
+void
+DoubleArrayBuilder::place (
+	std::size_t node,
+	std::size_t lo,
+	std::size_t hi,
+	std::size_t depth
+) {
+	// The keys are sorted, so each child's keys are contiguous and the labels come out in ascending order.
+	std::vector<unsigned> labels;
+	std::vector<std::size_t> starts;
+	for (std::size_t i(lo); i < hi; ++i) {
+		const unsigned l(label_for(keys[i], depth));
+		if (labels.empty() || labels.back() != l) {
+			labels.push_back(l);
+			starts.push_back(i);
+		}
+	}
+	starts.push_back(hi);
+	const std::size_t b(find_base(labels));
+	base[node] = static_cast<int32_t>(b);
+	for (std::vector<unsigned>::const_iterator i(labels.begin()), e(labels.end()); i != e; ++i)
+		check[b + *i] = node + 1U;
+	for (std::size_t k(0U); k < labels.size(); ++k) {
+		const std::size_t child(b + labels[k]);
+		if (0U == labels[k])
+			base[child] = -static_cast<int32_t>(starts[k] + 1U);
+		else
+			place(child, starts[k], starts[k + 1U], depth + 1U);
+	}
+}
+
+inline
+void
+append (
+	std::vector<uint32_t> & blob,
+	const CINDataTable::charvec & s
+) {
+	for (CINDataTable::charvec::const_iterator i(s.begin()), e(s.end()); i != e; ++i)
+		blob.push_back(*i);
+}
+
+}
+
+/* Data tables **************************************************************
+// **************************************************************************
+*/
+
+CINDataTable::CINDataTable(
+) :
+	fold_case(true),
+	max_conversion_length(0U),
+	image(0),
+	image_size(0U)
+{
+}
+
+CINDataTable::~CINDataTable()
+{
+	if (image) munmap(const_cast<uint32_t *>(image), image_size);
+}
+
+void
+CINDataTable::add_raw_to_kana(
+	const std::string & r,
+	const charvec & c
+) {
+	if (max_conversion_length < r.length())
+		max_conversion_length = r.length();
+	raw_to_kana.insert(std::make_pair(r,c));
+}
+
+CINDataTable::charvec
+CINDataTable::compiled_string (
+	uint32_t offset,
+	uint32_t length
+) const {
+	charvec r;
+	if (offset <= compiled.blob_length && length <= compiled.blob_length - offset) {
+		r.reserve(length);
+		for (const uint32_t * p(compiled.blob + offset), * e(p + length); p != e; ++p)
+			r.push_back(be32toh(*p));
+	}
+	return r;
+}
+
+CINDataTable::charvec
+CINDataTable::engraving_for (
+	char c
+) const {
+	if (image) {
+		const uint32_t * const p(compiled.engravings + 2U * static_cast<unsigned char>(c));
+		if (const uint32_t length = be32toh(p[1]))
+			return compiled_string(be32toh(p[0]), length - 1U);
+	} else
+	{
+		engraving_map::const_iterator i(raw_to_engraving.find(c));
+		if (raw_to_engraving.end() != i)
+			return i->second;
+	}
+	charvec r;
+	r.push_back(uint_fast32_t(c));
+	return r;
+}
+
+bool
+CINDataTable::find_compiled_range (
+	const std::string & ro_lo,
+	uint32_t & range
+) const {
+	uint32_t s(0U);
+	for (std::size_t depth(0U); depth <= ro_lo.length(); ++depth) {
+		const int32_t b(static_cast<int32_t>(be32toh(compiled.base[s])));
+		if (b <= 0) return false;
+		const uint32_t t(static_cast<uint32_t>(b) + label_for(ro_lo, depth));
+		if (t >= compiled.node_count || be32toh(compiled.check[t]) != s + 1U) return false;
+		s = t;
+	}
+	const int32_t b(static_cast<int32_t>(be32toh(compiled.base[s])));
+	if (b >= 0) return false;
+	range = static_cast<uint32_t>(-(b + 1));
+	return range < compiled.range_count;
+}
+
+bool
+CINDataTable::find_conversions (
+	const std::string & ro_lo,
+	conversion_list & results
+) const {
+	results.clear();
+	if (image) {
+		uint32_t range;
+		if (!find_compiled_range(ro_lo, range)) return false;
+		const uint32_t first(be32toh(compiled.ranges[2U * range + 0U])), count(be32toh(compiled.ranges[2U * range + 1U]));
+		if (first > compiled.value_count || count > compiled.value_count - first) return false;
+		for (const uint32_t * p(compiled.values + 2U * first), * e(p + 2U * count); p != e; p += 2)
+			results.push_back(compiled_string(be32toh(p[0]), be32toh(p[1])));
+		return true;
+	}
+	conversion_map::const_iterator i(raw_to_kana.find(ro_lo));
+	if (raw_to_kana.end() == i) return false;
+	for (conversion_map::const_iterator e(raw_to_kana.upper_bound(i->first)); i != e; ++i)
+		results.push_back(i->second);
+	return true;
+}
+
+bool
+CINDataTable::map_compiled (
+	int fd
+) {
+	struct stat s;
+	if (0 > fstat(fd, &s)) return false;
+	if (s.st_size < 0) return false;
+	const std::size_t size(s.st_size);
+	if (size < HEADER_WORDS * sizeof *image || 0U != size % sizeof *image) return false;
+	void * const base(mmap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+	if (MAP_FAILED == base) return false;
+	const uint32_t * const words(static_cast<const uint32_t *>(base));
+	const uint64_t node_count(be32toh(words[4])), range_count(be32toh(words[5])), value_count(be32toh(words[6])), blob_length(be32toh(words[7]));
+	if (MAGIC0 != be32toh(words[0])
+	||  MAGIC1 != be32toh(words[1])
+	||  node_count < 1U
+	||  HEADER_WORDS + 2U * (node_count + range_count + value_count + ENGRAVINGS) + blob_length != size / sizeof *words
+	) {
+		munmap(base, size);
+		return false;
+	}
+	if (image) munmap(const_cast<uint32_t *>(image), image_size);
+	image = words;
+	image_size = size;
+	fold_case = be32toh(words[2]) & FOLD_CASE_FLAG;
+	max_conversion_length = be32toh(words[3]);
+	compiled.node_count = node_count;
+	compiled.range_count = range_count;
+	compiled.value_count = value_count;
+	compiled.blob_length = blob_length;
+	compiled.base = words + HEADER_WORDS;
+	compiled.check = compiled.base + node_count;
+	compiled.ranges = compiled.check + node_count;
+	compiled.values = compiled.ranges + 2U * range_count;
+	compiled.blob = compiled.values + 2U * value_count;
+	compiled.engravings = compiled.blob + blob_length;
+	raw_to_kana.clear();
+	raw_to_engraving.clear();
+	return true;
+}
+
+void
+CINDataTable::write_compiled (
+	std::FILE * f
+) const {
+	std::vector<std::string> keys;
+	std::vector<uint32_t> ranges, values, blob;
+	for (conversion_map::const_iterator i(raw_to_kana.begin()), e(raw_to_kana.end()); i != e; ) {
+		const conversion_map::const_iterator u(raw_to_kana.upper_bound(i->first));
+		keys.push_back(i->first);
+		ranges.push_back(values.size() / 2U);
+		ranges.push_back(std::distance(i, u));
+		for (; i != u; ++i) {
+			values.push_back(blob.size());
+			values.push_back(i->second.size());
+			append(blob, i->second);
+		}
+	}
+	std::vector<uint32_t> engravings(2U * ENGRAVINGS, 0U);
+	for (engraving_map::const_iterator i(raw_to_engraving.begin()), e(raw_to_engraving.end()); i != e; ++i) {
+		const unsigned k(static_cast<unsigned char>(i->first));
+		engravings[2U * k + 0U] = blob.size();
+		engravings[2U * k + 1U] = i->second.size() + 1U;
+		append(blob, i->second);
+	}
+	DoubleArrayBuilder trie(keys);
+	trie.build();
+
+	std::vector<uint32_t> words;
+	words.reserve(HEADER_WORDS + 2U * trie.base.size() + ranges.size() + values.size() + blob.size() + engravings.size());
+	words.push_back(MAGIC0);
+	words.push_back(MAGIC1);
+	words.push_back(fold_case ? FOLD_CASE_FLAG : 0U);
+	words.push_back(max_conversion_length);
+	words.push_back(trie.base.size());
+	words.push_back(ranges.size() / 2U);
+	words.push_back(values.size() / 2U);
+	words.push_back(blob.size());
+	words.insert(words.end(), trie.base.begin(), trie.base.end());
+	words.insert(words.end(), trie.check.begin(), trie.check.end());
+	words.insert(words.end(), ranges.begin(), ranges.end());
+	words.insert(words.end(), values.begin(), values.end());
+	words.insert(words.end(), blob.begin(), blob.end());
+	words.insert(words.end(), engravings.begin(), engravings.end());
+	for (std::vector<uint32_t>::iterator i(words.begin()), e(words.end()); i != e; ++i)
+		*i = htobe32(*i);
+	std::fwrite(words.data(), sizeof *words.data(), words.size(), f);
+}
+
+/* Loading text data tables *************************************************
+// **************************************************************************
+*/
+
+CINDataTableLoader::CINDataTableLoader(
+	CINDataTable & t,
+	const char * p,
+	const char * f
+) :
+	table(t),
+	decoder(*this),
+	state(FIRST),
+	chardef(false),
+	keyname(false),
+	prog(p),
+	filename(f),
+	line(0UL)
+{
+}
+
+void
+CINDataTableLoader::load (
+) {
+	std::ifstream f(filename);
+	if (!f) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, filename, std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+	line = 1UL;
+	for (int c(f.get()); EOF != c; c = f.get()) 
+		decoder.Process(c);
+}
+
+void
+CINDataTableLoader::ProcessDecodedUTF8(
+	uint32_t character,
+	bool decoder_error,
+	bool /*overlong*/
+) {
+	if (decoder_error) {
+		std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid UTF-8 in file.");
+		throw EXIT_FAILURE;
+	}
+	if ('\n' == character) ++line;
+	switch (state) {
+		case FIRST:
+			if ('\n' == character)
+				break;
+			else
+			{
+				first.clear();
+				second.clear();
+				if ('%' == character)
+					state = DIRECTIVE_FIRST;
+				else
+				if ('#' == character)
+					state = COMMENT_REST;
+				else
+				if (character < 0x100 && std::isspace(character))
+					state = DATA_FIRST;
+				else
+				{
+					state = DATA_FIRST;
+					goto data1;
+				}
+			}
+			break;
+
+		case COMMENT_REST:
+			if ('\n' == character)
+				state = FIRST;
+			break;
+
+		// Parsing directives into a leading ASCII portion and a trailing Unicode portion.
+
+		case DIRECTIVE_FIRST:
+			if ('\n' == character)
+				goto directive_end;
+			if (0x100 <= character) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid directive name.");
+				throw EXIT_FAILURE;
+			} else
+			if (!std::isspace(static_cast<char>(character)))
+				first.push_back(static_cast<char>(character));
+			else
+			if (first.empty()) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid directive line with empty first field.");
+				throw EXIT_FAILURE;
+			} else
+			{
+				state = DIRECTIVE_SPACE1;
+				goto directive_space;
+			}
+			break;
+		case DIRECTIVE_SPACE1:
+		directive_space:
+			if ('\n' == character)
+				goto directive_end;
+			else
+			if (0x100 <= character || !std::isspace(static_cast<char>(character))) {
+				state = DIRECTIVE_SECOND;
+				goto directive2;
+			}
+			break;
+		case DIRECTIVE_SECOND:
+			if ('\n' == character)
+				goto directive_end;
+			else
+		directive2:
+				second.push_back(character);
+			break;
+		case DIRECTIVE_REST:
+			if ('\n' == character)
+				goto directive_end;
+			break;
+		directive_end:
+			if ("keyname" == first) {
+				if (is_begin(second)) {
+					keyname = true;
+					chardef = false;
+				} else
+				if (is_end(second)) {
+					keyname = false;
+				} else
+				{
+					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Directive followed by neither begin nor end.");
+					throw EXIT_FAILURE;
+				}
+			} else
+			if ("chardef" == first) {
+				if (is_begin(second)) {
+					chardef = true;
+					keyname = false;
+				} else
+				if (is_end(second)) {
+					chardef = false;
+				} else
+				{
+					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Directive followed by neither begin nor end.");
+					throw EXIT_FAILURE;
+				}
+			} else
+			if ("keep_key_case" == first)
+				table.set_fold_case(false);
+			else
+				;
+			state = FIRST;
+			break;
+
+		// Parsing data lines into a leading ASCII field, a Unicode field, and a trailing portion that is ignored.
+
+		case DATA_FIRST:
+			if ('\n' == character) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with only 1 field.");
+				throw EXIT_FAILURE;
+			}
+		data1:
+			if (0x100 <= character) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid raw data field.");
+				throw EXIT_FAILURE;
+			} else
+			if (!std::isspace(static_cast<char>(character)))
+				first.push_back(static_cast<char>(character));
+			else
+			if (first.empty()) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with empty first field.");
+				throw EXIT_FAILURE;
+			} else
+			{
+				state = DATA_SPACE1;
+				goto data_space;
+			}
+			break;
+		case DATA_SPACE1:
+		data_space:
+			if ('\n' == character) {
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with only 1 field.");
+				throw EXIT_FAILURE;
+			} else
+			if (0x100 <= character || !std::isspace(static_cast<char>(character))) {
+				state = DATA_SECOND;
+				goto data2;
+			}
+			break;
+		case DATA_SECOND:
+			if ('\n' == character)
+				goto data_end;
+		data2:
+			if (character < 0x100 && std::isspace(static_cast<char>(character))) {
+				state = DATA_REST;
+				goto data_rest;
+			} else
+				second.push_back(character);
+			break;
+		case DATA_REST:
+		data_rest:
+			if ('\n' == character)
+				goto data_end;
+			break;
+		data_end:
+			if (keyname) {
+				if (first.length() != 1U) {
+					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid key name that is not 1 character.");
+					throw EXIT_FAILURE;
+				}
+				table.add_engraving(first.front(), second);
+			} else
+			if (chardef)
+				table.add_raw_to_kana(first, second);
+			else
+			{
+				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Bogus data not part of an engraving or a conversion.");
+				throw EXIT_FAILURE;
+			}
+			state = FIRST;
+			break;
+	}
+}
@@ -0,0 +1,88 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#if !defined(INCLUDE_CINDATATABLE_H)
+#define INCLUDE_CINDATATABLE_H
+
+#include <vector>
+#include <list>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include "UTF8Decoder.h"
+
+/// \brief A CIN input method data table, mapping raw key sequences to conversions and keys to engravings.
+///
+/// A table is either built up in memory by a CINDataTableLoader from a text CIN file, or is a read-only memory-mapped image of a file previously compiled with write_compiled().
+/// The compiled form holds the conversions in a double-array trie, and is looked up in place without any parsing at load time.
+class CINDataTable
+{
+public:
+	typedef std::vector<uint_fast32_t> charvec;
+	typedef std::list<charvec> conversion_list;
+
+	CINDataTable();
+	~CINDataTable();
+
+	void set_fold_case(bool v) { fold_case = v; }
+	bool query_fold_case() const { return fold_case; }
+	void add_raw_to_kana(const std::string & r, const charvec & c);
+	void add_engraving(char k, const charvec & c) { raw_to_engraving.insert(std::make_pair(k,c)); }
+
+	bool exceeds_max_conversion_length(std::size_t l) const { return l > max_conversion_length; }
+	bool find_conversions (const std::string &, conversion_list &) const;
+	charvec engraving_for(char) const;
+
+	/// Map a compiled table image from the open file; returning false if the file is not a valid compiled table.
+	bool map_compiled(int fd);
+	/// Write the in-memory table out in compiled form.
+	void write_compiled(std::FILE *) const;
+
+protected:
+	typedef std::multimap<std::string,charvec> conversion_map;
+	conversion_map raw_to_kana;
+	typedef std::map<char,charvec> engraving_map;
+	engraving_map raw_to_engraving;
+	bool fold_case;
+	std::size_t max_conversion_length;
+
+	const uint32_t * image;
+	std::size_t image_size;
+	struct {
+		const uint32_t * base, * check, * ranges, * values, * blob, * engravings;
+		uint32_t node_count, range_count, value_count, blob_length;
+	} compiled;
+
+	bool find_compiled_range(const std::string &, uint32_t &) const;
+	charvec compiled_string(uint32_t offset, uint32_t length) const;
+
+private:
+	CINDataTable(const CINDataTable &);
+	CINDataTable & operator = (const CINDataTable &);
+};
+
+/// \brief Load a CINDataTable from a text CIN file.
+class CINDataTableLoader :
+	public UTF8Decoder::UCS32CharacterSink
+{
+public:
+	CINDataTableLoader(CINDataTable & t, const char * p, const char * f);
+	void load();
+protected:
+	CINDataTable & table;
+	UTF8Decoder decoder;
+	enum { FIRST, COMMENT_REST, DIRECTIVE_FIRST, DIRECTIVE_SPACE1, DIRECTIVE_SECOND, DIRECTIVE_REST, DATA_FIRST, DATA_SPACE1, DATA_SECOND, DATA_REST } state;
+	bool chardef, keyname;
+	const char * const prog, * const filename;
+	unsigned long line;
+	std::string first;
+	CINDataTable::charvec second;
+
+	virtual void ProcessDecodedUTF8(uint32_t character, bool decoder_error, bool overlong);
+};
+
+#endif
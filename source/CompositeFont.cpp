@@ -5,8 +5,12 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <vector>
 #include <list>
+#include <algorithm>
+#include <cstring>
 #include <stdint.h>
 #include <cstddef>
+#include <sys/types.h>
+#include <sys/stat.h>
 #include <sys/mman.h>
 #if defined(__LINUX__) || defined(__linux__)
 #include <endian.h>
@@ -18,18 +22,32 @@ For copyright and licensing terms, see the file named COPYING.
 #include "UnicodeClassification.h"
 #include "vtfont.h"
 
+namespace {
+
+/// Every 8-pixel row with each of its pixels doubled in width
+struct DoubledPixels {
+	DoubledPixels();
+	uint16_t rows[256];
+} const doubled_pixels;
+
+DoubledPixels::DoubledPixels()
+{
+	for (unsigned c(0U); c < 256U; ++c) {
+		uint_fast16_t r(0U);
+		for (unsigned n(0U); n < 8U; ++n)
+			if (c & (0x80U >> n)) r |= 0xC000U >> (2U * n);
+		rows[c] = r;
+	}
+}
+
+}
+
 static inline
 uint_fast16_t
 Expand8To16 (
 	uint_fast16_t c
 ) {
-	uint_fast16_t r(0U);
-	for (unsigned n(0U); n < 8U; ++n) {
-		r <<= 2U;
-		if (c & 0x8000) r |= 0x0003;
-		c <<= 1U;
-	}
-	return r;
+	return doubled_pixels.rows[(c >> 8U) & 0xFFU];
 }
 
 static inline
@@ -97,8 +115,18 @@ CombinedFont::FileFont::FileFont(
 	Font(w, s), 
 	FileDescriptorOwner(f), 
 	height(y), 
-	width(x) 
+	width(x),
+	base(0),
+	size(0U)
 {
+	struct stat t;
+	if (0 <= fstat(fd, &t) && 0 < t.st_size) {
+		void * const p(mmap(0, t.st_size, PROT_READ, MAP_SHARED, fd, 0));
+		if (MAP_FAILED != p) {
+			base = p;
+			size = t.st_size;
+		}
+	}
 }
 
 CombinedFont::LeftFileFont::LeftFileFont(
@@ -125,6 +153,7 @@ CombinedFont::LeftRightFileFont::LeftRightFileFont(
 
 CombinedFont::FileFont::~FileFont()
 {
+	if (base) munmap(const_cast<void *>(base), size);
 }
 
 off_t 
@@ -133,20 +162,33 @@ CombinedFont::FileFont::GlyphOffset (std::size_t g)
 	return sizeof (bsd_vtfont_header) + query_cell_size() * g;
 }
 
+/// Copy (the first l bytes of) a glyph cell; any part of it that lies beyond the end of the file is left unchanged.
+void
+CombinedFont::FileFont::ReadCell (std::size_t g, void * b, std::size_t l)
+{
+	const off_t start(GlyphOffset(g));
+	if (!base) {
+		pread(fd, b, l, start);
+		return;
+	}
+	if (static_cast<std::size_t>(start) >= size) return;
+	if (l > size - start) l = size - start;
+	std::memcpy(b, static_cast<const char *>(base) + start, l);
+}
+
 bool 
 CombinedFont::LeftFileFont::Read(uint32_t character, uint16_t b[16], unsigned short & h, unsigned short & w)
 {
 	UnicodeMap::const_iterator map_entry(find(unicode_map, character));
 	if (unicode_map.end() == map_entry) return false;
 	const std::size_t g(character - map_entry->codepoint + map_entry->glyph_number);
-	const off_t start(GlyphOffset(g));
 	if (width <= 8U) {
-		uint8_t glyph[16];
-		pread(fd, glyph, height < sizeof glyph ? height : sizeof glyph, start);
+		uint8_t glyph[16] = { 0 };
+		ReadCell(g, glyph, height < sizeof glyph ? height : sizeof glyph);
 		for (unsigned row(0U); row < height; ++row) b[row] = static_cast<uint16_t>(glyph[row]) << 8U;
 	} else {
-		uint16_t glyph[16];
-		pread(fd, glyph, height * sizeof *glyph < sizeof glyph ? height * sizeof *glyph : sizeof glyph, start);
+		uint16_t glyph[16] = { 0 };
+		ReadCell(g, glyph, height * sizeof *glyph < sizeof glyph ? height * sizeof *glyph : sizeof glyph);
 		for (unsigned row(0U); row < height; ++row) b[row] = be16toh(glyph[row]);
 	}
 	w = width;
@@ -166,14 +208,12 @@ CombinedFont::LeftRightFileFont::Read(uint32_t character, uint16_t b[16], unsign
 
 	if (left_map.end() != left_map_entry) {
 		const std::size_t g(character - left_map_entry->codepoint + left_map_entry->glyph_number);
-		const off_t start(GlyphOffset(g));
-		pread(fd, left_glyph, height < sizeof left_glyph ? height : sizeof left_glyph, start);
+		ReadCell(g, left_glyph, height < sizeof left_glyph ? height : sizeof left_glyph);
 	}
 
 	if (right_map.end() != right_map_entry) {
 		const std::size_t g(character - right_map_entry->codepoint + right_map_entry->glyph_number);
-		const off_t start(GlyphOffset(g));
-		pread(fd, right_glyph, height < sizeof right_glyph ? height : sizeof right_glyph, start);
+		ReadCell(g, right_glyph, height < sizeof right_glyph ? height : sizeof right_glyph);
 	}
 
 	if (left_map.end() == left_map_entry) {
@@ -200,6 +240,13 @@ CombinedFont::Font::AddMapping(CombinedFont::Font::UnicodeMap & unicode_map, uin
 	unicode_map.push_back(map_entry);
 }
 
+CombinedFont::CombinedFont() :
+	index_built(false)
+{
+	for (unsigned a(0U); a < 8U; ++a)
+		MakeFallbacks(fallbacks[a], a & 4U, a & 2U, a & 1U);
+}
+
 CombinedFont::~CombinedFont()
 {
 	for (FontList::iterator i(fonts.begin()); i != fonts.end(); i = fonts.erase(i))
@@ -210,7 +257,10 @@ CombinedFont::MemoryFont *
 CombinedFont::AddMemoryFont(CombinedFont::Font::Weight w, CombinedFont::Font::Slant s, unsigned short y, unsigned short x, void * b, std::size_t z, std::size_t o) 
 { 
 	MemoryFont * f(new MemoryFont(w, s, y, x, b, z, o));
-	if (f) fonts.push_back(f);
+	if (f) {
+		fonts.push_back(f);
+		index_built = false;
+	}
 	return f;
 }
 
@@ -218,7 +268,10 @@ CombinedFont::MemoryMappedFont *
 CombinedFont::AddMemoryMappedFont(CombinedFont::Font::Weight w, CombinedFont::Font::Slant s, unsigned short y, unsigned short x, void * b, std::size_t z, std::size_t o) 
 { 
 	MemoryMappedFont * f(new MemoryMappedFont(w, s, y, x, b, z, o));
-	if (f) fonts.push_back(f);
+	if (f) {
+		fonts.push_back(f);
+		index_built = false;
+	}
 	return f;
 }
 
@@ -226,7 +279,10 @@ CombinedFont::LeftFileFont *
 CombinedFont::AddLeftFileFont(int d, Font::Weight w, Font::Slant s, unsigned short y, unsigned short x)
 {
 	LeftFileFont * f(new LeftFileFont(d, w, s, y, x));
-	if (f) fonts.push_back(f);
+	if (f) {
+		fonts.push_back(f);
+		index_built = false;
+	}
 	return f;
 }
 
@@ -234,7 +290,10 @@ CombinedFont::LeftRightFileFont *
 CombinedFont::AddLeftRightFileFont(int d, Font::Weight w, Font::Slant s, unsigned short y, unsigned short x)
 {
 	LeftRightFileFont * f(new LeftRightFileFont(d, w, s, y, x));
-	if (f) fonts.push_back(f);
+	if (f) {
+		fonts.push_back(f);
+		index_built = false;
+	}
 	return f;
 }
 
@@ -297,64 +356,125 @@ CombinedFont::ReadGlyph (
 	return synthetic;
 }
 
-inline
-const uint16_t *
-CombinedFont::ReadGlyph (
-	uint32_t character, 
-	CombinedFont::Font::Weight w, 
-	CombinedFont::Font::Slant s,
-	bool synthesize_bold,
-	bool synthesize_oblique
+/// The order in which weights and slants are tried, and what is synthesized for each, for one combination of attributes
+void
+CombinedFont::MakeFallbacks (
+	FallbackList & l,
+	bool bold,
+	bool faint,
+	bool italic
 ) {
-	for (FontList::iterator fontit(fonts.begin()); fontit != fonts.end(); ++fontit) {
-		Font * font(*fontit);
-		if (w != font->query_weight() || s != font->query_slant()) continue;
-		if (const uint16_t * r = ReadGlyph(*font, character, synthesize_bold, synthesize_oblique))
-			return r;
-	}
-	return 0;
-}
-
-const uint16_t *
-CombinedFont::ReadGlyph (uint32_t character, bool bold, bool faint, bool italic)
-{
+	l.clear();
 	if (faint) {
 		if (bold) {
 			if (italic) {
-				if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::DEMIBOLD, CombinedFont::Font::ITALIC, false, false))
-					return f;
-				if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::DEMIBOLD, CombinedFont::Font::OBLIQUE, false, false))
-					return f;
+				l.push_back(Fallback(Font::DEMIBOLD, Font::ITALIC, false, false));
+				l.push_back(Fallback(Font::DEMIBOLD, Font::OBLIQUE, false, false));
 			}
-			if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::DEMIBOLD, CombinedFont::Font::UPRIGHT, false, italic)) 
-				return f;
+			l.push_back(Fallback(Font::DEMIBOLD, Font::UPRIGHT, false, italic));
 		}
 		if (italic) {
-			if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::LIGHT, CombinedFont::Font::ITALIC, bold, false))
-				return f;
-			if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::LIGHT, CombinedFont::Font::OBLIQUE, bold, false))
-				return f;
+			l.push_back(Fallback(Font::LIGHT, Font::ITALIC, bold, false));
+			l.push_back(Fallback(Font::LIGHT, Font::OBLIQUE, bold, false));
 		}
-		if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::LIGHT, CombinedFont::Font::UPRIGHT, bold, italic)) 
-			return f;
+		l.push_back(Fallback(Font::LIGHT, Font::UPRIGHT, bold, italic));
 	}
 	if (bold) {
 		if (italic) {
-			if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::BOLD, CombinedFont::Font::ITALIC, false, false))
-				return f;
-			if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::BOLD, CombinedFont::Font::OBLIQUE, false, false))
-				return f;
+			l.push_back(Fallback(Font::BOLD, Font::ITALIC, false, false));
+			l.push_back(Fallback(Font::BOLD, Font::OBLIQUE, false, false));
 		}
-		if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::BOLD, CombinedFont::Font::UPRIGHT, false, italic)) 
-			return f;
+		l.push_back(Fallback(Font::BOLD, Font::UPRIGHT, false, italic));
 	}
 	if (italic) {
-		if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::MEDIUM, CombinedFont::Font::ITALIC, bold, false))
-			return f;
-		if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::MEDIUM, CombinedFont::Font::OBLIQUE, bold, false))
+		l.push_back(Fallback(Font::MEDIUM, Font::ITALIC, bold, false));
+		l.push_back(Fallback(Font::MEDIUM, Font::OBLIQUE, bold, false));
+	}
+	l.push_back(Fallback(Font::MEDIUM, Font::UPRIGHT, bold, italic));
+}
+
+bool
+CombinedFont::IndexEntry::operator < (
+	const CombinedFont::IndexEntry & b
+) const {
+	return last < b.first;
+}
+
+/// \brief Merge the mappings of all fonts into a single sorted set of disjoint ranges.
+/// Earlier fonts in the list take precedence over later ones with the same weight and slant, as they always have.
+void
+CombinedFont::BuildIndex ()
+{
+	indexed_fonts.assign(fonts.begin(), fonts.end());
+	if (indexed_fonts.size() >= IndexEntry::NO_FONT)
+		indexed_fonts.resize(IndexEntry::NO_FONT);
+	index.clear();
+	index_built = true;
+
+	std::vector<Font::UnicodeMap> coverage(indexed_fonts.size());
+	std::vector<uint32_t> bounds;
+	for (std::size_t n(0U); n < indexed_fonts.size(); ++n) {
+		indexed_fonts[n]->GetCoverage(coverage[n]);
+		for (Font::UnicodeMap::const_iterator e(coverage[n].begin()); coverage[n].end() != e; ++e) {
+			if (!e->count) continue;
+			bounds.push_back(e->codepoint);
+			bounds.push_back(e->codepoint + e->count);
+		}
+	}
+	std::sort(bounds.begin(), bounds.end());
+	bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+	if (bounds.size() < 2U) return;
+
+	// No font's range starts or ends within any of these elementary ranges.
+	Index elementary(bounds.size() - 1U);
+	for (std::size_t i(0U); i < elementary.size(); ++i) {
+		IndexEntry & r(elementary[i]);
+		r.first = bounds[i];
+		r.last = bounds[i + 1U] - 1U;
+		for (unsigned w(0U); w < Font::NUM_WEIGHTS; ++w)
+			for (unsigned s(0U); s < Font::NUM_SLANTS; ++s)
+				r.font[w][s] = IndexEntry::NO_FONT;
+	}
+	// Going backwards lets earlier fonts overwrite later ones.
+	for (std::size_t n(indexed_fonts.size()); n--; ) {
+		const Font::Weight w(indexed_fonts[n]->query_weight());
+		const Font::Slant s(indexed_fonts[n]->query_slant());
+		for (Font::UnicodeMap::const_iterator e(coverage[n].begin()); coverage[n].end() != e; ++e) {
+			if (!e->count) continue;
+			const uint32_t end(e->codepoint + e->count);
+			for (std::size_t i(std::lower_bound(bounds.begin(), bounds.end(), e->codepoint) - bounds.begin()); bounds[i] < end; ++i)
+				elementary[i].font[w][s] = n;
+		}
+	}
+	// Coalesce neighbours that resolve identically, and drop ranges that no font covers.
+	for (Index::const_iterator i(elementary.begin()); elementary.end() != i; ++i) {
+		bool covered(false);
+		for (unsigned w(0U); w < Font::NUM_WEIGHTS; ++w)
+			for (unsigned s(0U); s < Font::NUM_SLANTS; ++s)
+				if (IndexEntry::NO_FONT != i->font[w][s]) covered = true;
+		if (!covered) continue;
+		if (!index.empty() && index.back().last + 1U == i->first && 0 == std::memcmp(index.back().font, i->font, sizeof i->font))
+			index.back().last = i->last;
+		else
+			index.push_back(*i);
+	}
+	Index(index).swap(index);
+}
+
+const uint16_t *
+CombinedFont::ReadGlyph (uint32_t character, bool bold, bool faint, bool italic)
+{
+	if (!index_built) BuildIndex();
+	IndexEntry one;
+	one.first = one.last = character;
+	const Index::const_iterator p(std::lower_bound(index.begin(), index.end(), one));
+	if (index.end() == p || p->first > character) return 0;
+	const FallbackList & l(fallbacks[(bold ? 4U : 0U) | (faint ? 2U : 0U) | (italic ? 1U : 0U)]);
+	for (FallbackList::const_iterator i(l.begin()); l.end() != i; ++i) {
+		const uint_fast16_t n(p->font[i->weight][i->slant]);
+		if (IndexEntry::NO_FONT == n) continue;
+		if (const uint16_t * const f = ReadGlyph(*indexed_fonts[n], character, i->synthesize_bold, i->synthesize_oblique))
 			return f;
 	}
-	if (const uint16_t * const f = ReadGlyph(character, CombinedFont::Font::MEDIUM, CombinedFont::Font::UPRIGHT, bold, italic)) 
-		return f;
 	return 0;
 }
@@ -37,6 +37,8 @@ public:
 
 		virtual bool Read(uint32_t, uint16_t b[16], unsigned short &, unsigned short &) = 0;
 		virtual bool empty() const = 0;
+		/// Append the ranges of characters that this font has glyphs for, in any order.
+		virtual void GetCoverage(UnicodeMap &) const = 0;
 	protected:
 		Weight weight;
 		Slant slant;
@@ -53,6 +55,7 @@ public:
 		~MemoryFont() {}
 		virtual bool Read(uint32_t, uint16_t b[16], unsigned short &, unsigned short &);
 		virtual bool empty() const { return unicode_map.empty(); }
+		virtual void GetCoverage(UnicodeMap & m) const { m.insert(m.end(), unicode_map.begin(), unicode_map.end()); }
 	};
 	struct MemoryMappedFont : public MemoryFont {
 		MemoryMappedFont(Weight w, Slant s, unsigned short y, unsigned short x, void * b, std::size_t z, std::size_t o) : MemoryFont(w, s, y, x, b, z, o) {}
@@ -64,9 +67,12 @@ public:
 		off_t GlyphOffset(std::size_t g) ;
 	protected:
 		unsigned short height, width;
+		const void * base;	///< the whole file, mapped at construction; null if it could not be, in which case glyphs are read with pread()
+		std::size_t size;
 
 		~FileFont() ;
 		unsigned short query_cell_size() const { return ((width + 7U) / 8U) * height; }
+		void ReadCell(std::size_t g, void * b, std::size_t l);
 	};
 	struct LeftFileFont : public FileFont {
 		LeftFileFont(int f, Weight w, Slant s, unsigned short y, unsigned short x);
@@ -75,6 +81,7 @@ public:
 		UnicodeMap unicode_map;
 		virtual bool Read(uint32_t, uint16_t b[16], unsigned short &, unsigned short &);
 		virtual bool empty() const { return unicode_map.empty(); }
+		virtual void GetCoverage(UnicodeMap & m) const { m.insert(m.end(), unicode_map.begin(), unicode_map.end()); }
 	};
 	struct LeftRightFileFont : public FileFont {
 		LeftRightFileFont(int f, Weight w, Slant s, unsigned short y, unsigned short x);
@@ -84,8 +91,11 @@ public:
 		UnicodeMap left_map, right_map;
 		virtual bool Read(uint32_t, uint16_t b[16], unsigned short &, unsigned short &);
 		virtual bool empty() const { return left_map.empty() && right_map.empty(); }
+		virtual void GetCoverage(UnicodeMap & m) const { m.insert(m.end(), left_map.begin(), left_map.end()); m.insert(m.end(), right_map.begin(), right_map.end()); }
 	};
 
+	CombinedFont();
+
 	~CombinedFont();
 
 	MemoryFont * AddMemoryFont(Font::Weight, Font::Slant, unsigned short y, unsigned short x, void * b, std::size_t z, std::size_t o);
@@ -99,11 +109,35 @@ public:
 	virtual const uint16_t * ReadGlyph (uint32_t character, bool bold, bool faint, bool italic);
 protected:
 	typedef std::list<Font *> FontList;
+	/// One step in the fallback order for a combination of attributes.
+	struct Fallback {
+		Fallback(Font::Weight w, Font::Slant s, bool b, bool o) : weight(w), slant(s), synthesize_bold(b), synthesize_oblique(o) {}
+		Font::Weight weight;
+		Font::Slant slant;
+		bool synthesize_bold, synthesize_oblique;
+	};
+	typedef std::vector<Fallback> FallbackList;
+	/// \brief A range of characters that every font either wholly covers or wholly does not.
+	/// For each weight and slant it records the first font in the list with those that covers the range, if any.
+	struct IndexEntry {
+		enum { NO_FONT = 0xFFFF };
+		uint32_t first, last;
+		uint16_t font[Font::NUM_WEIGHTS][Font::NUM_SLANTS];
+		bool operator < ( const IndexEntry & ) const ;
+	};
+	typedef std::vector<IndexEntry> Index;
+
 	FontList fonts;
 	uint16_t synthetic[16];
+	/// The index is built on the first glyph lookup, because fonts are given their mappings after they are added.
+	bool index_built;
+	std::vector<Font *> indexed_fonts;
+	Index index;
+	FallbackList fallbacks[8];
 
+	static void MakeFallbacks(FallbackList &, bool bold, bool faint, bool italic);
+	void BuildIndex();
 	const uint16_t * ReadGlyph (Font &, uint32_t character, bool synthesize_bold, bool synthesize_oblique);
-	const uint16_t * ReadGlyph (uint32_t character, Font::Weight w, Font::Slant s, bool synthesize_bold, bool synthesize_oblique);
 };
 
 #endif
@@ -201,24 +201,61 @@ ECMA48Output::SCUSR() const
 	}
 }
 
+bool
+ECMA48Output::has_colours() const
+{
+	return TerminalCapabilities::NO_COLOURS != caps.colour_level;
+}
+
+/// \brief The number of bytes in a control sequence that has a single numeric parameter of n and no intermediates.
+unsigned
+ECMA48Output::control_sequence_length(
+	unsigned n
+) const {
+	unsigned l(control_character_length(CSI) + 1U);
+	do { ++l; n /= 10U; } while (n);
+	return l;
+}
+
 void
 ECMA48Output::SGRColour(
 	bool is_fg
 ) const {
-	switch (caps.colour_level) {
-		case TerminalCapabilities::NO_COLOURS:
-			break;
-		default:
-			csi();
-			std::fprintf(out, "%um", is_fg ? 39U : 49U);
-			break;
-	}
+	if (!has_colours()) return;
+	char semi(0);
+	csi();
+	SGRColourParameters(is_fg, semi);
+	print_graphic_character('m');
 }
 
 void
 ECMA48Output::SGRColour(
 	bool is_fg,
 	const CharacterCell::colour_type & colour
+) const {
+	if (!has_colours()) return;
+	char semi(0);
+	csi();
+	SGRColourParameters(is_fg, colour, semi);
+	print_graphic_character('m');
+}
+
+/// \brief Print just the parameters for setting the default colour, so that they can be combined with others into one SGR.
+void
+ECMA48Output::SGRColourParameters(
+	bool is_fg,
+	char & semi
+) const {
+	if (has_colours())
+		SGRParameter(is_fg ? 39U : 49U, semi);
+}
+
+/// \brief Print just the parameters for setting a colour, so that they can be combined with others into one SGR.
+void
+ECMA48Output::SGRColourParameters(
+	bool is_fg,
+	const CharacterCell::colour_type & colour,
+	char & semi
 ) const {
 	switch (caps.colour_level) {
 		case TerminalCapabilities::NO_COLOURS:
@@ -234,7 +271,7 @@ ECMA48Output::SGRColour(
 						dist = d;
 					}
 				}
-				SGRColour8(is_fg, closest);
+				SGRColour8(is_fg, closest, semi);
 			}
 			break;
 		case TerminalCapabilities::ECMA_16_COLOURS:
@@ -248,7 +285,7 @@ ECMA48Output::SGRColour(
 						dist = d;
 					}
 				}
-				SGRColour16(is_fg, closest);
+				SGRColour16(is_fg, closest, semi);
 			}
 			break;
 		case TerminalCapabilities::INDEXED_COLOUR_FAULTY:
@@ -263,7 +300,7 @@ ECMA48Output::SGRColour(
 						dist = d;
 					}
 				}
-				SGRColour256Ambig(is_fg, closest);
+				SGRColour256Ambig(is_fg, closest, semi);
 			}
 			break;
 		case TerminalCapabilities::ISO_INDEXED_COLOUR:
@@ -278,14 +315,14 @@ ECMA48Output::SGRColour(
 						dist = d;
 					}
 				}
-				SGRColour256(is_fg, closest);
+				SGRColour256(is_fg, closest, semi);
 			}
 			break;
 		case TerminalCapabilities::DIRECT_COLOUR_FAULTY:
-			SGRTrueColourAmbig(is_fg, colour.red, colour.green, colour.blue);
+			SGRTrueColourAmbig(is_fg, colour.red, colour.green, colour.blue, semi);
 			break;
 		case TerminalCapabilities::ISO_DIRECT_COLOUR:
-			SGRTrueColour(is_fg, colour.red, colour.green, colour.blue);
+			SGRTrueColour(is_fg, colour.red, colour.green, colour.blue, semi);
 			break;
 	}
 }
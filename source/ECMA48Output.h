@@ -29,6 +29,9 @@ public:
 	void UTF8(uint32_t ch) const;
 	void SGRColour(bool is_fg, const CharacterCell::colour_type & colour) const;
 	void SGRColour(bool is_fg) const;
+	void SGRColourParameters(bool is_fg, const CharacterCell::colour_type & colour, char & semi) const;
+	void SGRColourParameters(bool is_fg, char & semi) const;
+	bool has_colours() const;
 	void SGRAttribute(unsigned n) const { csi(); std::fprintf(out, "%um", n); }
 	void print_subparameter(unsigned n) const { std::fprintf(out, ":%u", n); }
 	void print_graphic_character(unsigned char c) const { std::fputc(c, out); }
@@ -40,6 +43,8 @@ public:
 	void SCUSR() const;
 	void ED(unsigned n) const { csi(); std::fprintf(out, "%uJ", n); }
 	void EL(unsigned n) const { csi(); std::fprintf(out, "%uK", n); }
+	void IL(unsigned n) const { csi(); std::fprintf(out, "%uL", n); }
+	void DL(unsigned n) const { csi(); std::fprintf(out, "%uM", n); }
 	void HPA(unsigned n) const { csi(); std::fprintf(out, "%u`", n); }
 	void CHA(unsigned n) const { csi(); std::fprintf(out, "%uG", n); }
 	void CTC(unsigned n) const { csi(); std::fprintf(out, "%uW", n); }
@@ -50,6 +55,10 @@ public:
 	void CUD(unsigned n) const { csi(); std::fprintf(out, "%uB", n); }
 	void CUR(unsigned n) const { csi(); std::fprintf(out, "%uC", n); }
 	void CUL(unsigned n) const { csi(); std::fprintf(out, "%uD", n); }
+	void ECH(unsigned n) const { csi(); std::fprintf(out, "%uX", n); }
+	void REP(unsigned n) const { csi(); std::fprintf(out, "%ub", n); }
+	unsigned control_character_length(unsigned char c) const { return c < 0x80 ? 1U : c1_8bit ? 1U : 2U; }
+	unsigned control_sequence_length(unsigned n) const;
 	void IRM(bool v) const { Mode(1U, v); }
 	void DECSTR() const { csi(); std::fputs("!p", out); }
 	void DECST8C() const { DECCursorTabulationControl(5U); }
@@ -70,6 +79,7 @@ public:
 	void DECSLPP(unsigned n) const { csi(); std::fprintf(out, "%ut", n); }
 	void DTTermResize(unsigned n0, unsigned n1) const { csi(); std::fprintf(out, "8;%u;%ut", n0, n1); }
 	void DECSTBM(unsigned n0, unsigned n1) const { csi(); std::fprintf(out, "%u;%ur", n0, n1); }
+	void DECSTBM() const { csi(); std::fputs("r", out); }
 	void DECSLRM(unsigned n0, unsigned n1) const { csi(); std::fprintf(out, "%u;%us", n0, n1); }
 	// The 1006 private mode is not separately tweakable because we *always* want 1006 encoding; it entirely supersedes the 1005 and 1015 encodings.other encodings are inferior and superseded.
 	// The 1000, 1002, and 1003 private modes are radio buttons in a terminal emulator, but not all emulators implement all modes (MobaXTerm lacking 1003 support, for example).
@@ -93,12 +103,13 @@ protected:
 	// LINUXSCUSR is documented in VGA-softcursor.txt.
 	void LINUXSCUSR(unsigned n) const { csi(); std::fprintf(out, "?%uc", n); }
 	void LINUXSCUSR() const { csi(); std::fputs("?c", out); }
-	void SGRColour8(bool is_fg, unsigned n) const { csi(); std::fprintf(out, "%um", (is_fg ? 30U : 40U) + n); }
-	void SGRColour16(bool is_fg, unsigned n) const { if (n >= 8U) n += 90U - 38U; csi(); std::fprintf(out, "%um", (is_fg ? 30U : 40U) + n); }
-	void SGRColour256Ambig(bool is_fg, unsigned n) const { csi(); std::fprintf(out, "%u;5;%um", (is_fg ? 38U : 48U), n); }
-	void SGRColour256(bool is_fg, unsigned n) const { csi(); std::fprintf(out, "%u:5:%um", (is_fg ? 38U : 48U), n); }
-	void SGRTrueColourAmbig(bool is_fg, unsigned r, unsigned g, unsigned b) const { csi(); std::fprintf(out, "%u;2;%u;%u;%um", (is_fg ? 38U : 48U), r, g, b); }
-	void SGRTrueColour(bool is_fg, unsigned r, unsigned g, unsigned b) const { csi(); std::fprintf(out, "%u:2:%u:%u:%um", (is_fg ? 38U : 48U), r, g, b); }
+	void SGRParameter(unsigned n, char & semi) const { if (semi) std::fputc(semi, out); std::fprintf(out, "%u", n); semi = ';'; }
+	void SGRColour8(bool is_fg, unsigned n, char & semi) const { SGRParameter((is_fg ? 30U : 40U) + n, semi); }
+	void SGRColour16(bool is_fg, unsigned n, char & semi) const { if (n >= 8U) n += 90U - 38U; SGRParameter((is_fg ? 30U : 40U) + n, semi); }
+	void SGRColour256Ambig(bool is_fg, unsigned n, char & semi) const { SGRParameter(is_fg ? 38U : 48U, semi); std::fprintf(out, ";5;%u", n); }
+	void SGRColour256(bool is_fg, unsigned n, char & semi) const { SGRParameter(is_fg ? 38U : 48U, semi); std::fprintf(out, ":5:%u", n); }
+	void SGRTrueColourAmbig(bool is_fg, unsigned r, unsigned g, unsigned b, char & semi) const { SGRParameter(is_fg ? 38U : 48U, semi); std::fprintf(out, ";2;%u;%u;%u", r, g, b); }
+	void SGRTrueColour(bool is_fg, unsigned r, unsigned g, unsigned b, char & semi) const { SGRParameter(is_fg ? 38U : 48U, semi); std::fprintf(out, ":2:%u:%u:%u", r, g, b); }
 };
 
 #endif
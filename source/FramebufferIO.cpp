@@ -13,7 +13,8 @@ For copyright and licensing terms, see the file named COPYING.
 
 FramebufferIO::FramebufferIO(int pfd, bool l80) : 
 	FileDescriptorOwner(pfd),
-	limit_80_columns(l80)
+	limit_80_columns(l80),
+	double_buffered(false)
 {
 }
 
@@ -182,6 +183,54 @@ FramebufferIO::restore()
 #endif
 }
 
+/// \brief Attempt to make the virtual display two screens tall, so that the display can be panned between them.
+/// This must be done before the framebuffer memory is mapped, as the fixed information may change.
+bool
+FramebufferIO::enable_double_buffering()
+{
+#if defined(__LINUX__) || defined(__linux__)
+	if (!fixed_info.ypanstep || 0U != variable_info.yres % fixed_info.ypanstep) return false;
+	fb_var_screeninfo v(variable_info);
+	v.yres_virtual = 2U * v.yres;
+	v.xoffset = v.yoffset = 0U;
+	if (0 > ioctl(fd, FBIOPUT_VSCREENINFO, &v)
+	||  0 > ioctl(fd, FBIOGET_VSCREENINFO, &v)
+	||  0 > ioctl(fd, FBIOGET_FSCREENINFO, &fixed_info)
+	||  v.yres_virtual < 2U * v.yres
+	||  fixed_info.smem_len < 2U * std::size_t(fixed_info.line_length) * v.yres
+	) {
+		ioctl(fd, FBIOPUT_VSCREENINFO, &variable_info);
+		ioctl(fd, FBIOGET_FSCREENINFO, &fixed_info);
+		return false;
+	}
+	variable_info = v;
+	double_buffered = true;
+	return true;
+#else
+	// The BSD fbio and wscons APIs have no display panning.
+	return false;
+#endif
+}
+
+/// \brief Pan the display to show the given screen of a double-buffered virtual display.
+bool
+FramebufferIO::show_page(
+	unsigned page
+) {
+#if defined(__LINUX__) || defined(__linux__)
+	if (!double_buffered) return false;
+	fb_var_screeninfo v(variable_info);
+	v.xoffset = 0U;
+	v.yoffset = page * v.yres;
+	if (0 > ioctl(fd, FBIOPAN_DISPLAY, &v)) return false;
+	variable_info.yoffset = v.yoffset;
+	return true;
+#else
+	static_cast<void>(page);	// Silence a compiler warning.
+	return false;
+#endif
+}
+
 #if defined(__OpenBSD__)
 std::size_t 
 FramebufferIO::query_size() const
@@ -28,6 +28,9 @@ public:
 	void save(const char *, const char *);
 	void set_graphics_mode(const char *, const char *);
 	void restore();
+	bool enable_double_buffering();
+	bool show_page(unsigned page);
+	bool query_double_buffered() const { return double_buffered; }
 #if defined(__LINUX__) || defined(__linux__)
 	std::size_t query_size() const { return fixed_info.smem_len; }
 	unsigned short query_stride() const { return fixed_info.line_length; }
@@ -69,6 +72,7 @@ protected:
 #	error "Don't know how to query your framebuffer device."
 #endif
 	bool limit_80_columns;
+	bool double_buffered;
 };
 
 #endif
@@ -13,199 +13,158 @@ For copyright and licensing terms, see the file named COPYING.
 // **************************************************************************
 */
 
-static inline
+namespace {
+
+inline
 uint16_t
 colour15 (const CharacterCell::colour_type & colour)
 {
 	return (colour.alpha ? 0x8000 : 0x0000) | (uint16_t(colour.red & 0xF8) << 7U) | (uint16_t(colour.green & 0xF8) << 3U) | (uint16_t(colour.blue & 0xF8) >> 3U);
 }
 
-static inline
+inline
 uint16_t
 colour16 (const CharacterCell::colour_type & colour)
 {
 	return (uint16_t(colour.red & 0xF8) << 8U) | (uint16_t(colour.green & 0xFC) << 4U) | (uint16_t(colour.blue & 0xF8) >> 3U);
 }
 
-static inline
-void
-colour24 (uint8_t b[3], const CharacterCell::colour_type & colour)
-{
-	b[2] = colour.red;
-	b[1] = colour.green;
-	b[0] = colour.blue;
-}
-
-static inline
+inline
 uint32_t
 colour32 (const CharacterCell::colour_type & colour)
 {
 	return (uint32_t(colour.red) << 16U) | (uint32_t(colour.green) << 8U) | (uint32_t(colour.blue) << 0U);
 }
 
+/// Each pixel format knows how to convert a colour and how to store one converted pixel.
+struct Format15 {
+	typedef uint16_t pixel_type;
+	enum { BYTES = 2U };
+	static pixel_type Convert (const CharacterCell::colour_type & colour) { return colour15(colour); }
+	static void Store (uint8_t * p, pixel_type v) { std::memcpy(p, &v, sizeof v); }
+};
+
+struct Format16 {
+	typedef uint16_t pixel_type;
+	enum { BYTES = 2U };
+	static pixel_type Convert (const CharacterCell::colour_type & colour) { return colour16(colour); }
+	static void Store (uint8_t * p, pixel_type v) { std::memcpy(p, &v, sizeof v); }
+};
+
+// 24-bit pixels are always blue, green, red in byte order.
+struct Format24 {
+	typedef uint32_t pixel_type;
+	enum { BYTES = 3U };
+	static pixel_type Convert (const CharacterCell::colour_type & colour) { return colour32(colour); }
+	static void Store (uint8_t * p, pixel_type v) { p[0] = uint8_t(v); p[1] = uint8_t(v >> 8U); p[2] = uint8_t(v >> 16U); }
+};
+
+struct Format32 {
+	typedef uint32_t pixel_type;
+	enum { BYTES = 4U };
+	static pixel_type Convert (const CharacterCell::colour_type & colour) { return colour32(colour); }
+	static void Store (uint8_t * p, pixel_type v) { std::memcpy(p, &v, sizeof v); }
+};
+
 /* Bitmaps and blitting *****************************************************
 // **************************************************************************
 */
 
-void 
-GraphicsInterface::ScreenBitmap::Plot (unsigned short y, unsigned short x, uint16_t bits, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background)
-{
-	// The stride is in bytes, so this calculation is always in bytes and is common.
-	void * const start(static_cast<uint8_t *>(base) + std::size_t(stride) * y);
-	switch (depth) {
-		case 15U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t f(colour15(foreground)), b(colour15(background));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				p[off] = bit ? f : b;
-			}
-			break;
-		}
-		case 16U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t f(colour16(foreground)), b(colour16(background));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				p[off] = bit ? f : b;
-			}
-			break;
+/// \brief Glyph blitters specialized for a single pixel format.
+///
+/// Colours are converted once per glyph rather than once per row.
+/// For plain plotting, a table of every possible 4-pixel span is built once per glyph, and each row is then just four block copies out of the table.
+template <class Format>
+struct Blitter {
+	typedef typename Format::pixel_type pixel_type;
+	enum { NIBBLE_SPAN = 4U * Format::BYTES, SPAN = 16U * Format::BYTES };
+
+	static pixel_type Select (uint16_t bits, unsigned bit, pixel_type set, pixel_type unset)
+	{
+		const pixel_type m(pixel_type(0U - ((bits >> bit) & 1U)));
+		return unset ^ ((set ^ unset) & m);
+	}
+
+	static void Plot (void * start, std::size_t stride, const uint16_t * rows, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background)
+	{
+		const pixel_type f(Format::Convert(foreground)), b(Format::Convert(background));
+		uint8_t spans[16U][NIBBLE_SPAN];
+		for (unsigned nibble(0U); nibble < 16U; ++nibble)
+			for (unsigned off(0U); off < 4U; ++off)
+				Format::Store(spans[nibble] + off * Format::BYTES, Select(nibble, 3U - off, f, b));
+		uint8_t * p(static_cast<uint8_t *>(start));
+		for (unsigned row(0U); row < 16U; ++row, p += stride) {
+			const uint16_t bits(rows[row]);
+			std::memcpy(p + 0U * NIBBLE_SPAN, spans[(bits >> 12U) & 0x0F], NIBBLE_SPAN);
+			std::memcpy(p + 1U * NIBBLE_SPAN, spans[(bits >>  8U) & 0x0F], NIBBLE_SPAN);
+			std::memcpy(p + 2U * NIBBLE_SPAN, spans[(bits >>  4U) & 0x0F], NIBBLE_SPAN);
+			std::memcpy(p + 3U * NIBBLE_SPAN, spans[(bits >>  0U) & 0x0F], NIBBLE_SPAN);
 		}
-		case 24U:
-		{
-			uint8_t * const p(static_cast<uint8_t *>(start) + 3U * x);
-			uint8_t f[3], b[3];
-			colour24(f, foreground);
-			colour24(b, background);
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				std::memcpy(p + 3U * off, bit ? f : b, 3U);
+	}
+
+	// The mask selects amongst two colour pairs per pixel, which is too many combinations for a span table.
+	// Each row is instead expanded into a span in local memory with branch-free selects, and written out as one block copy.
+	static void PlotMask (void * start, std::size_t stride, const uint16_t * rows, const uint16_t * masks, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2])
+	{
+		const pixel_type fs[2] = { Format::Convert(foregrounds[0]), Format::Convert(foregrounds[1]) };
+		const pixel_type bs[2] = { Format::Convert(backgrounds[0]), Format::Convert(backgrounds[1]) };
+		uint8_t * p(static_cast<uint8_t *>(start));
+		uint8_t span[SPAN];
+		for (unsigned row(0U); row < 16U; ++row, p += stride) {
+			const uint16_t bits(rows[row]), mask(masks[row]);
+			for (unsigned off(0U); off < 16U; ++off) {
+				const unsigned bit(15U - off);
+				const pixel_type f(Select(mask, bit, fs[1], fs[0])), b(Select(mask, bit, bs[1], bs[0]));
+				Format::Store(span + off * Format::BYTES, Select(bits, bit, f, b));
 			}
-			break;
+			std::memcpy(p, span, sizeof span);
 		}
-		case 32U:
-		{
-			uint32_t * const p(static_cast<uint32_t *>(start) + x);
-			const uint32_t f(colour32(foreground)), b(colour32(background));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				p[off] = bit ? f : b;
-			}
-			break;
+	}
+
+	static void AlphaBlend (void * start, std::size_t stride, const uint16_t * rows, const CharacterCell::colour_type & colour)
+	{
+		const pixel_type c(Format::Convert(colour));
+		uint8_t * p(static_cast<uint8_t *>(start));
+		for (unsigned row(0U); row < 16U; ++row, p += stride) {
+			const uint16_t bits(rows[row]);
+			if (!bits) continue;
+			for (unsigned off(0U); off < 16U; ++off)
+				if ((bits >> (15U - off)) & 1U)
+					Format::Store(p + off * Format::BYTES, c);
 		}
 	}
+};
+
+/// Unsupported depths draw nothing.
+struct NullBlitter {
+	static void Plot (void *, std::size_t, const uint16_t *, const CharacterCell::colour_type &, const CharacterCell::colour_type &) {}
+	static void PlotMask (void *, std::size_t, const uint16_t *, const uint16_t *, const CharacterCell::colour_type [2], const CharacterCell::colour_type [2]) {}
+	static void AlphaBlend (void *, std::size_t, const uint16_t *, const CharacterCell::colour_type &) {}
+};
+
 }
 
-void 
-GraphicsInterface::ScreenBitmap::Plot (unsigned short y, unsigned short x, uint16_t bits, uint16_t mask, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2])
+template <class B>
+GraphicsInterface::Blitters
+GraphicsInterface::Blitters::Of (unsigned short bytes_per_pixel)
 {
-	// The stride is in bytes, so this calculation is always in bytes and is common.
-	void * const start(static_cast<uint8_t *>(base) + std::size_t(stride) * y);
-	switch (depth) {
-		case 15U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t fs[2] = { colour15(foregrounds[0]), colour15(foregrounds[1]) };
-			const uint16_t bs[2] = { colour15(backgrounds[0]), colour15(backgrounds[1]) };
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U, mask >>= 1U) {
-				const bool bit(bits & 1U);
-				const unsigned index(mask & 1U);
-				p[off] = bit ? fs[index] : bs[index];
-			}
-			break;
-		}
-		case 16U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t fs[2] = { colour16(foregrounds[0]), colour16(foregrounds[1]) };
-			const uint16_t bs[2] = { colour16(backgrounds[0]), colour16(backgrounds[1]) };
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U, mask >>= 1U) {
-				const bool bit(bits & 1U);
-				const unsigned index(mask & 1U);
-				p[off] = bit ? fs[index] : bs[index];
-			}
-			break;
-		}
-		case 24U:
-		{
-			uint8_t * const p(static_cast<uint8_t *>(start) + 3U * x);
-			uint8_t fs[2][3], bs[2][3];
-			colour24(fs[0], foregrounds[0]);
-			colour24(fs[1], foregrounds[1]);
-			colour24(bs[0], backgrounds[0]);
-			colour24(bs[1], backgrounds[1]);
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U, mask >>= 1U) {
-				const bool bit(bits & 1U);
-				const unsigned index(mask & 1U);
-				std::memcpy(p + 3U * off, bit ? fs[index] : bs[index], 3U);
-			}
-			break;
-		}
-		case 32U:
-		{
-			uint32_t * const p(static_cast<uint32_t *>(start) + x);
-			const uint32_t fs[2] = { colour32(foregrounds[0]), colour32(foregrounds[1]) };
-			const uint32_t bs[2] = { colour32(backgrounds[0]), colour32(backgrounds[1]) };
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U, mask >>= 1U) {
-				const bool bit(bits & 1U);
-				const unsigned index(mask & 1U);
-				p[off] = bit ? fs[index] : bs[index];
-			}
-			break;
-		}
-	}
+	Blitters r;
+	r.plot = &B::Plot;
+	r.plot_mask = &B::PlotMask;
+	r.alpha_blend = &B::AlphaBlend;
+	r.bytes_per_pixel = bytes_per_pixel;
+	return r;
 }
 
-void 
-GraphicsInterface::ScreenBitmap::AlphaBlend (unsigned short y, unsigned short x, uint16_t bits, const CharacterCell::colour_type & colour)
+GraphicsInterface::Blitters
+GraphicsInterface::Blitters::For (unsigned short depth)
 {
-	// The stride is in bytes, so this calculation is always in bytes and is common.
-	void * const start(static_cast<uint8_t *>(base) + std::size_t(stride) * y);
 	switch (depth) {
-		case 15U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t c(colour15(colour));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				if (bit) p[off] = c;
-			}
-			break;
-		}
-		case 16U:
-		{
-			uint16_t * const p(static_cast<uint16_t *>(start) + x);
-			const uint16_t c(colour16(colour));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				if (bit) p[off] = c;
-			}
-			break;
-		}
-		case 24U:
-		{
-			uint8_t * const p(static_cast<uint8_t *>(start) + 3U * x);
-			uint8_t c[3];
-			colour24(c, colour);
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				if (bit)
-					std::memcpy(p + 3U * off, c, 3U);
-			}
-			break;
-		}
-		case 32U:
-		{
-			uint32_t * const p(static_cast<uint32_t *>(start) + x);
-			const uint32_t c(colour32(colour));
-			for (unsigned off(16U); off-- > 0U; bits >>= 1U) {
-				const bool bit(bits & 1U);
-				if (bit) p[off] = c;
-			}
-			break;
-		}
+		case 15U:	return Of<Blitter<Format15> >(Format15::BYTES);
+		case 16U:	return Of<Blitter<Format16> >(Format16::BYTES);
+		case 24U:	return Of<Blitter<Format24> >(Format24::BYTES);
+		case 32U:	return Of<Blitter<Format32> >(Format32::BYTES);
+		default:	return Of<NullBlitter>(0U);
 	}
 }
 
@@ -225,7 +184,7 @@ GraphicsInterface::GraphicsInterface(
 
 GraphicsInterface::~GraphicsInterface()
 {
-	munmap(base, size);
+	if (base) munmap(base, size);
 }
 
 GraphicsInterface::GlyphBitmap * 
@@ -238,27 +197,47 @@ GraphicsInterface::MakeGlyphBitmap()
 void 
 GraphicsInterface::BitBLT(ScreenBitmapHandle s, GlyphBitmapHandle g, unsigned short y, unsigned short x, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background)
 {
-	for (unsigned row(0U); row < 16U; ++row) {
-		const uint16_t bits(g->Row(row));
-		s->Plot(y + row, x, bits, foreground, background);
-	}
+	s->blitters.plot(s->Start(y, x), s->stride, g->Rows(), foreground, background);
 }
 
 void 
 GraphicsInterface::BitBLTMask(ScreenBitmapHandle s, GlyphBitmapHandle g, GlyphBitmapHandle m, unsigned short y, unsigned short x, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2])
 {
-	for (unsigned row(0U); row < 16U; ++row) {
-		const uint16_t bits(g->Row(row));
-		const uint16_t mask(m->Row(row));
-		s->Plot(y + row, x, bits, mask, foregrounds, backgrounds);
-	}
+	s->blitters.plot_mask(s->Start(y, x), s->stride, g->Rows(), m->Rows(), foregrounds, backgrounds);
 }
 
 void 
 GraphicsInterface::BitBLTAlpha(ScreenBitmapHandle s, GlyphBitmapHandle g, unsigned short y, unsigned short x, const CharacterCell::colour_type & colour)
 {
-	for (unsigned row(0U); row < 16U; ++row) {
-		const uint16_t bits(g->Row(row));
-		s->AlphaBlend(y + row, x, bits, colour);
+	s->blitters.alpha_blend(s->Start(y, x), s->stride, g->Rows(), colour);
+}
+
+/// \brief Move whole scanlines from one screen bitmap to another, or within a single screen bitmap.
+/// The bitmaps must have the same pixel format; the source and destination may overlap.
+void 
+GraphicsInterface::MoveScanlines(ScreenBitmapHandle d, unsigned short dy, ScreenBitmapHandle s, unsigned short sy, unsigned short h)
+{
+	if (!h) return;
+	uint8_t * dp(static_cast<uint8_t *>(d->Start(dy, 0U)));
+	const uint8_t * sp(static_cast<const uint8_t *>(s->Start(sy, 0U)));
+	if (d->stride == s->stride) {
+		std::memmove(dp, sp, std::size_t(d->stride) * h);
+		return;
+	}
+	const std::size_t width(std::size_t(d->blitters.bytes_per_pixel) * (d->xres < s->xres ? d->xres : s->xres));
+	if (dp > sp) {
+		dp += std::size_t(d->stride) * h;
+		sp += std::size_t(s->stride) * h;
+		while (h--) {
+			dp -= d->stride;
+			sp -= s->stride;
+			std::memmove(dp, sp, width);
+		}
+	} else {
+		while (h--) {
+			std::memmove(dp, sp, width);
+			dp += d->stride;
+			sp += s->stride;
+		}
 	}
 }
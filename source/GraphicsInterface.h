@@ -26,18 +26,31 @@ public:
 	void BitBLT(ScreenBitmapHandle, GlyphBitmapHandle, unsigned short y, unsigned short x, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background);
 	void BitBLTMask(ScreenBitmapHandle, GlyphBitmapHandle, GlyphBitmapHandle, unsigned short y, unsigned short x, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2]);
 	void BitBLTAlpha(ScreenBitmapHandle, GlyphBitmapHandle, unsigned short y, unsigned short x, const CharacterCell::colour_type & colour);
+	void MoveScanlines(ScreenBitmapHandle, unsigned short dy, ScreenBitmapHandle, unsigned short sy, unsigned short h);
 
 	void DeleteGlyphBitmap(GlyphBitmap * handle) { delete handle; }
 	GlyphBitmap * MakeGlyphBitmap();
 
 protected:
+	/// \brief Per-pixel-format blitting functions, chosen once according to the screen depth.
+	struct Blitters {
+		typedef void (*Plot) (void * start, std::size_t stride, const uint16_t * rows, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background);
+		typedef void (*PlotMask) (void * start, std::size_t stride, const uint16_t * rows, const uint16_t * masks, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2]);
+		typedef void (*AlphaBlend) (void * start, std::size_t stride, const uint16_t * rows, const CharacterCell::colour_type & colour);
+		Plot plot;
+		PlotMask plot_mask;
+		AlphaBlend alpha_blend;
+		unsigned short bytes_per_pixel;
+		static Blitters For(unsigned short depth);
+	private:
+		template <class B> static Blitters Of(unsigned short bytes_per_pixel);
+	};
 	struct ScreenBitmap {
 		void * const base;
 		const unsigned short yres, xres, stride, depth;
-		ScreenBitmap(void * b, unsigned short y, unsigned short x, unsigned short s, unsigned short d) : base(b), yres(y), xres(x), stride(s), depth(d) {}
-		void Plot (unsigned short y, unsigned short x, uint16_t bits, const CharacterCell::colour_type & foreground, const CharacterCell::colour_type & background);
-		void Plot (unsigned short y, unsigned short x, uint16_t bits, uint16_t mask, const CharacterCell::colour_type foregrounds[2], const CharacterCell::colour_type backgrounds[2]);
-		void AlphaBlend (unsigned short y, unsigned short x, uint16_t bits, const CharacterCell::colour_type & colour);
+		const Blitters blitters;
+		ScreenBitmap(void * b, unsigned short y, unsigned short x, unsigned short s, unsigned short d) : base(b), yres(y), xres(x), stride(s), depth(d), blitters(Blitters::For(d)) {}
+		void * Start (unsigned short y, unsigned short x) const { return static_cast<uint8_t *>(base) + std::size_t(stride) * y + std::size_t(blitters.bytes_per_pixel) * x; }
 	};
 	struct GlyphBitmap {
 		uint16_t * base;
@@ -45,6 +58,7 @@ protected:
 		~GlyphBitmap() { delete[] base; }
 		void Plot (std::size_t row, uint16_t bits) { base[row] = bits; }
 		uint16_t Row (std::size_t row) const { return base[row]; }
+		const uint16_t * Rows () const { return base; }
 	};
 	void * const base;
 	const std::size_t size;
@@ -5,32 +5,118 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <cstddef>
 #include <cstring>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "FileDescriptorOwner.h"
+#include "InputMessage.h"
 #include "InputFIFO.h"
 
-InputFIFO::InputFIFO(int i) : 
+namespace {
+
+inline
+bool
+is_pointer_motion (
+	uint32_t m
+) {
+	const uint32_t t(m & INPUT_MSG_MASK);
+	return INPUT_MSG_XPOS == t || INPUT_MSG_YPOS == t;
+}
+
+}
+
+InputFIFO::InputFIFO(int i, bool c) : 
 	FileDescriptorOwner(i),
+	coalesce_pointer_motion(c),
+	input_start(0U),
 	input_read(0U)
 {
 }
 
+/// \brief Drain as much as there is room for, in a single system call.
+/// The free space in the ring is at most two discontiguous pieces, one after the data and one before them.
+/// Messages are never split across the wrap point, because the buffer size is a multiple of the message size and messages are only ever removed whole.
 void
 InputFIFO::ReadInput()
 {
-	const ssize_t l(read(fd, input_buffer + input_read, sizeof input_buffer - input_read));
+	if (input_read >= sizeof input_buffer) return;
+	const std::size_t end((input_start + input_read) % sizeof input_buffer);
+	struct iovec v[2];
+	int n(0);
+	if (end >= input_start) {
+		v[n].iov_base = input_buffer + end;
+		v[n].iov_len = sizeof input_buffer - end;
+		++n;
+		if (input_start > 0U) {
+			v[n].iov_base = input_buffer;
+			v[n].iov_len = input_start;
+			++n;
+		}
+	} else
+	{
+		v[n].iov_base = input_buffer + end;
+		v[n].iov_len = input_start - end;
+		++n;
+	}
+	const ssize_t l(readv(fd, v, n));
 	if (l > 0)
 		input_read += l;
 }
 
+inline
 uint32_t
-InputFIFO::PullMessage()
+InputFIFO::PeekMessage(
+	std::size_t i
+) const {
+	uint32_t b;
+	std::memcpy(&b, input_buffer + (input_start + i * sizeof b) % sizeof input_buffer, sizeof b);
+	return b;
+}
+
+inline
+void
+InputFIFO::DiscardMessage()
 {
-	uint32_t b(0);
-	if (input_read >= sizeof b) {
-		std::memcpy(&b, input_buffer, sizeof b);
-		input_read -= sizeof b;
-		std::memmove(input_buffer, input_buffer + sizeof b, input_read);
+	input_read -= sizeof(uint32_t);
+	input_start = input_read ? (input_start + sizeof(uint32_t)) % sizeof input_buffer : 0U;
+}
+
+/// \brief Whether the head message is a pointer position that a later message in the same run of pointer positions replaces.
+inline
+bool
+InputFIFO::IsSuperseded() const
+{
+	const uint32_t m(PeekMessage(0U));
+	if (!is_pointer_motion(m)) return false;
+	const std::size_t count(input_read / sizeof m);
+	for (std::size_t i(1U); i < count; ++i) {
+		const uint32_t o(PeekMessage(i));
+		if (!is_pointer_motion(o)) break;
+		if ((o & INPUT_MSG_MASK) == (m & INPUT_MSG_MASK)) return true;
 	}
+	return false;
+}
+
+uint32_t
+InputFIFO::PullMessage()
+{
+	if (!HasMessage()) return 0;
+	if (coalesce_pointer_motion)
+		while (IsSuperseded())
+			DiscardMessage();
+	const uint32_t b(PeekMessage(0U));
+	DiscardMessage();
 	return b;
 }
+
+/// \brief Pull up to n messages in one go.
+/// \returns the number of messages pulled
+std::size_t
+InputFIFO::PullMessages(
+	uint32_t * b,
+	std::size_t n
+) {
+	std::size_t i(0U);
+	while (i < n && HasMessage())
+		b[i++] = PullMessage();
+	return i;
+}
@@ -10,17 +10,27 @@ For copyright and licensing terms, see the file named COPYING.
 #include <stdint.h>
 #include "FileDescriptorOwner.h"
 
+/// \brief The read end of an input FIFO, receiving 4-byte input messages.
+///
+/// Messages are buffered in a ring, so that everything pending in the FIFO can be drained with a single system call, and pulled without shuffling the remainder.
+/// Optionally, a run of consecutive pointer position messages can be coalesced, so that only the final column and row positions of the run are pulled.
 class InputFIFO :
 	public FileDescriptorOwner
 {
 public:
-	InputFIFO(int);
+	InputFIFO(int, bool coalesce_pointer_motion = false);
 	void ReadInput();
 	bool HasMessage() const { return input_read >= sizeof(uint32_t); }
 	uint32_t PullMessage();
+	std::size_t PullMessages(uint32_t *, std::size_t);
 protected:
-	char input_buffer[4];
-	std::size_t input_read;
+	const bool coalesce_pointer_motion;
+	char input_buffer[4096];
+	std::size_t input_start, input_read;
+
+	uint32_t PeekMessage(std::size_t) const;
+	void DiscardMessage();
+	bool IsSuperseded() const;
 };
 
 #endif
@@ -4,119 +4,314 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <map>
+#include <vector>
 #include <string>
 #include <cstring>
 #include <cstdlib>
+#include <stdint.h>
 #include "ProcessEnvironment.h"
 
-#include <cstdio>
+/* Helper functions *********************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+const std::size_t MINIMUM_INDEX(16U), BLOCK_SIZE(4096U);
+
+inline
+std::size_t
+name_length (
+	const char * e
+) {
+	if (const char * q = std::strchr(e, '='))
+		return q - e;
+	return std::strlen(e);
+}
+
+/// An inherited string with no '=' is a variable with an empty value, when passing through the inherited environment.
+inline
+const char *
+value_of (
+	const char * e,
+	std::size_t l
+) {
+	return '=' == e[l] ? e + l + 1 : e + l;
+}
+
+/// Arena strings are allocated in multiples of this, so that a value can usually grow a little in place.
+inline
+std::size_t
+round_up (
+	std::size_t n
+) {
+	return (n + 15U) & ~std::size_t(15U);
+}
+
+inline
+bool
+matches (
+	const char * e,
+	const char * var,
+	std::size_t l
+) {
+	return 0 == std::strncmp(e, var, l) && ('=' == e[l] || '\0' == e[l]);
+}
+
+inline
+std::size_t
+hash (
+	const char * p,
+	std::size_t l
+) {
+	// FNV-1a
+	uint32_t h(2166136261U);
+	while (l--) {
+		h ^= static_cast<unsigned char>(*p++);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+}
+
+/* The environment **********************************************************
+// **************************************************************************
+*/
 
 ProcessEnvironment::ProcessEnvironment(const char * const * envp) :
-	global_environ(envp), 
-	cached_data(envp)
+	global_environ(envp),
+	arena_next(0),
+	arena_left(0U)
 {
 }
 
+ProcessEnvironment::~ProcessEnvironment()
+{
+	free_blocks(blocks);
+}
+
 void
-ProcessEnvironment::make_data()
+ProcessEnvironment::free_blocks(std::vector<char *> & v)
 {
-	if (!cached_data) {
-		s.clear();
-		s.reserve(m.size());
-		for (map::const_iterator i(m.begin()), e(m.end()); i != e; ++i)
-			s.push_back(i->first + "=" + i->second);
-		d.clear();
-		d.reserve(s.size() + 1);
-		for (vec::const_iterator i(s.begin()), e(s.end()); i != e; ++i)
-			d.push_back(i->c_str());
-		d.push_back(0);
-		cached_data = d.data();
+	for (std::vector<char *>::const_iterator i(v.begin()), e(v.end()); i != e; ++i)
+		delete[] *i;
+	v.clear();
+}
+
+/// Strings are never moved once allocated, so the smallest released string that is big enough is reused in preference to new space.
+/// \returns the string, with its allocated size updated in n
+char *
+ProcessEnvironment::allocate(std::size_t & n)
+{
+	const std::multimap<std::size_t, char *>::iterator r(released.lower_bound(n));
+	if (released.end() != r) {
+		char * const p(r->second);
+		n = r->first;
+		released.erase(r);
+		return p;
+	}
+	if (n > BLOCK_SIZE / 4U) {
+		// Large strings get blocks of their own, so as not to waste the remainder of the current block.
+		blocks.push_back(new char [n]);
+		return blocks.back();
 	}
+	if (n > arena_left) {
+		blocks.push_back(new char [BLOCK_SIZE]);
+		arena_next = blocks.back();
+		arena_left = BLOCK_SIZE;
+	}
+	char * const p(arena_next);
+	arena_next += n;
+	arena_left -= n;
+	return p;
 }
 
-bool 
-ProcessEnvironment::clear()
+/// \returns the slot holding the named variable, or the empty slot where it would go
+std::size_t
+ProcessEnvironment::find_slot(const char * var, std::size_t l) const
 {
-	m.clear();
-	global_environ = 0;
-	cached_data = 0;
-	return true;
+	const std::size_t mask(index.size() - 1U);
+	for (std::size_t s(hash(var, l) & mask); ; s = (s + 1U) & mask) {
+		const std::size_t p(index[s]);
+		if (!p || matches(d[p - 1U], var, l))
+			return s;
+	}
 }
 
-bool 
-ProcessEnvironment::set(const std::string & var, const std::string & val)
+/// A string that is overwritten or unset is kept for reuse by a later string.
+void
+ProcessEnvironment::release(std::size_t pos)
 {
-	make_copy();
-	typedef std::pair<map::iterator, bool> ret;
-	ret r(m.insert(map::value_type(var, val)));
-	if (!r.second)
-		r.first->second = val;
-	return true;
+	if (const std::size_t n = capacity[pos]) {
+		released.insert(std::make_pair(n, const_cast<char *>(d[pos])));
+		capacity[pos] = 0U;
+	}
+}
+
+void
+ProcessEnvironment::rehash(std::size_t n)
+{
+	index.assign(n, 0U);
+	for (std::size_t p(0U); p + 1U < d.size(); ++p)
+		index[find_slot(d[p], name_length(d[p]))] = p + 1U;
 }
 
-bool 
-ProcessEnvironment::set(const char * cvar, const std::string & val)
+/// Switch from passing through the inherited environment to indexing it; the inherited strings themselves are not copied.
+void
+ProcessEnvironment::make_index()
 {
-	const std::string var(cvar);
-	return set(var, val);
+	if (!global_environ) return;
+	std::size_t n(0U);
+	while (global_environ[n]) ++n;
+	std::size_t size(MINIMUM_INDEX);
+	while (size < 2U * (n + 1U)) size <<= 1U;
+	d.clear();
+	d.reserve(n + 1U);
+	d.push_back(0);
+	capacity.assign(1U, 0U);
+	index.assign(size, 0U);
+	for (const char * const * p(global_environ); *p; ++p) {
+		const std::size_t l(name_length(*p));
+		const std::size_t s(find_slot(*p, l));
+		// As with std::getenv(), the first of any duplicates wins.
+		if (index[s]) continue;
+		if ('=' != (*p)[l]) {
+			// A string with no '=' is normalized to NAME= from here on, as it always has been.
+			std::size_t c(round_up(l + 2U));
+			char * const e(allocate(c));
+			std::memcpy(e, *p, l);
+			e[l] = '=';
+			e[l + 1U] = '\0';
+			d.back() = e;
+			capacity.back() = c;
+		} else
+			d.back() = *p;
+		d.push_back(0);
+		capacity.push_back(0U);
+		index[s] = d.size() - 1U;
+	}
+	global_environ = 0;
 }
 
-bool 
-ProcessEnvironment::set(const char * cvar, const char * cval)
+/// Remove a variable's slot with backward shift deletion, then fill its hole in the envp array with the last variable.
+void
+ProcessEnvironment::erase_slot(std::size_t s)
 {
-	const std::string var(cvar);
-	if (cval) {
-		const std::string val(cval);
-		return set(var, val);
+	const std::size_t mask(index.size() - 1U);
+	const std::size_t pos(index[s] - 1U);
+	index[s] = 0U;
+	for (std::size_t j((s + 1U) & mask); index[j]; j = (j + 1U) & mask) {
+		const char * const e(d[index[j] - 1U]);
+		const std::size_t home(hash(e, name_length(e)) & mask);
+		// Move the entry back into the hole unless its home slot lies cyclically in (s, j].
+		if (s <= j ? (home <= s || home > j) : (home <= s && home > j)) {
+			index[s] = index[j];
+			index[j] = 0U;
+			s = j;
+		}
 	}
-	make_copy();
-	map::iterator i(m.find(var));
-	if (m.end() != i) m.erase(i);
+	release(pos);
+	const std::size_t last(d.size() - 2U);
+	if (pos != last) {
+		const char * const e(d[last]);
+		index[find_slot(e, name_length(e))] = pos + 1U;
+		d[pos] = e;
+		capacity[pos] = capacity[last];
+	}
+	d.pop_back();
+	d.back() = 0;
+	capacity.pop_back();
+	capacity.back() = 0U;
+}
+
+bool
+ProcessEnvironment::set(const char * var, std::size_t l, const char * val, std::size_t vl)
+{
+	make_index();
+	const std::size_t s(find_slot(var, l));
+	if (!val) {
+		if (index[s])
+			erase_slot(s);
+		return true;
+	}
+	const std::size_t n(l + 1U + vl + 1U);
+	if (index[s]) {
+		const std::size_t pos(index[s] - 1U);
+		if (capacity[pos] >= n) {
+			// Overwrite in place; the new value may be a part of the old one.
+			char * const e(const_cast<char *>(d[pos]));
+			std::memmove(e + l + 1U, val, vl);
+			e[l + 1U + vl] = '\0';
+			return true;
+		}
+	}
+	std::size_t c(round_up(n));
+	char * const e(allocate(c));
+	std::memcpy(e, var, l);
+	e[l] = '=';
+	std::memcpy(e + l + 1U, val, vl);
+	e[l + 1U + vl] = '\0';
+	if (index[s]) {
+		const std::size_t pos(index[s] - 1U);
+		release(pos);
+		d[pos] = e;
+		capacity[pos] = c;
+		return true;
+	}
+	d.back() = e;
+	capacity.back() = c;
+	d.push_back(0);
+	capacity.push_back(0U);
+	index[s] = d.size() - 1U;
+	if (2U * d.size() > index.size())
+		rehash(2U * index.size());
 	return true;
 }
 
-const char * 
-ProcessEnvironment::query(const char * var) const
+bool
+ProcessEnvironment::clear()
 {
-	if (global_environ) return std::getenv(var);
-	map::const_iterator i(m.find(var));
-	if (m.end() == i) return 0;
-	return i->second.c_str();
+	global_environ = 0;
+	d.assign(1U, 0);
+	capacity.assign(1U, 0U);
+	index.assign(MINIMUM_INDEX, 0U);
+	free_blocks(blocks);
+	released.clear();
+	arena_next = 0;
+	arena_left = 0U;
+	return true;
 }
 
-ProcessEnvironment::const_iterator
-ProcessEnvironment::find(const std::string & var)
+bool
+ProcessEnvironment::set(const std::string & var, const std::string & val)
 {
-	make_copy();
-	return m.find(var);
+	return set(var.data(), var.length(), val.data(), val.length());
 }
 
-ProcessEnvironment::const_iterator
-ProcessEnvironment::begin()
+bool
+ProcessEnvironment::set(const char * var, const std::string & val)
 {
-	make_copy();
-	return m.begin();
+	return set(var, std::strlen(var), val.data(), val.length());
 }
 
-ProcessEnvironment::const_iterator
-ProcessEnvironment::end()
+bool
+ProcessEnvironment::set(const char * var, const char * val)
 {
-	make_copy();
-	return m.end();
+	return set(var, std::strlen(var), val, val ? std::strlen(val) : 0U);
 }
 
-void 
-ProcessEnvironment::make_copy()
+const char *
+ProcessEnvironment::query(const char * var) const
 {
+	const std::size_t l(std::strlen(var));
 	if (global_environ) {
-		while (const char * e = *global_environ++) {
-			if (const char * q = std::strchr(e, '=')) {
-				const std::string var(e, q);
-				m.insert(map::value_type(var, q + 1));
-			} else
-				m.insert(map::value_type(e, ""));
-		}
-		global_environ = 0;
+		for (const char * const * p(global_environ); *p; ++p)
+			if (matches(*p, var, l))
+				return value_of(*p, l);
+		return 0;
 	}
-	cached_data = 0;
+	const std::size_t p(index[find_slot(var, l)]);
+	if (!p) return 0;
+	return value_of(d[p - 1U], l);
 }
@@ -9,34 +9,49 @@ For copyright and licensing terms, see the file named COPYING.
 #include <map>
 #include <vector>
 #include <string>
+#include <cstddef>
 
+/// \brief The environment to be passed on to the next program in a chain.
+///
+/// The environment is kept in envp form throughout, so that it never needs to be flattened again for execve().
+/// The inherited strings are used in place, and never copied; only the strings of variables that are set are allocated, in an arena.
+/// An overwritten value is written in place when it fits; otherwise, as with an unset variable, its old string is released for reuse by later strings.
+/// Strings never move once allocated, so that a value returned by query() stays valid until that same variable is next set or unset, or the environment is cleared.
+/// An open-addressed hash table indexes the variables by name, giving their positions in the envp array, which is patched in place on a change.
 struct ProcessEnvironment {
-private:
-	typedef std::map<std::string, std::string> map;
 public:
 	ProcessEnvironment(const char * const *);
-	const char * const * data() { if (!cached_data) make_data(); return cached_data; }
-	std::size_t size() { make_copy(); return m.size(); }
+	~ProcessEnvironment();
+	const char * const * data() const { return global_environ ? global_environ : d.data(); }
+	std::size_t size() { make_index(); return d.size() - 1U; }
 	bool clear();
 	bool set(const char *, const char *);
 	bool set(const char *, const std::string &);
 	bool set(const std::string &, const std::string &);
 	bool unset(const char * var) { return set(var, 0); }
-	bool unset(const std::string & var) { return set(var, 0); }
+	bool unset(const std::string & var) { return set(var.c_str(), 0); }
+	/// \returns the value, which is invalidated by the next set() or unset() of the same variable, or by clear()
 	const char * query(const char *) const;
-	typedef map::const_iterator const_iterator;
-	const_iterator find(const std::string &);
-	const_iterator begin();
-	const_iterator end();
 protected:
-	const char * const * global_environ;	///< non-NULL if we are simply passing through to std::getenv()
-	const char * const * cached_data;	///< non-NULL if the cache is valid
-	map m;	///< the actual environment dictionary
-	typedef std::vector<std::string> vec;
-	vec s;	///< cached var=value strings
-	std::vector<const char *> d;	///< cached vector of const char pointers
-	void make_copy();
-	void make_data();
+	const char * const * global_environ;	///< non-NULL if we are simply passing through the inherited environment unaltered
+	std::vector<const char *> d;	///< the var=value strings, in envp form with a terminating null pointer
+	std::vector<std::size_t> index;	///< open-addressed hash table of 1 plus positions in d, with 0 for an empty slot
+	std::vector<std::size_t> capacity;	///< parallel to d, the allocated size of each arena string, with 0 for an inherited string
+	std::vector<char *> blocks;	///< the arena blocks that hold the strings of variables that have been set
+	char * arena_next;
+	std::size_t arena_left;
+	std::multimap<std::size_t, char *> released;	///< arena strings that have been overwritten or unset, by allocated size, for reuse
+	void make_index();
+	void rehash(std::size_t);
+	std::size_t find_slot(const char *, std::size_t) const;
+	void erase_slot(std::size_t);
+	bool set(const char *, std::size_t, const char *, std::size_t);
+	char * allocate(std::size_t &);
+	void release(std::size_t);
+	static void free_blocks(std::vector<char *> &);
+private:
+	ProcessEnvironment(const ProcessEnvironment &);
+	ProcessEnvironment & operator = (const ProcessEnvironment &);
 };
 
 #endif
@@ -0,0 +1,308 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#if defined(__LINUX__) || defined(__linux__)
+#include <endian.h>
+#else
+#include <sys/endian.h>
+#endif
+#include "fdutils.h"
+#include "SocketAccessRules.h"
+
+/* The compiled database format *********************************************
+// **************************************************************************
+*/
+
+// A compiled database is a sequence of big-endian 32-bit words:
+//  * the header: two magic words, IPv4 node count, IPv6 node count, UID bucket count, GID bucket count, and names length;
+//  * the IPv4 trie nodes and then the IPv6 trie nodes, each a triple of 0-branch child, 1-branch child, and verdict;
+//  * the UID hash buckets and then the GID hash buckets, each a triple of name offset, name length, and verdict;
+// followed by the bytes of the names that the buckets point into.
+// Node 0 is the root of each trie, so a child index of 0 means no child; and a verdict of NONE in a bucket marks it as empty.
+// Bucket counts are powers of 2, or 0 for an empty table.
+
+namespace {
+
+const uint32_t MAGIC0(0x6E6F7368);	// "nosh"
+const uint32_t MAGIC1(0x52554C31);	// "RUL1"
+const std::size_t HEADER_WORDS(7U);
+const std::size_t NODE_WORDS(3U);
+const std::size_t BUCKET_WORDS(3U);
+
+inline
+uint32_t
+hash (
+	const char * p,
+	std::size_t l
+) {
+	// FNV-1a
+	uint32_t h(2166136261U);
+	while (l--) {
+		h ^= static_cast<unsigned char>(*p++);
+		h *= 16777619U;
+	}
+	return h;
+}
+
+inline
+unsigned
+bit_of (
+	const unsigned char * address,
+	unsigned n
+) {
+	return (address[n / 8U] >> (7U - n % 8U)) & 1U;
+}
+
+void
+build_table (
+	std::vector<uint32_t> & buckets,
+	std::string & names,
+	const std::map<std::string, SocketAccessRules::verdict> & ids
+) {
+	std::size_t count(0U);
+	for (std::map<std::string, SocketAccessRules::verdict>::const_iterator i(ids.begin()), e(ids.end()); i != e; ++i)
+		if (SocketAccessRules::NONE != i->second)
+			++count;
+	if (!count) return;
+	std::size_t size(1U);
+	while (size < 2U * count) size <<= 1U;
+	buckets.assign(BUCKET_WORDS * size, 0U);
+	for (std::map<std::string, SocketAccessRules::verdict>::const_iterator i(ids.begin()), e(ids.end()); i != e; ++i) {
+		if (SocketAccessRules::NONE == i->second) continue;
+		std::size_t b(hash(i->first.data(), i->first.length()) & (size - 1U));
+		while (SocketAccessRules::NONE != buckets[BUCKET_WORDS * b + 2U])
+			b = (b + 1U) & (size - 1U);
+		buckets[BUCKET_WORDS * b + 0U] = names.length();
+		buckets[BUCKET_WORDS * b + 1U] = i->first.length();
+		buckets[BUCKET_WORDS * b + 2U] = i->second;
+		names += i->first;
+	}
+}
+
+}
+
+/* Access control rules *****************************************************
+// **************************************************************************
+*/
+
+const SocketAccessRules::verdict SocketAccessRules::NONE;
+const SocketAccessRules::verdict SocketAccessRules::ALLOW;
+const SocketAccessRules::verdict SocketAccessRules::DENY;
+
+SocketAccessRules::SocketAccessRules(
+) :
+	image(0),
+	image_size(0U)
+{
+}
+
+SocketAccessRules::~SocketAccessRules()
+{
+	if (image) munmap(const_cast<uint32_t *>(image), image_size);
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_directory (
+	int base_dir_fd,
+	const char * subdir
+) {
+	const int dir_fd(open_dir_at(base_dir_fd, subdir));
+	if (0 > dir_fd) return NONE;
+	const int allowed(faccessat(dir_fd, "allow", F_OK, AT_EACCESS));
+	const int denied(faccessat(dir_fd, "deny", F_OK, AT_EACCESS));
+	close(dir_fd);
+	if (0 <= allowed) return ALLOW;
+	if (0 <= denied) return DENY;
+	return NONE;
+}
+
+void
+SocketAccessRules::add_ip (
+	std::vector<uint32_t> & nodes,
+	const unsigned char * address,
+	unsigned prefix_length,
+	verdict v
+) {
+	if (nodes.empty()) nodes.resize(NODE_WORDS, 0U);
+	std::size_t n(0U);
+	for (unsigned depth(0U); depth < prefix_length; ++depth) {
+		const std::size_t slot(NODE_WORDS * n + bit_of(address, depth));
+		if (!nodes[slot]) {
+			nodes[slot] = nodes.size() / NODE_WORDS;
+			nodes.resize(nodes.size() + NODE_WORDS, 0U);
+		}
+		n = nodes[slot];
+	}
+	nodes[NODE_WORDS * n + 2U] = v;
+}
+
+void
+SocketAccessRules::add_ip4 (
+	const in_addr & a,
+	unsigned prefix_length,
+	verdict v
+) {
+	add_ip(ip4_nodes, reinterpret_cast<const unsigned char *>(&a), prefix_length, v);
+}
+
+void
+SocketAccessRules::add_ip6 (
+	const in6_addr & a,
+	unsigned prefix_length,
+	verdict v
+) {
+	add_ip(ip6_nodes, reinterpret_cast<const unsigned char *>(&a), prefix_length, v);
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_ip (
+	const uint32_t * nodes,
+	uint32_t count,
+	const unsigned char * address,
+	unsigned bits
+) {
+	// The verdict of the deepest node with one is that of the longest matching prefix.
+	verdict v(NONE);
+	for (uint32_t n(0U), depth(0U); ; ++depth) {
+		const uint32_t * const node(nodes + NODE_WORDS * n);
+		if (const verdict here = be32toh(node[2]))
+			v = here;
+		if (depth >= bits) break;
+		n = be32toh(node[bit_of(address, depth)]);
+		if (!n || n >= count) break;
+	}
+	return v;
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_ip4 (
+	const in_addr & a
+) const {
+	if (!image) return NONE;
+	return query_ip(compiled.ip4_nodes, compiled.ip4_node_count, reinterpret_cast<const unsigned char *>(&a), 32U);
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_ip6 (
+	const in6_addr & a
+) const {
+	if (!image) return NONE;
+	return query_ip(compiled.ip6_nodes, compiled.ip6_node_count, reinterpret_cast<const unsigned char *>(&a), 128U);
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_id (
+	const uint32_t * buckets,
+	uint32_t count,
+	const std::string & name
+) const {
+	if (!image || !count) return NONE;
+	for (uint32_t b(hash(name.data(), name.length()) & (count - 1U)), probes(0U); probes < count; b = (b + 1U) & (count - 1U), ++probes) {
+		const uint32_t * const bucket(buckets + BUCKET_WORDS * b);
+		const verdict v(be32toh(bucket[2]));
+		if (NONE == v) break;
+		const uint32_t offset(be32toh(bucket[0])), length(be32toh(bucket[1]));
+		if (offset <= compiled.names_length
+		&&  length <= compiled.names_length - offset
+		&&  0 == name.compare(0, std::string::npos, compiled.names + offset, length)
+		)
+			return v;
+	}
+	return NONE;
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_uid (
+	const std::string & name
+) const {
+	return query_id(compiled.uid_buckets, compiled.uid_bucket_count, name);
+}
+
+SocketAccessRules::verdict
+SocketAccessRules::query_gid (
+	const std::string & name
+) const {
+	return query_id(compiled.gid_buckets, compiled.gid_bucket_count, name);
+}
+
+bool
+SocketAccessRules::map_compiled (
+	int fd
+) {
+	struct stat s;
+	if (0 > fstat(fd, &s)) return false;
+	if (s.st_size < static_cast<off_t>(HEADER_WORDS * sizeof *image)) return false;
+	const std::size_t size(s.st_size);
+	void * const base(mmap(0, size, PROT_READ, MAP_SHARED, fd, 0));
+	if (MAP_FAILED == base) return false;
+	const uint32_t * const words(static_cast<const uint32_t *>(base));
+	const uint64_t ip4_node_count(be32toh(words[2])), ip6_node_count(be32toh(words[3])), uid_bucket_count(be32toh(words[4])), gid_bucket_count(be32toh(words[5])), names_length(be32toh(words[6]));
+	if (MAGIC0 != be32toh(words[0])
+	||  MAGIC1 != be32toh(words[1])
+	||  ip4_node_count < 1U
+	||  ip6_node_count < 1U
+	||  (uid_bucket_count & (uid_bucket_count - 1U))
+	||  (gid_bucket_count & (gid_bucket_count - 1U))
+	||  (HEADER_WORDS + NODE_WORDS * (ip4_node_count + ip6_node_count) + BUCKET_WORDS * (uid_bucket_count + gid_bucket_count)) * sizeof *words + names_length != size
+	) {
+		munmap(base, size);
+		return false;
+	}
+	if (image) munmap(const_cast<uint32_t *>(image), image_size);
+	image = words;
+	image_size = size;
+	compiled.ip4_node_count = ip4_node_count;
+	compiled.ip6_node_count = ip6_node_count;
+	compiled.uid_bucket_count = uid_bucket_count;
+	compiled.gid_bucket_count = gid_bucket_count;
+	compiled.names_length = names_length;
+	compiled.ip4_nodes = words + HEADER_WORDS;
+	compiled.ip6_nodes = compiled.ip4_nodes + NODE_WORDS * ip4_node_count;
+	compiled.uid_buckets = compiled.ip6_nodes + NODE_WORDS * ip6_node_count;
+	compiled.gid_buckets = compiled.uid_buckets + BUCKET_WORDS * uid_bucket_count;
+	compiled.names = reinterpret_cast<const char *>(compiled.gid_buckets + BUCKET_WORDS * gid_bucket_count);
+	return true;
+}
+
+void
+SocketAccessRules::write_compiled (
+	std::FILE * f
+) const {
+	std::vector<uint32_t> ip4(ip4_nodes), ip6(ip6_nodes), uid_buckets, gid_buckets;
+	if (ip4.empty()) ip4.resize(NODE_WORDS, 0U);
+	if (ip6.empty()) ip6.resize(NODE_WORDS, 0U);
+	std::string names;
+	build_table(uid_buckets, names, uids);
+	build_table(gid_buckets, names, gids);
+
+	std::vector<uint32_t> words;
+	words.reserve(HEADER_WORDS + ip4.size() + ip6.size() + uid_buckets.size() + gid_buckets.size());
+	words.push_back(MAGIC0);
+	words.push_back(MAGIC1);
+	words.push_back(ip4.size() / NODE_WORDS);
+	words.push_back(ip6.size() / NODE_WORDS);
+	words.push_back(uid_buckets.size() / BUCKET_WORDS);
+	words.push_back(gid_buckets.size() / BUCKET_WORDS);
+	words.push_back(names.length());
+	words.insert(words.end(), ip4.begin(), ip4.end());
+	words.insert(words.end(), ip6.begin(), ip6.end());
+	words.insert(words.end(), uid_buckets.begin(), uid_buckets.end());
+	words.insert(words.end(), gid_buckets.begin(), gid_buckets.end());
+	for (std::vector<uint32_t>::iterator i(words.begin()), e(words.end()); i != e; ++i)
+		*i = htobe32(*i);
+	std::fwrite(words.data(), sizeof *words.data(), words.size(), f);
+	std::fwrite(names.data(), 1U, names.length(), f);
+}
@@ -0,0 +1,71 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#if !defined(INCLUDE_SOCKETACCESSRULES_H)
+#define INCLUDE_SOCKETACCESSRULES_H
+
+#include <vector>
+#include <map>
+#include <string>
+#include <cstddef>
+#include <cstdio>
+#include <stdint.h>
+#include <netinet/in.h>
+
+/// \brief A ucspi-socket-rules-check access control rules database.
+///
+/// The source of truth is always a tree of rule directories, which query_directory() reads directly.
+/// A database is built up in memory from such a tree and written out with write_compiled(); or is a read-only memory-mapped image of such a written file.
+/// The compiled form holds the IP address rules in binary tries, where a longest-prefix match is one walk from the root, and the UID and GID rules in hash tables.
+class SocketAccessRules
+{
+public:
+	typedef uint32_t verdict;
+	static const verdict NONE = 0U, ALLOW = 1U, DENY = 2U;
+
+	SocketAccessRules();
+	~SocketAccessRules();
+
+	/// Determine what a single rule directory says, as ucspi-socket-rules-check always has.
+	static verdict query_directory(int dir_fd, const char * subdir);
+
+	void add_uid(const std::string & name, verdict v) { uids[name] = v; }
+	void add_gid(const std::string & name, verdict v) { gids[name] = v; }
+	void add_ip4(const in_addr &, unsigned prefix_length, verdict);
+	void add_ip6(const in6_addr &, unsigned prefix_length, verdict);
+
+	verdict query_uid(const std::string &) const;
+	verdict query_gid(const std::string &) const;
+	verdict query_ip4(const in_addr &) const;
+	verdict query_ip6(const in6_addr &) const;
+
+	/// Map a compiled database image from the open file; returning false if the file is not a valid compiled database.
+	bool map_compiled(int fd);
+	/// Write the in-memory database out in compiled form.
+	void write_compiled(std::FILE *) const;
+
+protected:
+	typedef std::map<std::string, verdict> id_map;
+	id_map uids, gids;
+	std::vector<uint32_t> ip4_nodes, ip6_nodes;
+
+	const uint32_t * image;
+	std::size_t image_size;
+	struct {
+		const uint32_t * ip4_nodes, * ip6_nodes, * uid_buckets, * gid_buckets;
+		const char * names;
+		uint32_t ip4_node_count, ip6_node_count, uid_bucket_count, gid_bucket_count, names_length;
+	} compiled;
+
+	static void add_ip(std::vector<uint32_t> & nodes, const unsigned char * address, unsigned prefix_length, verdict);
+	static verdict query_ip(const uint32_t * nodes, uint32_t count, const unsigned char * address, unsigned bits);
+	verdict query_id(const uint32_t * buckets, uint32_t count, const std::string &) const;
+
+private:
+	SocketAccessRules(const SocketAccessRules &);
+	SocketAccessRules & operator = (const SocketAccessRules &);
+};
+
+#endif
@@ -4,6 +4,7 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <cstddef>
+#include <algorithm>
 #include "CharacterCell.h"
 #include "TUIDisplayCompositor.h"
 
@@ -20,6 +21,41 @@ operator != (
 	return a.character != b.character || a.attributes != b.attributes || a.foreground != b.foreground || a.background != b.background;
 }
 
+/* Row hashing **************************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+inline
+void
+hash_in (
+	uint32_t & h,
+	uint32_t v
+) {
+	h = (h ^ v) * 16777619U;
+}
+
+/// FNV-1a over the visible content of a row of cells.
+/// Hashes are only used to propose candidate scrolls; cells are always compared in full afterwards.
+template <class Cell>
+uint32_t
+row_hash (
+	const Cell * p,
+	std::size_t w
+) {
+	uint32_t h(2166136261U);
+	for (const Cell * e(p + w); p < e; ++p) {
+		hash_in(h, p->character);
+		hash_in(h, p->attributes);
+		hash_in(h, (uint32_t(p->foreground.alpha) << 24U) | (uint32_t(p->foreground.red) << 16U) | (uint32_t(p->foreground.green) << 8U) | p->foreground.blue);
+		hash_in(h, (uint32_t(p->background.alpha) << 24U) | (uint32_t(p->background.red) << 16U) | (uint32_t(p->background.green) << 8U) | p->background.blue);
+	}
+	return h;
+}
+
+}
+
 /* The TUIDisplayCompositor class *******************************************
 // **************************************************************************
 */
@@ -40,8 +76,13 @@ TUIDisplayCompositor::TUIDisplayCompositor(
 	h(init_h),
 	w(init_w),
 	cur_cells(static_cast<std::size_t>(h) * w),
-	new_cells(static_cast<std::size_t>(h) * w)
+	new_cells(static_cast<std::size_t>(h) * w),
+	cur_row_touched(h, true),
+	new_row_changed(h, true),
+	cur_row_hashes(h),
+	new_row_hashes(h)
 {
+	rehash_cur();
 }
 
 TUIDisplayCompositor::DirtiableCell & 
@@ -70,6 +111,18 @@ TUIDisplayCompositor::resize(
 	const std::size_t s(static_cast<std::size_t>(h) * w);
 	if (cur_cells.size() != s) cur_cells.resize(s);
 	if (new_cells.size() != s) new_cells.resize(s);
+	cur_row_touched.assign(h, true);
+	new_row_changed.assign(h, true);
+	cur_row_hashes.resize(h);
+	new_row_hashes.resize(h);
+	rehash_cur();
+}
+
+void
+TUIDisplayCompositor::rehash_cur()
+{
+	for (coordinate row(0U); row < h; ++row)
+		cur_row_hashes[row] = row_hash(&cur_at(row, 0U), w);
 }
 
 void
@@ -77,31 +130,168 @@ TUIDisplayCompositor::touch_all()
 {
 	for (unsigned row(0); row < h; ++row)
 		for (unsigned col(0); col < w; ++col)
-			cur_at(row, col).touch();
+			touch(row, col);
+}
+
+/// \brief Untouch every cell in a row, for when the row has been output in its entirety.
+void
+TUIDisplayCompositor::untouch_row(coordinate row)
+{
+	for (unsigned col(0); col < w; ++col)
+		cur_at(row, col).untouch();
+	cur_row_touched[row] = false;
 }
 
 void
 TUIDisplayCompositor::repaint_new_to_cur()
 {
-	for (unsigned row(0); row < h; ++row)
-		for (unsigned col(0); col < w; ++col)
-			cur_at(row, col) = new_at(row, col);
+	for (unsigned row(0); row < h; ++row) {
+		if (!new_row_changed[row]) continue;
+		new_row_changed[row] = false;
+		bool changed(false);
+		for (unsigned col(0); col < w; ++col) {
+			DirtiableCell & cur(cur_at(row, col));
+			const CharacterCell & n(new_at(row, col));
+			if (cur != n) {
+				cur = n;
+				changed = true;
+			}
+		}
+		if (changed) {
+			cur_row_touched[row] = true;
+			cur_row_hashes[row] = row_hash(&cur_at(row, 0U), w);
+		}
+	}
+}
+
+/// \brief Detect a vertical scroll of a band of rows between the "cur" and "new" arrays and apply it to the "cur" array.
+///
+/// On return, the rows from top up to (but not including) bottom of the "cur" array have been moved up by amount rows, or down if amount is negative.
+/// Cells keep their touched flags as they move, and the rows exposed by the move are touched.
+/// The caller is expected to make the same move on its output device, after which the usual repaint_new_to_cur() only finds the exposed rows and any other changes.
+/// Without margins, the output device can only move bands that extend to the bottom row, and no other moves are detected.
+bool
+TUIDisplayCompositor::scroll_cur_to_new(
+	coordinate & top,
+	coordinate & bottom,
+	int & amount,
+	bool margins
+) {
+	if (h < 3U) return false;
+	// Only the rows that have changed need hashing; the rest are the same as the "cur" array.
+	bool any(false);
+	for (coordinate row(0U); row < h; ++row) {
+		if (new_row_changed[row]) {
+			new_row_hashes[row] = row_hash(&new_at(row, 0U), w);
+			any = true;
+		} else
+			new_row_hashes[row] = cur_row_hashes[row];
+	}
+	if (!any) return false;
+	// The band is bounded by the first and last rows that have changed.
+	coordinate first(0U), last(h);
+	while (first < h && cur_row_hashes[first] == new_row_hashes[first]) ++first;
+	if (first >= h) return false;
+	while (last > first && cur_row_hashes[last - 1U] == new_row_hashes[last - 1U]) --last;
+	if (last < first + 2U) return false;
+	if (!margins && last < h) return false;
+
+	// Candidates are the nearest old positions of the first new row (scrolling up) and of the last new row (scrolling down).
+	int candidates[2] = { 0, 0 };
+	for (coordinate row(first + 1U); row < last; ++row)
+		if (cur_row_hashes[row] == new_row_hashes[first]) { candidates[0] = int(row) - int(first); break; }
+	for (coordinate row(last - 1U); row-- > first; )
+		if (cur_row_hashes[row] == new_row_hashes[last - 1U]) { candidates[1] = int(row) - int(last - 1U); break; }
+
+	int best_amount(0);
+	unsigned best_gain(0U);
+	for (unsigned i(0U); i < sizeof candidates/sizeof *candidates; ++i) {
+		const int n(candidates[i]);
+		if (!n) continue;
+		// Only count rows that a move would make correct and that were not already correct in place.
+		unsigned gain(0U);
+		for (coordinate row(first); row < last; ++row) {
+			const int source(int(row) + n);
+			if (source < int(first) || source >= int(last)) continue;
+			if (new_row_hashes[row] == cur_row_hashes[source] && new_row_hashes[row] != cur_row_hashes[row])
+				++gain;
+		}
+		if (gain > best_gain) {
+			best_gain = gain;
+			best_amount = n;
+		}
+	}
+	// A move that saves fewer than half of the band's rows is not worth the bother.
+	if (!best_amount || 2U * best_gain < unsigned(last - first)) return false;
+
+	const std::size_t moved(static_cast<std::size_t>(last - first - (best_amount > 0 ? best_amount : -best_amount)) * w);
+	if (best_amount > 0) {
+		const std::vector<DirtiableCell>::iterator dest(cur_cells.begin() + static_cast<std::size_t>(first) * w);
+		const std::vector<DirtiableCell>::iterator source(dest + static_cast<std::size_t>(best_amount) * w);
+		std::copy(source, source + moved, dest);
+		std::copy(cur_row_hashes.begin() + first + best_amount, cur_row_hashes.begin() + last, cur_row_hashes.begin() + first);
+		for (coordinate row(last - best_amount); row < last; ++row)
+			for (coordinate col(0U); col < w; ++col)
+				touch(row, col);
+	} else {
+		const std::vector<DirtiableCell>::iterator source(cur_cells.begin() + static_cast<std::size_t>(first) * w);
+		std::copy_backward(source, source + moved, source + moved + static_cast<std::size_t>(-best_amount) * w);
+		std::copy_backward(cur_row_hashes.begin() + first, cur_row_hashes.begin() + last + best_amount, cur_row_hashes.begin() + last);
+		for (coordinate row(first); row < first - best_amount; ++row)
+			for (coordinate col(0U); col < w; ++col)
+				touch(row, col);
+	}
+	// Every row in the band has moved relative to the "new" array, and may have carried touched cells with it.
+	for (coordinate row(first); row < last; ++row) {
+		new_row_changed[row] = true;
+		cur_row_touched[row] = true;
+	}
+	// Software cursor and pointer images move along with the cells that they were drawn over.
+	if (invalidate_software_cursor)
+		touch_moved_sprite(first, last, best_amount, cursor_row, cursor_col);
+	touch_moved_sprite(first, last, best_amount, pointer_row, pointer_col);
+
+	top = first;
+	bottom = last;
+	amount = best_amount;
+	return true;
+}
+
+void
+TUIDisplayCompositor::touch_moved_sprite(
+	coordinate top,
+	coordinate bottom,
+	int amount,
+	coordinate row,
+	coordinate col
+) {
+	if (row >= h || col >= w) return;
+	touch(row, col);
+	const int moved_row(int(row) - amount);
+	if (row >= top && row < bottom && moved_row >= int(top) && moved_row < int(bottom))
+		touch(moved_row, col);
 }
 
 void
 TUIDisplayCompositor::poke(coordinate y, coordinate x, const CharacterCell & c)
 {
-	if (y < h && x < w) new_at(y, x) = c;
+	if (y < h && x < w) {
+		CharacterCell & n(new_cells[static_cast<std::size_t>(y) * w + x]);
+		if (n != c) {
+			n = c;
+			new_row_changed[y] = true;
+		}
+	}
 }
 
 void 
 TUIDisplayCompositor::move_cursor(coordinate row, coordinate col) 
 {
 	if (cursor_row != row || cursor_col != col) {
-		if (invalidate_software_cursor) cur_at(cursor_row, cursor_col).touch();
+		if (invalidate_software_cursor) touch(cursor_row, cursor_col);
 		cursor_row = row;
 		cursor_col = col;
-		if (invalidate_software_cursor) cur_at(cursor_row, cursor_col).touch();
+		if (invalidate_software_cursor) touch(cursor_row, cursor_col);
 	}
 }
 
@@ -109,9 +299,9 @@ bool
 TUIDisplayCompositor::change_pointer_row(coordinate row) 
 {
 	if (row < h && pointer_row != row) {
-		cur_at(pointer_row, pointer_col).touch();
+		touch(pointer_row, pointer_col);
 		pointer_row = row;
-		cur_at(pointer_row, pointer_col).touch();
+		touch(pointer_row, pointer_col);
 		return true;
 	}
 	return false;
@@ -121,9 +311,9 @@ bool
 TUIDisplayCompositor::change_pointer_col(coordinate col) 
 {
 	if (col < w && pointer_col != col) {
-		cur_at(pointer_row, pointer_col).touch();
+		touch(pointer_row, pointer_col);
 		pointer_col = col;
-		cur_at(pointer_row, pointer_col).touch();
+		touch(pointer_row, pointer_col);
 		return true;
 	}
 	return false;
@@ -135,7 +325,7 @@ TUIDisplayCompositor::set_cursor_state(CursorSprite::attribute_type a, CursorSpr
 	if (cursor_attributes != a || cursor_glyph != g) {
 		cursor_attributes = a; 
 		cursor_glyph = g; 
-		if (invalidate_software_cursor) cur_at(cursor_row, cursor_col).touch();
+		if (invalidate_software_cursor) touch(cursor_row, cursor_col);
 	}
 }
 
@@ -144,7 +334,7 @@ TUIDisplayCompositor::set_pointer_attributes(PointerSprite::attribute_type a)
 { 
 	if (pointer_attributes != a) {
 		pointer_attributes = a; 
-		cur_at(pointer_row, pointer_col).touch();
+		touch(pointer_row, pointer_col);
 	}
 }
 
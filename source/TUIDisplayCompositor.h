@@ -14,7 +14,10 @@ For copyright and licensing terms, see the file named COPYING.
 /// This implements a "new" array and a "cur" array.
 /// The output is composed into the "new" array and then transposed into the "cur" array.
 /// Entries in the "cur" array have an additional "touched" flag to indicate that they were changed during transposition.
+/// Rows are tracked as well as cells, so that neither transposition nor output need visit rows where nothing has changed.
+/// Rows of the "new" array are marked as changed when poked with different content, and rows of the "cur" array are marked as touched whenever any of their cells are.
 /// Actually outputting the "cur" array is the job of another class; this class knows nothing about I/O.
+/// Realizers that can scroll their output devices cheaply can ask for vertical scrolls between the "new" and "cur" arrays to be detected and applied to the "cur" array first.
 /// Layered on top of this are VIO and other access methods.
 class TUIDisplayCompositor
 {
@@ -28,7 +31,10 @@ public:
 	coordinate query_cursor_row() const { return cursor_row; }
 	coordinate query_cursor_col() const { return cursor_col; }
 	void touch_all();
+	bool is_row_touched(coordinate row) const { return cur_row_touched[row]; }
+	void untouch_row(coordinate row);
 	void repaint_new_to_cur();
+	bool scroll_cur_to_new(coordinate & top, coordinate & bottom, int & amount, bool margins);
 	void poke(coordinate y, coordinate x, const CharacterCell & c);
 	void move_cursor(coordinate y, coordinate x);
 	bool change_pointer_row(coordinate row);
@@ -54,7 +60,7 @@ public:
 	};
 
 	DirtiableCell & cur_at(coordinate y, coordinate x) { return cur_cells[static_cast<std::size_t>(y) * w + x]; }
-	CharacterCell & new_at(coordinate y, coordinate x) { return new_cells[static_cast<std::size_t>(y) * w + x]; }
+	const CharacterCell & new_at(coordinate y, coordinate x) const { return new_cells[static_cast<std::size_t>(y) * w + x]; }
 protected:
 	bool invalidate_software_cursor;
 	coordinate cursor_row, cursor_col;
@@ -65,6 +71,14 @@ protected:
 	coordinate h, w;
 	std::vector<DirtiableCell> cur_cells;
 	std::vector<CharacterCell> new_cells;
+	std::vector<bool> cur_row_touched;	///< rows of the "cur" array that may have touched cells
+	std::vector<bool> new_row_changed;	///< rows of the "new" array that may differ from the "cur" array
+	std::vector<uint32_t> cur_row_hashes;	///< always the hashes of the current content of the rows of the "cur" array
+	std::vector<uint32_t> new_row_hashes;
+
+	void touch(coordinate y, coordinate x) { if (y < h && x < w) { cur_at(y, x).touch(); cur_row_touched[y] = true; } }
+	void rehash_cur();
+	void touch_moved_sprite(coordinate top, coordinate bottom, int amount, coordinate row, coordinate col);
 };
 
 #endif
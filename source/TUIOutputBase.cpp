@@ -6,6 +6,7 @@ For copyright and licensing terms, see the file named COPYING.
 #define __STDC_FORMAT_MACROS
 #define _XOPEN_SOURCE_EXTENDED
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -79,6 +80,31 @@ bright (
 	bright(c.blue);
 }
 
+inline
+bool
+operator != (
+	const CharacterCell & a,
+	const CharacterCell & b
+) {
+	return a.character != b.character || a.attributes != b.attributes || a.foreground != b.foreground || a.background != b.background;
+}
+
+inline
+unsigned
+UTF8Length (
+	uint32_t ch
+) {
+	return	ch < 0x00000080 ? 1U :
+		ch < 0x00000800 ? 2U :
+		ch < 0x00010000 ? 3U :
+		ch < 0x00200000 ? 4U :
+		ch < 0x04000000 ? 5U :
+		6U;
+}
+
+/// \brief A cost larger than any real one, but which can be summed a few times over without overflow.
+const unsigned IMPOSSIBLE(0x7FFFU);
+
 static const CharacterCell::colour_type overscan_fg(ALPHA_FOR_ERASED,255,255,255), overscan_bg(ALPHA_FOR_ERASED,0,0,0);
 static const CharacterCell overscan_blank(' ', 0U, overscan_fg, overscan_bg);
 
@@ -138,6 +164,163 @@ TUIOutputBase::is_all_blank(
 	return true;
 }
 
+/// \brief Whether blank cells in the current pen can be produced by erasure rather than by printing.
+/// Erasure only sets the background colour, so it cannot do underlining, strikethrough, or inversion.
+inline
+bool
+TUIOutputBase::is_erasable_pen() const
+{
+	return !(current_attr & (CharacterCell::UNDERLINES|CharacterCell::STRIKETHROUGH|CharacterCell::INVERSE));
+}
+
+/// \brief Count how many blank cells in the current pen run from the given position, up to the end of the row.
+inline
+unsigned
+TUIOutputBase::count_blank_run(
+	unsigned short row,
+	unsigned short col
+) const {
+	unsigned n(0U);
+	while (col + n < c.query_w() && is_all_blank(row, col + n, 1U))
+		++n;
+	return n;
+}
+
+/// \brief The first row of a wholly blank tail of the screen in a single pen, or the screen height if there is none.
+inline
+unsigned short
+TUIOutputBase::find_blank_tail() const
+{
+	const unsigned short h(c.query_h()), w(c.query_w());
+	if (!h || !w) return h;
+	const CharacterCell & ref(c.cur_at(h - 1U, w - 1U));
+	unsigned short row(h);
+	while (row > 0U) {
+		const unsigned short r(row - 1U);
+		for (unsigned short col(0U); col < w; ++col) {
+			const CharacterCell & cell(c.cur_at(r, col));
+			if (!is_blank(cell.character)
+			||  cell.attributes != ref.attributes
+			||  cell.foreground != ref.foreground
+			||  cell.background != ref.background
+			||  c.is_marked(false, r, col)
+			||  c.is_pointer(r, col)
+			)
+				return row;
+		}
+		row = r;
+	}
+	return row;
+}
+
+/// \brief The number of bytes taken to overprint the given cells with what they already contain, or IMPOSSIBLE.
+/// This is only a viable cursor motion for a short run of narrow characters in the current pen.
+inline
+unsigned
+TUIOutputBase::overprint_length(
+	unsigned short row,
+	unsigned short col,
+	unsigned cols
+) const {
+	if (cols > 16U || !is_cheap_to_print(row, col, cols))
+		return IMPOSSIBLE;
+	unsigned l(0U);
+	for (unsigned i(0U); i < cols; ++i) {
+		const uint32_t ch(c.cur_at(row, col + i).character);
+		if (1U != width(ch))
+			return IMPOSSIBLE;
+		l += is_blank(ch) ? 1U : UTF8Length(ch);
+	}
+	return l;
+}
+
+inline
+unsigned
+TUIOutputBase::vertical_motion_length(
+	unsigned short row
+) const {
+	if (row > cursor_y) {
+		const unsigned n(row - cursor_y);
+		return std::min(n, out.control_sequence_length(n));
+	} else
+	if (row < cursor_y) {
+		const unsigned n(cursor_y - row);
+		const unsigned cuu(out.control_sequence_length(n));
+		return out.caps.use_RI ? std::min(n * out.control_character_length(RI), cuu) : cuu;
+	} else
+		return 0U;
+}
+
+inline
+unsigned
+TUIOutputBase::horizontal_motion_length(
+	unsigned short row,
+	unsigned short from,
+	unsigned short to
+) const {
+	if (to < from) {
+		const unsigned n(from - to);
+		return std::min(n, out.control_sequence_length(n));
+	} else
+	if (to > from) {
+		const unsigned n(to - from);
+		return std::min(overprint_length(row, from, n), out.control_sequence_length(n));
+	} else
+		return 0U;
+}
+
+inline
+void
+TUIOutputBase::move_vertically(
+	unsigned short row
+) {
+	if (row > cursor_y) {
+		const unsigned n(row - cursor_y);
+		if (n <= out.control_sequence_length(n))
+			out.print_control_characters(LF, n);
+		else
+			out.CUD(n);
+	} else
+	if (row < cursor_y) {
+		const unsigned n(cursor_y - row);
+		if (out.caps.use_RI && n * out.control_character_length(RI) <= out.control_sequence_length(n))
+			out.print_control_characters(RI, n);
+		else
+			out.CUU(n);
+	}
+	cursor_y = row;
+}
+
+inline
+void
+TUIOutputBase::move_horizontally(
+	unsigned short col
+) {
+	if (col < cursor_x) {
+		const unsigned n(cursor_x - col);
+		if (n <= out.control_sequence_length(n))
+			out.print_control_characters(BS, n);
+		else
+			out.CUL(n);
+		cursor_x = col;
+	} else
+	if (col > cursor_x) {
+		const unsigned n(col - cursor_x);
+		if (overprint_length(cursor_y, cursor_x, n) <= out.control_sequence_length(n)) {
+			for (unsigned i(cursor_x); i < col; ++i) {
+				TUIDisplayCompositor::DirtiableCell & cell(c.cur_at(cursor_y, i));
+				print(cell, false /* We checked for no pointer or mark. */);
+				cell.untouch();
+			}
+		} else
+			out.CUR(n);
+		cursor_x = col;
+	}
+}
+
+/// \brief Move the cursor by whichever of the possible means costs the fewest bytes of output.
+/// The candidates are absolute positioning, relative motion, carriage return followed by relative motion, and absolute column positioning.
+/// Relative horizontal motion includes overprinting cells with what they already contain.
 inline
 void
 TUIOutputBase::GotoYX(
@@ -146,81 +329,46 @@ TUIOutputBase::GotoYX(
 ) {
 	if (row == cursor_y && col == cursor_x) 
 		return;
-	if (0 == col && 0 == row) {
-		out.CUP();
-		cursor_y = cursor_x = 0;
+	const unsigned csi(out.control_character_length(CSI));
+	const unsigned absolute(0U == row && 0U == col ? csi + 1U : out.control_sequence_length(row + 1U) + out.control_sequence_length(col + 1U) - csi);
+	// When the cursor is beyond the bottom edge of the screen, relative motions are not reliable.
+	if (cursor_y >= c.query_h()) {
+		if (0 == col && 0 == row)
+			out.CUP();
+		else
+			out.CUP(row + 1U, col + 1U);
+		cursor_y = row;
+		cursor_x = col;
 		return;
 	}
-	if (0 == col ? col != cursor_x :
-	    1 == col ? 2 < cursor_x :
-	    2 == col ? 5 < cursor_x :
-	    false
-	) {
-		if (row > cursor_y) {
-			out.newline();
-			++cursor_y;
-			if (row > cursor_y) {
-				const unsigned short n(row - cursor_y);
-				if (out.caps.use_IND && n <= 3U)
-					out.print_control_characters(IND, n);
-				else
-				if (n <= 6U)
-					out.print_control_characters(LF, n);
-				else
-					out.CUD(n);
-				cursor_y = row;
-			}
-		} else
-			out.print_control_character(CR);
-		cursor_x = 0;
-	}
-	if (col == cursor_x) {
-		if (row < cursor_y) {
-			const unsigned short n(cursor_y - row);
-			if (out.caps.use_RI && n <= 3U)
-				out.print_control_characters(RI, n);
-			else
-				out.CUU(n);
-			cursor_y = row;
-		} else
-		if (row > cursor_y) {
-			const unsigned short n(row - cursor_y);
-			if (out.caps.use_IND && n <= 3U)
-				out.print_control_characters(IND, n);
-			else
-			if (n <= 6U)
-				out.print_control_characters(LF, n);
-			else
-				out.CUD(n);
-			cursor_y = row;
-		}
+	const unsigned vertical(vertical_motion_length(row));
+	// When the cursor is beyond the right edge of the screen, only absolute horizontal motions are reliable.
+	const unsigned relative(cursor_x < c.query_w() ? vertical + horizontal_motion_length(row, cursor_x, col) : IMPOSSIBLE);
+	const unsigned from_left(vertical + out.control_character_length(CR) + horizontal_motion_length(row, 0U, col));
+	const unsigned column(out.caps.use_HPA ? vertical + out.control_sequence_length(col + 1U) : IMPOSSIBLE);
+
+	if (absolute < relative && absolute < from_left && absolute < column) {
+		if (0 == col && 0 == row)
+			out.CUP();
+		else
+			out.CUP(row + 1U, col + 1U);
+		cursor_y = row;
+		cursor_x = col;
 	} else
-	if (row == cursor_y && cursor_x < c.query_w()) {
-		if (col < cursor_x) {
-			const unsigned short n(cursor_x - col);
-			if (n <= 6U)
-				out.print_control_characters(BS, n);
-			else
-				out.CUL(n);
-			cursor_x = col;
+	{
+		move_vertically(row);
+		if (relative <= from_left && relative <= column)
+			move_horizontally(col);
+		else
+		if (from_left <= column) {
+			out.print_control_character(CR);
+			cursor_x = 0;
+			move_horizontally(col);
 		} else
-		if (col > cursor_x) {
-			const unsigned short n(col - cursor_x);
-			if (n <= 6U && is_cheap_to_print(cursor_y, cursor_x, n))
-				for (unsigned i(cursor_x); i < col; ++i) {
-					TUIDisplayCompositor::DirtiableCell & cell(c.cur_at(cursor_y, i));
-					print(cell, false /* We checked for no pointer or mark. */);
-					cell.untouch();
-				}
-			else
-				out.CUR(n);
+		{
+			out.HPA(col + 1U);
 			cursor_x = col;
 		}
-	} else
-	{
-		out.CUP(row + 1U, col + 1U);
-		cursor_y = row;
-		cursor_x = col;
 	}
 }
 
@@ -260,47 +408,74 @@ TUIOutputBase::SGRAttr1(
 	}
 }
 
+/// \brief Change whichever of the attributes and colours differ from the current pen, in a single control sequence.
+/// Attributes go first, because on terminals with no way to turn reverse video off the only way is a full reset, which also resets the colours.
 inline
 void
-TUIOutputBase::SGRAttr (
-	const CharacterCell::attribute_type & attr
+TUIOutputBase::SGR (
+	const CharacterCell::attribute_type & attr,
+	const CharacterCell::colour_type & fg,
+	const CharacterCell::colour_type & bg
 ) {
-	if (attr == current_attr) return;
+	enum { KNOWN = CharacterCell::BOLD|CharacterCell::FAINT|CharacterCell::ITALIC|CharacterCell::UNDERLINES|CharacterCell::BLINK|CharacterCell::INVERSE|CharacterCell::INVISIBLE|CharacterCell::STRIKETHROUGH };
+	bool change_fg(fg != current_fg), change_bg(bg != current_bg);
+	if (!out.has_colours()) {
+		// There is no way to change colours, so there is no point in trying.
+		current_fg = fg;
+		current_bg = bg;
+		change_fg = change_bg = false;
+	}
+	const bool change_attr((attr & KNOWN) != (current_attr & KNOWN));
+	if (!change_attr && !change_fg && !change_bg) {
+		current_attr = attr;
+		return;
+	}
 	out.csi();
 	char semi(0);
-	if (!out.caps.has_reverse_off && (current_attr & CharacterCell::INVERSE)) {
-		if (semi) out.print_graphic_character(semi);
-		out.print_graphic_character('0');
-		semi = ';';
-		current_attr = 0;
-	}
-	enum { BF = CharacterCell::BOLD|CharacterCell::FAINT };
-	if ((attr & BF) != (current_attr & BF)) {
-		if (current_attr & BF) {
-			if (semi) out.print_graphic_character(semi);
-			out.print_graphic_character('2');
-			out.print_graphic_character('2');
+	if (change_attr) {
+		if (!out.caps.has_reverse_off && (current_attr & CharacterCell::INVERSE)) {
+			out.print_graphic_character('0');
 			semi = ';';
+			current_attr = 0;
+			if (out.has_colours())
+				change_fg = change_bg = true;
 		}
-		if (CharacterCell::BOLD & attr) {
-			if (semi) out.print_graphic_character(semi);
-			out.print_graphic_character('1');
-			semi = ';';
-		}
-		if (CharacterCell::FAINT & attr) {
-			if (semi) out.print_graphic_character(semi);
-			out.print_graphic_character('2');
-			semi = ';';
+		enum { BF = CharacterCell::BOLD|CharacterCell::FAINT };
+		if ((attr & BF) != (current_attr & BF)) {
+			if (current_attr & BF) {
+				if (semi) out.print_graphic_character(semi);
+				out.print_graphic_character('2');
+				out.print_graphic_character('2');
+				semi = ';';
+			}
+			if (CharacterCell::BOLD & attr) {
+				if (semi) out.print_graphic_character(semi);
+				out.print_graphic_character('1');
+				semi = ';';
+			}
+			if (CharacterCell::FAINT & attr) {
+				if (semi) out.print_graphic_character(semi);
+				out.print_graphic_character('2');
+				semi = ';';
+			}
 		}
+		SGRAttr1(attr, CharacterCell::ITALIC, '3', semi);
+		SGRAttr1(attr, CharacterCell::UNDERLINES, CharacterCell::SIMPLE_UNDERLINE, '4', semi);
+		SGRAttr1(attr, CharacterCell::BLINK, '5', semi);
+		SGRAttr1(attr, CharacterCell::INVERSE, '7', semi);
+		SGRAttr1(attr, CharacterCell::INVISIBLE, '8', semi);
+		SGRAttr1(attr, CharacterCell::STRIKETHROUGH, '9', semi);
 	}
-	SGRAttr1(attr, CharacterCell::ITALIC, '3', semi);
-	SGRAttr1(attr, CharacterCell::UNDERLINES, CharacterCell::SIMPLE_UNDERLINE, '4', semi);
-	SGRAttr1(attr, CharacterCell::BLINK, '5', semi);
-	SGRAttr1(attr, CharacterCell::INVERSE, '7', semi);
-	SGRAttr1(attr, CharacterCell::INVISIBLE, '8', semi);
-	SGRAttr1(attr, CharacterCell::STRIKETHROUGH, '9', semi);
-	out.print_graphic_character('m');
 	current_attr = attr;
+	if (change_fg) {
+		out.SGRColourParameters(true, fg, semi);
+		current_fg = fg;
+	}
+	if (change_bg) {
+		out.SGRColourParameters(false, bg, semi);
+		current_bg = bg;
+	}
+	out.print_graphic_character('m');
 }
 
 // This has to match the way that most realizing terminals will advance the cursor.
@@ -327,8 +502,9 @@ TUIOutputBase::width (
 	return 1U;
 }
 
+/// \brief Select the pen for a cell, applying the various colour transformations that we perform.
 void
-TUIOutputBase::print(
+TUIOutputBase::select_pen(
 	const TUIDisplayCompositor::DirtiableCell & cell,
 	bool inverted
 ) {
@@ -353,34 +529,79 @@ TUIOutputBase::print(
 		invert(fg);
 		invert(bg);
 	}
+	if (!out.caps.has_invisible)
+		font_attributes &= ~CharacterCell::INVISIBLE;
 
-	const unsigned w(width(cell.character));
-	bool replace_with_spaces(false);
+	SGR(font_attributes, fg, bg);
+}
 
-	if (!out.caps.has_invisible && (CharacterCell::INVISIBLE & font_attributes)) {
-		font_attributes &= ~CharacterCell::INVISIBLE;
-		replace_with_spaces = true;
-	} else
-	if (is_blank(cell.character)) {
-		replace_with_spaces = true;
+void
+TUIOutputBase::advance_cursor(
+	unsigned n
+) {
+	for (; n > 0U; --n) {
+		++cursor_x;
+		if (!out.caps.pending_wrap && cursor_x >= c.query_w()) {
+			cursor_x = 0;
+			if (cursor_y < c.query_h())
+				++cursor_y;
+		}
 	}
+}
 
-	SGRFGColour(fg);
-	SGRBGColour(bg);
-	SGRAttr(font_attributes);
+void
+TUIOutputBase::print(
+	const TUIDisplayCompositor::DirtiableCell & cell,
+	bool inverted
+) {
+	const unsigned w(width(cell.character));
+	const bool replace_with_spaces(
+		(!out.caps.has_invisible && (CharacterCell::INVISIBLE & cell.attributes))
+	||
+		is_blank(cell.character)
+	);
+
+	select_pen(cell, inverted);
 	if (replace_with_spaces) {
 		for (unsigned n(w); n > 0U; --n)
 			out.UTF8(SPC);
 	} else
 		out.UTF8(cell.character);
-	for (unsigned n(w); n > 0U; --n) {
-		++cursor_x;
-		if (!out.caps.pending_wrap && cursor_x >= c.query_w()) {
-			cursor_x = 0;
-			if (cursor_y < c.query_h())
-				++cursor_y;
-		}
+	advance_cursor(w);
+}
+
+/// \brief Print a run of copies of the character that was just printed, using REP if that is cheaper.
+/// The following cells must be identical to the one just printed, not inverted, and not wrap off the row.
+/// \returns the number of cells so printed
+unsigned
+TUIOutputBase::repeat(
+	unsigned short row,
+	unsigned short col
+) {
+	const TUIDisplayCompositor::DirtiableCell & cell(c.cur_at(row, col));
+	if (!out.caps.use_REP || 1U != width(cell.character) || c.is_marked(false, row, col) || c.is_pointer(row, col))
+		return 0U;
+	const unsigned available(c.query_w() - col - 1U);
+	const unsigned limit(out.caps.pending_wrap || !available ? available : available - 1U);
+	unsigned n(0U);
+	while (n < limit) {
+		const unsigned short x(col + 1U + n);
+		if (c.cur_at(row, x) != cell || c.is_marked(false, row, x) || c.is_pointer(row, x))
+			break;
+		++n;
 	}
+	const bool replace_with_spaces(
+		(!out.caps.has_invisible && (CharacterCell::INVISIBLE & cell.attributes))
+	||
+		is_blank(cell.character)
+	);
+	if (!n || out.control_sequence_length(n) >= n * (replace_with_spaces ? 1U : UTF8Length(cell.character)))
+		return 0U;
+	out.REP(n);
+	advance_cursor(n);
+	for (unsigned i(1U); i <= n; ++i)
+		c.cur_at(row, col + i).untouch();
+	return n;
 }
 
 void
@@ -393,9 +614,7 @@ TUIOutputBase::enter_full_screen_mode(
 		out.XTermAlternateScreenBuffer(alternate_screen_buffer);
 	}
 	out.CUP();
-	SGRAttr(0U);
-	SGRFGColour(overscan_fg);
-	SGRBGColour(overscan_bg);
+	SGR(0U, overscan_fg, overscan_bg);
 	// DEC Locator is the less preferable protocol since it does not carry modifier information.
 	if (out.caps.use_DECLocator && !out.caps.has_XTerm1006Mouse) {
 		out.DECELR(true);
@@ -440,9 +659,7 @@ TUIOutputBase::exit_full_screen_mode(
 		if (out.caps.has_square_mode)
 			out.SquareMode(true);
 	}
-	SGRBGColour(overscan_bg);
-	SGRFGColour(overscan_fg);
-	SGRAttr(0U);
+	SGR(0U, overscan_fg, overscan_bg);
 	GotoYX(0U, 0U);
 	if (out.caps.use_DECPrivateMode) {
 		out.XTermAlternateScreenBuffer(false);
@@ -478,10 +695,11 @@ TUIOutputBase::TUIOutputBase(
 	current_bg(-1U, 0U, 0U, 0U),	// Set an impossible colour, forcing a change.
 	current_attr(-1U),	// Assume all attributes are on and need to be turned off.
 	cursor_glyph(CursorSprite::BOX),
-	cursor_attributes(CursorSprite::VISIBLE)
+	cursor_attributes(CursorSprite::VISIBLE),
+	out_buffer(64U * 1024U)
 {
 	out.flush();
-	std::setvbuf(out.file(), out_buffer, _IOFBF, sizeof out_buffer);
+	std::setvbuf(out.file(), out_buffer.data(), _IOFBF, out_buffer.size());
 	enter_full_screen_mode();
 }
 
@@ -499,10 +717,24 @@ TUIOutputBase::handle_resize_event (
 		struct winsize size;
 		if (0 <= tcgetwinsz_nointr(out.fd(), size))
 			c.resize(size.ws_row, size.ws_col);
+		size_output_buffer();
 		refresh_needed = true;
 	}
 }
 
+/// \brief Ensure that the output buffer can hold an entire frame, so that each frame goes out in a single write.
+void
+TUIOutputBase::size_output_buffer (
+) {
+	// This is generous: a change of both colours in direct colour and a multiple-byte character, for every cell.
+	const std::size_t wanted(std::size_t(c.query_h()) * c.query_w() * 48U + 4096U);
+	if (wanted <= out_buffer.size()) return;
+	std::vector<char> b(wanted);
+	out.flush();
+	std::setvbuf(out.file(), b.data(), _IOFBF, b.size());
+	out_buffer.swap(b);
+}
+
 void
 TUIOutputBase::handle_refresh_event (
 ) {
@@ -518,36 +750,94 @@ TUIOutputBase::handle_update_event (
 ) {
 	if (update_needed) {
 		update_needed = false;
+		TUIDisplayCompositor::coordinate top, bottom;
+		int amount;
+		// Terminals that cannot move lines have the rows repainted instead.
+		if (out.caps.use_IL_DL && c.scroll_cur_to_new(top, bottom, amount, out.caps.use_DECSTBM))
+			scroll_output(top, bottom, amount);
 		c.repaint_new_to_cur();
 		write_changed_cells_to_output();
 	}
 }
 
+/// \brief Move a band of rows on the output device by deleting and inserting lines.
+/// A scrolling margin is only needed when the band does not extend to the bottom of the screen.
+/// The exposed lines are erased to whatever the terminal thinks best, but they have been touched and will be overwritten anyway.
+void
+TUIOutputBase::scroll_output(
+	unsigned short top,
+	unsigned short bottom,
+	int amount
+) {
+	const bool margins(bottom < c.query_h());
+	if (margins) {
+		out.DECSTBM(top + 1U, bottom);
+		// Setting the margins homes the cursor.
+		cursor_y = cursor_x = 0U;
+	}
+	GotoYX(top, 0U);
+	if (amount > 0)
+		out.DL(amount);
+	else
+		out.IL(-amount);
+	if (margins) {
+		out.DECSTBM();
+		cursor_y = cursor_x = 0U;
+	}
+}
+
+/// \brief Erase from the start of the given row to the end of the screen, if that is possible with the cell's pen.
+bool
+TUIOutputBase::erase_to_end_of_screen(
+	unsigned short row
+) {
+	GotoYX(row, 0U);
+	select_pen(c.cur_at(row, 0U), false);
+	if (!is_erasable_pen() || !is_all_blank(row, 0U, 1U))
+		return false;
+	out.ED(0U);
+	for (unsigned short r(row); r < c.query_h(); ++r)
+		c.untouch_row(r);
+	return true;
+}
+
 void
 TUIOutputBase::write_changed_cells_to_output()
 {
 	const CursorSprite::attribute_type a(c.query_cursor_attributes());
 	if (CursorSprite::VISIBLE & a)
 		out.change_cursor_visibility(false);
+	const unsigned short blank_tail(find_blank_tail());
 	for (unsigned row(0); row < c.query_h(); ++row) {
+		if (!c.is_row_touched(row)) continue;
+		if (row == blank_tail && erase_to_end_of_screen(row)) break;
 		for (unsigned col(0); col < c.query_w(); ++col) {
 			TUIDisplayCompositor::DirtiableCell & cell(c.cur_at(row, col));
 			if (!cell.touched()) continue;
 			GotoYX(row, col);
-			if (is_blank(cell.character)) {
-				const unsigned n(c.query_w() - col);
-				if (3U < n && is_cheap_to_print(row, col, n) && is_all_blank(row, col, n)) {
+			const bool inverted(
+				((c.query_cursor_attributes() & CursorSprite::VISIBLE) && c.is_marked(false, row, col))
+			||
+				((c.query_pointer_attributes() & PointerSprite::VISIBLE) && c.is_pointer(row, col))
+			);
+			if (!inverted && is_blank(cell.character)) {
+				select_pen(cell, false);
+				const unsigned n(is_erasable_pen() ? count_blank_run(row, col) : 0U);
+				if (col + n >= c.query_w() && out.control_sequence_length(0U) < n) {
 					out.EL(0U);
 					while (col < c.query_w())
 						c.cur_at(row, col++).untouch();
 					continue;
 				}
+				if (out.caps.use_ECH && out.control_sequence_length(n) < n) {
+					// Erasure does not move the cursor.
+					out.ECH(n);
+					for (unsigned i(0U); i < n; ++i)
+						c.cur_at(row, col + i).untouch();
+					col += n - 1U;
+					continue;
+				}
 			}
-			const bool inverted(
-				((c.query_cursor_attributes() & CursorSprite::VISIBLE) && c.is_marked(false, row, col))
-			||
-				((c.query_pointer_attributes() & PointerSprite::VISIBLE) && c.is_pointer(row, col))
-			);
 			print(cell, inverted);
 			cell.untouch();
 			unsigned n(width(cell.character));
@@ -556,8 +846,11 @@ TUIOutputBase::write_changed_cells_to_output()
 					c.cur_at(row, ++col).untouch();
 					--n;
 				}
-			}
+			} else
+			if (!inverted)
+				col += repeat(row, col);
 		}
+		c.untouch_row(row);
 	}
 	GotoYX(c.query_cursor_row(), c.query_cursor_col());
 	const CursorSprite::glyph_type g(c.query_cursor_glyph());
@@ -568,6 +861,7 @@ TUIOutputBase::write_changed_cells_to_output()
 	}
 	if (CursorSprite::VISIBLE & a)
 		out.change_cursor_visibility(true);
+	// The whole frame has been accumulated in the output buffer, and goes out in one write.
 	out.flush();
 }
 
@@ -578,3 +872,21 @@ TUIOutputBase::erase_new_to_backdrop ()
 		for (unsigned short col(0U); col < c.query_w(); ++col)
 			c.poke(row, col, overscan_blank);
 }
+
+/// \brief Erase all except the given area, which the caller is about to overwrite in its entirety.
+/// This avoids every cell of that area being seen as changed twice over.
+void
+TUIOutputBase::erase_new_to_backdrop (
+	unsigned short top,
+	unsigned short left,
+	unsigned short height,
+	unsigned short width
+) {
+	for (unsigned short row(0U); row < c.query_h(); ++row) {
+		const bool in_rows(row >= top && row < top + height);
+		for (unsigned short col(0U); col < c.query_w(); ++col) {
+			if (in_rows && col >= left && col < left + width) continue;
+			c.poke(row, col, overscan_blank);
+		}
+	}
+}
@@ -6,6 +6,7 @@ For copyright and licensing terms, see the file named COPYING.
 #if !defined(INCLUDE_TUIOUTPUTBASE_H)
 #define INCLUDE_TUIOUTPUTBASE_H
 
+#include <vector>
 #include <termios.h>
 #include <csignal>
 #include "CharacterCell.h"
@@ -39,7 +40,9 @@ protected:
 	void invalidate_cur() { c.touch_all(); }
 	virtual void redraw_new () = 0;
 	void erase_new_to_backdrop ();
+	void erase_new_to_backdrop (unsigned short top, unsigned short left, unsigned short height, unsigned short width);
 	void write_changed_cells_to_output ();
+	void scroll_output (unsigned short top, unsigned short bottom, int amount);
 
 private:
 	ECMA48Output out;
@@ -58,19 +61,31 @@ private:
 
 	unsigned width (uint32_t ch) const;
 	bool is_blank(uint32_t cols) const;
+	void select_pen(const TUIDisplayCompositor::DirtiableCell & cell, bool inverted);
+	void advance_cursor(unsigned n);
 	void print(const TUIDisplayCompositor::DirtiableCell & cell, bool inverted);
+	unsigned repeat(unsigned short row, unsigned short col);
+	bool erase_to_end_of_screen(unsigned short row);
 	bool is_cheap_to_print(unsigned short row, unsigned short col, unsigned cols) const;
 	bool is_all_blank(unsigned short row, unsigned short col, unsigned cols) const;
+	bool is_erasable_pen() const;
+	unsigned count_blank_run(unsigned short row, unsigned short col) const;
+	unsigned short find_blank_tail() const;
+	unsigned overprint_length(unsigned short row, unsigned short col, unsigned cols) const;
+	unsigned vertical_motion_length(unsigned short row) const;
+	unsigned horizontal_motion_length(unsigned short row, unsigned short from, unsigned short to) const;
+	void move_vertically(unsigned short row);
+	void move_horizontally(unsigned short col);
 	void GotoYX(unsigned short row, unsigned short col);
-	void SGRFGColour(const CharacterCell::colour_type & colour) { if (colour != current_fg) out.SGRColour(true, current_fg = colour); }
-	void SGRBGColour(const CharacterCell::colour_type & colour) { if (colour != current_bg) out.SGRColour(false, current_bg = colour); }
-	void SGRAttr(const CharacterCell::attribute_type & attr);
+	void SGR(const CharacterCell::attribute_type & attr, const CharacterCell::colour_type & fg, const CharacterCell::colour_type & bg);
 	void SGRAttr1(const CharacterCell::attribute_type & attr, const CharacterCell::attribute_type & mask, char m, char & semi) const;
 	void SGRAttr1(const CharacterCell::attribute_type & attr, const CharacterCell::attribute_type & mask, const CharacterCell::attribute_type & unit, char m, char & semi) const;
 
 private:
 	termios original_attr;
-	char out_buffer[64U * 1024U];
+	std::vector<char> out_buffer;
+
+	void size_output_buffer();
 };
 
 #endif
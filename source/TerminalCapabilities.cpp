@@ -25,9 +25,13 @@ TerminalCapabilities::TerminalCapabilities(
 	use_IND(true),
 	use_CTC(false),
 	use_HPA(false),
+	use_REP(false),
+	use_ECH(true),
 	use_DECSNLS(false),
 	use_DECSCPP(true),
 	use_DECSLRM(true),
+	use_DECSTBM(true),
+	use_IL_DL(true),
 	has_DTTerm_DECSLPP_extensions(false),
 	pending_wrap(true),
 	linux_editing_keypad(false),
@@ -188,6 +192,13 @@ TerminalCapabilities::TerminalCapabilities(
 		use_HPA = true;
 	}
 
+	if (true_xterm	// per xterm ctlseqs doco
+        // Allows forcing the use of REP on KVT-compatible terminals that do indeed implement the control sequence:
+	||  (!true_kvt && teken)
+	) {
+		use_REP = true;
+	}
+
 	if (true_xterm
         // Allows forcing the use of CTC on KVT-compatible terminals that do indeed implement the control sequence:
 	||  (!true_kvt && (teken || linuxvt))
@@ -241,6 +252,7 @@ TerminalCapabilities::TerminalCapabilities(
 		use_DECPrivateMode = false;
 		use_RI = false;
 		use_IND = false;
+		use_ECH = false;
 		has_reverse_off = false;
 	}
 
@@ -251,6 +263,19 @@ TerminalCapabilities::TerminalCapabilities(
 		pending_wrap = false;
 	}
 
+	if (dumb
+	||  interix
+	) {
+		use_IL_DL = false;
+	}
+
+	if (dumb
+	||  interix
+	||  cons		// per the cons25 termcap entry, which has no cs capability
+	) {
+		use_DECSTBM = false;
+	}
+
 	if (linuxvt)
 		linux_editing_keypad = true;
 
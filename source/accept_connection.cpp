@@ -0,0 +1,461 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <sys/types.h>
+#include <time.h>
+#if defined(__LINUX__) || defined(__linux__)
+#include "kqueue_linux.h"
+#else
+#include <sys/event.h>
+#endif
+#include <sys/socket.h>
+#include <poll.h>
+#include <unistd.h>
+#include "utils.h"
+#include "fdutils.h"
+#include "listen.h"
+#include "SignalManagement.h"
+
+/* Helper functions *********************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+sig_atomic_t child_signalled(false);
+
+inline
+void
+handle_signal (
+	int signo
+) {
+	if (SIGCHLD != signo) return;
+	child_signalled = true;
+}
+
+inline
+void
+close_listen_fds (
+	unsigned listen_fds
+) {
+	for (unsigned j(0U); j < listen_fds; ++j)
+		close(LISTEN_SOCKET_FILENO + j);
+}
+
+/// Prepare an accepted socket for its handling process, which expects to dup2() it to standard input and output.
+inline
+int
+accepted (
+	int s,
+	unsigned listen_fds
+) {
+	close_listen_fds(listen_fds);
+	// dup2() onto itself would not clear close-on-exec.
+	if (STDIN_FILENO == s || STDOUT_FILENO == s)
+		set_close_on_exec(s, false);
+	return s;
+}
+
+/// \returns whether an accept() error is one that only affects that one connection
+inline
+bool
+is_transient (
+	int error
+) {
+	return EAGAIN == error || EWOULDBLOCK == error || EINTR == error || ECONNABORTED == error;
+}
+
+/// \returns whether an accept() error is a shortage of descriptors or buffers, which only passes once other connections end
+inline
+bool
+is_shortage (
+	int error
+) {
+	return EMFILE == error || ENFILE == error || ENOBUFS == error || ENOMEM == error;
+}
+
+/// Backing off from shortages starts with a short wait, which doubles every time that the shortage persists, up to a limit.
+const long min_backoff_ms(10L), max_backoff_ms(1000L);
+
+inline
+void
+increase_backoff (
+	long & ms
+) {
+	ms = ms < min_backoff_ms ? min_backoff_ms : ms < max_backoff_ms / 2L ? ms * 2L : max_backoff_ms;
+}
+
+inline
+timespec
+to_timespec (
+	long ms
+) {
+	const timespec r = { ms / 1000L, (ms % 1000L) * 1000000L };
+	return r;
+}
+
+inline
+bool
+operator < (
+	const timespec & a,
+	const timespec & b
+) {
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+inline
+timespec
+operator - (
+	const timespec & a,
+	const timespec & b
+) {
+	timespec r = { a.tv_sec - b.tv_sec, a.tv_nsec - b.tv_nsec };
+	if (r.tv_nsec < 0) {
+		r.tv_nsec += 1000000000L;
+		--r.tv_sec;
+	}
+	return r;
+}
+
+inline
+timespec
+operator + (
+	const timespec & a,
+	const timespec & b
+) {
+	timespec r = { a.tv_sec + b.tv_sec, a.tv_nsec + b.tv_nsec };
+	if (r.tv_nsec >= 1000000000L) {
+		r.tv_nsec -= 1000000000L;
+		++r.tv_sec;
+	}
+	return r;
+}
+
+inline
+void
+fatal [[gnu::noreturn]] (
+	const char * prog
+) {
+	const int error(errno);
+	std::fprintf(stderr, "%s: FATAL: %s\n", prog, std::strerror(error));
+	throw EXIT_FAILURE;
+}
+
+inline
+void
+reap (
+	const char * prog,
+	bool verbose,
+	unsigned long & connections,
+	unsigned long connection_limit
+) {
+	for (;;) {
+		int status, code;
+		pid_t c;
+		if (0 >= wait_nonblocking_for_anychild_exit(c, status, code)) break;
+		if (connections) {
+			--connections;
+			if (verbose)
+				std::fprintf(stderr, "%s: %u ended status %i code %i %lu/%lu\n", prog, c, status, code, connections, connection_limit);
+		}
+	}
+}
+
+/// \returns whether any idle worker ended abnormally, rather than after taking a connection
+inline
+bool
+reap (
+	const char * prog,
+	bool verbose,
+	std::set<pid_t> & idle,
+	std::set<pid_t> & busy,
+	unsigned long connection_limit
+) {
+	bool idle_failed(false);
+	for (;;) {
+		int status, code;
+		pid_t c;
+		if (0 >= wait_nonblocking_for_anychild_exit(c, status, code)) break;
+		if (busy.erase(c)) {
+			if (verbose)
+				std::fprintf(stderr, "%s: %u ended status %i code %i %zu/%lu\n", prog, c, status, code, busy.size(), connection_limit);
+		} else
+		if (idle.erase(c)) {
+			if (WAIT_STATUS_EXITED != status || EXIT_SUCCESS != code)
+				idle_failed = true;
+			if (verbose)
+				std::fprintf(stderr, "%s: %u idle worker ended status %i code %i\n", prog, c, status, code);
+		}
+	}
+	return idle_failed;
+}
+
+/// \brief A pre-forked worker accepts a single connection itself, tells the parent its process ID, and returns the connection.
+int
+worker_accept (
+	const char * prog,
+	unsigned listen_fds,
+	int taken_fd,
+	int lifeline_fd,
+	sockaddr * remoteaddr,
+	socklen_t & remoteaddrsz
+) {
+	const socklen_t maxsz(remoteaddrsz);
+	std::vector<pollfd> p(listen_fds + 1U);
+	for (unsigned i(0U); i < listen_fds; ++i) {
+		p[i].fd = LISTEN_SOCKET_FILENO + i;
+		p[i].events = POLLIN;
+	}
+	// The parent holds the other end of the lifeline, so that idle workers do not outlive it.
+	p[listen_fds].fd = lifeline_fd;
+	p[listen_fds].events = POLLIN;
+	long backoff_ms(0L);
+	for (;;) {
+		if (0 > poll(p.data(), p.size(), -1)) {
+			if (EINTR == errno) continue;
+			fatal(prog);
+		}
+		if (p[listen_fds].revents)
+			throw EXIT_SUCCESS;
+		for (unsigned i(0U); i < listen_fds; ++i) {
+			if (!p[i].revents) continue;
+			remoteaddrsz = maxsz;
+			const int s(accept4(p[i].fd, remoteaddr, &remoteaddrsz, SOCK_CLOEXEC));
+			if (0 > s) {
+				const int error(errno);
+				// Another worker won the race, or the client gave up.
+				if (is_transient(error)) continue;
+				if (is_shortage(error)) {
+					// Exiting would only have the parent respawn us straight into the same shortage; so wait it out, still minding the lifeline.
+					std::fprintf(stderr, "%s: ERROR: %s\n", prog, std::strerror(error));
+					increase_backoff(backoff_ms);
+					if (0 < poll(&p[listen_fds], 1U, backoff_ms) && p[listen_fds].revents)
+						throw EXIT_SUCCESS;
+					break;
+				}
+				fatal(prog);
+			}
+			const pid_t self(getpid());
+			write(taken_fd, &self, sizeof self);
+			close(taken_fd);
+			close(lifeline_fd);
+			return accepted(s, listen_fds);
+		}
+	}
+}
+
+}
+
+/* Accepting connections ****************************************************
+// **************************************************************************
+*/
+
+int
+accept_connection (
+	const char * prog,
+	bool verbose,
+	unsigned listen_fds,
+	unsigned long connection_limit,
+	unsigned long pre_fork,
+	sockaddr * remoteaddr,
+	socklen_t & remoteaddrsz
+) {
+	ReserveSignalsForKQueue kqueue_reservation(SIGPIPE, SIGCHLD, 0);
+	PreventDefaultForFatalSignals ignored_signals(SIGPIPE, 0);
+
+	const int queue(kqueue());
+	if (0 > queue) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kqueue", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+
+	std::vector<struct kevent> p(listen_fds + 2);
+	EV_SET(&p[0], SIGCHLD, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+	EV_SET(&p[1], SIGPIPE, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+	if (0 > kevent(queue, p.data(), 2, 0, 0, 0)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+
+	// Another process, or another pre-forked worker, may accept a connection first; so accept() must never block.
+	for (unsigned i(0U); i < listen_fds; ++i)
+		set_non_blocking(LISTEN_SOCKET_FILENO + i, true);
+
+	if (pre_fork) {
+		// Workers accept connections themselves, and tell us when they have through the taken pipe.
+		int taken[2], lifeline[2];
+		if (0 > pipe_close_on_exec(taken) || 0 > pipe_close_on_exec(lifeline)) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "pipe", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		set_non_blocking(taken[0], true);
+		EV_SET(&p[0], taken[0], EVFILT_READ, EV_ADD, 0, 0, 0);
+		if (0 > kevent(queue, p.data(), 1, 0, 0, 0)) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+
+		std::set<pid_t> idle, busy;
+		// Workers that die whilst idle are respawned at an increasing interval, rather than immediately into whatever killed them.
+		long respawn_backoff_ms(0L);
+		timespec respawn_time = { 0, 0 };
+		for (;;) {
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (child_signalled) {
+				if (reap(prog, verbose, idle, busy, connection_limit)) {
+					increase_backoff(respawn_backoff_ms);
+					respawn_time = now + to_timespec(respawn_backoff_ms);
+				}
+				child_signalled = false;
+			}
+			const timespec * timeout(0);
+			timespec until_respawn;
+			if (now < respawn_time) {
+				until_respawn = respawn_time - now;
+				timeout = &until_respawn;
+			}
+			// Idle workers count against the limit, so that they can never take it beyond it.
+			while (!timeout && idle.size() < pre_fork && idle.size() + busy.size() < connection_limit) {
+				const int child(fork());
+				if (0 > child) {
+					const int error(errno);
+					std::fprintf(stderr, "%s: ERROR: %s\n", prog, std::strerror(error));
+					break;
+				}
+				if (0 == child) {
+					close(queue);
+					close(taken[0]);
+					close(lifeline[1]);
+					return worker_accept(prog, listen_fds, taken[1], lifeline[0], remoteaddr, remoteaddrsz);
+				}
+				idle.insert(child);
+			}
+			const int rc(kevent(queue, 0, 0, p.data(), p.size(), timeout));
+			if (0 > rc) {
+				if (EINTR == errno) continue;
+				fatal(prog);
+			}
+			for (size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
+				const struct kevent & e(p[i]);
+				if (EVFILT_SIGNAL == e.filter) {
+					handle_signal(e.ident);
+					continue;
+				} else
+				if (EVFILT_READ != e.filter)
+					continue;
+				pid_t pids[64];
+				for (;;) {
+					const int n(read(taken[0], pids, sizeof pids));
+					if (0 >= n) break;
+					for (const pid_t * pp(pids), * pe(pids + n / sizeof *pids); pp != pe; ++pp) {
+						if (!idle.erase(*pp)) continue;
+						busy.insert(*pp);
+						respawn_backoff_ms = 0L;
+						if (verbose)
+							std::fprintf(stderr, "%s: %u started %zu/%lu\n", prog, *pp, busy.size(), connection_limit);
+					}
+				}
+			}
+		}
+	}
+
+	for (unsigned i(0U); i < listen_fds; ++i)
+		EV_SET(&p[i], LISTEN_SOCKET_FILENO + i, EVFILT_READ, EV_ADD, 0, 0, 0);
+	if (0 > kevent(queue, p.data(), listen_fds, 0, 0, 0)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+
+	const socklen_t maxsz(remoteaddrsz);
+	unsigned long connections(0);
+	bool accepting(true);
+	// During a shortage, the listening sockets are disabled until either the back-off interval passes or a connection ends.
+	long backoff_ms(0L);
+	bool backing_off(false);
+
+	for (;;) {
+		if (child_signalled) {
+			reap(prog, verbose, connections, connection_limit);
+			child_signalled = false;
+		}
+		// Only tell the kernel about the listening sockets when crossing the connection limit or backing off.
+		int nchanges(0);
+		if (accepting != (connections < connection_limit && !backing_off)) {
+			accepting = !accepting;
+			for (unsigned i(0U); i < listen_fds; ++i)
+				EV_SET(&p[i], LISTEN_SOCKET_FILENO + i, EVFILT_READ, accepting ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+			nchanges = listen_fds;
+		}
+		const timespec backoff_timeout(to_timespec(backoff_ms));
+		const int rc(kevent(queue, p.data(), nchanges, p.data(), listen_fds + 2, backing_off ? &backoff_timeout : 0));
+		backing_off = false;
+		if (0 > rc) {
+			if (EINTR == errno) continue;
+			fatal(prog);
+		}
+		for (size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
+			const struct kevent & e(p[i]);
+			if (EVFILT_SIGNAL == e.filter) {
+				handle_signal (e.ident);
+				continue;
+			} else
+			if (EVFILT_READ != e.filter)
+				continue;
+			const int l(static_cast<int>(e.ident));
+
+			// Drain the backlog, up to the connection limit.
+			while (connections < connection_limit) {
+				remoteaddrsz = maxsz;
+				const int s(accept4(l, remoteaddr, &remoteaddrsz, SOCK_CLOEXEC));
+				if (0 > s) {
+					const int error(errno);
+					if (EAGAIN == error || EWOULDBLOCK == error) break;
+					if (EINTR == error) continue;
+					if (ECONNABORTED == error) {
+						std::fprintf(stderr, "%s: ERROR: %s\n", prog, std::strerror(error));
+						continue;
+					}
+					if (is_shortage(error)) {
+						std::fprintf(stderr, "%s: ERROR: %s\n", prog, std::strerror(error));
+						increase_backoff(backoff_ms);
+						backing_off = true;
+						break;
+					}
+					fatal(prog);
+				}
+				backoff_ms = 0L;
+
+				const int child(fork());
+				if (0 > child) {
+					const int error(errno);
+					std::fprintf(stderr, "%s: ERROR: %s\n", prog, std::strerror(error));
+					close(s);
+					break;
+				}
+				if (0 == child) {
+					close(queue);
+					return accepted(s, listen_fds);
+				}
+				++connections;
+				if (verbose)
+					std::fprintf(stderr, "%s: %u started %lu/%lu\n", prog, child, connections, connection_limit);
+				close(s);
+			}
+		}
+	}
+}
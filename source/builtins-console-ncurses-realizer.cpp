@@ -28,3 +28,8 @@ struct command
 personalities[] = {
 };
 const std::size_t num_personalities = sizeof personalities/sizeof *personalities;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-console-ncurses-realizer.hash.h"
+#endif
@@ -13,6 +13,7 @@ For copyright and licensing terms, see the file named COPYING.
 
 // These are the built-in commands visible in the console utilities.
 
+extern void console_convert_cin_table ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void console_convert_kbdmap ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void console_decode_ecma48 ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void console_fb_realizer ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
@@ -46,6 +47,7 @@ extern const
 struct command 
 commands[] = {
 	// Terminals
+	{	"console-convert-cin-table",	console_convert_cin_table	},
 	{	"console-convert-kbdmap",	console_convert_kbdmap		},
 	{	"console-decode-ecma48",	console_decode_ecma48		},
 	{	"console-fb-realizer",		console_fb_realizer		},
@@ -93,3 +95,8 @@ personalities[] = {
 	{	0,			0,			},
 };
 const std::size_t num_personalities = 0;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-console-terminal-emulator.hash.h"
+#endif
@@ -91,6 +91,7 @@ extern void time_pause_until ( const char * &, std::vector<const char *> &, Proc
 extern void time_print_tai64n ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void true_command ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void ucspi_socket_rules_check ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
+extern void ucspi_socket_rules_compile ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void udp_socket_connect ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void udp_socket_listen ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void ulimit ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
@@ -166,6 +167,7 @@ commands[] = {
 	{	"local-stream-socket-accept",		local_stream_socket_accept	},
 	{	"local-seqpacket-socket-accept",	local_seqpacket_socket_accept	},
 	{	"ucspi-socket-rules-check",		ucspi_socket_rules_check	},
+	{	"ucspi-socket-rules-compile",		ucspi_socket_rules_compile	},
 	{	"local-stream-socket-connect",		local_stream_socket_connect	},
 	{	"tcp-socket-connect",			tcp_socket_connect		},
 	{	"udp-socket-connect",			udp_socket_connect		},
@@ -210,3 +212,8 @@ struct command
 personalities[] = {
 };
 const std::size_t num_personalities = sizeof personalities/sizeof *personalities;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-exec.hash.h"
+#endif
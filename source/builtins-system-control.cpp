@@ -53,6 +53,7 @@ extern void setsid ( const char * & , std::vector<const char *> &, ProcessEnviro
 extern void system_version ( const char * & , std::vector<const char *> &, ProcessEnvironment & );
 extern void unload_when_stopped ( const char * & , std::vector<const char *> &, ProcessEnvironment & );
 extern void service_dt_scanner ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
+extern void service_timer_scheduler ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void service_control ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void service_is_enabled ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
 extern void service_is_ok ( const char * &, std::vector<const char *> &, ProcessEnvironment & );
@@ -152,6 +153,7 @@ personalities[] = {
 	{	"service-manager",	service_manager		},
 	{	"service-dt-scanner",	service_dt_scanner	},
 	{	"svscan",		service_dt_scanner	},
+	{	"service-timer-scheduler",	service_timer_scheduler	},
 	{	"service-control",	service_control		},
 	{	"svc",			service_control		},
 	{	"svok",			service_is_ok		},
@@ -162,3 +164,8 @@ personalities[] = {
 	{	"chkservice",		chkservice		},
 };
 const std::size_t num_personalities = sizeof personalities/sizeof *personalities;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-system-control.hash.h"
+#endif
@@ -56,3 +56,8 @@ personalities[] = {
 	{	"systemd",		system_manager		},
 };
 const std::size_t num_personalities = sizeof personalities/sizeof *personalities;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-system-manager.hash.h"
+#endif
@@ -73,3 +73,8 @@ personalities[] = {
 	{	0,			0,			},
 };
 const std::size_t num_personalities = 0;
+
+// The name lookup tables, generated from the above by default.hash.h.do .
+#if !defined(GENERATING_HASHES)	// The generator preprocesses this file, before the tables exist.
+#include "builtins-telinit.hash.h"
+#endif
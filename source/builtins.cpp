@@ -9,6 +9,7 @@ For copyright and licensing terms, see the file named COPYING.
 #include <cstring>
 #include <cerrno>
 #include <new>
+#include <stdint.h>
 #include <unistd.h>
 #include "utils.h"
 #include "ProcessEnvironment.h"
@@ -18,20 +19,48 @@ For copyright and licensing terms, see the file named COPYING.
 // **************************************************************************
 */
 
+/// The generator in default.hash.h.do computes exactly the same function.
+static inline
+uint32_t
+hash_name (
+	uint32_t displacement,
+	const char * s,
+	std::size_t l
+) {
+	const uint64_t m(2U * displacement + 33U);
+	uint64_t h(0U);
+	while (l--)
+		h = (h * m + static_cast<unsigned char>(*s++)) % 16777213U;
+	return h;
+}
+
+static inline
+const command *
+find_in (
+	const command * table,
+	const command_hash & hash,
+	const char * prog,
+	std::size_t len
+) {
+	if (!hash.slots) return 0;
+	const int d(hash.displacements[hash_name(0U, prog, len) % hash.slots]);
+	const std::size_t slot(0 > d ? -1 - d : hash_name(d, prog, len) % hash.slots);
+	if (len != hash.lengths[slot]) return 0;
+	const command * c(table + hash.indices[slot]);
+	return 0 == std::memcmp(c->name, prog, len) ? c : 0;
+}
+
 const command *
 find (
 	const char * prog,
 	bool allow_personalities
 ) {
+	const std::size_t len(std::strlen(prog));
 	if (allow_personalities) {
-		for ( const command * c(personalities); c != personalities + num_personalities; ++c )
-			if (0 == strcmp(c->name, prog)) 
-				return c;
-	}
-	for ( const command * c(commands); c != commands + num_commands; ++c )
-		if (0 == strcmp(c->name, prog)) 
+		if (const command * c = find_in(personalities, personalities_hash, prog, len))
 			return c;
-	return 0;
+	}
+	return find_in(commands, commands_hash, prog, len);
 }
 
 static inline
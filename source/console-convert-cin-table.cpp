@@ -0,0 +1,56 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include "utils.h"
+#include "popt.h"
+#include "CINDataTable.h"
+
+/* Main function ************************************************************
+// **************************************************************************
+*/
+
+void
+console_convert_cin_table [[gnu::noreturn]] (
+	const char * & /*next_prog*/,
+	std::vector<const char *> & args,
+	ProcessEnvironment & /*envs*/
+) {
+	const char * prog(basename_of(args[0]));
+	try {
+		popt::top_table_definition main_option(0, 0, "Main options", "{file}");
+
+		std::vector<const char *> new_args;
+		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
+		p.process(true /* strictly options before arguments */);
+		args = new_args;
+		if (p.stopped()) throw EXIT_SUCCESS;
+	} catch (const popt::error & e) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
+		throw static_cast<int>(EXIT_USAGE);
+	}
+	if (args.empty()) {
+		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Missing data table name.");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+	const char * name(args.front());
+	args.erase(args.begin());
+	if (!args.empty()) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, args.front(), "Unexpected argument.");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+	CINDataTable table;
+	CINDataTableLoader loader(table, prog, name);
+	loader.load();
+	table.write_compiled(stdout);
+	if (std::ferror(stdout) || 0 != std::fflush(stdout)) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "<stdout>", "Write error.");
+		throw EXIT_FAILURE;
+	}
+	throw EXIT_SUCCESS;
+}
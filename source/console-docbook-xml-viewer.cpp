@@ -5,6 +5,9 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <map>
 #include <vector>
+#include <list>
+#include <string>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -101,12 +104,66 @@ struct DisplayLine : public std::vector<DisplayItem> {
 	unsigned long width() const;
 };
 
-struct DisplayDocument : public std::list<DisplayLine> {
-	DisplayDocument() {}
-	DisplayLine * append_line() {
-		push_back(DisplayLine());
-		return &back();
-	}
+/// \brief One step of laying out a document, as emitted by the parser and replayed at whatever width the document is displayed.
+struct LayoutOp {
+	enum Kind {
+		BREAK,	///< end the current line, so that the next item starts a new one
+		BLANK,	///< append a blank line, leaving the current line as it was
+		PRE,	///< append literal text to the current line
+		WRAP,	///< append text to the current line, first starting a new one if it would not fit
+	};
+	LayoutOp(Kind k) : kind(k), attr(0), colour(0), indent(0U), text() {}
+	LayoutOp(Kind k, CharacterCell::attribute_type a, uint_fast8_t c, std::size_t i, const u32string::const_iterator & b, const u32string::const_iterator & e) : kind(k), attr(a), colour(c), indent(i), text(b, e) {}
+	Kind kind;
+	CharacterCell::attribute_type attr;
+	uint_fast8_t colour;
+	std::size_t indent;	///< the indentation context for any new line that this starts
+	u32string text;
+};
+
+/// \brief A document as a stream of layout operations, laid out lazily into display lines.
+///
+/// The stream is divided into sections at line breaks, which can be laid out independently of one another.
+/// Sections are laid out only as far as the lines that are asked for, with their line counts remembered for each width that they have been laid out at and the lines themselves kept for the most recent width.
+/// So a change of width only lays out afresh the lines that are actually displayed, plus a line count of the sections before them.
+/// The final section is not laid out until the document is complete, as it may yet grow.
+class DisplayDocument
+{
+public:
+	DisplayDocument();
+
+	std::size_t intern_indent(const std::string &);
+	void append(const LayoutOp &);
+	void finish() { complete = true; }
+
+	void set_width(unsigned long);
+	unsigned long query_width() const { return width; }
+	bool has_line(std::size_t);
+	std::size_t size();
+	const DisplayLine & line(std::size_t);
+
+protected:
+	struct Section {
+		Section(std::size_t f) : first_op(f), end_op(f), lines_width(0UL), lines() {}
+		std::size_t first_op, end_op;
+		std::map<unsigned long, std::size_t> counts;
+		unsigned long lines_width;
+		std::vector<DisplayLine> lines;
+	};
+	typedef std::vector<Section> Sections;
+
+	std::vector<LayoutOp> ops;
+	Sections sections;
+	std::vector<std::string> indents;
+	std::map<std::string, std::size_t> indent_ids;
+	bool complete;
+	unsigned long width;
+	std::vector<std::size_t> first_lines;	///< the first line of each section that has been counted at the current width, plus the end
+
+	std::size_t layable_sections() const { return complete ? sections.size() : sections.size() - 1U; }
+	bool count_next_section();
+	std::size_t layout(const Section &, std::vector<DisplayLine> *) const;
+	std::size_t indent_spaces(std::size_t) const;
 };
 
 typedef std::map<u32string, u32string> Attributes;
@@ -142,12 +199,11 @@ protected:
 };
 
 struct DocumentParser : public UTF8Decoder::UCS32CharacterSink {
-	DocumentParser(DisplayDocument & d, unsigned long c) : doc(d), columns(c), state(CONTENT), current_line(0), content(), name(), value(), tag(false) {}
+	DocumentParser(DisplayDocument & d) : doc(d), state(CONTENT), content(), name(), value(), tag(false), indent_context(0U), indent_context_valid(false) {}
 protected:
 	typedef std::list<Element> Elements;
 
 	DisplayDocument & doc;
-	unsigned long columns;
 	enum State { 
 		CONTENT,
 		ENTITY,
@@ -168,10 +224,11 @@ protected:
 		PROCESSOR_COMMAND_BODY,
 		PROCESSOR_COMMAND_QUESTION,
 	} state;
-	DisplayLine * current_line;
 	u32string content, name, value;
 	Tag tag;
 	Elements elements;
+	std::size_t indent_context;
+	bool indent_context_valid;
 
 	virtual void ProcessDecodedUTF8(uint32_t character, bool decoder_error, bool overlong);
 	void flush_content();
@@ -184,7 +241,9 @@ protected:
 	void append_items_wrap(CharacterCell::attribute_type a, uint_fast8_t c, const u32string & s);
 	void append_items(const Element & e, CharacterCell::attribute_type a, const u32string & s);
 	void append_items(const Element & e, const u32string & s);
-	void indent();
+	void push_element(const Element & e) { elements.push_back(e); indent_context_valid = false; }
+	void pop_element() { elements.pop_back(); indent_context_valid = false; }
+	std::size_t indent();
 };
 
 struct TUI :
@@ -208,7 +267,7 @@ protected:
 	TUIVIO vio;
 	bool pending_quit_event, immediate_update_needed;
 	TUIDisplayCompositor::coordinate window_y, window_x;
-	unsigned long columns;
+	const unsigned long columns;	///< a fixed layout width, or 0 to lay out at the width of the terminal
 	DisplayDocument & doc;
 	std::size_t current_row, current_col;
 
@@ -238,6 +297,152 @@ DisplayLine::width() const
 	return w;
 }
 
+DisplayDocument::DisplayDocument(
+) :
+	complete(false),
+	width(80UL),
+	first_lines(1U, 0U)
+{
+	sections.push_back(Section(0U));
+}
+
+std::size_t
+DisplayDocument::intern_indent(
+	const std::string & steps
+) {
+	std::map<std::string, std::size_t>::const_iterator i(indent_ids.find(steps));
+	if (indent_ids.end() != i) return i->second;
+	const std::size_t id(indents.size());
+	indents.push_back(steps);
+	indent_ids[steps] = id;
+	return id;
+}
+
+void
+DisplayDocument::append(
+	const LayoutOp & op
+) {
+	// A line break is where one section ends and another starts, as nothing after it depends upon the lines before it.
+	if (LayoutOp::BREAK == op.kind) {
+		const Section & last(sections.back());
+		if (last.end_op != last.first_op && LayoutOp::BREAK != ops[last.end_op - 1U].kind)
+			sections.push_back(Section(ops.size()));
+	}
+	ops.push_back(op);
+	sections.back().end_op = ops.size();
+}
+
+void
+DisplayDocument::set_width(
+	unsigned long w
+) {
+	if (w == width) return;
+	width = w;
+	first_lines.assign(1U, 0U);
+}
+
+std::size_t
+DisplayDocument::indent_spaces(
+	std::size_t context
+) const {
+	const std::string & steps(indents[context]);
+	std::size_t spaces(0U);
+	for (std::string::const_iterator p(steps.begin()), e(steps.end()); e != p; ++p) {
+		if ('o' != *p && spaces + 2U < width)
+			spaces += 2U;
+		if ('i' != *p && spaces >= 2U)
+			spaces -= 2U;
+	}
+	return spaces;
+}
+
+/// Lay out a section at the current width, returning its line count and only generating the lines themselves if asked for.
+std::size_t
+DisplayDocument::layout(
+	const Section & section,
+	std::vector<DisplayLine> * lines
+) const {
+	std::size_t count(0U), current(0U);
+	unsigned long current_width(0UL);
+	bool have_line(false);
+	for (std::size_t i(section.first_op); i < section.end_op; ++i) {
+		const LayoutOp & op(ops[i]);
+		switch (op.kind) {
+			case LayoutOp::BREAK:
+				have_line = false;
+				break;
+			case LayoutOp::BLANK:
+				if (lines) lines->push_back(DisplayLine());
+				++count;
+				break;
+			case LayoutOp::PRE:
+			case LayoutOp::WRAP:
+				if (!have_line || (LayoutOp::WRAP == op.kind && current_width + op.text.length() > width)) {
+					current = count++;
+					have_line = true;
+					current_width = indent_spaces(op.indent);
+					if (lines) {
+						lines->push_back(DisplayLine());
+						if (current_width)
+							lines->back().push_back(DisplayItem(0, COLOUR_WHITE, u32string(current_width, SPC)));
+					}
+				}
+				if (!op.text.empty()) {
+					current_width += op.text.length();
+					if (lines)
+						(*lines)[current].push_back(DisplayItem(op.attr, op.colour, op.text));
+				}
+				break;
+		}
+	}
+	return count;
+}
+
+bool
+DisplayDocument::count_next_section(
+) {
+	const std::size_t i(first_lines.size() - 1U);
+	if (i >= layable_sections()) return false;
+	Section & section(sections[i]);
+	std::map<unsigned long, std::size_t>::const_iterator c(section.counts.find(width));
+	const std::size_t n(section.counts.end() != c ? c->second : layout(section, 0));
+	section.counts[width] = n;
+	first_lines.push_back(first_lines.back() + n);
+	return true;
+}
+
+bool
+DisplayDocument::has_line(
+	std::size_t n
+) {
+	while (first_lines.back() <= n)
+		if (!count_next_section())
+			return false;
+	return true;
+}
+
+std::size_t
+DisplayDocument::size(
+) {
+	while (count_next_section());
+	return first_lines.back();
+}
+
+/// The given line, which must have been established to exist with has_line() or size().
+const DisplayLine &
+DisplayDocument::line(
+	std::size_t n
+) {
+	const std::size_t i(std::upper_bound(first_lines.begin(), first_lines.end(), n) - first_lines.begin() - 1U);
+	Section & section(sections[i]);
+	if (section.lines_width != width || section.lines.empty()) {
+		section.lines.clear();
+		layout(section, &section.lines);
+		section.lines_width = width;
+	}
+	return section.lines[n - first_lines[i]];
+}
+
 Tag::Tag(
 	bool c,
 	const Element & e
@@ -439,18 +644,20 @@ Element::matches_attribute(
 	return Equals(i->second, value);
 }
 
-void
+/// The indentation context of the current element nesting, which determines how far any new line is indented.
+std::size_t
 DocumentParser::indent()
 {
-	std::size_t spaces(0U);
-	for (Elements::iterator ep(elements.begin()), ee(elements.end()); ee != ep; ++ep) {
-		if (ep->query_indent() && spaces + 2U < columns)
-			spaces += 2U;
-		if (ep->query_outdent() && spaces >= 2U)
-			spaces -= 2U;
+	if (!indent_context_valid) {
+		std::string steps;
+		for (Elements::iterator ep(elements.begin()), ee(elements.end()); ee != ep; ++ep) {
+			if (ep->query_indent() || ep->query_outdent())
+				steps += ep->query_indent() ? ep->query_outdent() ? 'b' : 'i' : 'o';
+		}
+		indent_context = doc.intern_indent(steps);
+		indent_context_valid = true;
 	}
-	if (spaces)
-		current_line->push_back(DisplayItem(0, COLOUR_WHITE, u32string(spaces, SPC)));
+	return indent_context;
 }
 
 void
@@ -460,12 +667,7 @@ DocumentParser::append_item_pre(
 	const u32string::const_iterator & b,
 	const u32string::const_iterator & e
 ) {
-	if (!current_line) {
-		current_line = doc.append_line();
-		indent();
-	}
-	if (e != b)
-		current_line->push_back(DisplayItem(a, c, b, e));
+	doc.append(LayoutOp(LayoutOp::PRE, a, c, indent(), b, e));
 }
 
 void
@@ -475,17 +677,7 @@ DocumentParser::append_item_wrap(
 	const u32string::const_iterator & b,
 	const u32string::const_iterator & e
 ) {
-	const std::size_t len(e - b);
-	if (!current_line) {
-		current_line = doc.append_line();
-		indent();
-	} else
-	if (current_line->width() + len > columns) {
-		current_line = doc.append_line();
-		indent();
-	}
-	if (e != b)
-		current_line->push_back(DisplayItem(a, c, b, e));
+	doc.append(LayoutOp(LayoutOp::WRAP, a, c, indent(), b, e));
 }
 
 void
@@ -500,7 +692,7 @@ DocumentParser::append_items_pre(
 		if (IsNewline(character)) {
 			append_item_pre(a, c, b, p);
 			b = p + 1;
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BREAK));
 		}
 	}
 	append_item_pre(a, c, b, p);
@@ -564,22 +756,22 @@ DocumentParser::flush_tag()
 		if (Equals(tag.name, "refnamediv")) {
 			u32string s;
 			Copy(s, "Name");
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BREAK));
 			append_items(element, CharacterCell::INVERSE, s);
-			doc.append_line();
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BLANK));
+			doc.append(LayoutOp(LayoutOp::BREAK));
 		}
 		if (Equals(tag.name, "refsynopsisdiv")) {
 			u32string s;
 			Copy(s, "Synopsis");
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BREAK));
 			append_items(element, CharacterCell::INVERSE, s);
-			doc.append_line();
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BLANK));
+			doc.append(LayoutOp(LayoutOp::BREAK));
 		}
 
 		if (element.query_block())
-			current_line = 0;
+			doc.append(LayoutOp(LayoutOp::BREAK));
 
 		// inline prefixes
 		if (Equals(tag.name, "refpurpose")) {
@@ -625,7 +817,7 @@ DocumentParser::flush_tag()
 
 		if (!elements.empty())
 			elements.back().has_children = true;
-		elements.push_back(element);
+		push_element(element);
 	}
 	if (tag.closing) {
 		if (elements.empty())
@@ -666,10 +858,10 @@ DocumentParser::flush_tag()
 
 		if (element.query_block()) {
 			if (element.query_margin())
-				doc.append_line();
+				doc.append(LayoutOp(LayoutOp::BLANK));
 		}
 
-		elements.pop_back();
+		pop_element();
 	}
 }
 
@@ -1087,12 +1279,11 @@ TUI::redraw_new (
 
 	erase_new_to_backdrop();
 
-	std::size_t nr(0U);
-	for (DisplayDocument::const_iterator rb(doc.begin()), re(doc.end()), ri(rb); re != ri; ++ri, ++nr) {
-		if (nr < window_y) continue;
-		long row(nr - window_y);
-		if (row >= c.query_h()) break;
-		const DisplayLine & r(*ri);
+	// Only the lines in the window are laid out and visited.
+	doc.set_width(columns ? columns : c.query_w());
+	for (std::size_t nr(window_y), ne(window_y + c.query_h()); nr < ne && doc.has_line(nr); ++nr) {
+		const long row(nr - window_y);
+		const DisplayLine & r(doc.line(nr));
 		long col(-window_x);
 		for (DisplayLine::const_iterator fb(r.begin()), fe(r.end()), fi(fb); fe != fi; ++fi) {
 			const DisplayItem & f(*fi);
@@ -1117,11 +1308,11 @@ TUI::ExtendedKey(
 			break;
 		case EXTENDED_KEY_RIGHT_ARROW:
 		case EXTENDED_KEY_PAD_RIGHT:
-			if (current_col + 1 < columns) { ++current_col; set_refresh_and_immediate_update_needed(); }
+			if (current_col + 1 < doc.query_width()) { ++current_col; set_refresh_and_immediate_update_needed(); }
 			break;
 		case EXTENDED_KEY_DOWN_ARROW:
 		case EXTENDED_KEY_PAD_DOWN:
-			if (current_row + 1 < doc.size()) { ++current_row; set_refresh_and_immediate_update_needed(); }
+			if (doc.has_line(current_row + 1)) { ++current_row; set_refresh_and_immediate_update_needed(); }
 			break;
 		case EXTENDED_KEY_UP_ARROW:
 		case EXTENDED_KEY_PAD_UP:
@@ -1140,9 +1331,9 @@ TUI::ExtendedKey(
 			break;
 		case EXTENDED_KEY_PAGE_DOWN:
 		case EXTENDED_KEY_PAD_PAGE_DOWN:
-			if (doc.size() && current_row + 1 < doc.size()) {
+			if (doc.has_line(current_row + 1)) {
 				unsigned n(c.query_h());
-				if (current_row + n < doc.size())
+				if (doc.has_line(current_row + n))
 					current_row += n;
 				else
 					current_row = doc.size() - 1;
@@ -1279,14 +1470,103 @@ namespace {
 		if (c)
 			columns = std::strtoul(c, const_cast<char **>(&c), 0);
 		if (c == s || *c) {
+			// Otherwise the layout follows the width of the terminal, as it changes.
 			winsize size;
 			if (0 <= tcgetwinsz_nointr(fd, size))
-				columns = size.ws_col;
+				columns = 0UL;
 			else
 				columns = 80UL;
 		}
 		return columns;
 	}
+
+	/// \brief Read documents a block at a time, so that parsing can be interleaved with the user interface.
+	///
+	/// Pipes, sockets, and terminals are only read once the event queue has reported them readable, so that waiting for their input does not block the user interface.
+	/// Anything else (regular files, and devices such as /dev/null that epoll cannot poll) never blocks for long, and is read without waiting.
+	class DocumentReader
+	{
+	public:
+		DocumentReader(const std::vector<const char *> & n, UTF8Decoder & d) : names(n), decoder(d), next(0U), file(-1), fd(-1), polled(false), readable(false), at_eof(false), name(0), line(1ULL), error(0) {}
+		bool done() const { return next >= names.size() && 0 > fd; }
+		bool failed() const { return error; }
+		bool at_end() const { return at_eof; }
+		/// Whether read_block() can make progress without blocking, by opening the next document or by reading the current one.
+		bool block_available() const { return 0 > fd ? next < names.size() : !at_eof && (!polled || readable); }
+		/// The current document, if it has to be waited for in the event queue.
+		int query_polled_fd() const { return polled ? fd : -1; }
+		void set_readable() { readable = true; }
+		void read_block();
+		void close();
+		void report(const char * prog) const { std::fprintf(stderr, "%s: FATAL: %s(%llu): %s\n", prog, name, line, error); }
+	protected:
+		const std::vector<const char *> names;	///< a null pointer denotes standard input
+		UTF8Decoder & decoder;
+		std::size_t next;
+		FileDescriptorOwner file;
+		int fd;
+		bool polled, readable, at_eof;
+		const char * name;
+		unsigned long long line;
+		const char * error;
+		char buffer[64U * 1024U];
+	};
+
+	void
+	DocumentReader::read_block()
+	{
+		if (0 > fd) {
+			const char * n(names[next++]);
+			line = 1ULL;
+			if (!n) {
+				name = "<stdin>";
+				fd = STDIN_FILENO;
+			} else
+			{
+				name = n;
+				file.reset(open_read_at(AT_FDCWD, n));
+				if (0 > file.get()) {
+					error = std::strerror(errno);
+					return;
+				}
+				fd = file.get();
+			}
+			struct stat s;
+			polled = 0 <= fstat(fd, &s) && (S_ISFIFO(s.st_mode) || S_ISSOCK(s.st_mode) || isatty(fd));
+			readable = false;
+			at_eof = false;
+			if (polled) return;
+		}
+		const ssize_t l(read(fd, buffer, sizeof buffer));
+		readable = false;
+		if (0 > l) {
+			const int e(errno);
+			if (EINTR != e && EAGAIN != e) error = std::strerror(e);
+			return;
+		}
+		if (0 == l) {
+			at_eof = true;
+			return;
+		}
+		try {
+			for (const char * p(buffer), * e(buffer + l); e != p; ++p) {
+				const int c(static_cast<unsigned char>(*p));
+				decoder.Process(c);
+				if (LF == c) ++line;
+			}
+		} catch (const char * s) {
+			error = s;
+		}
+	}
+
+	/// Finish with a document that has reached its end; which must first have been removed from the event queue if it was polled.
+	void
+	DocumentReader::close()
+	{
+		file.reset(-1);
+		fd = -1;
+		polled = readable = at_eof = false;
+	}
 }
 
 /* Main function ************************************************************
@@ -1337,58 +1617,27 @@ console_docbook_xml_viewer [[gnu::noreturn]]
 
 	const unsigned long columns(get_columns(envs, fileno(control)));
 
-	DisplayDocument doc;
+	if (args.empty()) {
+		if (isatty(STDIN_FILENO)) {
+			struct stat s0, st;
 
-	{
-		DocumentParser parser(doc, columns);
-		UTF8Decoder decoder(parser);
-
-		if (args.empty()) {
-			if (isatty(STDIN_FILENO)) {
-				struct stat s0, st;
-
-				if (0 <= fstat(STDIN_FILENO, &s0)
-				&&  0 <= fstat(fileno(control), &st)
-				&&  S_ISCHR(s0.st_mode)
-				&&  (s0.st_rdev == st.st_rdev)
-				) {
-					std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, tty, "The controlling terminal cannot be both standard input and control input.");
-					throw EXIT_FAILURE;
-				}
-			}
-			unsigned long long line(1ULL);
-			try {
-				for (int c = std::fgetc(stdin); EOF != c; c = std::fgetc(stdin)) {
-					decoder.Process(c);
-					if (LF == c) ++line;
-				}
-				if (std::ferror(stdin)) throw std::strerror(errno);
-			} catch (const char * s) {
-				std::fprintf(stderr, "%s: FATAL: %s(%llu): %s\n", prog, "<stdin>", line, s);
+			if (0 <= fstat(STDIN_FILENO, &s0)
+			&&  0 <= fstat(fileno(control), &st)
+			&&  S_ISCHR(s0.st_mode)
+			&&  (s0.st_rdev == st.st_rdev)
+			) {
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, tty, "The controlling terminal cannot be both standard input and control input.");
 				throw EXIT_FAILURE;
 			}
-		} else
-		{
-			while (!args.empty()) {
-				unsigned long long line(1ULL);
-				const char * file(args.front());
-				args.erase(args.begin());
-				FileStar f(std::fopen(file, "r"));
-				try {
-					if (!f) throw std::strerror(errno);
-					for (int c = std::fgetc(f); EOF != c; c = std::fgetc(f)) {
-						decoder.Process(c);
-						if (LF == c) ++line;
-					}
-					if (std::ferror(f)) throw std::strerror(errno);
-				} catch (const char * s) {
-					std::fprintf(stderr, "%s: FATAL: %s(%llu): %s\n", prog, file, line, s);
-					throw EXIT_FAILURE;
-				}
-			}
 		}
+		args.push_back(0);
 	}
 
+	DisplayDocument doc;
+	DocumentParser parser(doc);
+	UTF8Decoder decoder(parser);
+	DocumentReader reader(args, decoder);
+
 	const FileDescriptorOwner queue(kqueue());
 	if (0 > queue.get()) {
 		const int error(errno);
@@ -1408,57 +1657,86 @@ console_docbook_xml_viewer [[gnu::noreturn]]
 	append_event(ip, SIGTSTP, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
 	append_event(ip, SIGCONT, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
 
-	TUIDisplayCompositor compositor(false /* no software cursor */, 24, 80);
-	TUI ui(envs, doc, compositor, control, columns, cursor_application_mode, calculator_application_mode, !no_alternate_screen_buffer);
-
-	// How long to wait with updates pending.
-	const struct timespec short_timeout = { 0, 100000000L };
-	const struct timespec immediate_timeout = { 0, 0 };
+	{
+		TUIDisplayCompositor compositor(false /* no software cursor */, 24, 80);
+		TUI ui(envs, doc, compositor, control, columns, cursor_application_mode, calculator_application_mode, !no_alternate_screen_buffer);
 
-	std::vector<struct kevent> p(4);
-	while (true) {
-		if (ui.exit_signalled() || ui.quit_flagged())
-			break;
-		ui.handle_resize_event();
-		ui.handle_refresh_event();
+		// How long to wait with updates pending.
+		const struct timespec short_timeout = { 0, 100000000L };
+		const struct timespec immediate_timeout = { 0, 0 };
 
-		const struct timespec * timeout(ui.immediate_update() ? &immediate_timeout : ui.has_update_pending() ? &short_timeout : 0);
-		const int rc(kevent(queue.get(), ip.data(), ip.size(), p.data(), p.size(), timeout));
-		ip.clear();
+		std::vector<struct kevent> p(4);
+		while (true) {
+			if (ui.exit_signalled() || ui.quit_flagged())
+				break;
+			// Documents are parsed a block at a time, so that the first screenful is displayed without waiting for the whole of them.
+			if (reader.block_available()) {
+				const int polled_fd(reader.query_polled_fd());
+				reader.read_block();
+				if (reader.failed())
+					break;
+				if (0 > polled_fd && 0 <= reader.query_polled_fd())
+					append_event(ip, reader.query_polled_fd(), EVFILT_READ, EV_ADD, 0, 0, 0);
+				ui.set_refresh_needed();
+			}
+			// A polled document has to leave the queue before it is closed, so it is closed after the next kevent().
+			const bool document_ended(reader.at_end());
+			if (document_ended && 0 <= reader.query_polled_fd())
+				append_event(ip, reader.query_polled_fd(), EVFILT_READ, EV_DELETE, 0, 0, 0);
+			ui.handle_resize_event();
+			ui.handle_refresh_event();
+
+			const struct timespec * timeout(ui.immediate_update() || document_ended || reader.block_available() ? &immediate_timeout : ui.has_update_pending() ? &short_timeout : 0);
+			const int rc(kevent(queue.get(), ip.data(), ip.size(), p.data(), p.size(), timeout));
+			ip.clear();
+			if (document_ended) {
+				reader.close();
+				if (reader.done())
+					doc.finish();
+				ui.set_refresh_needed();
+			}
 
-		if (0 > rc) {
-			const int error(errno);
-			if (EINTR == error) continue;
+			if (0 > rc) {
+				const int error(errno);
+				if (EINTR == error) continue;
 #if defined(__LINUX__) || defined(__linux__)
-			if (EINVAL == error) continue;	// This works around a Linux bug when an inotify queue overflows.
-			if (0 == error) continue;	// This works around another Linux bug.
+				if (EINVAL == error) continue;	// This works around a Linux bug when an inotify queue overflows.
+				if (0 == error) continue;	// This works around another Linux bug.
 #endif
-			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
-			throw EXIT_FAILURE;
-		}
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+				throw EXIT_FAILURE;
+			}
 
-		if (0 == rc) {
-			ui.handle_update_event();
-			continue;
-		}
+			if (0 == rc) {
+				ui.handle_update_event();
+				continue;
+			}
 
-		for (std::size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
-			const struct kevent & e(p[i]);
-			switch (e.filter) {
-				case EVFILT_SIGNAL:
-					ui.handle_signal(e.ident);
-					break;
-				case EVFILT_READ:
-				{
-					const int fd(static_cast<int>(e.ident));
-					if (fileno(control) == fd) {
-						ui.handle_control(fd, e.data);
+			for (std::size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
+				const struct kevent & e(p[i]);
+				switch (e.filter) {
+					case EVFILT_SIGNAL:
+						ui.handle_signal(e.ident);
+						break;
+					case EVFILT_READ:
+					{
+						const int fd(static_cast<int>(e.ident));
+						if (fileno(control) == fd) {
+							ui.handle_control(fd, e.data);
+						} else
+						if (reader.query_polled_fd() == fd) {
+							reader.set_readable();
+						}
+						break;
 					}
-					break;
 				}
 			}
 		}
 	}
 
+	if (reader.failed()) {
+		reader.report(prog);
+		throw EXIT_FAILURE;
+	}
 	throw EXIT_SUCCESS;
 }
@@ -641,7 +641,7 @@ class Realizer
 {
 public:
 	typedef unsigned short coordinate;
-	Realizer(FramebufferIO & f, unsigned, bool wrong_way_up, bool, bool, bool, GraphicsInterface & g, Monospace16x16Font & mf, VirtualTerminalBackEnd & vt, TUIDisplayCompositor & c);
+	Realizer(FramebufferIO & f, unsigned, bool wrong_way_up, bool, bool, bool, GraphicsInterface & g, GraphicsInterface * sh, Monospace16x16Font & mf, VirtualTerminalBackEnd & vt, TUIDisplayCompositor & c);
 	~Realizer();
 
 	enum { AXIS_W, AXIS_X, AXIS_Y, AXIS_Z, H_SCROLL, V_SCROLL };
@@ -649,7 +649,7 @@ public:
 	void set_refresh_needed() { refresh_needed = true; }
 	void handle_update_event();
 	void handle_refresh_event();
-	void invalidate_all() { c.touch_all(); }
+	void invalidate_all() { c.touch_all(); full_flushes_needed = 2U; }
 
 	static coordinate pixel_to_column(unsigned long x) { return x / CHARACTER_PIXEL_WIDTH; }
 	static coordinate pixel_to_row(unsigned long y) { return y / CHARACTER_PIXEL_HEIGHT; }
@@ -687,6 +687,7 @@ protected:
 	const bool has_pointer;
 	FramebufferIO & fb;
 	GraphicsInterface & gdi;
+	GraphicsInterface * const shadow;	///< an optional composition surface in system memory, or null to paint directly onto the framebuffer
 	Monospace16x16Font & font;
 	GlyphCache glyph_cache;		///< a recently-used cache of handles to 2-colour bitmaps
 	const GlyphBitmapHandle mouse_glyph_handle;
@@ -698,10 +699,16 @@ protected:
 	const CharacterCell::colour_type mouse_fg;
 
 	bool refresh_needed, update_needed;
+	unsigned shown_page;
+	unsigned full_flushes_needed;
+	std::vector<bool> damaged_rows;	///< rows painted onto the shadow since the last flush
+	std::vector<bool> back_page_damaged_rows;	///< rows painted onto the shadow that the back page of a double-buffered display lacks
 	void erase_new_to_backdrop ();
 	void position_vt_visible_area ();
 	void compose_new_from_vt ();
 	void paint_changed_cells_onto_framebuffer();
+	void scroll_framebuffer(coordinate top, coordinate bottom, int amount);
+	void flush_damage_onto_framebuffer();
 
 	GlyphBitmapHandle GetCursorGlyphBitmap() const;
 	GlyphBitmapHandle GetCachedGlyphBitmap(uint32_t character, CharacterCell::attribute_type attributes);
@@ -733,6 +740,7 @@ Realizer::Realizer(
 	bool bc,
 	bool hp,
 	GraphicsInterface & g,
+	GraphicsInterface * sh,
 	Monospace16x16Font & mf,
 	VirtualTerminalBackEnd & t,
 	TUIDisplayCompositor & comp
@@ -744,6 +752,7 @@ Realizer::Realizer(
 	has_pointer(hp),
 	fb(f),
 	gdi(g),
+	shadow(sh),
 	font(mf),
 	mouse_glyph_handle(gdi.MakeGlyphBitmap()),
 	underline_glyph_handle(gdi.MakeGlyphBitmap()),
@@ -754,6 +763,10 @@ Realizer::Realizer(
 	mouse_fg(31,0xFF,0xFF,0xFF),
 	refresh_needed(true),
 	update_needed(true),
+	shown_page(0U),
+	full_flushes_needed(2U),
+	damaged_rows(comp.query_h(), false),
+	back_page_damaged_rows(comp.query_h(), false),
 	pointer_xpixel(0),
 	pointer_ypixel(0),
 	screen_y(0U),
@@ -904,12 +917,14 @@ inline
 void
 Realizer::paint_changed_cells_onto_framebuffer()
 {
-	const GraphicsInterface::ScreenBitmapHandle screen(gdi.GetScreenBitmap());
+	const GraphicsInterface::ScreenBitmapHandle screen((shadow ? shadow : &gdi)->GetScreenBitmap());
 
 	for (unsigned row(0); row < c.query_h(); ++row) {
+		if (!c.is_row_touched(row)) continue;
 		for (unsigned col(0); col < c.query_w(); ++col) {
 			TUIDisplayCompositor::DirtiableCell & cell(c.cur_at(row, col));
 			if (!cell.touched()) continue;
+			damaged_rows[row] = true;
 			CharacterCell::attribute_type font_attributes(cell.attributes);
 			CharacterCell::colour_type fg(cell.foreground), bg(cell.background);
 			if (faint_as_colour) {
@@ -958,16 +973,87 @@ Realizer::paint_changed_cells_onto_framebuffer()
 			}
 			cell.untouch();
 		}
+		c.untouch_row(row);
 	}
 }
 
+/// \brief Move a band of character rows up (or down, if amount is negative) as whole scanlines, rather than repainting every glyph.
+/// The compositor has already moved its record of the cells, and touched the exposed rows.
+inline
+void
+Realizer::scroll_framebuffer(
+	coordinate top,
+	coordinate bottom,
+	int amount
+) {
+	GraphicsInterface & surface(shadow ? *shadow : gdi);
+	const GraphicsInterface::ScreenBitmapHandle screen(surface.GetScreenBitmap());
+	const unsigned n(amount > 0 ? amount : -amount);
+	const unsigned short h((bottom - top - n) * CHARACTER_PIXEL_HEIGHT);
+	if (amount > 0)
+		surface.MoveScanlines(screen, top * CHARACTER_PIXEL_HEIGHT, screen, (top + n) * CHARACTER_PIXEL_HEIGHT, h);
+	else
+		surface.MoveScanlines(screen, (top + n) * CHARACTER_PIXEL_HEIGHT, screen, top * CHARACTER_PIXEL_HEIGHT, h);
+	if (shadow)
+		std::fill(damaged_rows.begin() + top, damaged_rows.begin() + bottom, true);
+}
+
+/// \brief Copy the rows painted onto the shadow since the last flush onto the framebuffer.
+/// Adjacent damaged rows are coalesced into single spans of whole scanlines.
+/// On a double-buffered display, the spans are copied onto the back page, which is then displayed.
+inline
+void
+Realizer::flush_damage_onto_framebuffer()
+{
+	if (!shadow) return;
+	const bool double_buffered(fb.query_double_buffered());
+	if (!double_buffered && full_flushes_needed > 1U)
+		full_flushes_needed = 1U;
+	if (!full_flushes_needed && damaged_rows.end() == std::find(damaged_rows.begin(), damaged_rows.end(), true))
+		return;
+
+	const GraphicsInterface::ScreenBitmapHandle from(shadow->GetScreenBitmap()), to(gdi.GetScreenBitmap());
+	const unsigned page(double_buffered ? 1U - shown_page : 0U);
+	const unsigned short page_y(page * fb.query_yres());
+	if (full_flushes_needed) {
+		--full_flushes_needed;
+		gdi.MoveScanlines(to, page_y, from, 0U, fb.query_yres());
+	} else {
+		const std::size_t h(damaged_rows.size());
+		for (std::size_t row(0U); row < h; ) {
+			if (!damaged_rows[row] && !back_page_damaged_rows[row]) {
+				++row;
+				continue;
+			}
+			std::size_t end(row + 1U);
+			while (end < h && (damaged_rows[end] || back_page_damaged_rows[end])) ++end;
+			gdi.MoveScanlines(to, page_y + row * CHARACTER_PIXEL_HEIGHT, from, row * CHARACTER_PIXEL_HEIGHT, (end - row) * CHARACTER_PIXEL_HEIGHT);
+			row = end;
+		}
+	}
+	if (double_buffered) {
+		if (fb.show_page(page))
+			shown_page = page;
+		else
+			gdi.MoveScanlines(to, shown_page * fb.query_yres(), from, 0U, fb.query_yres());
+		back_page_damaged_rows.swap(damaged_rows);
+	}
+	std::fill(damaged_rows.begin(), damaged_rows.end(), false);
+}
+
+/// \brief Erase the overscan area around the terminal's visible area.
+/// The visible area itself is left alone, so that cells that the terminal overwrites with the same content are not seen as changes.
 inline
 void
 Realizer::erase_new_to_backdrop () 
 {
-	for (unsigned short row(0U); row < c.query_h(); ++row)
-		for (unsigned short col(0U); col < c.query_w(); ++col)
+	for (unsigned short row(0U); row < c.query_h(); ++row) {
+		const bool in_vt_rows(row >= screen_y && row < screen_y + vt.query_visible_h());
+		for (unsigned short col(0U); col < c.query_w(); ++col) {
+			if (in_vt_rows && col >= screen_x && col < screen_x + vt.query_visible_w()) continue;
 			c.poke(row, col, overscan_blank);
+		}
+	}
 }
 
 /// \brief Clip and position the visible portion of the terminal's display buffer.
@@ -1010,8 +1096,8 @@ Realizer::handle_refresh_event (
 ) {
 	if (refresh_needed) {
 		refresh_needed = false;
-		erase_new_to_backdrop();
 		position_vt_visible_area();
+		erase_new_to_backdrop();
 		compose_new_from_vt();
 		update_needed = true;
 	}
@@ -1023,8 +1109,13 @@ Realizer::handle_update_event (
 ) {
 	if (update_needed) {
 		update_needed = false;
+		coordinate top, bottom;
+		int amount;
+		if (c.scroll_cur_to_new(top, bottom, amount, true))
+			scroll_framebuffer(top, bottom, amount);
 		c.repaint_new_to_cur();
 		paint_changed_cells_onto_framebuffer();
+		flush_damage_onto_framebuffer();
 	}
 }
 
@@ -4393,6 +4484,7 @@ console_fb_realizer [[gnu::noreturn]] (
 	std::list< std::pair<std::string,std::string> > ugen_input_filenames;
 	bool wrong_way_up(false);
 	bool bold_as_colour(false);
+	bool shadow_framebuffer(false);
 	bool initial_numlock(false);
 	FontSpecList fonts;
 	unsigned long quadrant(3U);
@@ -4422,6 +4514,7 @@ console_fb_realizer [[gnu::noreturn]] (
 		popt::string_definition keyboard_map_option('\0', "keyboard-map", "filename", "Use this keyboard map.", keyboard_map_filename);
 		popt::unsigned_number_definition quadrant_option('\0', "quadrant", "number", "Position the terminal in quadrant 0, 1, 2, or 3.", quadrant, 0);
 		popt::bool_definition wrong_way_up_option('\0', "wrong-way-up", "Display from bottom to top.", wrong_way_up);
+		popt::bool_definition shadow_framebuffer_option('\0', "shadow-framebuffer", "Compose the display in system memory and copy changes to the framebuffer.", shadow_framebuffer);
 		fontspec_definition vtfont_option('\0', "vtfont", "filename", "Use this font as a medium+bold upright vt font.", fonts, -1, CombinedFont::Font::UPRIGHT);
 		fontspec_definition vtfont_faint_r_option('\0', "vtfont-faint-r", "filename", "Use this font as a light+demibold upright vt font.", fonts, -2, CombinedFont::Font::UPRIGHT);
 		fontspec_definition vtfont_faint_o_option('\0', "vtfont-faint-o", "filename", "Use this font as a light+demibold oblique vt font.", fonts, -2, CombinedFont::Font::OBLIQUE);
@@ -4461,6 +4554,7 @@ console_fb_realizer [[gnu::noreturn]] (
 			&keyboard_map_option,
 			&quadrant_option,
 			&wrong_way_up_option,
+			&shadow_framebuffer_option,
 			&vtfont_option,
 			&vtfont_faint_r_option,
 			&vtfont_faint_o_option,
@@ -4788,6 +4882,9 @@ console_fb_realizer [[gnu::noreturn]] (
 	}
 #endif
 	fb.set_graphics_mode(prog, fb_filename);
+	// With a shadow, the display can be panned between two pages to avoid tearing, if the device supports it.
+	if (shadow_framebuffer)
+		fb.enable_double_buffering();
 
 	void * const base(mmap(0, fb.query_size(), PROT_READ|PROT_WRITE, MAP_SHARED, fb.get(), 0));
 	if (MAP_FAILED == base) {
@@ -4795,13 +4892,21 @@ console_fb_realizer [[gnu::noreturn]] (
 		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, fb_filename, std::strerror(error));
 		throw EXIT_FAILURE;
 	}
+	const std::size_t shadow_size(std::size_t(fb.query_stride()) * fb.query_yres());
+	void * const shadow_base(shadow_framebuffer ? mmap(0, shadow_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANON, -1, 0) : 0);
+	if (MAP_FAILED == shadow_base) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "shadow framebuffer", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
 
 	VirtualTerminalBackEnd vt(vt_dirname, buffer_file.release(), input_fd.release());
 	append_event(ip, vt.query_buffer_fd(), EVFILT_VNODE, EV_ADD|EV_ENABLE|EV_CLEAR, NOTE_WRITE, 0, 0);
 	append_event(ip, vt.query_input_fd(), EVFILT_WRITE, EV_ADD|EV_DISABLE, 0, 0, 0);
 	TUIDisplayCompositor c(true /* software cursor */, Realizer::pixel_to_row(fb.query_yres()), Realizer::pixel_to_column(fb.query_xres()));
 	GraphicsInterface gdi(base, fb.query_size(), fb.query_yres(), fb.query_xres(), fb.query_stride(), fb.query_depth());
-	Realizer realizer(fb, quadrant, wrong_way_up, !font.has_faint(), bold_as_colour, has_pointer, gdi, font, vt, c);
+	GraphicsInterface shadow(shadow_base, shadow_base ? shadow_size : 0U, fb.query_yres(), fb.query_xres(), fb.query_stride(), fb.query_depth());
+	Realizer realizer(fb, quadrant, wrong_way_up, !font.has_faint(), bold_as_colour, has_pointer, gdi, shadow_base ? &shadow : 0, font, vt, c);
 
 #if defined(__LINUX__) || defined(__linux__)
 	if (0 <= kvt.query_input_fd()) {
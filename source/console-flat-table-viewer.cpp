@@ -16,6 +16,7 @@ For copyright and licensing terms, see the file named COPYING.
 #include <inttypes.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #if defined(__FreeBSD__) || defined(__DragonFly__) || defined(__OpenBSD__)
 #include <vis.h>
@@ -44,9 +45,90 @@ For copyright and licensing terms, see the file named COPYING.
 
 namespace {
 
-typedef std::string Field;
-typedef std::vector<Field> Record;
-typedef std::vector<Record> Table;
+/// \brief A table of records of fields, stored by column offsets rather than as individual strings.
+///
+/// Field contents live either in a single arena of bytes or, if the table is verbatim, in a memory-mapped input file that the fields are taken directly from.
+/// Each field is a pair of offsets into that storage, and each record is an offset into the list of fields.
+/// Fields are only ever appended to, at the end of the last field of the last record, as they are parsed.
+class Table
+{
+public:
+	Table() : source(0) {}
+
+	void set_source(const char * p) { clear(); source = p; }
+	bool is_verbatim() const { return source; }
+	void clear();
+	std::size_t size() const { return records.size(); }
+	std::size_t field_count(std::size_t nr) const { return (nr + 1U < records.size() ? records[nr + 1U] : starts.size()) - records[nr]; }
+	const char * field_data(std::size_t nr, std::size_t nf, std::size_t & length) const;
+
+	void start_field(std::size_t nr, std::size_t nf);
+	std::size_t append(char c);
+	std::size_t extend(const char * p);
+
+protected:
+	const char * source;
+	std::vector<char> arena;
+	std::vector<std::size_t> records, starts, ends;
+};
+
+void
+Table::clear (
+) {
+	arena.clear();
+	records.clear();
+	starts.clear();
+	ends.clear();
+}
+
+const char *
+Table::field_data (
+	std::size_t nr,
+	std::size_t nf,
+	std::size_t & length
+) const {
+	const std::size_t i(records[nr] + nf);
+	length = ends[i] - starts[i];
+	if (!length) return "";
+	return (source ? source : arena.data()) + starts[i];
+}
+
+/// Ensure that the table has at least the given record, and that the last record has at least the given field.
+void
+Table::start_field (
+	std::size_t nr,
+	std::size_t nf
+) {
+	while (records.size() < nr + 1U)
+		records.push_back(starts.size());
+	while (starts.size() - records.back() < nf + 1U) {
+		const std::size_t o(source ? 0U : arena.size());
+		starts.push_back(o);
+		ends.push_back(o);
+	}
+}
+
+/// Append a character to the last field, returning its new length.
+std::size_t
+Table::append (
+	char c
+) {
+	arena.push_back(c);
+	++ends.back();
+	return ends.back() - starts.back();
+}
+
+/// Extend the last field, in a verbatim table, to include the given input character, returning its new length.
+std::size_t
+Table::extend (
+	const char * p
+) {
+	const std::size_t o(p - source);
+	if (starts.back() == ends.back())
+		starts.back() = o;
+	ends.back() = o + 1U;
+	return ends.back() - starts.back();
+}
 
 struct ParserCharacters {
 	ParserCharacters() :
@@ -86,6 +168,9 @@ struct TUI :
 	void handle_signal (int);
 	void handle_control (int, int);
 	void handle_data (int, int);
+	void set_mapped_data (const char *, std::size_t, std::size_t);
+	bool has_mapped_data_pending() const { return mapped_data_offset < mapped_data_length; }
+	void handle_mapped_data ();
 	void handle_update_event () { immediate_update_needed = false; TUIOutputBase::handle_update_event(); }
 
 protected:
@@ -114,6 +199,8 @@ protected:
 	int unvis_state;
 #endif
 	std::size_t data_nr, data_nf, current_nr, current_nf;
+	const char * mapped_data;
+	std::size_t mapped_data_length, mapped_data_offset;
 
 	virtual void redraw_new();
 	void set_refresh_and_immediate_update_needed () { immediate_update_needed = true; TUIOutputBase::set_refresh_needed(); }
@@ -183,12 +270,16 @@ TUI::TUI(
 	data_nr(0U),
 	data_nf(0U),
 	current_nr(0U),
-	current_nf(0U)
+	current_nf(0U),
+	mapped_data(0),
+	mapped_data_length(0U),
+	mapped_data_offset(0U)
 {
 }
 
 TUI::~TUI(
 ) {
+	if (mapped_data) munmap(const_cast<char *>(mapped_data), mapped_data_length);
 }
 
 void
@@ -220,6 +311,33 @@ TUI::handle_data (
 	}
 }
 
+/// Take ownership of a memory-mapped regular file, from which the table is parsed in place, starting at the given offset.
+void
+TUI::set_mapped_data (
+	const char * p,
+	std::size_t length,
+	std::size_t offset
+) {
+	mapped_data = p;
+	mapped_data_length = length;
+	mapped_data_offset = offset;
+#if defined(__FreeBSD__) || defined(__DragonFly__) || defined(__OpenBSD__)
+	// Decoding vis changes field contents, so they cannot be taken verbatim from the file.
+	if (DecodingVis()) return;
+#endif
+	table.set_source(p);
+}
+
+/// Parse the next chunk of a memory-mapped regular file, so that a large file does not hold up the user interface.
+void
+TUI::handle_mapped_data (
+) {
+	std::size_t l(mapped_data_length - mapped_data_offset);
+	if (l > sizeof data_buffer) l = sizeof data_buffer;
+	HandleData(mapped_data + mapped_data_offset, l);
+	mapped_data_offset += l;
+}
+
 void
 TUI::HandleData (
 	const char * buf,
@@ -265,10 +383,7 @@ TUI::HandleData (
 				[[clang::fallthrough]];
 			case FIELD:
 			{
-				if (table.size() < data_nr + 1) table.resize(data_nr + 1);
-				Record & record(table[data_nr]);
-				if (record.size() < data_nf + 1) record.resize(data_nf + 1);
-				Field & field(record[data_nf]);
+				table.start_field(data_nr, data_nf);
 				if (info.size() < data_nf + 1) info.resize(data_nf + 1);
 				ColumnInfo & ci(info[data_nf]);
 
@@ -277,8 +392,7 @@ TUI::HandleData (
 					if (DecodingVis()) {
 						char c;
 						if (UNVIS_VALID == unvis(&c, '\0', &unvis_state, UNVIS_END)) {
-							field.push_back(c);
-							ci.set_min_auto(field.length());
+							ci.set_min_auto(table.append(c));
 							set_refresh_needed();
 						}
 						unvis_state = 0;
@@ -302,21 +416,18 @@ TUI::HandleData (
 						case UNVIS_SYNBAD:
 							break;
 						case UNVIS_VALID:
-							field.push_back(c);
-							ci.set_min_auto(field.length());
+							ci.set_min_auto(table.append(c));
 							set_refresh_needed();
 							break;
 						case UNVIS_VALIDPUSH:
-							field.push_back(c);
-							ci.set_min_auto(field.length());
+							ci.set_min_auto(table.append(c));
 							set_refresh_needed();
 							goto again;
 					}
 				} else
 #endif
 				{
-					field.push_back(*buf);
-					ci.set_min_auto(field.length());
+					ci.set_min_auto(table.is_verbatim() ? table.extend(buf) : table.append(*buf));
 					set_refresh_needed();
 				}
 				++buf;
@@ -371,31 +482,32 @@ TUI::redraw_new (
 
 	erase_new_to_backdrop();
 
-	std::size_t nr(0U);
-	for (Table::const_iterator rb(table.begin()), re(table.end()), ri(rb); re != ri; ++ri, ++nr) {
-		const Record & r(*ri);
-		const bool is_header(nr < header_count);
-		long row(is_header ? nr : nr - window_y);
-		if (row < (is_header ? 0 : static_cast<long>(header_count))) continue;
-		if (row >= c.query_h()) break;
+	// Only the records that are in the window are visited, so that the cost of a redraw does not depend upon the size of the table.
+	const std::size_t h(c.query_h());
+	for (std::size_t row(0U); row < h; ++row) {
+		const bool is_header(row < header_count);
+		const std::size_t nr(is_header ? row : row + window_y);
+		if (nr >= table.size()) {
+			if (is_header) continue; else break;
+		}
 		const bool is_current_row(nr == current_nr);
 		const ColourPair colour(is_header ? heading : body);
-		std::size_t nf(0U);
 		long col(-window_x);
-		for (Record::const_iterator fb(r.begin()), fe(r.end()), fi(fb); fe != fi; ++fi, ++nf) {
-			const Field & f(*fi);
+		for (std::size_t nf(0U), fe(table.field_count(nr)); nf < fe; ++nf) {
+			std::size_t length;
+			const char * f(table.field_data(nr, nf, length));
 			const ColumnInfo & ci(info[nf]);
 			const bool is_current_col(nf == current_nf);
 			const unsigned width(ci.width());
 			unsigned precision(width);
-			if (precision > f.length()) precision = f.length();
+			if (precision > length) precision = length;
 			const CharacterCell::attribute_type attr(
 				is_header && (is_current_col || is_current_row) ? CharacterCell::INVERSE|CharacterCell::BOLD :
 				is_header || is_current_col || is_current_row ? CharacterCell::INVERSE :
 				0U
 			);
-			vio.PrintFormatted(row, col, attr, colour, "%*.*s", width, precision, f.c_str());
-			if (fi + 1 != fe)
+			vio.PrintFormatted(row, col, attr, colour, "%*.*s", width, precision, f);
+			if (nf + 1U != fe)
 				vio.Print(row, col, attr, colour, ' ');
 		}
 	}
@@ -778,11 +890,19 @@ console_flat_table_viewer
 		throw static_cast<int>(EXIT_USAGE);
 	}
 
+	// Regular file standard input is mapped into memory and parsed in place, rather than read.
+	// This saves copying it, and allows fields to be taken directly from it.
+	struct stat s;
+	const bool stat_ok(0 <= fstat(STDIN_FILENO, &s));
+	const bool is_regular(stat_ok && S_ISREG(s.st_mode));
+	const off_t start_offset(is_regular ? lseek(STDIN_FILENO, 0, SEEK_CUR) : 0);
+	void * const mapped_data(is_regular && 0 < s.st_size ? mmap(0, s.st_size, PROT_READ, MAP_SHARED, STDIN_FILENO, 0) : MAP_FAILED);
+	const bool is_mapped(is_regular && 0 <= start_offset && (0 == s.st_size || MAP_FAILED != mapped_data));
+
 #if defined(__LINUX__) || defined(__linux__)
 	// epoll_ctl(), and hence kevent(), cannot poll anything other than devices, sockets, and pipes.
-	// So we have to turn regular file standard input into a pipe.
-	struct stat s;
-	if (0 <= fstat(STDIN_FILENO, &s) && !(S_ISCHR(s.st_mode) || S_ISFIFO(s.st_mode) || S_ISSOCK(s.st_mode))) {
+	// So we have to turn unmappable regular file standard input into a pipe.
+	if (stat_ok && !is_mapped && !(S_ISCHR(s.st_mode) || S_ISFIFO(s.st_mode) || S_ISSOCK(s.st_mode))) {
 		int fds[2];
 		if (0 > pipe_close_on_exec(fds)) {
 			const int error(errno);
@@ -796,6 +916,7 @@ console_flat_table_viewer
 			throw EXIT_FAILURE;
 		} else
 		if (0 == child) {
+			if (MAP_FAILED != mapped_data) munmap(mapped_data, s.st_size);
 			dup2(fds[1], STDOUT_FILENO);
 			args.push_back("cat");
 			next_prog = arg0_of(args);
@@ -836,7 +957,8 @@ console_flat_table_viewer
 		}
 	}
 
-	append_event(ip, STDIN_FILENO, EVFILT_READ, EV_ADD, 0, 0, 0);
+	if (!is_mapped)
+		append_event(ip, STDIN_FILENO, EVFILT_READ, EV_ADD, 0, 0, 0);
 	append_event(ip, fileno(control), EVFILT_READ, EV_ADD, 0, 0, 0);
 	ReserveSignalsForKQueue kqueue_reservation(SIGTERM, SIGINT, SIGHUP, SIGPIPE, SIGUSR1, SIGUSR2, SIGWINCH, SIGTSTP, SIGCONT, 0);
 	PreventDefaultForFatalSignals ignored_signals(SIGTERM, SIGINT, SIGHUP, SIGPIPE, SIGUSR1, SIGUSR2, 0);
@@ -852,6 +974,8 @@ console_flat_table_viewer
 
 	TUIDisplayCompositor compositor(false /* no software cursor */, 24, 80);
 	TUI ui(envs, table, compositor, control, header_count, format_option, header_colour, body_colour, cursor_application_mode, calculator_application_mode, !no_alternate_screen_buffer);
+	if (MAP_FAILED != mapped_data)
+		ui.set_mapped_data(static_cast<const char *>(mapped_data), s.st_size, start_offset < s.st_size ? start_offset : s.st_size);
 
 	// How long to wait with updates pending.
 	const struct timespec short_timeout = { 0, 100000000L };
@@ -861,10 +985,12 @@ console_flat_table_viewer
 	while (true) {
 		if (ui.exit_signalled() || ui.quit_flagged())
 			break;
+		if (ui.has_mapped_data_pending())
+			ui.handle_mapped_data();
 		ui.handle_resize_event();
 		ui.handle_refresh_event();
 
-		const struct timespec * timeout(ui.immediate_update() ? &immediate_timeout : ui.has_update_pending() ? &short_timeout : 0);
+		const struct timespec * timeout(ui.immediate_update() || ui.has_mapped_data_pending() ? &immediate_timeout : ui.has_update_pending() ? &short_timeout : 0);
 		const int rc(kevent(queue.get(), ip.data(), ip.size(), p.data(), p.size(), timeout));
 		ip.clear();
 
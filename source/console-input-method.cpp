@@ -35,7 +35,7 @@ For copyright and licensing terms, see the file named COPYING.
 #include "TUIDisplayCompositor.h"
 #include "VirtualTerminalBackEnd.h"
 #include "InputFIFO.h"
-#include "UTF8Decoder.h"
+#include "CINDataTable.h"
 
 
 /* Realizing a virtual terminal *********************************************
@@ -44,60 +44,64 @@ For copyright and licensing terms, see the file named COPYING.
 
 namespace {
 
-typedef std::vector<uint_fast32_t> charvec;
-typedef std::list<charvec> conversion_list;
+typedef CINDataTable::charvec charvec;
+typedef CINDataTable::conversion_list conversion_list;
 
 enum { CHINESE1_DATA_TABLE, CHINESE2_DATA_TABLE, KATAKANA_DATA_TABLE, HIRAGANA_DATA_TABLE, HANGEUL_DATA_TABLE, ROMAJI_DATA_TABLE, MAX_DATA_TABLES };
 
-class DataTable
+/// \brief The table conversions of a raw input string, as a lattice over input positions.
+///
+/// Each position has a list of edges, one per conversion of a sequence starting there, in rank order: longest sequences first, and then in table order.
+/// Every path through the lattice from the start to the end is a candidate conversion.
+/// The edges of each position are looked up once, when first reached, and are shared by all paths through that position.
+/// Candidates are enumerated lazily, one path at a time, in rank order; so stepping to an adjacent candidate costs time proportional to the length of the input, not to the number of candidates.
+class ConversionLattice
 {
 public:
-	DataTable();
-	~DataTable();
+	ConversionLattice() : table(0) {}
 
-	void set_fold_case(bool v) { fold_case = v; }
-	bool query_fold_case() const { return fold_case; }
-	void add_raw_to_kana(const std::string & r, const charvec & c);
-	void add_engraving(char k, const charvec & c) { raw_to_engraving.insert(std::make_pair(k,c)); }
+	void reset(const CINDataTable &, const std::string &);
+	void clear();
+	bool empty() const { return !table; }
 
-	bool exceeds_max_conversion_length(std::size_t l) const { return l > max_conversion_length; }
-	bool find_conversions (const std::string &, conversion_list &) const;
-	charvec engraving_for(char) const;
+	const charvec & query_text() const { return text; }
+	bool at_first() const;
+	bool at_last() const;
+	void first();
+	void last();
+	bool next();
+	bool prev();
+	std::size_t longest_text();
 
 protected:
-	typedef std::multimap<std::string,charvec> conversion_map;
-	conversion_map raw_to_kana;
-	typedef std::map<char,charvec> engraving_map;
-	engraving_map raw_to_engraving;
-	bool fold_case;
-	std::size_t max_conversion_length;
-
-private:
-};
-
-class DataTableLoader :
-	public UTF8Decoder::UCS32CharacterSink
-{
-public:
-	DataTableLoader(DataTable & t, const char * p, const char * f);
-	void load();
-protected:
-	DataTable & table;
-	UTF8Decoder decoder;
-	enum { FIRST, COMMENT_REST, DIRECTIVE_FIRST, DIRECTIVE_SPACE1, DIRECTIVE_SECOND, DIRECTIVE_REST, DATA_FIRST, DATA_SPACE1, DATA_SECOND, DATA_REST } state;
-	bool chardef, keyname;
-	const char * const prog, * const filename;
-	unsigned long line;
-	std::string first;
-	charvec second;
-
-	virtual void ProcessDecodedUTF8(uint32_t character, bool decoder_error, bool overlong);
+	struct edge {
+		edge(std::size_t e, const charvec & t) : end(e), text(t) {}
+		std::size_t end;
+		charvec text;
+	};
+	typedef std::vector<edge> edge_list;
+	struct step {
+		step(std::size_t n, std::size_t c) : node(n), choice(c) {}
+		std::size_t node, choice;
+	};
+	typedef std::vector<step> path_type;
+
+	const CINDataTable * table;
+	std::string to_convert;
+	std::vector<edge_list> edges;
+	std::vector<bool> looked_up, measured;
+	std::vector<std::size_t> longest;
+	path_type path;
+	charvec text;
+
+	const edge_list & edges_at(std::size_t);
+	void extend(bool);
 };
 
 class Realizer
 {
 public:
-	Realizer(FILE *, VirtualTerminalBackEnd &, TUIDisplayCompositor &, const DataTable tables[MAX_DATA_TABLES]);
+	Realizer(FILE *, VirtualTerminalBackEnd &, TUIDisplayCompositor &, const CINDataTable tables[MAX_DATA_TABLES]);
 	~Realizer();
 
 	void set_refresh_needed() { refresh_needed = true; }
@@ -113,7 +117,7 @@ protected:
 	FileStar const buffer_file;
 	VirtualTerminalBackEnd & lower_vt;
 	TUIDisplayCompositor & comp;
-	const DataTable * const tables;
+	const CINDataTable * const tables;
 	bool active;
 
 	std::string raw;
@@ -126,8 +130,9 @@ protected:
 
 	ConversionMode conversion_mode;
 
-	conversion_list conversions;
-	conversion_list::const_iterator current_conversion;
+	ConversionLattice table_conversions;
+	conversion_list fixed_conversions;
+	conversion_list::const_iterator current_fixed;	///< fixed_conversions.end() whilst on a table conversion
 	charvec converted_engravings, unconverted_engravings;
 
 	void resize ();
@@ -137,9 +142,14 @@ protected:
 	void convert ();
 	void use_current_conversion ();
 	void copy_conversion_to_send (const charvec &);
-	void lookup_all_table_conversions (const charvec &, const DataTable &, const std::string &);
 	void create_all_fixed_english_conversions ();
-	const DataTable & current_table() const;
+	bool has_conversions() const { return !table_conversions.empty(); }
+	const charvec & current_conversion() const { return fixed_conversions.end() != current_fixed ? *current_fixed : table_conversions.query_text(); }
+	bool at_first_conversion() const { return fixed_conversions.end() == current_fixed && table_conversions.at_first(); }
+	bool at_last_conversion() const;
+	bool next_conversion();
+	bool prev_conversion();
+	const CINDataTable & current_table() const;
 
 	enum { CELL_LENGTH = 16U, HEADER_LENGTH = 16U };
 };
@@ -151,289 +161,171 @@ const CharacterCell blank_cell(' ', CharacterCell::INVERSE, border_fg, border_bg
 const CharacterCell::colour_type converted_fg(ALPHA_FOR_TRUE_COLOURED,255,255,255), converted_bg(ALPHA_FOR_TRUE_COLOURED,0,0,0);
 const CharacterCell::colour_type unconverted_fg(ALPHA_FOR_TRUE_COLOURED,191,191,191), unconverted_bg(ALPHA_FOR_TRUE_COLOURED,0,0,0);
 
-inline
-bool
-is_begin (
-	const charvec & v
-) {
-	return 5 == v.size() && 'b' == v[0] && 'e' == v[1] && 'g' == v[2] && 'i' == v[3] && 'n' == v[4];
 }
 
-inline
-bool
-is_end (
-	const charvec & v
+void
+ConversionLattice::clear (
 ) {
-	return 3 == v.size() && 'e' == v[0] && 'n' == v[1] && 'd' == v[2];
+	table = 0;
+	to_convert.clear();
+	edges.clear();
+	looked_up.clear();
+	measured.clear();
+	longest.clear();
+	path.clear();
+	text.clear();
 }
 
+void
+ConversionLattice::reset (
+	const CINDataTable & t,
+	const std::string & s
+) {
+	clear();
+	table = &t;
+	to_convert = s;
+	edges.resize(s.length() + 1U);
+	looked_up.resize(s.length() + 1U, false);
+	measured.resize(s.length() + 1U, false);
+	longest.resize(s.length() + 1U, 0U);
+	first();
 }
 
-DataTable::DataTable(
-) :
-	fold_case(true),
-	max_conversion_length(0U)
-{
+const ConversionLattice::edge_list &
+ConversionLattice::edges_at (
+	std::size_t pos
+) {
+	edge_list & l(edges[pos]);
+	if (looked_up[pos]) return l;
+	looked_up[pos] = true;
+
+	const std::size_t len(to_convert.length());
+	std::size_t start(pos);
+	while (start < len && std::isspace(static_cast<unsigned char>(to_convert[start]))) ++start;
+	if (len <= start) return l;	// Only whitespace remains, which converts to nothing; so this is an end.
+
+	std::size_t end_or_space(start);
+	while (end_or_space < len && !std::isspace(static_cast<unsigned char>(to_convert[end_or_space]))) ++end_or_space;
+
+	conversion_list c;
+	std::string s;
+	for (std::size_t e(end_or_space); e > start; --e) {
+		if (table->exceeds_max_conversion_length(e - start)) continue;	// Avoid constructing and destroying lists and strings.
+		s.assign(to_convert, start, e - start);
+		if (table->find_conversions(s, c))
+			for (conversion_list::const_iterator p(c.begin()); p != c.end(); ++p)
+				l.push_back(edge(e, *p));
+	}
+	if (l.empty())
+		l.push_back(edge(start + 1U, table->engraving_for(to_convert[start])));
+	return l;
 }
 
-DataTable::~DataTable() {}
+/// Complete the path from its last node to an end, taking the first or last edge at each node.
+void
+ConversionLattice::extend (
+	bool take_last
+) {
+	std::size_t pos(path.empty() ? 0U : edges[path.back().node][path.back().choice].end);
+	for (;;) {
+		const edge_list & l(edges_at(pos));
+		if (l.empty()) break;
+		const std::size_t choice(take_last ? l.size() - 1U : 0U);
+		path.push_back(step(pos, choice));
+		pos = l[choice].end;
+	}
+	text.clear();
+	for (path_type::const_iterator i(path.begin()); i != path.end(); ++i) {
+		const charvec & t(edges[i->node][i->choice].text);
+		text.insert(text.end(), t.begin(), t.end());
+	}
+}
 
 void
-DataTable::add_raw_to_kana(
-	const std::string & r,
-	const charvec & c
+ConversionLattice::first (
 ) {
-	if (max_conversion_length < r.length())
-		max_conversion_length = r.length();
-	raw_to_kana.insert(std::make_pair(r,c));
+	path.clear();
+	extend(false);
 }
 
-charvec
-DataTable::engraving_for (
-	char c
-) const {
-	engraving_map::const_iterator i(raw_to_engraving.find(c));
-	if (raw_to_engraving.end() != i)
-		return i->second;
-	charvec r;
-	r.push_back(uint_fast32_t(c));
-	return r;
+void
+ConversionLattice::last (
+) {
+	path.clear();
+	extend(true);
 }
 
 bool
-DataTable::find_conversions (
-	const std::string & ro_lo,
-	conversion_list & results
+ConversionLattice::at_first (
 ) const {
-	results.clear();
-	conversion_map::const_iterator i(raw_to_kana.find(ro_lo));
-	if (raw_to_kana.end() == i) return false;
-	for (conversion_map::const_iterator e(raw_to_kana.upper_bound(i->first)); i != e; ++i)
-		results.push_back(i->second);
+	for (path_type::const_iterator i(path.begin()); i != path.end(); ++i)
+		if (0U != i->choice) return false;
 	return true;
 }
 
-DataTableLoader::DataTableLoader(
-	DataTable & t,
-	const char * p,
-	const char * f
-) :
-	table(t),
-	decoder(*this),
-	state(FIRST),
-	chardef(false),
-	keyname(false),
-	prog(p),
-	filename(f),
-	line(0UL)
-{
+bool
+ConversionLattice::at_last (
+) const {
+	for (path_type::const_iterator i(path.begin()); i != path.end(); ++i)
+		if (edges[i->node].size() != i->choice + 1U) return false;
+	return true;
 }
 
-void
-DataTableLoader::load (
+bool
+ConversionLattice::next (
 ) {
-	std::ifstream f(filename);
-	if (!f) {
-		const int error(errno);
-		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, filename, std::strerror(error));
-		throw EXIT_FAILURE;
+	for (std::size_t n(path.size()); n > 0U; --n) {
+		step & s(path[n - 1U]);
+		if (s.choice + 1U < edges[s.node].size()) {
+			++s.choice;
+			path.erase(path.begin() + n, path.end());
+			extend(false);
+			return true;
+		}
 	}
-	line = 1UL;
-	for (int c(f.get()); EOF != c; c = f.get()) 
-		decoder.Process(c);
+	return false;
 }
 
-void
-DataTableLoader::ProcessDecodedUTF8(
-	uint32_t character,
-	bool decoder_error,
-	bool /*overlong*/
+bool
+ConversionLattice::prev (
 ) {
-	if (decoder_error) {
-		std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid UTF-8 in file.");
-		throw EXIT_FAILURE;
+	for (std::size_t n(path.size()); n > 0U; --n) {
+		step & s(path[n - 1U]);
+		if (0U < s.choice) {
+			--s.choice;
+			path.erase(path.begin() + n, path.end());
+			extend(true);
+			return true;
+		}
 	}
-	if ('\n' == character) ++line;
-	switch (state) {
-		case FIRST:
-			if ('\n' == character)
-				break;
-			else
-			{
-				first.clear();
-				second.clear();
-				if ('%' == character)
-					state = DIRECTIVE_FIRST;
-				else
-				if ('#' == character)
-					state = COMMENT_REST;
-				else
-				if (character < 0x100 && std::isspace(character))
-					state = DATA_FIRST;
-				else
-				{
-					state = DATA_FIRST;
-					goto data1;
-				}
-			}
-			break;
-
-		case COMMENT_REST:
-			if ('\n' == character)
-				state = FIRST;
-			break;
-
-		// Parsing directives into a leading ASCII portion and a trailing Unicode portion.
-
-		case DIRECTIVE_FIRST:
-			if ('\n' == character)
-				goto directive_end;
-			if (0x100 <= character) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid directive name.");
-				throw EXIT_FAILURE;
-			} else
-			if (!std::isspace(static_cast<char>(character)))
-				first.push_back(static_cast<char>(character));
-			else
-			if (first.empty()) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid directive line with empty first field.");
-				throw EXIT_FAILURE;
-			} else
-			{
-				state = DIRECTIVE_SPACE1;
-				goto directive_space;
-			}
-			break;
-		case DIRECTIVE_SPACE1:
-		directive_space:
-			if ('\n' == character)
-				goto directive_end;
-			else
-			if (0x100 <= character || !std::isspace(static_cast<char>(character))) {
-				state = DIRECTIVE_SECOND;
-				goto directive2;
-			}
-			break;
-		case DIRECTIVE_SECOND:
-			if ('\n' == character)
-				goto directive_end;
-			else
-		directive2:
-				second.push_back(character);
-			break;
-		case DIRECTIVE_REST:
-			if ('\n' == character)
-				goto directive_end;
-			break;
-		directive_end:
-			if ("keyname" == first) {
-				if (is_begin(second)) {
-					keyname = true;
-					chardef = false;
-				} else
-				if (is_end(second)) {
-					keyname = false;
-				} else
-				{
-					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Directive followed by neither begin nor end.");
-					throw EXIT_FAILURE;
-				}
-			} else
-			if ("chardef" == first) {
-				if (is_begin(second)) {
-					chardef = true;
-					keyname = false;
-				} else
-				if (is_end(second)) {
-					chardef = false;
-				} else
-				{
-					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Directive followed by neither begin nor end.");
-					throw EXIT_FAILURE;
-				}
-			} else
-			if ("keep_key_case" == first)
-				table.set_fold_case(false);
-			else
-				;
-			state = FIRST;
-			break;
-
-		// Parsing data lines into a leading ASCII field, a Unicode field, and a trailing portion that is ignored.
+	return false;
+}
 
-		case DATA_FIRST:
-			if ('\n' == character) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with only 1 field.");
-				throw EXIT_FAILURE;
-			}
-		data1:
-			if (0x100 <= character) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid raw data field.");
-				throw EXIT_FAILURE;
-			} else
-			if (!std::isspace(static_cast<char>(character)))
-				first.push_back(static_cast<char>(character));
-			else
-			if (first.empty()) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with empty first field.");
-				throw EXIT_FAILURE;
-			} else
-			{
-				state = DATA_SPACE1;
-				goto data_space;
-			}
-			break;
-		case DATA_SPACE1:
-		data_space:
-			if ('\n' == character) {
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid data line with only 1 field.");
-				throw EXIT_FAILURE;
-			} else
-			if (0x100 <= character || !std::isspace(static_cast<char>(character))) {
-				state = DATA_SECOND;
-				goto data2;
-			}
-			break;
-		case DATA_SECOND:
-			if ('\n' == character)
-				goto data_end;
-		data2:
-			if (character < 0x100 && std::isspace(static_cast<char>(character))) {
-				state = DATA_REST;
-				goto data_rest;
-			} else
-				second.push_back(character);
-			break;
-		case DATA_REST:
-		data_rest:
-			if ('\n' == character)
-				goto data_end;
-			break;
-		data_end:
-			if (keyname) {
-				if (first.length() != 1U) {
-					std::fprintf(stderr, "%s: FATAL: %s(%lu): %s\n", prog, filename, line, "Invalid key name that is not 1 character.");
-					throw EXIT_FAILURE;
-				}
-				table.add_engraving(first.front(), second);
-			} else
-			if (chardef)
-				table.add_raw_to_kana(first, second);
-			else
-			{
-				std::fprintf(stderr, "%s: FATAL: %s(%lu): %s: %s\n", prog, filename, line, first.c_str(), "Bogus data not part of an engraving or a conversion.");
-				throw EXIT_FAILURE;
-			}
-			state = FIRST;
-			break;
+/// The length of the longest candidate, found by dynamic programming over the positions rather than by enumerating the candidates.
+std::size_t
+ConversionLattice::longest_text (
+) {
+	if (!table) return 0U;
+	for (std::size_t pos(to_convert.length() + 1U); pos > 0U; ) {
+		--pos;
+		if (measured[pos]) continue;
+		std::size_t m(0U);
+		const edge_list & l(edges_at(pos));
+		for (edge_list::const_iterator i(l.begin()); i != l.end(); ++i) {
+			const std::size_t n(i->text.size() + longest[i->end]);
+			if (m < n) m = n;
+		}
+		longest[pos] = m;
+		measured[pos] = true;
 	}
+	return longest[0];
 }
 
 Realizer::Realizer (
 	FILE * f,
 	VirtualTerminalBackEnd & l,
 	TUIDisplayCompositor & c,
-	const DataTable t[MAX_DATA_TABLES]
+	const CINDataTable t[MAX_DATA_TABLES]
 ) :
 	refresh_needed(true),
 	update_needed(true),
@@ -448,13 +340,13 @@ Realizer::Realizer (
 	rawpos(0U),
 	cursorpos(0U),
 	conversion_mode(TO_HANJI1),
-	current_conversion(conversions.begin())
+	current_fixed(fixed_conversions.end())
 {
 }
 
 Realizer::~Realizer() {}
 
-const DataTable &
+const CINDataTable &
 Realizer::current_table (
 ) const {
 	switch (conversion_mode) {
@@ -496,76 +388,62 @@ Realizer::create_all_fixed_english_conversions (
 	}
 	switch (conversion_mode) {
 		case TO_ROMAJI_LOWER:
-			conversions.push_back(l);
-			conversions.push_back(u);
-			conversions.push_back(m);
+			fixed_conversions.push_back(l);
+			fixed_conversions.push_back(u);
+			fixed_conversions.push_back(m);
 			break;
 		case TO_ROMAJI_UPPER:
-			conversions.push_back(u);
-			conversions.push_back(m);
-			conversions.push_back(l);
+			fixed_conversions.push_back(u);
+			fixed_conversions.push_back(m);
+			fixed_conversions.push_back(l);
 			break;
 		case TO_ROMAJI_CAMEL:
-			conversions.push_back(m);
-			conversions.push_back(l);
-			conversions.push_back(u);
+			fixed_conversions.push_back(m);
+			fixed_conversions.push_back(l);
+			fixed_conversions.push_back(u);
 			break;
 		default:
 			break;
 	}
-	conversions.push_back(r);
+	fixed_conversions.push_back(r);
 }
 
-void
-Realizer::lookup_all_table_conversions (
-	const charvec & c,
-	const DataTable & table,
-	const std::string & to_convert		///< guaranteed to be non-empty by the caller
-) {
-	const std::size_t len(to_convert.length());
-
-	std::size_t start(0U);
-	while (std::isspace(static_cast<unsigned char>(to_convert[start]))) {
-		++start;
-		if (len <= start) {
-			// We reached the end by skipping whitespace, so we need to explicitly add the prefix as a conversion.
-			conversions.push_back(c);
-			return;
-		}
-	}
+bool
+Realizer::at_last_conversion (
+) const {
+	if (fixed_conversions.end() == current_fixed) return fixed_conversions.empty() && table_conversions.at_last();
+	conversion_list::const_iterator next(current_fixed);
+	++next;
+	return fixed_conversions.end() == next;
+}
 
-	std::size_t end_or_space(start);
-	while (end_or_space < len && !std::isspace(static_cast<unsigned char>(to_convert[end_or_space]))) ++end_or_space;
+/// Step to the next candidate, through the table conversions and then the fixed conversions.
+bool
+Realizer::next_conversion (
+) {
+	if (!has_conversions() || at_last_conversion()) return false;
+	if (fixed_conversions.end() != current_fixed)
+		++current_fixed;
+	else
+	if (!table_conversions.next())
+		current_fixed = fixed_conversions.begin();
+	return true;
+}
 
-	bool found(false);
-	for (std::size_t e(end_or_space); e > start; --e) {
-		if (table.exceeds_max_conversion_length(e - start)) continue;	// Avoid constructing and destroying lists and strings.
-		conversion_list l;
-		const std::string s(to_convert.substr(start, e - start));
-		if (table.find_conversions(s, l)) {
-			const std::string remainder(to_convert.substr(e));
-			for (conversion_list::const_iterator p(l.begin()); p != l.end(); ++p) {
-				const charvec & tail(*p);
-				charvec r(c);
-				r.insert(r.end(), tail.begin(), tail.end());
-				if (len <= e)
-					conversions.push_back(r);
-				else
-					lookup_all_table_conversions(r, table, remainder);
-			}
-			found = true;
-		}
-	}
-	if (!found) {
-		charvec r(c);
-		const char k(to_convert[start]);
-		const charvec s(table.engraving_for(k));
-		r.insert(r.end(), s.begin(), s.end());
-		if (len <= start + 1U)
-			conversions.push_back(r);
-		else
-			lookup_all_table_conversions(r, table, to_convert.substr(start + 1U));
-	}
+/// Step to the previous candidate, through the fixed conversions and then the table conversions.
+bool
+Realizer::prev_conversion (
+) {
+	if (!has_conversions() || at_first_conversion()) return false;
+	if (fixed_conversions.end() == current_fixed)
+		table_conversions.prev();
+	else
+	if (fixed_conversions.begin() == current_fixed) {
+		current_fixed = fixed_conversions.end();
+		table_conversions.last();
+	} else
+		--current_fixed;
+	return true;
 }
 
 void
@@ -581,23 +459,24 @@ Realizer::copy_conversion_to_send (
 void
 Realizer::use_current_conversion (
 ) {
-	if (conversions.end() == current_conversion)
+	if (!has_conversions())
 		copy_conversion_to_send(converted_engravings);
 	else
-		copy_conversion_to_send(*current_conversion);
+		copy_conversion_to_send(current_conversion());
 	set_refresh_needed();
 }
 
 void
 Realizer::convert (
 ) {
-	const DataTable & table(current_table());
-	conversions.clear();
+	const CINDataTable & table(current_table());
+	table_conversions.clear();
+	fixed_conversions.clear();
 	if (0U < rawpos) {
 		std::string to_convert(raw.substr(0U, rawpos));
 		if (table.query_fold_case())
 			to_convert = tolower(to_convert);
-		lookup_all_table_conversions(charvec(), table, to_convert);
+		table_conversions.reset(table, to_convert);
 		create_all_fixed_english_conversions();
 	}
 	converted_engravings.clear();
@@ -608,7 +487,7 @@ Realizer::convert (
 		charvec & t (i < rawpos ? converted_engravings : unconverted_engravings);
 		t.insert(t.end(), s.begin(), s.end());
 	}
-	current_conversion = conversions.begin();
+	current_fixed = fixed_conversions.end();
 	use_current_conversion();
 	resize();
 }
@@ -618,8 +497,8 @@ void
 Realizer::resize ()
 {
 	const std::size_t data_to_sendlen(data_to_send.size());
-	std::size_t maxmenulen(0U);
-	for (conversion_list::const_iterator p(conversions.begin()), e(conversions.end()); p != e; ++p) {
+	std::size_t maxmenulen(table_conversions.longest_text());
+	for (conversion_list::const_iterator p(fixed_conversions.begin()), e(fixed_conversions.end()); p != e; ++p) {
 		if (maxmenulen < p->size())
 			maxmenulen = p->size();
 	}
@@ -657,7 +536,7 @@ Realizer::compose ()
 	}
 
 	const std::size_t data_to_sendlen(data_to_send.size());
-	const std::size_t menulen(current_conversion == conversions.end() ? 0U : current_conversion->size());
+	const std::size_t menulen(has_conversions() ? current_conversion().size() : 0U);
 	const std::size_t len(data_to_sendlen + 1U < menulen + 1U ? menulen + 1U : data_to_sendlen + 1U);
 	if (x + len > comp.query_w()) x = comp.query_w() - len;
 	if (y + 2U > comp.query_h()) y = comp.query_h() - 2U;
@@ -674,8 +553,8 @@ Realizer::compose ()
 	for (unsigned short col(data_to_sendlen); col < len; ++col)
 		comp.poke(y + 0U, x + col, blank_cell);
 
-	if (current_conversion != conversions.end()) {
-		const charvec & line(*current_conversion);
+	if (has_conversions()) {
+		const charvec & line(current_conversion());
 		for (unsigned short col(0U); col < menulen; ++col) {
 			const CharacterCell cell(line[col], CharacterCell::INVERSE, converted_fg, converted_bg);
 			comp.poke(y + 1U, x + col, cell);
@@ -684,18 +563,15 @@ Realizer::compose ()
 	for (unsigned short col(menulen); col < len - 1U; ++col)
 		comp.poke(y + 1U, x + col, blank_cell);
 	CharacterCell status_cell(' ', CharacterCell::INVERSE, border_fg, border_bg);
-	if (current_conversion != conversions.end()) {
+	if (has_conversions()) {
 		// If there are conversions, the status cell is an arrow indicating scrollability.
-		if (current_conversion == conversions.begin()) 
+		if (at_first_conversion()) 
 			status_cell.character = 0x2193;
-		else {
-			conversion_list::const_iterator next_conversion(current_conversion);
-			++next_conversion;
-			if (next_conversion == conversions.end())
-				status_cell.character = 0x2191;
-			else
-				status_cell.character = 0x2195;
-		}
+		else
+		if (at_last_conversion())
+			status_cell.character = 0x2191;
+		else
+			status_cell.character = 0x2195;
 	} else {
 		// If there are no conversions, display the conversion mode as the status cell.
 		switch (conversion_mode) {
@@ -744,6 +620,7 @@ Realizer::paint_changed_cells (
 		std::fseek(buffer_file, HEADER_LENGTH, SEEK_SET);
 
 	for (unsigned row(0); row < rows; ++row) {
+		if (!comp.is_row_touched(row)) continue;
 		for (unsigned col(0); col < cols; ++col) {
 			TUIDisplayCompositor::DirtiableCell & cell(comp.cur_at(row, col));
 			if (!cell.touched()) continue;
@@ -761,6 +638,7 @@ Realizer::paint_changed_cells (
 			std::fwrite(b, sizeof b, 1U, buffer_file);
 			cell.untouch();
 		}
+		comp.untouch_row(row);
 	}
 	const off_t pos(HEADER_LENGTH + CELL_LENGTH * (rows * cols));
 	if (pos != ftello(buffer_file))
@@ -969,10 +847,9 @@ Realizer::handle_input_event(
 				case EXTENDED_KEY_PAD_UP:
 					while (repeat) {
 						--repeat;
-						if (conversions.begin() != current_conversion) {
-							--current_conversion;
+						if (prev_conversion())
 							use_current_conversion();
-						} else
+						else
 							break;
 					}
 					break;
@@ -984,15 +861,9 @@ Realizer::handle_input_event(
 				case EXTENDED_KEY_PAD_DOWN:
 					while (repeat) {
 						--repeat;
-						if (conversions.end() != current_conversion) {
-							conversion_list::const_iterator next_conversion(current_conversion);
-							++next_conversion;
-							if (conversions.end() != next_conversion) {
-								current_conversion = next_conversion;
-								use_current_conversion();
-							} else
-								break;
-						} else
+						if (next_conversion())
+							use_current_conversion();
+						else
 							break;
 					}
 					break;
@@ -1058,6 +929,37 @@ Realizer::handle_input_event(
 	}
 }
 
+/* Loading data tables ******************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+/// Prefer a compiled table that is at least as new as its text source, falling back to parsing the text.
+void
+load (
+	CINDataTable & table,
+	const char * prog,
+	const char * name
+) {
+	const std::string compiled_name(std::string(name) + ".compiled");
+	const FileDescriptorOwner compiled_fd(open_read_at(AT_FDCWD, compiled_name.c_str()));
+	if (0 <= compiled_fd.get()) {
+		struct stat compiled_s, source_s;
+		if (0 <= fstat(compiled_fd.get(), &compiled_s)
+		&&  (0 > stat(name, &source_s) || source_s.st_mtime <= compiled_s.st_mtime)
+		) {
+			if (table.map_compiled(compiled_fd.get()))
+				return;
+			std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, compiled_name.c_str(), "Not a valid compiled data table.");
+		}
+	}
+	CINDataTableLoader loader(table, prog, name);
+	loader.load();
+}
+
+}
+
 /* Main function ************************************************************
 // **************************************************************************
 */
@@ -1109,7 +1011,7 @@ console_input_method [[gnu::noreturn]] (
 	const char * lvcname(args.front());
 	args.erase(args.begin());
 
-	DataTable tables[MAX_DATA_TABLES];
+	CINDataTable tables[MAX_DATA_TABLES];
 	if (chinese1_table) {
 		if (args.empty()) {
 			std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Missing chinese data table name.");
@@ -1117,8 +1019,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[CHINESE1_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[CHINESE1_DATA_TABLE], prog, table_name);
 	}
 	if (chinese2_table) {
 		if (args.empty()) {
@@ -1127,8 +1028,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[CHINESE2_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[CHINESE2_DATA_TABLE], prog, table_name);
 	}
 	if (kana_table) {
 		if (args.empty()) {
@@ -1137,8 +1037,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[HIRAGANA_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[HIRAGANA_DATA_TABLE], prog, table_name);
 	}
 	if (kana_table) {
 		if (args.empty()) {
@@ -1147,8 +1046,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[KATAKANA_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[KATAKANA_DATA_TABLE], prog, table_name);
 	}
 	if (hangeul_table) {
 		if (args.empty()) {
@@ -1157,8 +1055,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[HANGEUL_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[HANGEUL_DATA_TABLE], prog, table_name);
 	}
 	if (romaji_table) {
 		if (args.empty()) {
@@ -1167,8 +1064,7 @@ console_input_method [[gnu::noreturn]] (
 		}
 		const char * table_name(args.front());
 		args.erase(args.begin());
-		DataTableLoader loader(tables[ROMAJI_DATA_TABLE], prog, table_name);
-		loader.load();
+		load(tables[ROMAJI_DATA_TABLE], prog, table_name);
 	}
 	if (!args.empty()) {
 		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, args.front(), "Unexpected argument.");
@@ -1327,8 +1223,10 @@ console_input_method [[gnu::noreturn]] (
 			}
 		}
 
-		while (upper_input.HasMessage())
-			realizer.handle_input_event(upper_input.PullMessage());
+		uint32_t messages[256];
+		while (const std::size_t n = upper_input.PullMessages(messages, sizeof messages/sizeof *messages))
+			for (std::size_t i(0U); i < n; ++i)
+				realizer.handle_input_event(messages[i]);
 		if (lower_vt.MessageAvailable()) {
 			if (!lower_vt.query_polling_for_write()) {
 				append_event(ip, lower_vt.query_input_fd(), EVFILT_WRITE, EV_ENABLE, 0, 0, 0);
@@ -233,11 +233,14 @@ console_multiplexor [[gnu::noreturn]] (
 ) {
 	const char * prog(basename_of(args[0]));
 	bool display_only(false);
+	bool coalesce_pointer_motion(false);
 
 	try {
 		popt::bool_definition display_only_option('\0', "display-only", "Only render the display; do not send input.", display_only);
+		popt::bool_definition coalesce_pointer_motion_option('\0', "coalesce-pointer-motion", "Only pass on the latest of a run of pointer position messages.", coalesce_pointer_motion);
 		popt::definition * top_table[] = {
-			&display_only_option
+			&display_only_option,
+			&coalesce_pointer_motion_option
 		};
 		popt::top_table_definition main_option(sizeof top_table/sizeof *top_table, top_table, "Main options", "{vc-multiplexed} {virtual-terminal(s)...}");
 
@@ -282,7 +285,7 @@ console_multiplexor [[gnu::noreturn]] (
 	}
 	// We are allowed to open the read end of a FIFO in non-blocking mode without having to wait for a writer.
 	mkfifoat(upper_vt_dir_fd.get(), "input", 0620);
-	InputFIFO upper_input_fifo(open_read_at(upper_vt_dir_fd.get(), "input"));
+	InputFIFO upper_input_fifo(open_read_at(upper_vt_dir_fd.get(), "input"), coalesce_pointer_motion);
 	if (0 > upper_input_fifo.get()) {
 		const int error(errno);
 		std::fprintf(stderr, "%s: FATAL: %s/%s: %s\n", prog, dirname, "input", std::strerror(error));
@@ -452,8 +455,10 @@ console_multiplexor [[gnu::noreturn]] (
 			}
 		}
 
-		while (upper_input_fifo.HasMessage())
-			realizer.handle_input_event(upper_input_fifo.PullMessage());
+		uint32_t messages[256];
+		while (const std::size_t n = upper_input_fifo.PullMessages(messages, sizeof messages/sizeof *messages))
+			for (std::size_t i(0U); i < n; ++i)
+				realizer.handle_input_event(messages[i]);
 		for (VirtualTerminalList::iterator t(vts.begin()); t != vts.end(); ++t) {
 			VirtualTerminalBackEnd & lower_vt(**t);
 			if (lower_vt.MessageAvailable()) {
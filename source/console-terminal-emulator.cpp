@@ -1732,6 +1732,7 @@ console_terminal_emulator [[gnu::noreturn]] (
 	ECMA48InputEncoder::Emulation emulation(ECMA48InputEncoder::DECVT);
 #endif
 	bool vcsa(false);
+	bool coalesce_pointer_motion(false);
 
 	try {
 		emulation_definition linux_option('\0', "linux", "Emulate the Linux virtual console.", emulation, ECMA48InputEncoder::LINUX_CONSOLE);
@@ -1741,6 +1742,7 @@ console_terminal_emulator [[gnu::noreturn]] (
 		emulation_definition decvt_option('\0', "decvt", "Emulate the DEC VT.", emulation, ECMA48InputEncoder::DECVT);
 		emulation_definition xtermpc_option('\0', "xtermpc", "Emulate a subset of XTerm in Sun/PC mode.", emulation, ECMA48InputEncoder::XTERM_PC);
 		popt::bool_definition vcsa_option('\0', "vcsa", "Maintain a vcsa-compatible display buffer.", vcsa);
+		popt::bool_definition coalesce_pointer_motion_option('\0', "coalesce-pointer-motion", "Only act upon the latest of a run of pointer position messages.", coalesce_pointer_motion);
 		popt::definition * top_table[] = {
 			&linux_option,
 			&sco_option,
@@ -1748,7 +1750,8 @@ console_terminal_emulator [[gnu::noreturn]] (
 			&netbsd_option,
 			&decvt_option,
 			&xtermpc_option,
-			&vcsa_option
+			&vcsa_option,
+			&coalesce_pointer_motion_option
 		};
 		popt::top_table_definition main_option(sizeof top_table/sizeof *top_table, top_table, "Main options", "{directory}");
 
@@ -1804,7 +1807,7 @@ console_terminal_emulator [[gnu::noreturn]] (
 	}
 	// We are allowed to open the read end of a FIFO in non-blocking mode without having to wait for a writer.
 	mkfifoat(dir_fd.get(), "input", 0620);
-	InputFIFO input_fifo(open_read_at(dir_fd.get(), "input"));
+	InputFIFO input_fifo(open_read_at(dir_fd.get(), "input"), coalesce_pointer_motion);
 	if (0 > input_fifo.get()) {
 		const int error(errno);
 		std::fprintf(stderr, "%s: FATAL: %s/%s: %s\n", prog, dirname, "input", std::strerror(error));
@@ -148,8 +148,8 @@ Realizer::compose_new_from_vt ()
 void
 Realizer::redraw_new (
 ) {
-	erase_new_to_backdrop();
 	position_vt_visible_area();
+	erase_new_to_backdrop(screen_y, screen_x, vt.query_visible_h(), vt.query_visible_w());
 	compose_new_from_vt();
 }
 
@@ -5,10 +5,12 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <vector>
 #include <map>
+#include <set>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
 #include <climits>
+#include <ctime>
 #include <cerrno>
 #include <iostream>
 #include <fstream>
@@ -16,9 +18,12 @@ For copyright and licensing terms, see the file named COPYING.
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <sys/socket.h>	// Necessary for the SO_REUSEPORT macro.
 #include <netinet/in.h>	// Necessary for the IPV6_V6ONLY macro.
 #include <unistd.h>
+#include <poll.h>
+#include <stdint.h>
 #include <pwd.h>
 #include <grp.h>
 #include "utils.h"
@@ -205,7 +210,10 @@ std::string
 names::substitute (
 	const std::string & s
 ) {
+	// Most settings have no specifiers at all.
+	if (std::string::npos == s.find('%')) return s;
 	std::string r;
+	r.reserve(s.length());
 	for (std::string::const_iterator e(s.end()), q(s.begin()); e != q; ++q) {
 		char c(*q);
 		if ('%' != c) {
@@ -306,6 +314,99 @@ struct profile {
 	FirstLevel m0;
 };
 
+/// A setting in a unit file or drop-in snippet as parsed, before it is appended to a profile.
+struct parsed_setting {
+	std::string section, var, val;
+};
+typedef std::vector<parsed_setting> parsed_settings;
+
+/// \brief A unit file or drop-in snippet as parsed, along with its manifest description as of when it was read.
+struct parsed_file {
+	parsed_settings settings;
+	std::string description;
+};
+typedef std::map<std::string, parsed_file> parsed_file_cache;
+
+/// Template units and drop-ins are shared amongst many units in a bulk conversion, so each file is parsed only once.
+parsed_file_cache parsed_files;
+
+/// Every file and directory whose presence or content went into a conversion, with its manifest description, for the manifest of a bulk conversion.
+/// Each is described as it was when it was looked at, not afterwards, so that a change made during a conversion is seen by the next one.
+/// They are only recorded when there is a manifest to record them in, as describing a file means hashing it.
+typedef std::map<std::string, std::string> consulted_map;
+consulted_map consulted;
+bool recording_consulted(false);
+
+inline
+uint64_t
+hash (
+	const char * p,
+	std::size_t l,
+	uint64_t h = 14695981039346656037ULL
+) {
+	// FNV-1a
+	while (l--) {
+		h ^= static_cast<unsigned char>(*p++);
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+bool
+hash_file (
+	const std::string & name,
+	uint64_t & h
+) {
+	const FileDescriptorOwner fd(open_read_at(AT_FDCWD, name.c_str()));
+	if (0 > fd.get()) return false;
+	h = hash(0, 0U);
+	for (;;) {
+		char buf[65536];
+		const ssize_t n(read(fd.get(), buf, sizeof buf));
+		if (0 > n) return false;
+		if (0 == n) return true;
+		h = hash(buf, n, h);
+	}
+}
+
+std::string
+describe (
+	const std::string & name,
+	const struct stat & s,
+	uint64_t h
+) {
+	char buf[128];
+	std::snprintf(buf, sizeof buf, "file %016llx %llu %lld.%09ld ", static_cast<unsigned long long>(h), static_cast<unsigned long long>(s.st_size), static_cast<long long>(s.st_mtim.tv_sec), static_cast<long>(s.st_mtim.tv_nsec));
+	return buf + name;
+}
+
+/// Describe a file or directory as it is now; files that are parsed are instead described by parse(), from what it read.
+std::string
+describe (
+	const std::string & name
+) {
+	struct stat s;
+	if (0 > stat(name.c_str(), &s))
+		return "none " + name;
+	if (S_ISDIR(s.st_mode)) {
+		char buf[64];
+		std::snprintf(buf, sizeof buf, "dir %lld.%09ld ", static_cast<long long>(s.st_mtim.tv_sec), static_cast<long>(s.st_mtim.tv_nsec));
+		return buf + name;
+	}
+	uint64_t h(0U);
+	hash_file(name, h);
+	return describe(name, s, h);
+}
+
+inline
+void
+consult (
+	const std::string & name
+) {
+	if (recording_consulted)
+		consulted[name] = describe(name);
+}
+
 const char * systemd_prefixes[] = {
 	// Administrator-supplied units have the highest precedence.
 	"/etc/",
@@ -334,13 +435,19 @@ find (
 	std::string & path,
 	const std::string & base
 ) {
-	if (!path.empty())
-		return std::fopen((path + base).c_str(), "r");
+	if (!path.empty()) {
+		FILE * f = std::fopen((path + base).c_str(), "r");
+		if (!f) consult(path + base);
+		return f;
+	}
 	int error(ENOENT);	// the most interesting error encountered
 	for ( const char ** p(systemd_prefixes); p < systemd_prefixes + sizeof systemd_prefixes/sizeof *systemd_prefixes; ++p) {
 		path = (std::string(*p) + "systemd/") + (per_user_mode ? "user/" : "system/");
 		FILE * f = std::fopen((path + base).c_str(), "r");
 		if (f) return f;
+		const int open_error(errno);
+		consult(path + base);
+		errno = open_error;
 		if (ENOENT == errno) 
 			errno = error;	// Restore a more interesting error.
 		else
@@ -381,24 +488,60 @@ is_section_heading (
 	return true;
 }
 
+/// The file is read whole, so that what is parsed is exactly what is hashed for the manifest.
 inline
 void
-load (
-	profile & p,
+parse (
+	parsed_file & parsed,
+	const std::string & name,
 	FILE * file
 ) {
-	for (std::string line, section; read_line(file, line); ) {
-		line = ltrim(line);
+	struct stat s;
+	const bool stated(0 <= fstat(fileno(file), &s));
+	std::string contents;
+	for (;;) {
+		char buf[65536];
+		const std::size_t n(std::fread(buf, 1U, sizeof buf, file));
+		contents.append(buf, n);
+		if (n < sizeof buf) break;
+	}
+	// An unrecognized description is never unchanged, so a file that could not be described is always reconverted from.
+	if (recording_consulted) {
+		if (!stated || std::ferror(file))
+			parsed.description = "unreadable " + name;
+		else
+			parsed.description = describe(name, s, hash(contents.data(), contents.length()));
+	}
+	parsed_settings & settings(parsed.settings);
+	std::string section;
+	for (std::string::size_type b(0U); b < contents.length(); ) {
+		std::string::size_type nl(contents.find('\n', b));
+		if (std::string::npos == nl) nl = contents.length();
+		std::string line(ltrim(contents.substr(b, nl - b)));
+		b = nl + 1U;
 		if (line.length() < 1) continue;
 		if ('#' == line[0] || ';' == line[0]) continue;
 		if (is_section_heading(line, section)) continue;
 		const std::string::size_type eq(line.find('='));
-		const std::string var(line.substr(0, eq));
-		const std::string val(eq == std::string::npos ? std::string() : line.substr(eq + 1, std::string::npos));
-		p.append(section, tolower(var), val);
+		const parsed_setting setting = {
+			section,
+			tolower(line.substr(0, eq)),
+			eq == std::string::npos ? std::string() : line.substr(eq + 1, std::string::npos)
+		};
+		settings.push_back(setting);
 	}
 }
 
+inline
+void
+load (
+	profile & p,
+	const parsed_settings & settings
+) {
+	for (parsed_settings::const_iterator i(settings.begin()), e(settings.end()); e != i; ++i)
+		p.append(i->section, i->var, i->val);
+}
+
 inline
 bool
 is_regular (
@@ -429,7 +572,14 @@ load (
 ) {
 	if (!is_regular(prog, file_name, file))
 		throw EXIT_FAILURE;
-	load(p, file);
+	parsed_file_cache::iterator i(parsed_files.find(file_name));
+	if (parsed_files.end() == i) {
+		i = parsed_files.insert(parsed_file_cache::value_type(file_name, parsed_file())).first;
+		parse(i->second, file_name, file);
+	}
+	if (recording_consulted)
+		consulted[file_name] = i->second.description;
+	load(p, i->second.settings);
 }
 
 inline
@@ -442,6 +592,7 @@ load (
 	const std::string & base_name
 ) {
 	const std::string snippet_dir_name(path_name + base_name);
+	consult(snippet_dir_name);
 	FileDescriptorOwner snippet_dir_fd(open_dir_at(AT_FDCWD, snippet_dir_name.c_str()));
 	if (0 > snippet_dir_fd.get()) {
 		const int error(errno);
@@ -921,74 +1072,44 @@ open (
 	chmod(name.c_str(), 0755);
 }
 
-}
-
-/* Main function ************************************************************
-// **************************************************************************
-*/
-
+/// \brief Write every setting of a timer unit's span entry as a line of a service-timer-scheduler timer file.
 void
-convert_systemd_units [[gnu::noreturn]] (
-	const char * & /*next_prog*/,
-	std::vector<const char *> & args,
-	ProcessEnvironment & envs
+write_timer_spans (
+	std::ostream & file,
+	const char * key,
+	const value * spans
 ) {
-	const char * prog(basename_of(args[0]));
-	std::string bundle_root;
-	bool escape_instance(false), escape_prefix(false), alt_escape(false), ext_escape(false), etc_bundle(false), local_bundle(false), systemd_quirks(true), generation_comment(true);
-	try {
-		const char * bundle_root_str(0);
-		bool no_ext_escape(false), no_systemd_quirks(false), no_generation_comment(false);
-		popt::bool_definition user_option('u', "user", "Create a bundle that runs under the per-user manager.", per_user_mode);
-		popt::string_definition bundle_option('\0', "bundle-root", "directory", "Root directory for bundles.", bundle_root_str);
-		popt::bool_definition escape_instance_option('\0', "escape-instance", "Escape the instance part of a template instantiation.", escape_instance);
-		popt::bool_definition escape_prefix_option('\0', "escape-prefix", "Escape the prefix part of a template instantiation.", escape_prefix);
-		popt::bool_definition alt_escape_option('\0', "alt-escape", "Use an alternative escape algorithm.", alt_escape);
-		popt::bool_definition no_ext_escape_option('\0', "no-ext-escape", "Do not use an extended escape sequences.", no_ext_escape);
-		popt::bool_definition etc_bundle_option('\0', "etc-bundle", "Consider this service to live in the /etc/service-bundles/ area.", etc_bundle);
-		popt::bool_definition local_bundle_option('\0', "local-bundle", "Consider this service to live in a service bundle area like /var/local/sv/.", local_bundle);
-		popt::bool_definition no_systemd_quirks_option('\0', "no-systemd-quirks", "Turn off systemd quirks.", no_systemd_quirks);
-		popt::bool_definition no_generation_comment_option('\0', "no-generation-comment", "Turn off the comment that mentions the source file.", no_generation_comment);
-		popt::definition * main_table[] = {
-			&user_option,
-			&bundle_option,
-			&escape_instance_option,
-			&escape_prefix_option,
-			&alt_escape_option,
-			&no_ext_escape_option,
-			&etc_bundle_option,
-			&local_bundle_option,
-			&no_systemd_quirks_option,
-			&no_generation_comment_option
-		};
-		popt::top_table_definition main_option(sizeof main_table/sizeof *main_table, main_table, "Main options", "{unit}");
+	if (!spans) return;
+	for (value::settings::const_iterator i(spans->all_settings().begin()), e(spans->all_settings().end()); e != i; ++i)
+		file << key << " " << *i << "\n";
+}
 
-		std::vector<const char *> new_args;
-		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
-		p.process(true /* strictly options before arguments */);
-		args = new_args;
-		if (p.stopped()) throw EXIT_SUCCESS;
-		if (bundle_root_str) bundle_root = bundle_root_str + slash;
-		ext_escape = !no_ext_escape;
-		systemd_quirks = !no_systemd_quirks;
-		generation_comment = !no_generation_comment;
-	} catch (const popt::error & e) {
-		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
-		throw static_cast<int>(EXIT_USAGE);
-	}
+}
 
-	if (args.empty()) {
-		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Missing argument(s).");
-		throw static_cast<int>(EXIT_USAGE);
-	}
+/* Converting a unit *******************************************************
+// **************************************************************************
+*/
 
-	struct names names(args.front());
+namespace {
 
-	args.erase(args.begin());
-	if (!args.empty()) {
-		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Unrecognized argument(s).");
-		throw static_cast<int>(EXIT_USAGE);
-	}
+/// \returns the name of the bundle directory that was made
+std::string
+convert_unit (
+	const char * prog,
+	const ProcessEnvironment & envs,
+	const std::string & bundle_root,
+	bool escape_instance,
+	bool escape_prefix,
+	bool alt_escape,
+	bool ext_escape,
+	bool etc_bundle,
+	bool local_bundle,
+	bool systemd_quirks,
+	bool generation_comment,
+	bool timer_scheduler,
+	const char * unit
+) {
+	struct names names(unit);
 
 	bool is_socket_activated(false), is_timer_activated(false), is_target(false), merge_run_into_start(false);
 
@@ -1011,9 +1132,6 @@ convert_systemd_units [[gnu::noreturn]] (
 		names.set_bundle(bundle_root, bundle_basename);
 	}
 
-	machine_id::erase();
-	if (!machine_id::read_non_volatile() && !machine_id::read_fallbacks(envs))
-	       machine_id::create();
 	names.set_machine_id(machine_id::human_readable_form_compact());
 
 	std::string socket_filename;
@@ -1361,7 +1479,7 @@ convert_systemd_units [[gnu::noreturn]] (
 	const bool is_remain(is_bool_true(remainafterexit, is_target));
 	if (!is_remain) {
 		if (is_oneshot) {
-			if (restart ? "no" != tolower(restart->last_setting()) && "never" != tolower(restart->last_setting()) : !systemd_quirks || is_timer_activated)
+			if (restart ? "no" != tolower(restart->last_setting()) && "never" != tolower(restart->last_setting()) : !systemd_quirks || (is_timer_activated && !timer_scheduler))
 				std::fprintf(stderr, "%s: WARNING: %s: restart=%s: %s\n", prog, service_filename.c_str(), restart ? restart->last_setting().c_str() : "always", "Single-shot service may never reach ready");
 		} else
 		if (!execstart) {
@@ -2414,81 +2532,100 @@ convert_systemd_units [[gnu::noreturn]] (
 		service << execute_command.str();
 	} else
 	if (is_timer_activated) {
-		const char * flags(systemd_quirks ? "--systemd-compatibility --gnu-compatibility " : "");
 		if (timer_description) {
 			for (value::settings::const_iterator i(timer_description->all_settings().begin()), e(timer_description->all_settings().end()); e != i; ++i) {
 				const std::string & val(*i);
 				run_or_start << multi_line_comment(names.substitute(val));
 			}
 		}
-		start << "foreground touch stamp-on-start ;\n";
-		run_or_start << "unsetenv wake_time\n";
-		if (onbootsec) {
-			for (value::settings::const_iterator i(onbootsec->all_settings().begin()), e(onbootsec->all_settings().end()); e != i; ++i) {
-				const std::string & v(*i);
-				run_or_start <<
-					"time-env-set since_boot boot\n"
-					"time-env-add " << flags << "-- since_boot " << quote(v) << "\n"
-					"time-env-unset-if-later since_boot now\n"
-					"time-env-set-if-earlier wake_time $since_boot\n"
-				;
+		if (timer_scheduler) {
+			// service-timer-scheduler reads this, and runs the service once when it expires.
+			std::ofstream timer;
+			open(prog, timer, names.query_bundle_dirname() + "/timer");
+			if (generation_comment)
+				timer << multi_line_comment("Timer file generated from " + timer_filename);
+			write_timer_spans(timer, "on-boot", onbootsec);
+			write_timer_spans(timer, "on-startup", onstartupsec);
+			write_timer_spans(timer, "on-active", onactivesec);
+			write_timer_spans(timer, "on-unit-active", onunitactivesec);
+			if (onunitinactivesec)
+				std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, timer_filename.c_str(), "OnUnitInactiveSec is not supported by service-timer-scheduler, and is ignored.");
+			if (oncalendar)
+				std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, timer_filename.c_str(), "OnCalendar is not supported by service-timer-scheduler, and is ignored.");
+		} else {
+			const char * flags(systemd_quirks ? "--systemd-compatibility --gnu-compatibility " : "");
+			start << "foreground touch stamp-on-start ;\n";
+			run_or_start << "unsetenv wake_time\n";
+			if (onbootsec) {
+				for (value::settings::const_iterator i(onbootsec->all_settings().begin()), e(onbootsec->all_settings().end()); e != i; ++i) {
+					const std::string & v(*i);
+					run_or_start <<
+						"time-env-set since_boot boot\n"
+						"time-env-add " << flags << "-- since_boot " << quote(v) << "\n"
+						"time-env-unset-if-later since_boot now\n"
+						"time-env-set-if-earlier wake_time $since_boot\n"
+					;
+				}
 			}
-		}
-		if (onstartupsec) {
-			for (value::settings::const_iterator i(onstartupsec->all_settings().begin()), e(onstartupsec->all_settings().end()); e != i; ++i) {
-				const std::string & v(*i);
-				run_or_start <<
-					"time-env-set since_startup startup\n"
-					"time-env-add " << flags << "-- since_startup " << quote(v) << "\n"
-					"time-env-unset-if-later since_startup now\n"
-					"time-env-set-if-earlier wake_time $since_startup\n"
-				;
+			if (onstartupsec) {
+				for (value::settings::const_iterator i(onstartupsec->all_settings().begin()), e(onstartupsec->all_settings().end()); e != i; ++i) {
+					const std::string & v(*i);
+					run_or_start <<
+						"time-env-set since_startup startup\n"
+						"time-env-add " << flags << "-- since_startup " << quote(v) << "\n"
+						"time-env-unset-if-later since_startup now\n"
+						"time-env-set-if-earlier wake_time $since_startup\n"
+					;
+				}
 			}
-		}
-		if (onactivesec) {
-			for (value::settings::const_iterator i(onactivesec->all_settings().begin()), e(onactivesec->all_settings().end()); e != i; ++i) {
-				const std::string & v(*i);
-				run_or_start <<
-					"time-env-set since_start >stamp-on-start\n"
-					"time-env-add " << flags << "-- since_start " << quote(v) << "\n"
-					"time-env-unset-if-later since_start now\n"
-					"time-env-set-if-earlier wake_time $since_start\n"
-				;
+			if (onactivesec) {
+				for (value::settings::const_iterator i(onactivesec->all_settings().begin()), e(onactivesec->all_settings().end()); e != i; ++i) {
+					const std::string & v(*i);
+					run_or_start <<
+						"time-env-set since_start >stamp-on-start\n"
+						"time-env-add " << flags << "-- since_start " << quote(v) << "\n"
+						"time-env-unset-if-later since_start now\n"
+						"time-env-set-if-earlier wake_time $since_start\n"
+					;
+				}
 			}
-		}
-		if (onunitactivesec) {
-			for (value::settings::const_iterator i(onunitactivesec->all_settings().begin()), e(onunitactivesec->all_settings().end()); e != i; ++i) {
-				const std::string & v(*i);
-				run_or_start <<
-					"time-env-set since_service >stamp-on-service\n"
-					"time-env-add " << flags << "-- since_service " << quote(v) << "\n"
-					"time-env-unset-if-later since_service now\n"
-					"time-env-set-if-earlier wake_time $since_service\n"
-				;
+			if (onunitactivesec) {
+				for (value::settings::const_iterator i(onunitactivesec->all_settings().begin()), e(onunitactivesec->all_settings().end()); e != i; ++i) {
+					const std::string & v(*i);
+					run_or_start <<
+						"time-env-set since_service >stamp-on-service\n"
+						"time-env-add " << flags << "-- since_service " << quote(v) << "\n"
+						"time-env-unset-if-later since_service now\n"
+						"time-env-set-if-earlier wake_time $since_service\n"
+					;
+				}
 			}
-		}
-		if (onunitinactivesec) {
-			for (value::settings::const_iterator i(onunitinactivesec->all_settings().begin()), e(onunitinactivesec->all_settings().end()); e != i; ++i) {
-				const std::string & v(*i);
+			if (onunitinactivesec) {
+				for (value::settings::const_iterator i(onunitinactivesec->all_settings().begin()), e(onunitinactivesec->all_settings().end()); e != i; ++i) {
+					const std::string & v(*i);
+					run_or_start <<
+						"time-env-set since_restart >stamp-on-restart\n"
+						"time-env-add " << flags << "-- since_restart " << quote(v) << "\n"
+						"time-env-unset-if-later since_restart now\n"
+						"time-env-set-if-earlier wake_time $since_restart\n"
+					;
+				}
+			}
+			if (oncalendar) {
 				run_or_start <<
-					"time-env-set since_restart >stamp-on-restart\n"
-					"time-env-add " << flags << "-- since_restart " << quote(v) << "\n"
-					"time-env-unset-if-later since_restart now\n"
-					"time-env-set-if-earlier wake_time $since_restart\n"
+					"time-env-set calendar_time now\n"
+					"time-env-next-matching calendar_time -- " << quote(oncalendar->last_setting()) << "\n"
+					"time-env-set-if-earlier wake_time $calendar_time\n"
 				;
 			}
 		}
-		if (oncalendar) {
-			run_or_start <<
-				"time-env-set calendar_time now\n"
-				"time-env-next-matching calendar_time -- " << quote(oncalendar->last_setting()) << "\n"
-				"time-env-set-if-earlier wake_time $calendar_time\n"
-			;
-		}
 		run_or_start <<
 			setup_environment.str() <<
-			drop_privileges.str() <<
-			"time-pause-until $wake_time\n"
+			drop_privileges.str()
+		;
+		if (!timer_scheduler) 
+			run_or_start << "time-pause-until $wake_time\n";
+		run_or_start <<
 			"foreground touch stamp-on-service ;\n"
 			"./service\n"
 		;
@@ -2545,7 +2682,7 @@ convert_systemd_units [[gnu::noreturn]] (
 	restart_script << "#!/bin/sh\n";
 	if (generation_comment)
 		restart_script << multi_line_comment("Restart file generated from " + service_filename);
-	if (is_timer_activated) {
+	if (is_timer_activated && !timer_scheduler) {
 		restart_script << "touch stamp-on-restart\n";
 	}
 	if (restartsec) {
@@ -2571,7 +2708,7 @@ convert_systemd_units [[gnu::noreturn]] (
 		}
 		restart_script << escape_newlines(escape_metacharacters(s.str(), false)) << "\n";
 	}
-	if (is_string(restart, "always", !systemd_quirks || is_timer_activated)) {
+	if (is_string(restart, "always", !systemd_quirks || (is_timer_activated && !timer_scheduler))) {
 		restart_script << "exec true\t# ignore script arguments\n";
 	} else
 	if (!restart || "no" == tolower(restart->last_setting()) || "never" == tolower(restart->last_setting()) ) {
@@ -2662,10 +2799,11 @@ convert_systemd_units [[gnu::noreturn]] (
 	CREATE_LINKS(timer_conflicts, "conflicts/");
 	CREATE_LINKS(service_conflicts, "conflicts/");
 	CREATE_LINKS(socket_wantedby, "wanted-by/");
-	CREATE_LINKS(timer_wantedby, "wanted-by/");
+	// A timer that service-timer-scheduler runs is enabled by its presence in the scheduler's directory, not by a target.
+	if (!timer_scheduler) CREATE_LINKS(timer_wantedby, "wanted-by/");
 	CREATE_LINKS(service_wantedby, "wanted-by/");
 	CREATE_LINKS(socket_requiredby, "wanted-by/");
-	CREATE_LINKS(timer_requiredby, "wanted-by/");
+	if (!timer_scheduler) CREATE_LINKS(timer_requiredby, "wanted-by/");
 	CREATE_LINKS(service_requiredby, "wanted-by/");
 	CREATE_LINKS(socket_partof, "requires/");
 	CREATE_LINKS(timer_partof, "requires/");
@@ -2731,7 +2869,7 @@ convert_systemd_units [[gnu::noreturn]] (
 	if (defaultdependencies) {
 		if (is_socket_activated)
 			create_links(prog, envs, names.query_bundle_dirname(), per_user_mode, is_target, services_are_relative, targets_are_relative, bundle_dir_fd, "sockets.target", "wanted-by/");
-		if (is_timer_activated)
+		if (is_timer_activated && !timer_scheduler)
 			create_links(prog, envs, names.query_bundle_dirname(), per_user_mode, is_target, services_are_relative, targets_are_relative, bundle_dir_fd, "timers.target", "wanted-by/");
 		if (is_dbus) {
 			create_links(prog, envs, names.query_bundle_dirname(), per_user_mode, is_target, services_are_relative, targets_are_relative, bundle_dir_fd, "dbus.socket", "after/");
@@ -2785,5 +2923,482 @@ convert_systemd_units [[gnu::noreturn]] (
 	report_unused(prog, timer_profile, timer_filename);
 	report_unused(prog, service_profile, service_filename);
 
+	return names.query_bundle_dirname();
+}
+
+}
+
+/* Bulk conversion **********************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+bool
+list_directory (
+	const std::string & name,
+	std::vector<std::string> & entries
+) {
+	FileDescriptorOwner dir_fd(open_dir_at(AT_FDCWD, name.c_str()));
+	if (0 > dir_fd.get()) return false;
+	const DirStar dir(dir_fd);
+	if (!dir) return false;
+	for (;;) {
+		errno = 0;
+		const dirent * entry(readdir(dir));
+		if (!entry) return 0 == errno;
+#if defined(_DIRENT_HAVE_D_NAMLEN)
+		if (1 > entry->d_namlen) continue;
+#endif
+		if ('.' == entry->d_name[0]) continue;
+		entries.push_back(entry->d_name);
+	}
+}
+
+/// Parse a file into the cache ahead of time, so that all of the forked workers share the one parse; errors are left for the workers to report.
+void
+prefetch (
+	const std::string & name
+) {
+	if (parsed_files.end() != parsed_files.find(name)) return;
+	FileStar file(std::fopen(name.c_str(), "r"));
+	if (!file) return;
+	struct stat s;
+	if (0 > fstat(fileno(file), &s) || !S_ISREG(s.st_mode)) return;
+	parse(parsed_files[name], name, file);
+}
+
+/// Add a unit, or every unit in a directory, to the list, as the build's per-unit conversions would pick them.
+///
+/// A socket or timer unit takes precedence over a service unit of the same name, since it is what the bundle is converted from.
+/// A target unit comes last of all, so that which unit is picked never depends upon directory order; its being shadowed is warned about.
+/// Template units cannot be converted by themselves, but are prefetched along with all drop-ins for their instances to share.
+void
+add_units (
+	const char * prog,
+	std::vector<std::string> & units,
+	const char * arg
+) {
+	struct stat s;
+	if (0 > stat(arg, &s) || !S_ISDIR(s.st_mode)) {
+		units.push_back(arg);
+		return;
+	}
+	std::string dir_name(arg);
+	while (1U < dir_name.length() && '/' == dir_name[dir_name.length() - 1U])
+		dir_name.erase(dir_name.length() - 1U);
+	std::vector<std::string> entries;
+	if (!list_directory(dir_name, entries)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, dir_name.c_str(), std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+	static const char * const suffixes[] = { ".socket", ".timer", ".service", ".target" };
+	typedef std::map<std::string, std::pair<std::size_t, std::string> > choice_map;
+	choice_map choices;
+	for (std::vector<std::string>::const_iterator i(entries.begin()), e(entries.end()); e != i; ++i) {
+		const std::string & entry(*i);
+		const std::string name(dir_name + slash + entry);
+		std::string base;
+		if (ends_in(entry, ".d", base)) {
+			std::vector<std::string> snippets;
+			if (list_directory(name, snippets))
+				for (std::vector<std::string>::const_iterator j(snippets.begin()), f(snippets.end()); f != j; ++j)
+					if (ends_with(j->c_str(), ".conf"))
+						prefetch(name + slash + *j);
+			continue;
+		}
+		for (std::size_t k(0U); k < sizeof suffixes/sizeof *suffixes; ++k) {
+			if (!ends_in(entry, suffixes[k], base)) continue;
+			prefetch(name);
+			if (base.empty() || '@' == base[base.length() - 1U]) break;
+			const std::size_t precedence(k);
+			choice_map::iterator c(choices.find(base));
+			if (choices.end() == c)
+				choices.insert(choice_map::value_type(base, std::make_pair(precedence, name)));
+			else {
+				const std::size_t target(sizeof suffixes/sizeof *suffixes - 1U);
+				if (target == precedence || target == c->second.first)
+					std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, base.c_str(), "A target unit has the same name as another unit, and is ignored.");
+				if (precedence < c->second.first)
+					c->second = std::make_pair(precedence, name);
+			}
+			break;
+		}
+	}
+	for (choice_map::const_iterator i(choices.begin()), e(choices.end()); e != i; ++i)
+		units.push_back(i->second.second);
+}
+
+/* The manifest *************************************************************
+// **************************************************************************
+*/
+
+/// \brief What a unit was last converted from, keyed by unit name.
+///
+/// Each unit has a signature of the conversion options, the bundle that it was converted into, and every file and directory that was consulted.
+/// A file is unchanged if its size and modification time are, or failing that if its size and content hash are; which copes with checkouts that merely touch files.
+struct manifest_entry {
+	std::string signature;
+	std::vector<std::string> lines;
+};
+typedef std::map<std::string, manifest_entry> manifest;
+
+bool
+is_unchanged (
+	const std::string & line
+) {
+	struct stat s;
+	unsigned long long h, size;
+	long long sec;
+	long nsec;
+	int n(0);
+	if (0 == line.compare(0, 7, "bundle ")) {
+		return 0 <= stat(line.c_str() + 7, &s) && S_ISDIR(s.st_mode);
+	} else
+	if (0 == line.compare(0, 5, "none ")) {
+		return 0 > stat(line.c_str() + 5, &s) && (ENOENT == errno || ENOTDIR == errno);
+	} else
+	if (2 == std::sscanf(line.c_str(), "dir %lld.%ld %n", &sec, &nsec, &n) && n) {
+		return 0 <= stat(line.c_str() + n, &s) && S_ISDIR(s.st_mode) && sec == s.st_mtim.tv_sec && nsec == s.st_mtim.tv_nsec;
+	} else
+	if (4 == std::sscanf(line.c_str(), "file %llx %llu %lld.%ld %n", &h, &size, &sec, &nsec, &n) && n) {
+		const std::string name(line.substr(n));
+		if (0 > stat(name.c_str(), &s) || !S_ISREG(s.st_mode) || size != static_cast<unsigned long long>(s.st_size)) return false;
+		if (sec == s.st_mtim.tv_sec && nsec == s.st_mtim.tv_nsec) return true;
+		uint64_t c;
+		return hash_file(name, c) && h == c;
+	}
+	return false;
+}
+
+bool
+is_unchanged (
+	const manifest_entry & m,
+	const std::string & signature
+) {
+	if (signature != m.signature || m.lines.empty()) return false;
+	for (std::vector<std::string>::const_iterator i(m.lines.begin()), e(m.lines.end()); e != i; ++i)
+		if (!is_unchanged(*i)) return false;
+	return true;
+}
+
+void
+load (
+	const char * prog,
+	manifest & m,
+	const char * name
+) {
+	FileStar file(std::fopen(name, "r"));
+	if (!file) {
+		const int error(errno);
+		if (ENOENT != error)
+			std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, name, std::strerror(error));
+		return;
+	}
+	manifest_entry * current(0);
+	for (std::string line; read_line(file, line); ) {
+		if (0 == line.compare(0, 5, "unit ")) {
+			const std::string::size_type space(line.find(' ', 5));
+			if (std::string::npos == space) {
+				current = 0;
+				continue;
+			}
+			current = &m[line.substr(space + 1)];
+			current->signature = line.substr(5, space - 5);
+			current->lines.clear();
+		} else
+		if (current)
+			current->lines.push_back(line);
+	}
+}
+
+void
+save (
+	const char * prog,
+	const manifest & m,
+	const char * name
+) {
+	const std::string temp_name(name + std::string(".new"));
+	FileStar file(std::fopen(temp_name.c_str(), "w"));
+	if (!file) {
+fail:
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, temp_name.c_str(), std::strerror(error));
+		return;
+	}
+	for (manifest::const_iterator i(m.begin()), e(m.end()); e != i; ++i) {
+		std::fprintf(file, "unit %s %s\n", i->second.signature.c_str(), i->first.c_str());
+		for (std::vector<std::string>::const_iterator j(i->second.lines.begin()), f(i->second.lines.end()); f != j; ++j)
+			std::fprintf(file, "%s\n", j->c_str());
+	}
+	if (0 != std::fflush(file) || std::ferror(file)) goto fail;
+	file = 0;
+	if (0 > rename(temp_name.c_str(), name)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, name, std::strerror(error));
+	}
+}
+
+/* The worker pool **********************************************************
+// **************************************************************************
+*/
+
+/// \brief A forked worker converting one unit, which reports back what it consulted through a pipe.
+struct worker {
+	worker(pid_t p, int f, const std::string & u) : pid(p), fd(f), unit(u) {}
+	pid_t pid;
+	int fd;
+	std::string unit, report;
+};
+
+void
+write_all (
+	int fd,
+	const std::string & s
+) {
+	for (const char * p(s.data()), * e(p + s.length()); p < e; ) {
+		const ssize_t n(write(fd, p, e - p));
+		if (0 > n) {
+			if (EINTR == errno) continue;
+			return;
+		}
+		p += n;
+	}
+}
+
+inline
+double
+seconds_since (
+	const timespec & start
+) {
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+void
+convert_in_bulk [[gnu::noreturn]] (
+	const char * prog,
+	const ProcessEnvironment & envs,
+	unsigned long jobs,
+	const char * manifest_name,
+	const std::vector<const char *> & args,
+	const std::string & bundle_root,
+	bool escape_instance,
+	bool escape_prefix,
+	bool alt_escape,
+	bool ext_escape,
+	bool etc_bundle,
+	bool local_bundle,
+	bool systemd_quirks,
+	bool generation_comment,
+	bool timer_scheduler
+) {
+	timespec start;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	recording_consulted = manifest_name;
+
+	// Units are parsed here, before any workers are forked, so that the workers share the parses copy-on-write.
+	std::vector<std::string> units;
+	for (std::vector<const char *>::const_iterator i(args.begin()), e(args.end()); e != i; ++i)
+		add_units(prog, units, *i);
+
+	// Anything that changes the conversion output invalidates every manifest entry.
+	char flags[16];
+	std::snprintf(flags, sizeof flags, "%d%d%d%d%d%d%d%d%d%d", per_user_mode, escape_instance, escape_prefix, alt_escape, ext_escape, etc_bundle, local_bundle, systemd_quirks, generation_comment, timer_scheduler);
+	const std::string options(flags + bundle_root + machine_id::human_readable_form_compact());
+	char signature[24];
+	std::snprintf(signature, sizeof signature, "%016llx", static_cast<unsigned long long>(hash(options.data(), options.length())));
+
+	// Units that are not converted in this run, such as those of other directories, keep the records of earlier runs.
+	manifest recorded;
+	if (manifest_name)
+		load(prog, recorded, manifest_name);
+
+	if (0UL == jobs) {
+		const long n(sysconf(_SC_NPROCESSORS_ONLN));
+		jobs = 0L < n ? n : 1UL;
+	}
+
+	std::size_t next(0U), converted(0U), unchanged(0U), failed(0U);
+	std::vector<worker> running;
+	std::vector<pollfd> p;
+	for (;;) {
+		while (running.size() < jobs && next < units.size()) {
+			const std::string & unit(units[next++]);
+			if (manifest_name) {
+				manifest::const_iterator m(recorded.find(unit));
+				if (recorded.end() != m && is_unchanged(m->second, signature)) {
+					++unchanged;
+					continue;
+				}
+			}
+			int fds[2];
+			if (0 > pipe_close_on_exec(fds)) {
+				const int error(errno);
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "pipe", std::strerror(error));
+				throw EXIT_FAILURE;
+			}
+			const pid_t child(fork());
+			if (0 > child) {
+				const int error(errno);
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "fork", std::strerror(error));
+				throw EXIT_FAILURE;
+			}
+			if (0 == child) {
+				close(fds[0]);
+				int status(EXIT_SUCCESS);
+				try {
+					std::string report("bundle " + convert_unit(prog, envs, bundle_root, escape_instance, escape_prefix, alt_escape, ext_escape, etc_bundle, local_bundle, systemd_quirks, generation_comment, timer_scheduler, unit.c_str()) + "\n");
+					for (consulted_map::const_iterator i(consulted.begin()), e(consulted.end()); e != i; ++i)
+						report += i->second + "\n";
+					write_all(fds[1], report);
+				} catch (int r) {
+					status = r;
+				}
+				_exit(status);
+			}
+			close(fds[1]);
+			running.push_back(worker(child, fds[0], unit));
+		}
+		if (running.empty()) break;
+
+		p.resize(running.size());
+		for (std::size_t i(0U); i < running.size(); ++i) {
+			p[i].fd = running[i].fd;
+			p[i].events = POLLIN;
+			p[i].revents = 0;
+		}
+		if (0 > poll(p.data(), p.size(), -1)) {
+			const int error(errno);
+			if (EINTR == error) continue;
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "poll", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		for (std::size_t i(running.size()); i-- > 0U; ) {
+			if (!p[i].revents) continue;
+			worker & w(running[i]);
+			char buf[4096];
+			const ssize_t n(read(w.fd, buf, sizeof buf));
+			if (0 < n) {
+				w.report.append(buf, n);
+				continue;
+			}
+			if (0 > n && EINTR == errno) continue;
+			// The worker has closed its end of the pipe, so it has finished.
+			close(w.fd);
+			int status;
+			while (0 > waitpid(w.pid, &status, 0) && EINTR == errno);
+			if (WIFEXITED(status) && EXIT_SUCCESS == WEXITSTATUS(status) && !w.report.empty()) {
+				manifest_entry & m(recorded[w.unit]);
+				m.signature = signature;
+				m.lines.clear();
+				for (std::string::size_type b(0U), nl; std::string::npos != (nl = w.report.find('\n', b)); b = nl + 1U)
+					m.lines.push_back(w.report.substr(b, nl - b));
+				++converted;
+			} else {
+				// A unit that failed to convert has no record, so that it is retried by the next run.
+				recorded.erase(w.unit);
+				++failed;
+			}
+			running.erase(running.begin() + i);
+		}
+	}
+
+	if (manifest_name)
+		save(prog, recorded, manifest_name);
+
+	std::fprintf(stderr, "%s: INFO: %zu converted, %zu unchanged, %zu failed, in %.3f seconds with %lu job(s).\n", prog, converted, unchanged, failed, seconds_since(start), jobs);
+	throw failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+}
+
+/* Main function ************************************************************
+// **************************************************************************
+*/
+
+void
+convert_systemd_units [[gnu::noreturn]] (
+	const char * & /*next_prog*/,
+	std::vector<const char *> & args,
+	ProcessEnvironment & envs
+) {
+	const char * prog(basename_of(args[0]));
+	std::string bundle_root;
+	bool escape_instance(false), escape_prefix(false), alt_escape(false), ext_escape(false), etc_bundle(false), local_bundle(false), systemd_quirks(true), generation_comment(true), timer_scheduler(false), bulk(false);
+	unsigned long jobs(0UL);
+	const char * manifest_name(0);
+	try {
+		const char * bundle_root_str(0);
+		bool no_ext_escape(false), no_systemd_quirks(false), no_generation_comment(false);
+		popt::bool_definition user_option('u', "user", "Create a bundle that runs under the per-user manager.", per_user_mode);
+		popt::string_definition bundle_option('\0', "bundle-root", "directory", "Root directory for bundles.", bundle_root_str);
+		popt::bool_definition escape_instance_option('\0', "escape-instance", "Escape the instance part of a template instantiation.", escape_instance);
+		popt::bool_definition escape_prefix_option('\0', "escape-prefix", "Escape the prefix part of a template instantiation.", escape_prefix);
+		popt::bool_definition alt_escape_option('\0', "alt-escape", "Use an alternative escape algorithm.", alt_escape);
+		popt::bool_definition no_ext_escape_option('\0', "no-ext-escape", "Do not use an extended escape sequences.", no_ext_escape);
+		popt::bool_definition etc_bundle_option('\0', "etc-bundle", "Consider this service to live in the /etc/service-bundles/ area.", etc_bundle);
+		popt::bool_definition local_bundle_option('\0', "local-bundle", "Consider this service to live in a service bundle area like /var/local/sv/.", local_bundle);
+		popt::bool_definition no_systemd_quirks_option('\0', "no-systemd-quirks", "Turn off systemd quirks.", no_systemd_quirks);
+		popt::bool_definition no_generation_comment_option('\0', "no-generation-comment", "Turn off the comment that mentions the source file.", no_generation_comment);
+		popt::bool_definition timer_scheduler_option('\0', "timer-scheduler", "Leave timer units for service-timer-scheduler to run.", timer_scheduler);
+		popt::bool_definition bulk_option('\0', "bulk", "Convert many units, and directories of units, at once.", bulk);
+		popt::unsigned_number_definition jobs_option('\0', "jobs", "number", "Specify how many units to convert in parallel in bulk mode.", jobs, 0);
+		popt::string_definition manifest_option('\0', "manifest", "filename", "Skip units that are unchanged since the bulk conversion recorded in this file.", manifest_name);
+		popt::definition * main_table[] = {
+			&user_option,
+			&bundle_option,
+			&escape_instance_option,
+			&escape_prefix_option,
+			&alt_escape_option,
+			&no_ext_escape_option,
+			&etc_bundle_option,
+			&local_bundle_option,
+			&no_systemd_quirks_option,
+			&no_generation_comment_option,
+			&timer_scheduler_option,
+			&bulk_option,
+			&jobs_option,
+			&manifest_option
+		};
+		popt::top_table_definition main_option(sizeof main_table/sizeof *main_table, main_table, "Main options", "{unit(s)...}");
+
+		std::vector<const char *> new_args;
+		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
+		p.process(true /* strictly options before arguments */);
+		args = new_args;
+		if (p.stopped()) throw EXIT_SUCCESS;
+		if (bundle_root_str) bundle_root = bundle_root_str + slash;
+		ext_escape = !no_ext_escape;
+		systemd_quirks = !no_systemd_quirks;
+		generation_comment = !no_generation_comment;
+	} catch (const popt::error & e) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+	if (args.empty()) {
+		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Missing argument(s).");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+
+	machine_id::erase();
+	if (!machine_id::read_non_volatile() && !machine_id::read_fallbacks(envs))
+	       machine_id::create();
+
+	if (bulk)
+		convert_in_bulk(prog, envs, jobs, manifest_name, args, bundle_root, escape_instance, escape_prefix, alt_escape, ext_escape, etc_bundle, local_bundle, systemd_quirks, generation_comment, timer_scheduler);
+
+	if (1U != args.size()) {
+		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Unrecognized argument(s).");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+	convert_unit(prog, envs, bundle_root, escape_instance, escape_prefix, alt_escape, ext_escape, etc_bundle, local_bundle, systemd_quirks, generation_comment, timer_scheduler, args.front());
+
 	throw EXIT_SUCCESS;
 }
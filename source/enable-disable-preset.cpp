@@ -5,6 +5,7 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <algorithm>
 #include <iostream>
@@ -184,59 +185,6 @@ static
 std::size_t
 rcconf_filec = sizeof default_rcconf_files/sizeof *default_rcconf_files;
 
-static inline
-bool
-scan_rcconf_file (
-	bool & wants,	///< always set to a value
-	const char * prog,
-	const std::string & wanted,
-	const std::string & rcconf_file
-) {
-	FILE * f(std::fopen(rcconf_file.c_str(), "r"));
-	if (!f) return false;
-	std::vector<std::string> env_strings(read_file(prog, rcconf_file.c_str(), f));
-	for (std::vector<std::string>::const_iterator j(env_strings.begin()); j != env_strings.end(); ++j) {
-		const std::string & s(*j);
-		const std::string::size_type p(s.find('='));
-		const std::string var(s.substr(0, p));
-		if (var == wanted) {
-			const std::string val(p == std::string::npos ? std::string() : s.substr(p + 1, std::string::npos));
-			wants = checkyesno(val);
-			return true;
-		}
-	}
-	return false;
-}
-
-static inline
-bool	/// \returns setting \retval true explicit \retval false defaulted
-query_rcconf_preset (
-	bool & wants,	///< always set to a value
-	const char * prog,
-	const ProcessEnvironment & envs,
-	const std::string & name
-) {
-	const std::string wanted(name + "_enable");
-	if (per_user_mode) {
-		const std::string h(effective_user_home_dir(envs));
-		const std::string
-		user_rcconf_files[2] = {
-			h + "/.config/rc.conf",
-		};
-		for (const std::string * q(user_rcconf_files); q < user_rcconf_files + sizeof user_rcconf_files/sizeof *user_rcconf_files; ++q)
-			if (scan_rcconf_file(wants, prog, wanted, *q))
-				return true;
-	} else {
-		for (size_t i(0); i < rcconf_filec; ++i) {
-			const std::string rcconf_file(rcconf_filev[i]);
-			if (scan_rcconf_file(wants, prog, wanted, rcconf_file))
-				return true;
-		}
-	}
-	wants = false;
-	return false;
-}
-
 static inline
 bool
 initial_space (
@@ -328,6 +276,15 @@ wildmat (
 	return wildmat(pattern.begin(), pattern.end(), name.begin(), name.end());
 }
 
+static
+const char *
+unit_suffixes[] = {
+	".target",
+	".service",
+	".socket",
+	".timer",
+};
+
 static inline
 bool
 matches (
@@ -337,19 +294,10 @@ matches (
 ) {
 	std::string base;
 	if (suffix.empty()) {
-		if (ends_in(pattern, ".target", base))
-			return wildmat(base, name);
-		else
-		if (ends_in(pattern, ".service", base))
-			return wildmat(base, name);
-		else
-		if (ends_in(pattern, ".socket", base))
-			return wildmat(base, name);
-		else
-		if (ends_in(pattern, ".timer", base))
-			return wildmat(base, name);
-		else
-			return wildmat(pattern, name);
+		for (size_t i(0); i < sizeof unit_suffixes/sizeof *unit_suffixes; ++i)
+			if (ends_in(pattern, unit_suffixes[i], base))
+				return wildmat(base, name);
+		return wildmat(pattern, name);
 	} else {
 		if (ends_in(pattern, suffix, base))
 			return wildmat(base, name);
@@ -358,70 +306,13 @@ matches (
 	}
 }
 
-static
-bool
-scan (
-	const std::string & name,
-	const std::string & suffix,
-	FILE * file,
-	bool & wants_enable
-) {
-	for (std::string line; read_line(file, line); ) {
-		line = ltrim(line);
-		if (line.length() < 1) continue;
-		if ('#' == line[0] || ';' == line[0]) continue;
-		std::string remainder;
-		if (begins_with(line, "enable", remainder) && initial_space(remainder)) {
-			remainder = rtrim(ltrim(remainder));
-			if (matches(remainder, name, suffix)) {
-				wants_enable = true;
-				return true;
-			}
-		} else
-		if (begins_with(line, "disable", remainder) && initial_space(remainder)) {
-			remainder = rtrim(ltrim(remainder));
-			if (matches(remainder, name, suffix)) {
-				wants_enable = false;
-				return true;
-			}
-		}
-	}
-	return false;
-}
-
+/// \returns the leading part of the pattern that can only match itself
 static inline
-void
-scan_preset_files (
-	std::string & earliest,
-	const std::string & preset_dir_name,
-	const std::string & name,
-	const std::string & suffix,
-	bool & wants_enable
+std::string
+literal_prefix (
+	const std::string & pattern
 ) {
-	FileDescriptorOwner preset_dir_fd(open_dir_at(AT_FDCWD, preset_dir_name.c_str()));
-	if (preset_dir_fd.get() < 0) return;
-	const DirStar preset_dir(preset_dir_fd);
-	if (!preset_dir) return;
-	for (;;) {
-		const dirent * entry(readdir(preset_dir));
-		if (!entry) break;
-#if defined(_DIRENT_HAVE_D_NAMLEN)
-		if (1 > entry->d_namlen) continue;
-#endif
-		if ('.' == entry->d_name[0]) continue;
-#if defined(_DIRENT_HAVE_D_TYPE)
-		if (DT_REG != entry->d_type && DT_LNK != entry->d_type) continue;
-#endif
-		const std::string d_name(entry->d_name);
-		if (!earliest.empty() && earliest <= d_name) continue;
-		const std::string p(preset_dir_name + d_name);
-		const int f(open_read_at(preset_dir.fd(), entry->d_name));
-		if (0 > f) continue;
-		FileStar preset_file(fdopen(f, "rt"));
-		if (!preset_file) continue;
-		if (scan(name, suffix, preset_file, wants_enable))
-			earliest = d_name;
-	}
+	return pattern.substr(0, pattern.find_first_of("*?[\\"));
 }
 
 static
@@ -437,55 +328,6 @@ preset_directories[] = {
 	"/lib/systemd/system-preset/",
 };
 
-static inline
-bool	/// \returns setting \retval true explicit \retval false defaulted
-query_systemd_preset (
-	bool & wants,	///< always set to a value
-	const ProcessEnvironment & envs,
-	const std::string & name,
-	const std::string & suffix
-) {
-	wants = true;
-	std::string earliest;
-	if (per_user_mode) {
-		const std::string h(effective_user_home_dir(envs));
-		const std::string
-		user_preset_directories[9] = {
-			"/usr/local/etc/system-control/user-presets/",
-			"/etc/system-control/user-presets/",
-			"/etc/systemd/user-preset/",
-			h + "/.config/system-control/presets/",
-			"/usr/local/share/system-control/user-presets/",
-			"/usr/local/lib/systemd/user-preset/",
-			"/usr/share/system-control/user-presets/",
-			"/usr/lib/systemd/user-preset/",
-			"/lib/systemd/user-preset/",
-		};
-		for (const std::string * q(user_preset_directories); q < user_preset_directories + sizeof user_preset_directories/sizeof *user_preset_directories; ++q)
-			scan_preset_files (earliest, *q, name, suffix, wants);
-	} else {
-		for (size_t i(0); i < sizeof preset_directories/sizeof *preset_directories; ++i)
-			scan_preset_files (earliest, preset_directories[i], name, suffix, wants);
-	}
-	return !earliest.empty();
-}
-
-static inline
-bool	/// \returns setting \retval true explicit \retval false defaulted
-query_ttys_preset (
-	bool & wants,	///< always set to a value
-	const std::string & name
-) {
-	if (!setttyent()) {
-		wants = false;
-		return false;
-	}
-	const struct ttyent *entry(getttynam(name.c_str()));
-	wants = entry && is_on(*entry);
-	endttyent();
-	return entry != 0;
-}
-
 static inline
 std::string 
 unescape ( 
@@ -533,29 +375,286 @@ is_auto (
 	return !has_option(options, "noauto");
 }
 
-static inline
+/* The preset database ******************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+/// \brief One enable or disable line from a preset file.
+struct preset_rule {
+	preset_rule(const std::string & p, bool e) : pattern(p), prefix(literal_prefix(p)), enable(e) {}
+	std::string pattern;
+	std::string prefix;	///< a name must begin with this to be matched
+	bool enable;
+	bool is_literal() const { return prefix.length() == pattern.length(); }
+};
+
+/// \brief All of the preset sources, each read at most once per invocation, on first use.
+///
+/// The preset files are flattened into a single ordered list of rules, in which the first matching rule is the one that the first matching file would have supplied.
+/// Files are consulted in name order, with a file in an earlier directory taking precedence over a same-named one in a later directory.
+/// Rules with literal patterns are looked up by name; only the rules with wildcards that precede the best literal match are tried against each name.
+class preset_database {
+public:
+	preset_database(const char * p, const ProcessEnvironment & e) : prog(p), envs(e), rules_loaded(false), rcconf_loaded(false), ttys_loaded(false), fstab_loaded(false), ttys_available(false), fstab_available(false) {}
+	bool query_systemd_preset(bool & wants, const std::string & name, const std::string & suffix);
+	bool query_rcconf_preset(bool & wants, const std::string & name);
+	bool query_ttys_preset(bool & wants, const std::string & name);
+	bool query_fstab_preset(bool & wants, const std::string & escaped_name);
+protected:
+	typedef std::unordered_map<std::string, std::size_t> literal_map;
+	typedef std::map<std::string, std::string> variable_map;
+	typedef std::map<std::string, bool> setting_map;
+
+	const char * const prog;
+	const ProcessEnvironment & envs;
+	bool rules_loaded, rcconf_loaded, ttys_loaded, fstab_loaded, ttys_available, fstab_available;
+	std::vector<preset_rule> rules;	///< in order of precedence
+	literal_map literals;	///< the first rule for each literal pattern
+	std::vector<std::size_t> wildcards;	///< the rules with wildcard patterns, in order of precedence
+	variable_map rcconf_variables;	///< the first setting of each variable across all rc.conf files
+	setting_map ttys_on, fstab_auto_by_file, fstab_auto_by_spec;
+
+	void load_rules();
+	void load_rule_file(const std::string &);
+	void load_rcconf();
+	void load_rcconf_file(const std::string &);
+	void load_ttys();
+	void load_fstab();
+	void find_literal(std::size_t & best, const std::string & pattern, const std::string & name, const std::string & suffix) const;
+};
+
+}
+
+void
+preset_database::load_rule_file (
+	const std::string & filename
+) {
+	const int f(open_read_at(AT_FDCWD, filename.c_str()));
+	if (0 > f) return;
+	FileStar file(fdopen(f, "rt"));
+	if (!file) return;
+	for (std::string line; read_line(file, line); ) {
+		line = ltrim(line);
+		if (line.length() < 1) continue;
+		if ('#' == line[0] || ';' == line[0]) continue;
+		std::string remainder;
+		if (begins_with(line, "enable", remainder) && initial_space(remainder))
+			rules.push_back(preset_rule(rtrim(ltrim(remainder)), true));
+		else
+		if (begins_with(line, "disable", remainder) && initial_space(remainder))
+			rules.push_back(preset_rule(rtrim(ltrim(remainder)), false));
+	}
+}
+
+void
+preset_database::load_rules (
+) {
+	rules_loaded = true;
+	std::vector<std::string> directories;
+	if (per_user_mode) {
+		const std::string h(effective_user_home_dir(envs));
+		directories.push_back("/usr/local/etc/system-control/user-presets/");
+		directories.push_back("/etc/system-control/user-presets/");
+		directories.push_back("/etc/systemd/user-preset/");
+		directories.push_back(h + "/.config/system-control/presets/");
+		directories.push_back("/usr/local/share/system-control/user-presets/");
+		directories.push_back("/usr/local/lib/systemd/user-preset/");
+		directories.push_back("/usr/share/system-control/user-presets/");
+		directories.push_back("/usr/lib/systemd/user-preset/");
+		directories.push_back("/lib/systemd/user-preset/");
+	} else
+		directories.assign(preset_directories, preset_directories + sizeof preset_directories/sizeof *preset_directories);
+
+	// Each file name maps to the directories that contain it, in directory order.
+	typedef std::map<std::string, std::vector<std::size_t> > file_map;
+	file_map files;
+	for (std::size_t i(0U); i < directories.size(); ++i) {
+		FileDescriptorOwner preset_dir_fd(open_dir_at(AT_FDCWD, directories[i].c_str()));
+		if (preset_dir_fd.get() < 0) continue;
+		const DirStar preset_dir(preset_dir_fd);
+		if (!preset_dir) continue;
+		for (;;) {
+			const dirent * entry(readdir(preset_dir));
+			if (!entry) break;
+#if defined(_DIRENT_HAVE_D_NAMLEN)
+			if (1 > entry->d_namlen) continue;
+#endif
+			if ('.' == entry->d_name[0]) continue;
+#if defined(_DIRENT_HAVE_D_TYPE)
+			if (DT_REG != entry->d_type && DT_LNK != entry->d_type) continue;
+#endif
+			files[entry->d_name].push_back(i);
+		}
+	}
+	for (file_map::const_iterator i(files.begin()), e(files.end()); i != e; ++i)
+		for (std::vector<std::size_t>::const_iterator j(i->second.begin()), je(i->second.end()); j != je; ++j)
+			load_rule_file(directories[*j] + i->first);
+
+	for (std::size_t k(0U); k < rules.size(); ++k) {
+		if (rules[k].is_literal())
+			literals.insert(literal_map::value_type(rules[k].pattern, k));	// An earlier rule for the same pattern is kept.
+		else
+			wildcards.push_back(k);
+	}
+}
+
+inline
+void
+preset_database::find_literal (
+	std::size_t & best,
+	const std::string & pattern,
+	const std::string & name,
+	const std::string & suffix
+) const {
+	const literal_map::const_iterator i(literals.find(pattern));
+	if (literals.end() != i && i->second < best && matches(pattern, name, suffix))
+		best = i->second;
+}
+
+bool	/// \returns setting \retval true explicit \retval false defaulted
+preset_database::query_systemd_preset (
+	bool & wants,	///< always set to a value
+	const std::string & name,
+	const std::string & suffix
+) {
+	if (!rules_loaded) load_rules();
+	std::size_t best(rules.size());
+	// A literal pattern can only match the name itself, or the name with a suffix that matching strips off.
+	find_literal(best, name, name, suffix);
+	if (suffix.empty()) {
+		for (size_t i(0); i < sizeof unit_suffixes/sizeof *unit_suffixes; ++i)
+			find_literal(best, name + unit_suffixes[i], name, suffix);
+	} else
+		find_literal(best, name + suffix, name, suffix);
+	for (std::vector<std::size_t>::const_iterator i(wildcards.begin()), e(wildcards.end()); i != e && *i < best; ++i) {
+		const preset_rule & rule(rules[*i]);
+		if (0 == name.compare(0, rule.prefix.length(), rule.prefix) && matches(rule.pattern, name, suffix)) {
+			best = *i;
+			break;
+		}
+	}
+	if (best >= rules.size()) {
+		wants = true;
+		return false;
+	}
+	wants = rules[best].enable;
+	return true;
+}
+
+void
+preset_database::load_rcconf_file (
+	const std::string & rcconf_file
+) {
+	FILE * f(std::fopen(rcconf_file.c_str(), "r"));
+	if (!f) return;
+	const std::vector<std::string> env_strings(read_file(prog, rcconf_file.c_str(), f));
+	for (std::vector<std::string>::const_iterator j(env_strings.begin()); j != env_strings.end(); ++j) {
+		const std::string & s(*j);
+		const std::string::size_type p(s.find('='));
+		const std::string var(s.substr(0, p));
+		const std::string val(p == std::string::npos ? std::string() : s.substr(p + 1, std::string::npos));
+		rcconf_variables.insert(variable_map::value_type(var, val));	// An earlier setting, in this or an earlier file, is kept.
+	}
+}
+
+void
+preset_database::load_rcconf (
+) {
+	rcconf_loaded = true;
+	if (per_user_mode) {
+		const std::string h(effective_user_home_dir(envs));
+		load_rcconf_file(h + "/.config/rc.conf");
+	} else {
+		for (size_t i(0); i < rcconf_filec; ++i)
+			load_rcconf_file(rcconf_filev[i]);
+	}
+}
+
 bool	/// \returns setting \retval true explicit \retval false defaulted
-query_fstab_preset (
+preset_database::query_rcconf_preset (
+	bool & wants,	///< always set to a value
+	const std::string & name
+) {
+	if (!rcconf_loaded) load_rcconf();
+	const variable_map::const_iterator i(rcconf_variables.find(name + "_enable"));
+	if (rcconf_variables.end() == i) {
+		wants = false;
+		return false;
+	}
+	wants = checkyesno(i->second);
+	return true;
+}
+
+void
+preset_database::load_ttys (
+) {
+	ttys_loaded = true;
+	if (!setttyent()) return;
+	ttys_available = true;
+	while (const struct ttyent * entry = getttyent())
+		ttys_on.insert(setting_map::value_type(entry->ty_name, is_on(*entry)));	// The first entry for a name is the one that getttynam() would find.
+	endttyent();
+}
+
+bool	/// \returns setting \retval true explicit \retval false defaulted
+preset_database::query_ttys_preset (
+	bool & wants,	///< always set to a value
+	const std::string & name
+) {
+	if (!ttys_loaded) load_ttys();
+	const setting_map::const_iterator i(ttys_on.find(name));
+	if (!ttys_available || ttys_on.end() == i) {
+		wants = false;
+		return false;
+	}
+	wants = i->second;
+	return true;
+}
+
+void
+preset_database::load_fstab (
+) {
+	fstab_loaded = true;
+	if (!setfsent()) return;
+	fstab_available = true;
+	while (const struct fstab * entry = getfsent()) {
+		const bool a(is_auto(*entry));
+		// The first entry for a name is the one that getfsfile() or getfsspec() would find.
+		if (entry->fs_file) fstab_auto_by_file.insert(setting_map::value_type(entry->fs_file, a));
+		if (entry->fs_spec) fstab_auto_by_spec.insert(setting_map::value_type(entry->fs_spec, a));
+	}
+	endfsent();
+}
+
+bool	/// \returns setting \retval true explicit \retval false defaulted
+preset_database::query_fstab_preset (
 	bool & wants,	///< always set to a value
 	const std::string & escaped_name
 ) {
-	if (!setfsent()) {
+	if (!fstab_loaded) load_fstab();
+	if (!fstab_available) {
 		wants = true;
 		return false;
 	}
 	const std::string name(unescape(escaped_name));
-	const struct fstab *entry(getfsfile(name.c_str()));
-	if (!entry) entry = getfsspec(name.c_str());
-	wants = entry && is_auto(*entry);
-	endfsent();
-	return entry != 0;
+	setting_map::const_iterator i(fstab_auto_by_file.find(name));
+	if (fstab_auto_by_file.end() == i) {
+		i = fstab_auto_by_spec.find(name);
+		if (fstab_auto_by_spec.end() == i) {
+			wants = false;
+			return false;
+		}
+	}
+	wants = i->second;
+	return true;
 }
 
 static inline
 bool
 determine_preset (
-	const char * prog,
-	const ProcessEnvironment & envs,
+	preset_database & database,
 	bool system,
 	bool rcconf,
 	bool ttys,
@@ -566,14 +665,14 @@ determine_preset (
 ) {
 	bool wants(false);
 	// systemd (and system-manager) settings take precedence over compatibility ones.
-	if (system && query_systemd_preset(wants, envs, prefix + name, suffix))
+	if (system && database.query_systemd_preset(wants, prefix + name, suffix))
 		return wants;
 	// The newer BSD rc.conf takes precedence over the older Sixth Edition ttys .
-	if (rcconf && query_rcconf_preset(wants, prog, envs, name))
+	if (rcconf && database.query_rcconf_preset(wants, name))
 		return wants;
-	if (ttys && query_ttys_preset(wants, name))
+	if (ttys && database.query_ttys_preset(wants, name))
 		return wants;
-	if (fstab && query_fstab_preset(wants, name))
+	if (fstab && database.query_fstab_preset(wants, name))
 		return wants;
 	return wants;
 }
@@ -720,6 +819,7 @@ preset [[gnu::noreturn]] (
 
 	bool failed(false);
 	const std::string p(prefix);
+	preset_database database(prog, envs);
 	for (std::vector<const char *>::const_iterator i(args.begin()); args.end() != i; ++i) {
 		std::string path, name, suffix;
 		const FileDescriptorOwner bundle_dir_fd(open_bundle_directory(envs, prefix, *i, path, name, suffix));
@@ -729,7 +829,7 @@ preset [[gnu::noreturn]] (
 			failed = true;
 			continue;
 		}
-		const bool make(determine_preset(prog, envs, !no_system, !no_rcconf, ttys, fstab, p, name, suffix));
+		const bool make(determine_preset(database, !no_system, !no_rcconf, ttys, fstab, p, name, suffix));
 		if (dry_run)
 			std::fprintf(stdout, "%s %s\n", make ? "enable" : "disable", (path + p + name).c_str());
 		else
@@ -12,11 +12,10 @@ For copyright and licensing terms, see the file named COPYING.
 #include <climits>
 #include <cerrno>
 #include <iostream>
-#include <sstream>
-#include <iomanip>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
+#include <strings.h>
 #include "kqueue_common.h"
 #include <dirent.h>
 #include <unistd.h>
@@ -31,6 +30,188 @@ static const int socket_fd(7);
 
 static std::string hostname;
 
+/* Priorities and framing ***************************************************
+// **************************************************************************
+*/
+
+static unsigned default_facility(3U), default_severity(5U);	// daemon.notice
+static bool detect_severity(false), rfc5424_format(false), octet_counting(false);
+
+namespace {
+
+struct priority_name {
+	const char * name;
+	unsigned value;
+};
+
+const priority_name facilities[] = {
+	{ "kern",	0U },
+	{ "user",	1U },
+	{ "mail",	2U },
+	{ "daemon",	3U },
+	{ "auth",	4U },
+	{ "syslog",	5U },
+	{ "lpr",	6U },
+	{ "news",	7U },
+	{ "uucp",	8U },
+	{ "cron",	9U },
+	{ "authpriv",	10U },
+	{ "ftp",	11U },
+	{ "ntp",	12U },
+	{ "security",	13U },
+	{ "console",	14U },
+	{ "local0",	16U },
+	{ "local1",	17U },
+	{ "local2",	18U },
+	{ "local3",	19U },
+	{ "local4",	20U },
+	{ "local5",	21U },
+	{ "local6",	22U },
+	{ "local7",	23U },
+};
+
+/// Besides the syslog names, these include the words that programs commonly put at the starts of their log lines.
+const priority_name severities[] = {
+	{ "emerg",	0U },
+	{ "emergency",	0U },
+	{ "panic",	0U },
+	{ "alert",	1U },
+	{ "crit",	2U },
+	{ "critical",	2U },
+	{ "fatal",	2U },
+	{ "err",	3U },
+	{ "error",	3U },
+	{ "warn",	4U },
+	{ "warning",	4U },
+	{ "notice",	5U },
+	{ "info",	6U },
+	{ "debug",	7U },
+};
+
+bool
+lookup (
+	const priority_name * b,
+	const priority_name * e,
+	const char * s,
+	std::size_t l,
+	unsigned & value
+) {
+	for (; b != e; ++b) {
+		if (0 == strncasecmp(b->name, s, l) && '\0' == b->name[l]) {
+			value = b->value;
+			return true;
+		}
+	}
+	return false;
+}
+
+bool
+parse_priority (
+	const priority_name * b,
+	const priority_name * e,
+	unsigned limit,
+	const char * s,
+	unsigned & value
+) {
+	char * end(0);
+	const unsigned long n(std::strtoul(s, &end, 10));
+	if (*end || end == s)
+		return lookup(b, e, s, std::strlen(s), value);
+	if (n >= limit) return false;
+	value = n;
+	return true;
+}
+
+inline
+bool
+parse_facility (
+	const char * s,
+	unsigned & value
+) {
+	return parse_priority(facilities, facilities + sizeof facilities/sizeof *facilities, 24U, s, value);
+}
+
+inline
+bool
+parse_severity (
+	const char * s,
+	unsigned & value
+) {
+	return parse_priority(severities, severities + sizeof severities/sizeof *severities, 8U, s, value);
+}
+
+/// \brief Detect a severity from a "<N>" prefix, which is removed, or from an initial "word:", possibly after a "name:".
+bool
+detect (
+	const char * & b,
+	std::size_t & l,
+	unsigned & severity
+) {
+	if (3U <= l && '<' == b[0] && '0' <= b[1] && b[1] <= '7' && '>' == b[2]) {
+		severity = b[1] - '0';
+		b += 3;
+		l -= 3;
+		return true;
+	}
+	std::size_t p(0U);
+	for (unsigned words(0U); words < 2U; ++words) {
+		while (p < l && ' ' == b[p]) ++p;
+		const std::size_t start(p);
+		while (p < l && ':' != b[p] && ' ' != b[p]) ++p;
+		if (p >= l || ':' != b[p] || start == p) break;
+		if (lookup(severities, severities + sizeof severities/sizeof *severities, b + start, p - start, severity))
+			return true;
+		++p;
+	}
+	return false;
+}
+
+/// Write all of the vector, however many writes that takes, as a stream socket might not take it all at once.
+void
+write_all (
+	int fd,
+	struct iovec * v,
+	std::size_t n
+) {
+	while (n) {
+		const ssize_t rc(writev(fd, v, n));
+		if (0 > rc) {
+			if (EINTR == errno) continue;
+			return;
+		}
+		std::size_t l(rc);
+		while (n && l >= v->iov_len) {
+			l -= v->iov_len;
+			++v;
+			--n;
+		}
+		if (n) {
+			v->iov_base = static_cast<char *>(v->iov_base) + l;
+			v->iov_len -= l;
+		}
+	}
+}
+
+/// Read the first line of a small per-cursor setting file; a missing file is not an error.
+bool
+read_setting (
+	int dir_fd,
+	const char * name,
+	std::string & value
+) {
+	const FileDescriptorOwner fd(open_read_at(dir_fd, name));
+	if (0 > fd.get()) return false;
+	char buf[64];
+	const ssize_t n(read(fd.get(), buf, sizeof buf - 1));
+	if (0 >= n) return false;
+	std::size_t l(0U);
+	while (l < static_cast<std::size_t>(n) && !std::isspace(buf[l])) ++l;
+	value.assign(buf, l);
+	return l > 0U;
+}
+
+}
+
 /* Cursors ******************************************************************
 // **************************************************************************
 */
@@ -129,18 +310,24 @@ public:
 	Cursor ( const struct stat &, const ProcessEnvironment & );
 	~Cursor() {}
 	std::string appname;
+	unsigned facility, severity;
 	FileDescriptorOwner main_dir, last_file, current_file;
 	void eof();
 	void process(const char *, std::size_t);
 	bool at_or_beyond(const char stamp[EXTERNAL_TAI64N_LENGTH]) const;
 	void read_last();
 	void update(const char stamp[EXTERNAL_TAI64N_LENGTH]);
+	void preformat();
 	char last[EXTERNAL_TAI64N_LENGTH];
 protected:
 	enum { BOL, STAMP, ONESPACE, BODY, SKIP } state;
 	std::string message;
 	char line_stamp[EXTERNAL_TAI64N_LENGTH];
 	std::size_t line_stamp_pos;
+	/// The parts of the header that do not change from line to line are formatted once, in advance.
+	std::string pris[8], trailer;
+	char cached_seconds[EXTERNAL_TAI64_LENGTH], timebuf[64];
+	std::size_t timelen;
 	void process(char);
 	void emit();
 	const ProcessEnvironment & envs;
@@ -152,15 +339,36 @@ inline
 Cursor::Cursor ( const struct stat & s, const ProcessEnvironment & e ) :
 	index(s),
 	appname(),
+	facility(default_facility),
+	severity(default_severity),
 	main_dir(-1),
 	last_file(-1),
 	current_file(-1),
 	state(BOL),
 	message(),
 	line_stamp_pos(0),
+	timelen(0U),
 	envs(e)
 {
 	std::memset(last, '0', EXTERNAL_TAI64N_LENGTH);
+	std::memset(cached_seconds, 0, EXTERNAL_TAI64_LENGTH);
+}
+
+/// Format the PRI fields and the HOSTNAME and APP-NAME fields, with their surrounding punctuation, once and for all.
+inline
+void
+Cursor::preformat()
+{
+	for (unsigned s(0U); s < sizeof pris/sizeof *pris; ++s) {
+		char buf[16];
+		const int n(std::snprintf(buf, sizeof buf, rfc5424_format ? "<%u>1 " : "<%u>", facility * 8U + s));
+		pris[s].assign(buf, n);
+	}
+	if (rfc5424_format) {
+		// RFC 5424 requires NILVALUE for absent fields and limits APP-NAME to 48 characters.
+		trailer = " " + (hostname.empty() ? std::string("-") : hostname) + " " + (appname.empty() ? std::string("-") : appname.substr(0, 48U)) + " - - - ";
+	} else
+		trailer = " " + hostname + " " + appname + ":  ";
 }
 
 inline
@@ -194,30 +402,43 @@ inline
 void
 Cursor::emit ()
 {
-	const TimeTAndLeap z(tai64_to_time(envs, convert(line_stamp, EXTERNAL_TAI64_LENGTH)));
-	const uint32_t nano(convert(line_stamp + EXTERNAL_TAI64_LENGTH, EXTERNAL_TAI64N_LENGTH - EXTERNAL_TAI64_LENGTH));
-	struct tm tm;
-	gmtime_r(&z.time, &tm);
-	if (z.leap) ++tm.tm_sec;
-	char timebuf[64];
-	const std::size_t timelen(std::strftime(timebuf, sizeof timebuf, "%FT%T", &tm));
-	std::ostringstream os;
-	os << std::setw(6) << std::setfill('0') << nano / 1000U << std::setfill(' ');
-	const std::string & frac(os.str());
-	const struct iovec v[] = {
-		// \bug FIXME: We should not hardwire facility and severity.
-		{ const_cast<char *>("<29>"), 4 },
+	// Lines mostly arrive in bursts within the same second, so the formatted date and time are reused until it changes.
+	if (0 != std::memcmp(cached_seconds, line_stamp, EXTERNAL_TAI64_LENGTH)) {
+		const TimeTAndLeap z(tai64_to_time(envs, convert(line_stamp, EXTERNAL_TAI64_LENGTH)));
+		struct tm tm;
+		gmtime_r(&z.time, &tm);
+		if (z.leap) ++tm.tm_sec;
+		timelen = std::strftime(timebuf, sizeof timebuf, "%FT%T", &tm);
+		std::memcpy(cached_seconds, line_stamp, EXTERNAL_TAI64_LENGTH);
+	}
+	uint32_t micro(convert(line_stamp + EXTERNAL_TAI64_LENGTH, EXTERNAL_TAI64N_LENGTH - EXTERNAL_TAI64_LENGTH) / 1000U);
+	char frac[8] = { '.', '0', '0', '0', '0', '0', '0', 'Z' };
+	for (unsigned i(6U); i > 0U; --i) {
+		frac[i] = '0' + micro % 10U;
+		micro /= 10U;
+	}
+
+	const char * body(message.data());
+	std::size_t bodylen(message.length());
+	unsigned s(severity);
+	if (detect_severity)
+		detect(body, bodylen, s);
+	const std::string & pri(pris[s]);
+
+	char count[24];
+	std::size_t countlen(0U);
+	if (octet_counting)
+		countlen = std::snprintf(count, sizeof count, "%zu ", pri.length() + timelen + sizeof frac + trailer.length() + bodylen);
+
+	struct iovec v[] = {
+		{ count, countlen },
+		{ const_cast<char *>(pri.data()), pri.length() },
 		{ timebuf, timelen },
-		{ const_cast<char *>("."), 1 },
-		{ const_cast<char *>(frac.data()), frac.length() },
-		{ const_cast<char *>("Z "), 2 },
-		{ const_cast<char *>(hostname.data()), hostname.length() },
-		{ const_cast<char *>(" "), 1 },
-		{ const_cast<char *>(appname.data()), appname.length() },
-		{ const_cast<char *>(":  "), 3 },
-		{ const_cast<char *>(message.data()), message.length() }
+		{ frac, sizeof frac },
+		{ const_cast<char *>(trailer.data()), trailer.length() },
+		{ const_cast<char *>(body), bodylen }
 	};
-	writev(socket_fd, v, sizeof v/sizeof *v);
+	write_all(socket_fd, v, sizeof v/sizeof *v);
 	message.clear();
 }
 
@@ -300,6 +521,15 @@ Cursor::process (
 	std::size_t l
 ) {
 	while (l) {
+		// Message bodies are copied in runs up to the next newline, rather than character by character.
+		if (BODY == state) {
+			const char * nl(static_cast<const char *>(std::memchr(b, '\n', l)));
+			const std::size_t n(nl ? static_cast<std::size_t>(nl - b) : l);
+			message.append(b, n);
+			b += n;
+			l -= n;
+			if (!l) break;
+		}
 		process(*b);
 		--l;
 		++b;
@@ -395,6 +625,13 @@ exit_scan:
 		c->last_file.reset(last_file_fd.release());
 		c->appname = entry->d_name;
 
+		std::string setting;
+		if (read_setting(cursor_dir_fd.get(), "facility", setting) && !parse_facility(setting.c_str(), c->facility))
+			std::fprintf(stderr, "ERROR: %s/%s/%s: %s: %s\n", scan_directory, entry->d_name, "facility", setting.c_str(), "Unknown facility");
+		if (read_setting(cursor_dir_fd.get(), "severity", setting) && !parse_severity(setting.c_str(), c->severity))
+			std::fprintf(stderr, "ERROR: %s/%s/%s: %s: %s\n", scan_directory, entry->d_name, "severity", setting.c_str(), "Unknown severity");
+		c->preformat();
+
 		c->read_last();
 
 		by_main_dir_fd.insert(fd_index::value_type(c->main_dir.get(), c));
@@ -561,7 +798,20 @@ export_to_rsyslog [[gnu::noreturn]] (
 ) {
 	const char * prog(basename_of(args[0]));
 	try {
-		popt::top_table_definition main_option(0, 0, "Main options", "{directory}");
+		const char * facility(0), * severity(0);
+		popt::string_definition facility_option('\0', "facility", "name", "Specify the default facility.", facility);
+		popt::string_definition severity_option('\0', "severity", "name", "Specify the default severity.", severity);
+		popt::bool_definition detect_severity_option('\0', "detect-severity", "Detect severities from the starts of log lines.", detect_severity);
+		popt::bool_definition rfc5424_option('\0', "rfc5424", "Send messages in RFC 5424 form.", rfc5424_format);
+		popt::bool_definition octet_counting_option('\0', "octet-counting", "Prefix each message with its length, for stream sockets.", octet_counting);
+		popt::definition * top_table[] = {
+			&facility_option,
+			&severity_option,
+			&detect_severity_option,
+			&rfc5424_option,
+			&octet_counting_option
+		};
+		popt::top_table_definition main_option(sizeof top_table/sizeof *top_table, top_table, "Main options", "{directory}");
 
 		std::vector<const char *> new_args;
 		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
@@ -569,6 +819,14 @@ export_to_rsyslog [[gnu::noreturn]] (
 		args = new_args;
 		next_prog = arg0_of(args);
 		if (p.stopped()) throw EXIT_SUCCESS;
+		if (facility && !parse_facility(facility, default_facility)) {
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, facility, "Unknown facility");
+			throw static_cast<int>(EXIT_USAGE);
+		}
+		if (severity && !parse_severity(severity, default_severity)) {
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, severity, "Unknown severity");
+			throw static_cast<int>(EXIT_USAGE);
+		}
 	} catch (const popt::error & e) {
 		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
 		throw static_cast<int>(EXIT_USAGE);
@@ -5,6 +5,8 @@ For copyright and licensing terms, see the file named COPYING.
 
 #include <map>
 #include <vector>
+#include <deque>
+#include <string>
 #include <iostream>
 #include <iomanip>
 #include <cstdio>
@@ -59,20 +61,299 @@ struct prf_ra : public in6_prflags::prf_ra {};
 #include "TerminalCapabilities.h"
 #include "IPAddress.h"
  
-/* getifaddrs helpers *******************************************************
+/* Enumerating interfaces ***************************************************
 // **************************************************************************
 */
 
 namespace {
 
-	struct InterfaceAddresses {
-		InterfaceAddresses(ifaddrs * a) : addr_list(a) {}
-		~InterfaceAddresses() { freeifaddrs(addr_list); addr_list = 0; }
-		operator ifaddrs * () const { return addr_list; }
+	/// \brief All interfaces and their addresses, in the form that getifaddrs() presents them, grouped by interface name.
+	/// On Linux this is built directly from a single route netlink dump of links and a single dump of addresses.
+	struct InterfaceList {
+		typedef std::vector<const ifaddrs *> Addresses;
+		typedef std::map<std::string, Addresses> NameMap;
+
+		InterfaceList(const char * prog);
+		~InterfaceList();
+
+		NameMap names;
 	protected:
+#if defined(__LINUX__) || defined(__linux__)
+		struct Entry {
+			ifaddrs a;
+			std::string name;
+			sockaddr_storage addr, netmask, broadaddr;
+			rtnl_link_stats stats;
+		};
+		struct Link {
+			std::string name;
+			unsigned int flags;
+		};
+		typedef std::map<int, Link> IndexMap;
+
+		std::deque<Entry> entries;
+		IndexMap links;
+		std::vector<char> buffer;
+
+		void Dump(const char * prog, int s, unsigned short type, const void * body, std::size_t body_len);
+		void AddLink(const ifinfomsg &, std::size_t len);
+		void AddAddress(const ifaddrmsg &, std::size_t len);
+		Entry & NewEntry(const std::string &, unsigned int ifflags);
+#else
 		ifaddrs * addr_list;
+#endif
 	};
 
+#if defined(__LINUX__) || defined(__linux__)
+	InterfaceList::InterfaceList(
+		const char * prog
+	) :
+		buffer(65536U)
+	{
+		const FileDescriptorOwner s(socket_close_on_exec(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE));
+		if (0 > s.get()) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "netlink", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		// Links must come first, so that addresses can be given the names and flags of their interfaces.
+		const ifinfomsg link_request = {};
+		Dump(prog, s.get(), RTM_GETLINK, &link_request, sizeof link_request);
+		const ifaddrmsg address_request = {};
+		Dump(prog, s.get(), RTM_GETADDR, &address_request, sizeof address_request);
+		for (std::deque<Entry>::iterator e(entries.begin()); entries.end() != e; ++e)
+			names[e->name].push_back(&e->a);
+	}
+
+	InterfaceList::~InterfaceList()
+	{
+	}
+
+	void
+	InterfaceList::Dump (
+		const char * prog,
+		int s,
+		unsigned short type,
+		const void * body,
+		std::size_t body_len
+	) {
+		char request[NLMSG_SPACE(sizeof(ifinfomsg) > sizeof(ifaddrmsg) ? sizeof(ifinfomsg) : sizeof(ifaddrmsg))] = {};
+		nlmsghdr & h(*reinterpret_cast<nlmsghdr *>(request));
+		h.nlmsg_len = NLMSG_LENGTH(body_len);
+		h.nlmsg_type = type;
+		h.nlmsg_flags = NLM_F_REQUEST|NLM_F_DUMP;
+		h.nlmsg_seq = type;
+		std::memcpy(NLMSG_DATA(&h), body, body_len);
+		if (0 > send(s, request, h.nlmsg_len, 0)) {
+	fail:
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "netlink", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		for (;;) {
+			const ssize_t rc(recv(s, buffer.data(), buffer.size(), 0));
+			if (0 > rc) {
+				if (EINTR == errno) continue;
+				goto fail;
+			}
+			unsigned int len(rc);
+			for (const nlmsghdr * r(reinterpret_cast<const nlmsghdr *>(buffer.data())); NLMSG_OK(r, len); r = NLMSG_NEXT(r, len)) {
+				if (type != r->nlmsg_seq) continue;
+				switch (r->nlmsg_type) {
+					case NLMSG_DONE:
+						return;
+					case NLMSG_ERROR:
+					{
+						const nlmsgerr & e(*static_cast<const nlmsgerr *>(NLMSG_DATA(r)));
+						if (!e.error) break;
+						std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "netlink", std::strerror(-e.error));
+						throw EXIT_FAILURE;
+					}
+					case RTM_NEWLINK:
+						AddLink(*static_cast<const ifinfomsg *>(NLMSG_DATA(r)), r->nlmsg_len);
+						break;
+					case RTM_NEWADDR:
+						AddAddress(*static_cast<const ifaddrmsg *>(NLMSG_DATA(r)), r->nlmsg_len);
+						break;
+				}
+			}
+		}
+	}
+
+	InterfaceList::Entry &
+	InterfaceList::NewEntry (
+		const std::string & name,
+		unsigned int ifflags
+	) {
+		entries.push_back(Entry());
+		Entry & e(entries.back());
+		e.name = name;
+		e.a.ifa_name = const_cast<char *>(e.name.c_str());
+		e.a.ifa_flags = ifflags;
+		return e;
+	}
+
+	inline
+	void
+	set_link_address (
+		sockaddr_storage & storage,
+		const ifinfomsg & i,
+		const rtattr * attr
+	) {
+		sockaddr_ll & addrl(reinterpret_cast<sockaddr_ll &>(storage));
+		addrl.sll_family = AF_PACKET;
+		addrl.sll_ifindex = i.ifi_index;
+		addrl.sll_hatype = i.ifi_type;
+		addrl.sll_halen = RTA_PAYLOAD(attr) < sizeof addrl.sll_addr ? RTA_PAYLOAD(attr) : sizeof addrl.sll_addr;
+		std::memcpy(addrl.sll_addr, RTA_DATA(attr), addrl.sll_halen);
+	}
+
+	/// This follows what the GNU C library does, so that output does not vary with the means of enumeration.
+	void
+	InterfaceList::AddLink (
+		const ifinfomsg & i,
+		std::size_t len
+	) {
+		Link & link(links[i.ifi_index]);
+		link.flags = i.ifi_flags;
+		const rtattr * attrs[IFLA_MAX + 1] = {};
+		int attrlen(len - NLMSG_LENGTH(sizeof i));
+		for (const rtattr * attr(IFLA_RTA(&i)); RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen))
+			if (attr->rta_type <= IFLA_MAX)
+				attrs[attr->rta_type] = attr;
+		if (const rtattr * attr = attrs[IFLA_IFNAME])
+			link.name.assign(static_cast<const char *>(RTA_DATA(attr)), strnlen(static_cast<const char *>(RTA_DATA(attr)), RTA_PAYLOAD(attr)));
+		Entry & e(NewEntry(link.name, link.flags));
+		if (const rtattr * attr = attrs[IFLA_ADDRESS]) {
+			set_link_address(e.addr, i, attr);
+			e.a.ifa_addr = reinterpret_cast<sockaddr *>(&e.addr);
+		}
+		if (const rtattr * attr = attrs[IFLA_BROADCAST]) {
+			set_link_address(e.broadaddr, i, attr);
+			e.a.ifa_broadaddr = reinterpret_cast<sockaddr *>(&e.broadaddr);
+		}
+		if (const rtattr * attr = attrs[IFLA_STATS]) {
+			std::memcpy(&e.stats, RTA_DATA(attr), RTA_PAYLOAD(attr) < sizeof e.stats ? RTA_PAYLOAD(attr) : sizeof e.stats);
+			e.a.ifa_data = &e.stats;
+		}
+	}
+
+	inline
+	void
+	set_address (
+		sockaddr_storage & storage,
+		const ifaddrmsg & m,
+		const rtattr * attr
+	) {
+		switch (m.ifa_family) {
+			case AF_INET:
+			{
+				sockaddr_in & addr4(reinterpret_cast<sockaddr_in &>(storage));
+				addr4.sin_family = AF_INET;
+				if (RTA_PAYLOAD(attr) >= sizeof addr4.sin_addr)
+					std::memcpy(&addr4.sin_addr, RTA_DATA(attr), sizeof addr4.sin_addr);
+				break;
+			}
+			case AF_INET6:
+			{
+				sockaddr_in6 & addr6(reinterpret_cast<sockaddr_in6 &>(storage));
+				addr6.sin6_family = AF_INET6;
+				if (RTA_PAYLOAD(attr) >= sizeof addr6.sin6_addr)
+					std::memcpy(&addr6.sin6_addr, RTA_DATA(attr), sizeof addr6.sin6_addr);
+				if (IN6_IS_ADDR_LINKLOCAL(&addr6.sin6_addr) || IN6_IS_ADDR_MC_LINKLOCAL(&addr6.sin6_addr))
+					addr6.sin6_scope_id = m.ifa_index;
+				break;
+			}
+			default:
+				storage.ss_family = m.ifa_family;
+				break;
+		}
+	}
+
+	/// This follows what the GNU C library does, so that output does not vary with the means of enumeration.
+	void
+	InterfaceList::AddAddress (
+		const ifaddrmsg & m,
+		std::size_t len
+	) {
+		IndexMap::const_iterator link(links.find(m.ifa_index));
+		if (links.end() == link) return;
+		Entry & e(NewEntry(link->second.name, link->second.flags));
+		int attrlen(len - NLMSG_LENGTH(sizeof m));
+		for (const rtattr * attr(IFA_RTA(&m)); RTA_OK(attr, attrlen); attr = RTA_NEXT(attr, attrlen)) {
+			switch (attr->rta_type) {
+				case IFA_ADDRESS:
+					// A second address is the far end of a point-to-point link.
+					if (e.a.ifa_addr) {
+						set_address(e.broadaddr, m, attr);
+						e.a.ifa_broadaddr = reinterpret_cast<sockaddr *>(&e.broadaddr);
+					} else {
+						set_address(e.addr, m, attr);
+						e.a.ifa_addr = reinterpret_cast<sockaddr *>(&e.addr);
+					}
+					break;
+				case IFA_LOCAL:
+					// An earlier IFA_ADDRESS was the far end of a point-to-point link.
+					if (e.a.ifa_addr) {
+						e.broadaddr = e.addr;
+						e.a.ifa_broadaddr = reinterpret_cast<sockaddr *>(&e.broadaddr);
+						e.addr = sockaddr_storage();
+					}
+					set_address(e.addr, m, attr);
+					e.a.ifa_addr = reinterpret_cast<sockaddr *>(&e.addr);
+					break;
+				case IFA_BROADCAST:
+					e.broadaddr = sockaddr_storage();
+					set_address(e.broadaddr, m, attr);
+					e.a.ifa_broadaddr = reinterpret_cast<sockaddr *>(&e.broadaddr);
+					break;
+				case IFA_LABEL:
+					e.name.assign(static_cast<const char *>(RTA_DATA(attr)), strnlen(static_cast<const char *>(RTA_DATA(attr)), RTA_PAYLOAD(attr)));
+					e.a.ifa_name = const_cast<char *>(e.name.c_str());
+					break;
+			}
+		}
+		switch (m.ifa_family) {
+			case AF_INET:
+			{
+				sockaddr_in & netmask4(reinterpret_cast<sockaddr_in &>(e.netmask));
+				netmask4.sin_family = AF_INET;
+				IPAddress::SetPrefix(netmask4.sin_addr, m.ifa_prefixlen);
+				e.a.ifa_netmask = reinterpret_cast<sockaddr *>(&e.netmask);
+				break;
+			}
+			case AF_INET6:
+			{
+				sockaddr_in6 & netmask6(reinterpret_cast<sockaddr_in6 &>(e.netmask));
+				netmask6.sin6_family = AF_INET6;
+				IPAddress::SetPrefix(netmask6.sin6_addr, m.ifa_prefixlen);
+				e.a.ifa_netmask = reinterpret_cast<sockaddr *>(&e.netmask);
+				break;
+			}
+		}
+	}
+#else
+	InterfaceList::InterfaceList(
+		const char * prog
+	) :
+		addr_list(0)
+	{
+		if (0 > getifaddrs(&addr_list)) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "getifaddrs", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		for (const ifaddrs * a(addr_list); a; a = a->ifa_next)
+			names[a->ifa_name].push_back(a);
+	}
+
+	InterfaceList::~InterfaceList()
+	{
+		freeifaddrs(addr_list);
+		addr_list = 0;
+	}
+#endif
+
 }
 
 /* Flags ********************************************************************
@@ -456,30 +737,23 @@ namespace {
 		int address_family,
 		const char * interface_name
 	) {
-		ifaddrs * al(0);
-		if (0 > getifaddrs(&al)) {
-			const int error(errno);
-			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "getifaddrs", std::strerror(error));
-			throw EXIT_FAILURE;
-		}
-		const InterfaceAddresses addr_list(al);
-
-		// Create a map of interface names to linked-list pointers.
-		typedef std::map<std::string, ifaddrs *> name_to_ifaddrs;
-		name_to_ifaddrs start_points;
-		for (ifaddrs * a(addr_list); a; a = a->ifa_next) {
-			const std::string name(a->ifa_name);
-			name_to_ifaddrs::iterator i(start_points.find(name));
-			if (start_points.end() != i) continue;
-			start_points[name] = a;
-		}
+		const InterfaceList interfaces(prog);
 
 		bool first(true);
-		for (name_to_ifaddrs::const_iterator b(start_points.begin()), e(start_points.end()), p(b); p != e; ++p) {
+		InterfaceList::NameMap::const_iterator b(interfaces.names.begin()), e(interfaces.names.end());
+		if (interface_name) {
+			b = interfaces.names.find(interface_name);
+			if (e != b) {
+				e = b;
+				++e;
+			}
+		}
+		for (InterfaceList::NameMap::const_iterator p(b); p != e; ++p) {
+			const InterfaceList::Addresses & addresses(p->second);
 			if (AF_UNSPEC != address_family) {
 				bool found_any(false);
-				for (const ifaddrs * a(p->second); a; a = a->ifa_next) {
-					if (p->first != a->ifa_name) continue;
+				for (InterfaceList::Addresses::const_iterator i(addresses.begin()); addresses.end() != i; ++i) {
+					const ifaddrs * a(*i);
 					if (a->ifa_addr && a->ifa_addr->sa_family == address_family) {
 						found_any = true;
 						break;
@@ -487,11 +761,11 @@ namespace {
 				}
 				if (!found_any) continue;
 			}
-			if (const ifaddrs * a = p->second) {
+			if (!addresses.empty()) {
+				const ifaddrs * a(addresses.front());
 				if (up_only && !(a->ifa_flags & IFF_UP)) continue;
 				if (down_only && (a->ifa_flags & IFF_UP)) continue;
 			}
-			if (interface_name && p->first != interface_name) continue;
 
 			if (names_only && !first) std::cout.put(' ');
 			first = false;
@@ -501,8 +775,8 @@ namespace {
 			std::cout.put('\n');
 			const unsigned int * pflags(0);
 			// Process each group of items in the list that share a single interface name.
-			for (const ifaddrs * a(p->second); a; a = a->ifa_next) {
-				if (p->first != a->ifa_name) continue;
+			for (InterfaceList::Addresses::const_iterator i(addresses.begin()); addresses.end() != i; ++i) {
+				const ifaddrs * a(*i);
 
 				if (AF_UNSPEC != address_family && a->ifa_addr && a->ifa_addr->sa_family != address_family) continue;
 
@@ -874,18 +1148,12 @@ namespace {
 		const char * interface_name,
 		sockaddr_in6 & dest
 	) {
-		ifaddrs * al(0);
-		if (0 > getifaddrs(&al)) {
-			const int error(errno);
-			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "getifaddrs", std::strerror(error));
-			throw EXIT_FAILURE;
-		}
-		const InterfaceAddresses addr_list(al);
-		for (ifaddrs * a(addr_list); a; a = a->ifa_next) {
-			if (0 == std::strcmp(a->ifa_name, interface_name)
-			&&  a->ifa_addr
-			&&  AF_INET6 == a->ifa_addr->sa_family
-			) {
+		const InterfaceList interfaces(prog);
+		const InterfaceList::NameMap::const_iterator p(interfaces.names.find(interface_name));
+		if (interfaces.names.end() == p) return false;
+		for (InterfaceList::Addresses::const_iterator i(p->second.begin()); p->second.end() != i; ++i) {
+			const ifaddrs * a(*i);
+			if (a->ifa_addr && AF_INET6 == a->ifa_addr->sa_family) {
 				const struct sockaddr_in6 & src(reinterpret_cast<struct sockaddr_in6 &>(*a->ifa_addr));
 				if (IPAddress::IsLinkLocal(src.sin6_addr)) {
 					std::memcpy(dest.sin6_addr.s6_addr + 8, src.sin6_addr.s6_addr + 8, 8);
@@ -1456,15 +1724,88 @@ namespace {
 #if defined(__LINUX__) || defined(__linux__)
 namespace {
 
-	struct rtnl_im {
-		nlmsghdr h;
-		ifaddrmsg m;
-	};
-	struct rtnl_em {
-		nlmsghdr h;
-		nlmsgerr e;
+	/// \brief A set of route netlink requests that are sent to the kernel in one go and acknowledged together.
+	/// The kernel processes and acknowledges every request in a batch, even after one of them has failed.
+	struct RouteNetlinkBatch {
+		RouteNetlinkBatch() : len(0U), count(0U) {}
+		nlmsghdr & Begin(unsigned short type, unsigned short nl_flags, std::size_t body_len);
+		void End(nlmsghdr & h) { h.nlmsg_len = buf + len - reinterpret_cast<char *>(&h); }
+		void Commit(const char * prog, const char * interface_name);
+
+		union {
+			nlmsghdr align;
+			char buf[4096];	///< far more than the few requests that a single command line can produce
+		};
+		std::size_t len;
+		unsigned count;
 	};
 
+	nlmsghdr &
+	RouteNetlinkBatch::Begin (
+		unsigned short type,
+		unsigned short nl_flags,
+		std::size_t body_len
+	) {
+		nlmsghdr & h(*reinterpret_cast<nlmsghdr *>(buf + len));
+		std::memset(&h, 0, NLMSG_SPACE(body_len));
+		h.nlmsg_type = type;
+		h.nlmsg_flags = NLM_F_REQUEST|NLM_F_ACK|nl_flags;
+		h.nlmsg_seq = ++count;
+		len += NLMSG_SPACE(body_len);
+		return h;
+	}
+
+	void
+	RouteNetlinkBatch::Commit (
+		const char * prog,
+		const char * interface_name
+	) {
+		if (!count) return;
+		const FileDescriptorOwner s(socket_close_on_exec(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE));
+		if (0 > s.get()) {
+	fail:
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: netlink: %s\n", prog, interface_name, std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		if (0 > send(s.get(), buf, len, 0)) goto fail;
+		// Each request produces exactly one acknowledgement, with an error code of zero for success.
+		int first_error(0);
+		for (unsigned acknowledged(0U); acknowledged < count; ) {
+			char reply[8192];
+			const ssize_t rc(recv(s.get(), reply, sizeof reply, 0));
+			if (0 > rc) {
+				if (EINTR == errno) continue;
+				goto fail;
+			}
+			unsigned int rlen(rc);
+			for (const nlmsghdr * h(reinterpret_cast<const nlmsghdr *>(reply)); NLMSG_OK(h, rlen); h = NLMSG_NEXT(h, rlen)) {
+				if (NLMSG_ERROR != h->nlmsg_type) continue;
+				const nlmsgerr & e(*static_cast<const nlmsgerr *>(NLMSG_DATA(h)));
+				++acknowledged;
+				if (e.error && !first_error) first_error = -e.error;
+			}
+		}
+		if (first_error) {
+			std::fprintf(stderr, "%s: FATAL: %s: netlink: %s\n", prog, interface_name, std::strerror(first_error));
+			throw EXIT_FAILURE;
+		}
+	}
+
+	int
+	get_interface_index (
+		const char * prog,
+		const char * family_name,
+		const char * interface_name
+	) {
+		const int interface_index(if_nametoindex(interface_name));
+		if (interface_index <= 0) {
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, family_name, "Cannot obtain the index of that interface.");
+			throw EXIT_FAILURE;
+		}
+		return interface_index;
+	}
+
 	void
 	append_attribute (
 		char * buf,
@@ -1502,11 +1843,12 @@ namespace {
 	}
 
 	void
-	send_rtnetlink (
+	queue_rtnetlink (
 		const char * prog,
+		RouteNetlinkBatch & batch,
 		int address_family,
 		const char * family_name,
-		const char * interface_name,
+		int interface_index,
 		unsigned short nl_flags,
 		unsigned short type,
 		const sockaddr_storage & addr,
@@ -1521,57 +1863,32 @@ namespace {
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, family_name, "Network mask is not a valid prefix.");
 			throw static_cast<int>(EXIT_USAGE);
 		}
-		const int interface_index(if_nametoindex(interface_name));
-		if (interface_index <= 0) {
-			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, family_name, "Cannot obtain the index of that interface.");
-			throw EXIT_FAILURE;
-		}
-
-		const FileDescriptorOwner s(socket_close_on_exec(AF_NETLINK, SOCK_DGRAM, NETLINK_ROUTE));
-		if (0 > s.get()) {
-	fail:
-			const int error(errno);
-			std::fprintf(stderr, "%s: FATAL: %s: netlink: %s\n", prog, interface_name, std::strerror(error));
-			throw EXIT_FAILURE;
-		}
 
-		char buf[4096];
-		rtnl_im & msg(*reinterpret_cast<rtnl_im *>(buf));
-		std::size_t buflen(NLMSG_ALIGN(NLMSG_LENGTH(sizeof msg.m)));
+		nlmsghdr & h(batch.Begin(type, nl_flags, sizeof(ifaddrmsg)));
+		ifaddrmsg & m(*static_cast<ifaddrmsg *>(NLMSG_DATA(&h)));
+		m.ifa_family = address_family;
+		m.ifa_prefixlen = prefixlen;
+		m.ifa_flags = addr_flags;
+		m.ifa_index = interface_index;
+		m.ifa_scope = scope;
 
 		if (address_family == addr.ss_family)
-			append_attribute(buf, buflen, IFA_LOCAL, addr);
+			append_attribute(batch.buf, batch.len, IFA_LOCAL, addr);
 		if (address_family == broadaddr.ss_family)
-			append_attribute(buf, buflen, IFA_BROADCAST, broadaddr);
+			append_attribute(batch.buf, batch.len, IFA_BROADCAST, broadaddr);
 		if (address_family == destaddr.ss_family)
-			append_attribute(buf, buflen, IFA_ADDRESS, addr);	// That IFA_ADDRESS is the point-to-point dest is hidden in a comment in an obscure header.
-
-		msg.h.nlmsg_len = buflen;
-		msg.h.nlmsg_flags = NLM_F_REQUEST|NLM_F_ACK|nl_flags;
-		msg.h.nlmsg_type = type;
-		msg.m.ifa_family = address_family;
-		msg.m.ifa_prefixlen = prefixlen;
-		msg.m.ifa_flags = addr_flags;
-		msg.m.ifa_index = interface_index;
-		msg.m.ifa_scope = scope;
-
-		if (0 > send(s.get(), buf, buflen, 0)) goto fail;
-		const int rc(recv(s.get(), buf, sizeof buf, 0));
-		if (0 > rc) goto fail;
-		const nlmsgerr & e(reinterpret_cast<const rtnl_em *>(buf)->e);
-		if (e.error) {
-			std::fprintf(stderr, "%s: FATAL: %s: netlink: %s\n", prog, interface_name, std::strerror(-e.error));
-			throw EXIT_FAILURE;
-		}
+			append_attribute(batch.buf, batch.len, IFA_ADDRESS, addr);	// That IFA_ADDRESS is the point-to-point dest is hidden in a comment in an obscure header.
+		batch.End(h);
 	}
 
 	inline
 	void
 	delete_address (
 		const char * prog,
+		RouteNetlinkBatch & batch,
 		int address_family,
 		const char * family_name,
-		const char * interface_name,
+		int interface_index,
 		const sockaddr_storage & addr,
 		const sockaddr_storage & netmask,
 		const sockaddr_storage & broadaddr,
@@ -1579,16 +1896,17 @@ namespace {
 		unsigned short addr_flags,
 		unsigned long scope
 	) {
-		send_rtnetlink (prog, address_family, family_name, interface_name, 0, RTM_DELADDR, addr, netmask, broadaddr, destaddr, addr_flags, scope);
+		queue_rtnetlink (prog, batch, address_family, family_name, interface_index, 0, RTM_DELADDR, addr, netmask, broadaddr, destaddr, addr_flags, scope);
 	}
 
 	inline
 	void
 	add_address (
 		const char * prog,
+		RouteNetlinkBatch & batch,
 		int address_family,
 		const char * family_name,
-		const char * interface_name,
+		int interface_index,
 		const sockaddr_storage & addr,
 		const sockaddr_storage & netmask,
 		const sockaddr_storage & broadaddr,
@@ -1596,7 +1914,7 @@ namespace {
 		unsigned short addr_flags,
 		unsigned long scope
 	) {
-		send_rtnetlink (prog, address_family, family_name, interface_name, NLM_F_CREATE|NLM_F_REPLACE, RTM_NEWADDR, addr, netmask, broadaddr, destaddr, addr_flags, scope);
+		queue_rtnetlink (prog, batch, address_family, family_name, interface_index, NLM_F_CREATE|NLM_F_REPLACE, RTM_NEWADDR, addr, netmask, broadaddr, destaddr, addr_flags, scope);
 	}
 
 }
@@ -1606,6 +1924,28 @@ namespace {
 // **************************************************************************
 */
 
+#if defined(__LINUX__) || defined(__linux__)
+namespace {
+
+	/// The change mask names only the flags being altered, so that the kernel leaves all others as they are.
+	void
+	set_flags (
+		RouteNetlinkBatch & batch,
+		int interface_index,
+		uint_least32_t ifflags_on,
+		uint_least32_t ifflags_off
+	) {
+		nlmsghdr & h(batch.Begin(RTM_NEWLINK, 0, sizeof(ifinfomsg)));
+		ifinfomsg & i(*static_cast<ifinfomsg *>(NLMSG_DATA(&h)));
+		i.ifi_family = AF_UNSPEC;
+		i.ifi_index = interface_index;
+		i.ifi_flags = ifflags_on & ~ifflags_off;
+		i.ifi_change = ifflags_on | ifflags_off;
+		batch.End(h);
+	}
+
+}
+#else
 namespace {
 
 	void
@@ -1665,6 +2005,7 @@ namespace {
 #endif
 	}
 }
+#endif
 
 /* Default IPv6 interface ***************************************************
 // **************************************************************************
@@ -1861,6 +2202,23 @@ ifconfig [[gnu::noreturn]]
 					parse_addresses_flags_and_options(prog, args, family_name, interface_name, address_family, flags_on, flags_off, ifflags_on, ifflags_off, in6flags_on, in6flags_off, nd6flags_on, nd6flags_off, capflags_on, capflags_off, addr, netmask, broadaddr, destaddr, scope);
 
 					// Actually enact stuff.
+#if defined(__LINUX__) || defined(__linux__)
+					// Flag and address changes go to the kernel as a single batch of route netlink requests.
+					// Linux has no ND6 flags, capability flags, or default IPv6 interface to set.
+					RouteNetlinkBatch batch;
+					const bool change_address(address_family == addr.ss_family);
+					const int interface_index(ifflags_on || ifflags_off || change_address ? get_interface_index(prog, family_name, interface_name) : 0);
+					if (ifflags_on || ifflags_off)
+						set_flags(batch, interface_index, ifflags_on, ifflags_off);
+					if (change_address) {
+						const unsigned long addr_flags(in6flags_on & ~in6flags_off);
+						if (flags_off & ALIAS)
+							delete_address(prog, batch, address_family, family_name, interface_index, addr, netmask, broadaddr, destaddr, addr_flags, scope);
+						else
+							add_address(prog, batch, address_family, family_name, interface_index, addr, netmask, broadaddr, destaddr, addr_flags, scope);
+					}
+					batch.Commit(prog, interface_name);
+#else
 					if (ifflags_on || ifflags_off || nd6flags_on || nd6flags_off || capflags_on || capflags_off)
 						set_flags_and_options(prog, address_family, interface_name, ifflags_on, ifflags_off, nd6flags_on, nd6flags_off, capflags_on, capflags_off);
 					if ((flags_on & DEFAULTIF) || (flags_off & DEFAULTIF))
@@ -1872,6 +2230,7 @@ ifconfig [[gnu::noreturn]]
 						else
 							add_address(prog, address_family, family_name, interface_name, addr, netmask, broadaddr, destaddr, addr_flags, scope);
 					}
+#endif
 				}
 			}
 		}
@@ -12,6 +12,7 @@ For copyright and licensing terms, see the file named COPYING.
 #include <map>
 #include <vector>
 #include <deque>
+#include <string>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -37,12 +38,15 @@ For copyright and licensing terms, see the file named COPYING.
 //  * EVFILT_VNODE does not handle character devices, block devices, or FIFOs.
 //  * EVFILT_READ and EVFILT_WRITE do not handle regular files (because epoll does not).
 //  * User data in filters is not supported.
+//    EVFILT_VNODE with the NOTE_NAMES extension uses it to return directory entry names instead.
 //
 // Differences from Linux libkqueue:
 //
 //  * All internal file descriptors are marked close-on-exec.
 //  * EVFILT_VNODE/NOTE_WRITE on a directory actually works.
 //  * Reading from the inotify doesn't overflow.
+//  * An inotify queue overflow is reported as NOTE_WRITE on every watched directory.
+//  * Entries renamed into or out of a directory are NOTE_WRITE on that directory, as on the BSDs.
 
 namespace {
 
@@ -79,6 +83,11 @@ public:
 	void return_event(int & n, struct kevent * pevents, int nevents, const struct kevent & k);
 
 	std::deque<struct kevent> pending;
+	std::deque<std::string> names;	///< for NOTE_NAMES events, oldest first
+	std::size_t names_returned;	///< how many names were handed out by the last call
+
+	void release_returned_names();
+	void count_returned_name(const struct kevent &);
 
 	typedef std::map<int, Watch> WatchMap;
 	WatchMap watches;
@@ -158,7 +167,7 @@ Watch::notes_for(
 			n |= NOTE_WRITE;
 	} else
 	if (S_ISDIR(s.st_mode)) {
-		if (mask & (IN_CREATE|IN_DELETE))
+		if (mask & (IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO))
 			n |= NOTE_WRITE;
 	}
 	if (mask & IN_DELETE_SELF)
@@ -182,7 +191,7 @@ Watch::mask_for(
 	} else
 	if (S_ISDIR(s.st_mode)) {
 		if (notes & NOTE_WRITE)
-			m |= IN_CREATE|IN_DELETE;
+			m |= IN_CREATE|IN_DELETE|IN_MOVED_FROM|IN_MOVED_TO;
 	}
 	if (notes & NOTE_DELETE)
 		m |= IN_DELETE_SELF;
@@ -200,6 +209,8 @@ Queue::Queue(
 	added_signals(),
 	enabled_signals(),
 	pending(),
+	names(),
+	names_returned(0),
 	watches(),
 	signal_off(0),
 	notify_off(0)
@@ -490,6 +501,24 @@ Queue::apply_changes(
 	return true;
 }
 
+inline
+void 
+Queue::release_returned_names(
+) {
+	// Events are returned in the order that they were generated, so the names handed out are always the oldest ones.
+	names.erase(names.begin(), names.begin() + names_returned);
+	names_returned = 0;
+}
+
+inline
+void 
+Queue::count_returned_name(
+	const struct kevent & k
+) {
+	if (EVFILT_VNODE == k.filter && k.udata)
+		++names_returned;
+}
+
 inline
 void 
 Queue::return_event(
@@ -498,9 +527,10 @@ Queue::return_event(
 	int nevents, 
 	const struct kevent & k
 ) {
-	if (n < nevents)
+	if (n < nevents) {
 		pevents[n++] = k;
-	else
+		count_returned_name(k);
+	} else
 		pending.push_back(k);
 }
 
@@ -518,9 +548,12 @@ Queue::wait(
 
 	int nreturn(0);
 
+	release_returned_names();
+
 	if (!pending.empty()) {
 		while (nreturn < nevents) {
 			pevents[nreturn++] = pending.front();
+			count_returned_name(pending.front());
 			pending.pop_front();
 			if (pending.empty()) break;
 		}
@@ -579,13 +612,30 @@ Queue::wait(
 				if (0 >= n) break;
 				notify_off += n;
 				while (notify_off >= sizeof notify_event && notify_off >= sizeof notify_event + notify_event.len) {
-					WatchMap::iterator wi(watches.find(notify_event.wd));
-					if (wi != watches.end()) {
-						Watch & w(wi->second);
-						if (IN_OPEN != notify_event.mask) {
-							struct kevent k;
-							EV_SET(&k, w.fd, EVFILT_VNODE, 0, w.notes_for(notify_event.mask), 0, 0);
-							return_event(nreturn, pevents, nevents, k);
+					if (notify_event.mask & IN_Q_OVERFLOW) {
+						for (WatchMap::iterator wi(watches.begin()); watches.end() != wi; ++wi) {
+							const Watch & w(wi->second);
+							if (S_ISDIR(w.s.st_mode) && (w.wanted_notes & NOTE_WRITE)) {
+								struct kevent k;
+								EV_SET(&k, w.fd, EVFILT_VNODE, 0, NOTE_WRITE, 0, 0);
+								return_event(nreturn, pevents, nevents, k);
+							}
+						}
+					} else
+					{
+						WatchMap::iterator wi(watches.find(notify_event.wd));
+						if (wi != watches.end()) {
+							Watch & w(wi->second);
+							if (IN_OPEN != notify_event.mask) {
+								const int notes(w.notes_for(notify_event.mask));
+								struct kevent k;
+								EV_SET(&k, w.fd, EVFILT_VNODE, 0, notes, 0, 0);
+								if ((w.wanted_notes & NOTE_NAMES) && (notes & NOTE_WRITE) && S_ISDIR(w.s.st_mode) && notify_event.len) {
+									names.push_back(notify_event.name);
+									k.udata = const_cast<char *>(names.back().c_str());
+								}
+								return_event(nreturn, pevents, nevents, k);
+							}
 						}
 					}
 					notify_off -= sizeof notify_event + notify_event.len;
@@ -59,8 +59,13 @@ enum { // Notes for VNODE filters
 	NOTE_ATTRIB	= 0x0008,
 	NOTE_LINK	= 0x0010,
 	NOTE_RENAME	= 0x0020,
-	NOTE_REVOKE	= 0x0040
+	NOTE_REVOKE	= 0x0040,
+	NOTE_NAMES	= 0x40000000,	// nosh extension
 };
+
+// With NOTE_NAMES, a watch on a directory returns a separate NOTE_WRITE event for every entry created, deleted, or renamed, with udata pointing to the entry name.
+// The name remains valid until the next call to kevent() on the queue.
+// A NOTE_WRITE event with a null udata means that names have been lost, and the whole directory must be rescanned.
 	
 extern "C" int kqueue_linux();
 extern "C" int kevent_linux(int, const struct kevent *, int, struct kevent *, int, const struct timespec*);
@@ -6,6 +6,8 @@ For copyright and licensing terms, see the file named COPYING.
 #if !defined(INCLUDE_LISTEN_H)
 #define INCLUDE_LISTEN_H
 
+#include <sys/socket.h>
+
 enum { LISTEN_SOCKET_FILENO = 3 };
 
 struct ProcessEnvironment;
@@ -13,5 +15,8 @@ struct ProcessEnvironment;
 extern unsigned query_listen_fds(ProcessEnvironment &);
 extern unsigned query_listen_fds_or_daemontools(ProcessEnvironment &);
 extern int query_listen_fds_passthrough(ProcessEnvironment &);
+/// \brief Accept connections on the listening sockets, forking a process per connection, until this returns in a child process with an accepted socket.
+/// With pre_fork, that many idle worker processes each wait to accept a connection themselves; idle and busy workers together never exceeding connection_limit.
+extern int accept_connection(const char * prog, bool verbose, unsigned listen_fds, unsigned long connection_limit, unsigned long pre_fork, sockaddr * remoteaddr, socklen_t & remoteaddrsz);
 
 #endif
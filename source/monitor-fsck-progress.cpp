@@ -14,6 +14,8 @@ For copyright and licensing terms, see the file named COPYING.
 #include <cerrno>
 #include <stdint.h>
 #include <inttypes.h>
+#include <ctime>
+#include <cctype>
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <unistd.h>
@@ -37,42 +39,53 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 namespace {
+	/// \brief One fsck's progress, parsed incrementally from its stream of "pass count max name" lines.
+	/// The fields of a line are accumulated as its characters arrive, and only replace the displayed values when the line ends.
 	struct ConnectedClient {
-		ConnectedClient() : count(0U), max(0U) {}
+		ConnectedClient();
 
-		std::string lines, pass, name;
+		bool changed;	///< whether the displayed values have changed since the client's row was last drawn
 		uint_least64_t count, max;
+		char pass[16], name[256];
 
 		std::string left() const;
 		std::string right() const;
-		void parse(std::string);
+		void parse(const char *, std::size_t);
+		void end();
+	protected:
+		enum { BEFORE_PASS, PASS, BEFORE_COUNT, COUNT, BEFORE_MAX, MAX, BEFORE_NAME, NAME } field;
+		bool in_line, in_number;
+		uint_least64_t next_count, next_max;
+		std::size_t pass_length, name_length;
+		char next_pass[sizeof pass], next_name[sizeof name];
+
+		void number(uint_least64_t &, char);
+		void finish_line();
 	};
 
 	typedef std::map<int, ConnectedClient> ClientTable;
 }
 
-static inline
-std::string
-munch (
-	std::string & s
-) {
-	s = ltrim(s);
-	for (std::string::size_type p(0); s.length() != p; ++p) {
-		if (std::isspace(s[p])) {
-			const std::string r(s.substr(0, p));
-			s = s.substr(p, std::string::npos);
-			return r;
-		}
-	}
-	const std::string r(s);
-	s = std::string();
-	return r;
+ConnectedClient::ConnectedClient() :
+	changed(true),
+	count(0U),
+	max(0U),
+	field(BEFORE_PASS),
+	in_line(false),
+	in_number(false),
+	next_count(0U),
+	next_max(0U),
+	pass_length(0U),
+	name_length(0U)
+{
+	pass[0] = name[0] = '\0';
 }
 
 std::string 
 ConnectedClient::left() const
 {
-	std::string r(pass + " ");
+	std::string r(pass);
+	r += " ";
 	if (max) {
 		const long double percent(count * 100.0L / max);
 		char buf[10];
@@ -92,14 +105,104 @@ ConnectedClient::right() const
 	return buf;
 }
 
-void 
-ConnectedClient::parse(
-	std::string s
+/// Numbers are their leading decimal digits; anything from the first non-digit onwards is ignored.
+inline
+void
+ConnectedClient::number (
+	uint_least64_t & v,
+	char c
 ) {
-	pass = munch(s);
-	count = val(munch(s));
-	max = val(munch(s));
-	name = ltrim(s);
+	if (!in_number) return;
+	if (std::isdigit(static_cast<unsigned char>(c)))
+		v = v * 10U + static_cast<unsigned char>(c - '0');
+	else
+		in_number = false;
+}
+
+void
+ConnectedClient::finish_line()
+{
+	next_pass[pass_length] = '\0';
+	next_name[name_length] = '\0';
+	if (next_count != count || next_max != max || 0 != std::strcmp(next_pass, pass) || 0 != std::strcmp(next_name, name)) {
+		count = next_count;
+		max = next_max;
+		std::memcpy(pass, next_pass, pass_length + 1U);
+		std::memcpy(name, next_name, name_length + 1U);
+		changed = true;
+	}
+	field = BEFORE_PASS;
+	in_line = false;
+	next_count = next_max = 0U;
+	pass_length = name_length = 0U;
+}
+
+void
+ConnectedClient::parse (
+	const char * p,
+	std::size_t l
+) {
+	for (const char * e(p + l); p != e; ++p) {
+		const char c(*p);
+		if ('\n' == c) {
+			// Blank lines are ignored.
+			if (in_line) finish_line();
+			continue;
+		}
+		in_line = true;
+		const bool space(std::isspace(static_cast<unsigned char>(c)));
+		switch (field) {
+			case BEFORE_PASS:
+				if (space) break;
+				field = PASS;
+				[[clang::fallthrough]];
+			case PASS:
+				if (space)
+					field = BEFORE_COUNT;
+				else
+				if (pass_length + 1U < sizeof next_pass)
+					next_pass[pass_length++] = c;
+				break;
+			case BEFORE_COUNT:
+				if (space) break;
+				field = COUNT;
+				in_number = true;
+				[[clang::fallthrough]];
+			case COUNT:
+				if (space)
+					field = BEFORE_MAX;
+				else
+					number(next_count, c);
+				break;
+			case BEFORE_MAX:
+				if (space) break;
+				field = MAX;
+				in_number = true;
+				[[clang::fallthrough]];
+			case MAX:
+				if (space)
+					field = BEFORE_NAME;
+				else
+					number(next_max, c);
+				break;
+			case BEFORE_NAME:
+				if (space) break;
+				field = NAME;
+				[[clang::fallthrough]];
+			case NAME:
+				// Names can contain spaces.
+				if (name_length + 1U < sizeof next_name)
+					next_name[name_length++] = c;
+				break;
+		}
+	}
+}
+
+/// A final line without a terminating newline still counts.
+void
+ConnectedClient::end()
+{
+	if (in_line) finish_line();
 }
 
 /* Full-screen TUI **********************************************************
@@ -125,15 +228,18 @@ struct TUI :
 	bool exit_signalled() const { return terminate_signalled||interrupt_signalled||hangup_signalled; }
 	void handle_signal (int);
 	void handle_stdin (int);
+	/// Adding or removing a client moves the rows of all after it, and can change the status line.
+	void set_full_redraw_needed() { full_redraw_needed = true; }
 
 protected:
 	sig_atomic_t terminate_signalled, interrupt_signalled, hangup_signalled, usr1_signalled, usr2_signalled;
 	ClientTable & clients;
 	TUIVIO vio;
-	bool pending_quit_event;
+	bool pending_quit_event, full_redraw_needed;
 	const ColourPair normal, title, status, line, progress;
 
 	virtual void redraw_new();
+	void redraw_row(long row, const ConnectedClient &);
 
 	virtual void ExtendedKey(uint_fast16_t k, uint_fast8_t m);
 	virtual void FunctionKey(uint_fast16_t k, uint_fast8_t m);
@@ -165,6 +271,7 @@ TUI::TUI(
 	clients(m),
 	vio(comp),
 	pending_quit_event(false),
+	full_redraw_needed(true),
 	normal(C(COLOUR_WHITE, COLOUR_BLACK)),
 	title(C(COLOUR_BLUE, COLOUR_WHITE)),
 	status(C(COLOUR_WHITE, COLOUR_BLUE)),
@@ -192,7 +299,7 @@ TUI::handle_signal (
 	int signo
 ) {
 	switch (signo) {
-		case SIGWINCH:	set_resized(); break;
+		case SIGWINCH:	set_resized(); full_redraw_needed = true; break;
 		case SIGTERM:	terminate_signalled = true; break;
 		case SIGINT:	interrupt_signalled = true; break;
 		case SIGHUP:	hangup_signalled = true; break;
@@ -204,34 +311,48 @@ TUI::handle_signal (
 }
 
 void
-TUI::redraw_new (
+TUI::redraw_row (
+	long row,
+	const ConnectedClient & client
 ) {
-	erase_new_to_backdrop();
+	const std::string l(client.left()), r(client.right());
+	vio.WriteNCharsAttr(row, 0, 0U, line, ' ', c.query_w());
+	long col(0);
+	vio.PrintFormatted(row, col, 0U, line, "%s %s ", l.c_str(), client.name);
+	if (col + r.length() < c.query_w())
+		col = c.query_w() - r.length();
+	vio.WriteCharStrAttr(row, col, 0U, line, r.c_str(), r.length());
+	if (client.max) {
+		const unsigned n(client.count * c.query_w() / client.max);
+		vio.WriteNAttrs(row, 0, 0U, progress, n);
+	}
+}
 
-	vio.WriteNCharsAttr(0, 0, 0U, title, ' ', c.query_w());
-	vio.WriteCharStrAttr(0, (c.query_w() - sizeof title_text + 1) / 2, 0U, title, title_text, sizeof title_text - 1);
-	vio.WriteNCharsAttr(1, 0, 0U, status, ' ', c.query_w());
-	const std::size_t sl(clients.empty() ? sizeof no_fscks : sizeof in_progress);
-	const char * st(clients.empty() ? no_fscks : in_progress);
-	vio.WriteCharStrAttr(1, (c.query_w() - sl + 1) / 2, 0U, status, st, sl - 1);
-	vio.WriteNCharsAttr(2, 0, 0U, status, '=', c.query_w());
+/// \brief Only the rows of clients that have changed are redrawn, unless the layout itself has changed.
+/// The compositor then only sends those rows to the terminal.
+void
+TUI::redraw_new (
+) {
+	const bool full(full_redraw_needed);
+	full_redraw_needed = false;
+	if (full) {
+		erase_new_to_backdrop();
+
+		vio.WriteNCharsAttr(0, 0, 0U, title, ' ', c.query_w());
+		vio.WriteCharStrAttr(0, (c.query_w() - sizeof title_text + 1) / 2, 0U, title, title_text, sizeof title_text - 1);
+		vio.WriteNCharsAttr(1, 0, 0U, status, ' ', c.query_w());
+		const std::size_t sl(clients.empty() ? sizeof no_fscks : sizeof in_progress);
+		const char * st(clients.empty() ? no_fscks : in_progress);
+		vio.WriteCharStrAttr(1, (c.query_w() - sl + 1) / 2, 0U, status, st, sl - 1);
+		vio.WriteNCharsAttr(2, 0, 0U, status, '=', c.query_w());
+	}
 
 	long row(3);
-	for (ClientTable::const_iterator i(clients.begin()); i != clients.end(); ++i, ++row) {
-		if (row < 0) continue;
-		if (row >= c.query_h()) break;
-		const ConnectedClient & client(i->second);
-		const std::string l(client.left()), r(client.right());
-		vio.WriteNCharsAttr(row, 0, 0U, line, ' ', c.query_w());
-		long col(0);
-		vio.PrintFormatted(row, col, 0U, line, "%s %s ", l.c_str(), client.name.c_str());
-		if (col + r.length() < c.query_w())
-			col = c.query_w() - r.length();
-		vio.WriteCharStrAttr(row, col, 0U, line, r.c_str(), r.length());
-		if (client.max) {
-			const unsigned n(client.count * c.query_w() / client.max);
-			vio.WriteNAttrs(row, 0, 0U, progress, n);
-		}
+	for (ClientTable::iterator i(clients.begin()); i != clients.end(); ++i, ++row) {
+		ConnectedClient & client(i->second);
+		if ((full || client.changed) && row < c.query_h())
+			redraw_row(row, client);
+		client.changed = false;
 	}
 	c.move_cursor(0U, 0U);
 	c.set_cursor_state(CursorSprite::BLINK, CursorSprite::BOX);
@@ -299,6 +420,49 @@ TUI::MouseButton(
 // **************************************************************************
 */
 
+namespace {
+
+/// Progress reports from many clients are coalesced into frames drawn no more often than this.
+const long frame_interval_ns(100000000L);
+
+inline
+bool
+operator < (
+	const timespec & a,
+	const timespec & b
+) {
+	return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+}
+
+inline
+timespec
+operator - (
+	const timespec & a,
+	const timespec & b
+) {
+	timespec r = { a.tv_sec - b.tv_sec, a.tv_nsec - b.tv_nsec };
+	if (r.tv_nsec < 0) {
+		r.tv_nsec += 1000000000L;
+		--r.tv_sec;
+	}
+	return r;
+}
+
+inline
+void
+advance (
+	timespec & t,
+	long ns
+) {
+	t.tv_nsec += ns;
+	if (t.tv_nsec >= 1000000000L) {
+		t.tv_nsec -= 1000000000L;
+		++t.tv_sec;
+	}
+}
+
+}
+
 void
 monitor_fsck_progress [[gnu::noreturn]] ( 
 	const char * & next_prog,
@@ -360,15 +524,37 @@ monitor_fsck_progress [[gnu::noreturn]] (
 	TUI ui(envs, clients, compositor);
 
 	std::vector<struct kevent> p(listen_fds + 4);
+	// Clients that have hung up are closed once the deletions of their events have been passed to the kernel.
+	std::vector<int> hungup;
+	bool frame_pending(false);
+	timespec next_frame = { 0, 0 };
 	while (true) {
 		if (ui.exit_signalled() || ui.quit_flagged())
 			break;
+		const timespec * timeout(0);
+		timespec until_next_frame;
+		if (frame_pending) {
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if (now < next_frame) {
+				until_next_frame = next_frame - now;
+				timeout = &until_next_frame;
+			} else {
+				frame_pending = false;
+				next_frame = now;
+				advance(next_frame, frame_interval_ns);
+				ui.set_refresh_needed();
+			}
+		}
 		ui.handle_resize_event();
 		ui.handle_refresh_event();
 		ui.handle_update_event();
 
-		const int rc(kevent(queue.get(), ip.data(), ip.size(), p.data(), p.size(), 0));
+		const int rc(kevent(queue.get(), ip.data(), ip.size(), p.data(), p.size(), timeout));
 		ip.clear();
+		for (std::vector<int>::const_iterator i(hungup.begin()); hungup.end() != i; ++i)
+			close(*i);
+		hungup.clear();
 
 		if (0 > rc) {
 			const int error(errno);
@@ -405,41 +591,31 @@ monitor_fsck_progress [[gnu::noreturn]] (
 
 						append_event(ip, s, EVFILT_READ, EV_ADD|EV_ENABLE, 0, 0, 0);
 						clients[s];
+						ui.set_full_redraw_needed();
+						frame_pending = true;
 					} else
 					{
 						if (EV_ERROR & e.flags) break;
+						const ClientTable::iterator ci(clients.find(fd));
+						if (clients.end() == ci) break;
+						ConnectedClient & client(ci->second);
 						const bool hangup(EV_EOF & e.flags);
 
-						ConnectedClient & client(clients[fd]);
 						char buf[8U * 1024U];
 						const ssize_t c(read(fd, buf, sizeof buf));
 						if (c > 0)
-							client.lines += std::string(buf, buf + c);
-						if (hangup && !c && !client.lines.empty())
-							client.lines += '\n';
-						std::string line;
-						for (;;) {
-							if (client.lines.empty()) break;
-							const std::string::size_type n(client.lines.find('\n'));
-							if (std::string::npos == n) break;
-							line = client.lines.substr(0, n);
-							client.lines = client.lines.substr(n + 1, std::string::npos);
-						}
-						if (!line.empty())
-							client.parse(line);
+							client.parse(buf, c);
 						if (hangup && !c) {
-							struct kevent o;
-							EV_SET(&o, fd, EVFILT_READ, EV_DELETE|EV_DISABLE, 0, 0, 0);
-							if (0 > kevent(queue.get(), &o, 1, 0, 0, 0)) {
-								const int error(errno);
-								std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
-								throw EXIT_FAILURE;
-							}
-							close(fd);
-							clients.erase(fd);
-						}
+							client.end();
+							append_event(ip, fd, EVFILT_READ, EV_DELETE|EV_DISABLE, 0, 0, 0);
+							hungup.push_back(fd);
+							clients.erase(ci);
+							ui.set_full_redraw_needed();
+							frame_pending = true;
+						} else
+						if (client.changed)
+							frame_pending = true;
 					}
-					ui.set_refresh_needed();
 					break;
 				}
 			}
@@ -4,6 +4,9 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <vector>
+#include <algorithm>
+#include <utility>
+#include <string>
 #include <cstdio>
 #include <cstdlib>
 #include <cerrno>
@@ -79,18 +82,28 @@ printenv [[gnu::noreturn]] (
 
 	const char eol(print0 ? '\0' : '\n');
 	if (args.empty()) {
-		for (ProcessEnvironment::const_iterator i(envs.begin()), e(envs.end()); e != i; ++i) {
+		// The environment is not kept in any particular order, but this output always has been sorted by name.
+		std::vector<std::pair<std::string, std::string> > vars;
+		vars.reserve(envs.size());
+		for (const char * const * p(envs.data()); *p; ++p) {
+			const char * const q(std::strchr(*p, '='));
+			if (q)
+				vars.push_back(std::make_pair(std::string(*p, q), std::string(q + 1)));
+			else
+				vars.push_back(std::make_pair(std::string(*p), std::string()));
+		}
+		std::sort(vars.begin(), vars.end());
+		for (std::vector<std::pair<std::string, std::string> >::const_iterator i(vars.begin()), e(vars.end()); e != i; ++i) {
 			std::cout << process(i->first, print0, envdir, conf) << '=' << process(i->second, print0, envdir, conf) << eol;
 		}
 	} else {
 		bool not_found(false);
 		for (std::vector<const char *>::const_iterator i(args.begin()), e(args.end()); e != i; ++i) {
 			const std::string var(*i);
-			ProcessEnvironment::const_iterator p(envs.find(var));
-			if (envs.end() != p) {
+			if (const char * val = envs.query(var.c_str())) {
 				if (full)
-					std::cout << process(p->first, print0, envdir, conf) << '=';
-				std::cout << process(p->second, print0, envdir, conf) << eol;
+					std::cout << process(var, print0, envdir, conf) << '=';
+				std::cout << process(val, print0, envdir, conf) << eol;
 			} else
 				not_found = true;
 		}
@@ -21,6 +21,59 @@ For copyright and licensing terms, see the file named COPYING.
 
 enum { PTY_MASTER_FILENO = 4 };
 
+/* Relay buffers ************************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+/// \brief A relay buffer that starts small, for interactive use, and grows whilst reads keep filling it, for bulk output.
+struct relay_buffer {
+	enum { MINIMUM_SIZE = 4096U, MAXIMUM_SIZE = 65536U };
+	relay_buffer() : b(MINIMUM_SIZE), start(0U), len(0U) {}
+	bool empty() const { return !len; }
+	bool has_room() const { return len < b.size(); }
+	ssize_t fill(int);
+	ssize_t drain(int);
+protected:
+	std::vector<char> b;
+	std::size_t start, len;
+};
+
+ssize_t
+relay_buffer::fill (
+	int fd
+) {
+	// Only move the contents down when there is no room left after them.
+	if (start && start + len >= b.size()) {
+		std::memmove(b.data(), b.data() + start, len);
+		start = 0U;
+	}
+	const std::size_t room(b.size() - start - len);
+	const ssize_t l(read(fd, b.data() + start + len, room));
+	if (l > 0) {
+		len += l;
+		if (static_cast<std::size_t>(l) == room && b.size() < MAXIMUM_SIZE)
+			b.resize(2U * b.size());
+	}
+	return l;
+}
+
+ssize_t
+relay_buffer::drain (
+	int fd
+) {
+	const ssize_t l(write(fd, b.data() + start, len));
+	if (l > 0) {
+		start += l;
+		len -= l;
+		if (!len) start = 0U;
+	}
+	return l;
+}
+
+}
+
 /* Signal handling **********************************************************
 // **************************************************************************
 */
@@ -124,15 +177,16 @@ pty_run (
 		}
 	}
 
-	char inb[1024], outb[1024];
-	size_t inl(0), outl(0);
+	relay_buffer inb, outb;
 	bool ine(false), oute(false);
+	// The filters are all enabled when added, and only changes to that are passed to the kernel.
+	bool stdin_enabled(true), stdout_enabled(true), masterin_enabled(true), masterout_enabled(true);
 	int status(WAIT_STATUS_RUNNING), code(0);
 	termios original_attr;
 
 	program_continued = true;
 
-	while (WAIT_STATUS_RUNNING == status || WAIT_STATUS_PAUSED == status || !oute || outl) {
+	while (WAIT_STATUS_RUNNING == status || WAIT_STATUS_PAUSED == status || !oute || !outb.empty()) {
 		if (terminate_signalled||interrupt_signalled||hangup_signalled) {
 			if (WAIT_STATUS_RUNNING == status || WAIT_STATUS_PAUSED == status) {
 				if (terminate_signalled) kill(child, SIGTERM);
@@ -172,16 +226,29 @@ pty_run (
 				tcsetwinsz_nointr(PTY_MASTER_FILENO, size);
 		}
 
-		// Read from stdin if we have emptied the in buffer and haven't hit EOF.
-		set_event(&p[0], STDIN_FILENO, EVFILT_READ, !ine && !inl ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
-		// Read from master if we have emptied the out buffer and haven't hit EOF.
-		set_event(&p[2], PTY_MASTER_FILENO, EVFILT_READ, !oute && !outl ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		std::size_t changes(0U);
+		// Read from stdin if we have room in the in buffer and haven't hit EOF.
+		if (stdin_enabled != (!ine && inb.has_room())) {
+			stdin_enabled = !stdin_enabled;
+			set_event(&p[changes++], STDIN_FILENO, EVFILT_READ, stdin_enabled ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		}
+		// Read from master if we have room in the out buffer and haven't hit EOF.
+		if (masterin_enabled != (!oute && outb.has_room())) {
+			masterin_enabled = !masterin_enabled;
+			set_event(&p[changes++], PTY_MASTER_FILENO, EVFILT_READ, masterin_enabled ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		}
 		// Write to stdout if we have things in the out buffer.
-		set_event(&p[1], STDOUT_FILENO, EVFILT_WRITE, outl ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		if (stdout_enabled != !outb.empty()) {
+			stdout_enabled = !stdout_enabled;
+			set_event(&p[changes++], STDOUT_FILENO, EVFILT_WRITE, stdout_enabled ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		}
 		// Write to master if we have things in the in buffer.
-		set_event(&p[3], PTY_MASTER_FILENO, EVFILT_WRITE, inl ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		if (masterout_enabled != !inb.empty()) {
+			masterout_enabled = !masterout_enabled;
+			set_event(&p[changes++], PTY_MASTER_FILENO, EVFILT_WRITE, masterout_enabled ? EV_ENABLE : EV_DISABLE, 0, 0, 0);
+		}
 
-		const int rc(kevent(queue, p, 4, p, sizeof p/sizeof *p, 0));
+		const int rc(kevent(queue, p, changes, p, sizeof p/sizeof *p, 0));
 
 		if (0 > rc) {
 			if (EINTR == errno) continue;
@@ -213,42 +280,26 @@ pty_run (
 		}
 
 		if (stdin_ready) {
-			if (!inl) {
-				const ssize_t l(read(STDIN_FILENO, inb, sizeof inb));
-				if (l > 0) 
-					inl = l;
-				else if (0 == l)
+			if (inb.has_room()) {
+				if (0 == inb.fill(STDIN_FILENO))
 					ine = true;
 			}
 		}
 		if (stdout_ready) {
-			if (outl) {
-				const ssize_t l(write(STDOUT_FILENO, outb, outl));
-				if (l > 0) {
-					memmove(outb, outb + l, outl - l);
-					outl -= l;
-				}
-			}
+			if (!outb.empty())
+				outb.drain(STDOUT_FILENO);
 		}
 		if (masterin_ready) {
-			if (!outl) {
-				const ssize_t l(read(PTY_MASTER_FILENO, outb, sizeof outb));
-				if (l > 0) 
-					outl = l;
-				else if (0 == l)
+			if (outb.has_room()) {
+				if (0 == outb.fill(PTY_MASTER_FILENO))
 					oute = true;
 			}
 		}
 		if (master_hangup)
 			oute = true;
 		if (masterout_ready) {
-			if (inl) {
-				const ssize_t l(write(PTY_MASTER_FILENO, inb, inl));
-				if (l > 0) {
-					memmove(inb, inb + l, inl - l);
-					inl -= l;
-				}
-			}
+			if (!inb.empty())
+				inb.drain(PTY_MASTER_FILENO);
 		}
 	}
 
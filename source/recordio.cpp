@@ -4,6 +4,7 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <vector>
+#include <algorithm>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -15,6 +16,9 @@ For copyright and licensing terms, see the file named COPYING.
 #include <sys/types.h>
 #include <sys/event.h>
 #endif
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include "popt.h"
 #include "utils.h"
@@ -38,32 +42,178 @@ writeall (
 	}
 }
 
-static
+/// \brief The transcript of one direction of I/O, written to standard error with as few writev() calls as there are batches of lines.
+class Transcript {
+public:
+	Transcript(char dir);
+	void log(const char *, std::size_t);
+protected:
+	enum { BATCH_LINES = 64U };
+	char prefix[32];
+	std::size_t prefix_length;
+	struct iovec v[3U * BATCH_LINES];
+	std::size_t n;
+	void add(const char * p, std::size_t l) { v[n].iov_base = const_cast<char *>(p); v[n].iov_len = l; ++n; }
+	void flush();
+};
+
+Transcript::Transcript(char dir) :
+	n(0U)
+{
+	const int l(std::snprintf(prefix, sizeof prefix, "%u: %c ", pid, dir));
+	prefix_length = 0 > l ? 0U : static_cast<std::size_t>(l) < sizeof prefix ? l : sizeof prefix - 1U;
+}
+
+/// Write all of the batch, however many writes that takes; giving up, as std::fwrite() to stderr would, upon an error.
+void
+Transcript::flush()
+{
+	struct iovec * p(v);
+	while (n) {
+		const ssize_t rc(writev(STDERR_FILENO, p, n));
+		if (0 > rc) {
+			if (EINTR == errno) continue;
+			break;
+		}
+		std::size_t l(rc);
+		while (n && l >= p->iov_len) {
+			l -= p->iov_len;
+			++p;
+			--n;
+		}
+		if (n) {
+			p->iov_base = static_cast<char *>(p->iov_base) + l;
+			p->iov_len -= l;
+		}
+	}
+	n = 0U;
+}
+
 void
-log (
-	char dir,
+Transcript::log(
 	const char * ptr,
 	std::size_t len
 ) {
-	if (!len)
-		std::fprintf(stderr, "%u: %c [EOF]\n", pid, dir);
-	else
+	static const char eof[] = "[EOF]\n", whole[] = " \n", partial[] = "+\n";
+	if (!len) {
+		add(prefix, prefix_length);
+		add(eof, sizeof eof - 1U);
+	} else
 	while (len) {
-		std::fprintf(stderr, "%u: %c ", pid, dir);
+		if (n >= 3U * BATCH_LINES) flush();
+		add(prefix, prefix_length);
 		if (const char * nl = static_cast<const char *>(std::memchr(ptr, '\n', len))) {
 			const std::size_t l(nl - ptr);
-			std::fwrite(ptr, l, 1, stderr);
-			std::fputc(' ', stderr);
+			add(ptr, l);
+			add(whole, sizeof whole - 1U);
 			ptr += l + 1;
 			len -= l + 1;
 		} else {
-			std::fwrite(ptr, len, 1, stderr);
-			std::fputc('+', stderr);
+			add(ptr, len);
+			add(partial, sizeof partial - 1U);
 			ptr += len;
 			len = 0;
 		}
-		std::fputc('\n', stderr);
 	}
+	flush();
+}
+
+/// \brief One direction of the relay, which duplicates data with tee() on Linux when both ends are pipes, and otherwise reads and writes.
+/// tee() does not block when the destination pipe is full; instead the relay stops reading until the destination has room, so that a full pipe in one direction cannot hold up the other.
+class Relay {
+public:
+	Relay(const char * p, const char * n, int f, int t, char dir) : prog(p), name(n), from(f), to(t), transcript(dir), can_tee(is_pipe(f) && is_pipe(t)), buf(BUFFER_SIZE) {}
+	enum result { RELAYED, BLOCKED, ENDED };
+	result transfer();
+	void wait_for_room(int queue) { change(queue, EV_DISABLE, EV_ADD); }
+	void resume(int queue) { change(queue, EV_ENABLE, EV_DELETE); }
+	bool is_destination(int fd) const { return to == fd; }
+protected:
+	enum { BUFFER_SIZE = 65536U };
+	const char * prog, * name;
+	const int from, to;
+	Transcript transcript;
+	bool can_tee;
+	std::vector<char> buf;
+	static bool is_pipe(int);
+	void fatal [[gnu::noreturn]] ();
+	void change(int, int, int);
+};
+
+bool
+Relay::is_pipe (
+	int fd
+) {
+#if defined(__LINUX__) || defined(__linux__)
+	struct stat s;
+	return 0 <= fstat(fd, &s) && S_ISFIFO(s.st_mode);
+#else
+	static_cast<void>(fd);	// Silence a compiler warning.
+	return false;
+#endif
+}
+
+void
+Relay::fatal()
+{
+	const int error(errno);
+	std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, name, std::strerror(error));
+	throw EXIT_FAILURE;
+}
+
+void
+Relay::change(int queue, int read_flags, int write_flags)
+{
+	struct kevent p[2];
+	EV_SET(&p[0], from, EVFILT_READ, read_flags, 0, 0, 0);
+	EV_SET(&p[1], to, EVFILT_WRITE, write_flags, 0, 0, 0);
+	if (0 > kevent(queue, p, sizeof p/sizeof *p, 0, 0, 0)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+}
+
+Relay::result
+Relay::transfer()
+{
+#if defined(__LINUX__) || defined(__linux__)
+	if (can_tee) {
+		// The kernel duplicates the data straight into the destination pipe, and they are only read out of the source for the transcript.
+		const ssize_t t(tee(from, to, buf.size(), SPLICE_F_NONBLOCK));
+		if (0 < t) {
+			for (std::size_t done(0U); done < static_cast<std::size_t>(t); ) {
+				const ssize_t n(read(from, buf.data(), std::min(buf.size(), t - done)));
+				if (0 > n) {
+					if (EINTR == errno) continue;
+					fatal();
+				}
+				if (0 == n) break;
+				transcript.log(buf.data(), n);
+				done += n;
+			}
+			return RELAYED;
+		}
+		if (0 == t) {
+			transcript.log(buf.data(), 0U);
+			return ENDED;
+		}
+		if (EINTR == errno) return RELAYED;
+		// The source is readable, so it is the destination that is full.
+		if (EAGAIN == errno) return BLOCKED;
+		if (EINVAL != errno) fatal();
+		can_tee = false;
+	}
+#endif
+	const ssize_t n(read(from, buf.data(), buf.size()));
+	if (0 > n) {
+		if (EINTR == errno) return RELAYED;
+		fatal();
+	}
+	transcript.log(buf.data(), n);
+	if (0 == n) return ENDED;
+	writeall(to, buf.data(), n);
+	return RELAYED;
 }
 
 /* Main function ************************************************************
@@ -161,6 +311,8 @@ recordio (
 		throw EXIT_FAILURE;
 	}
 
+	Relay output(prog, "read-pipe", output_fds[0], STDOUT_FILENO, '>'), input(prog, "read-stdin", STDIN_FILENO, input_fds[1], '<');
+
 	for (;;) {
 		const int rc(kevent(queue, 0, 0, p, sizeof p/sizeof *p, 0));
 		if (0 > rc) {
@@ -171,22 +323,22 @@ recordio (
 		}
 		for (size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
 			const struct kevent & e(p[i]);
+			const int fd(static_cast<int>(e.ident));
+			if (EVFILT_WRITE == e.filter) {
+				if (output.is_destination(fd))
+					output.resume(queue);
+				if (input.is_destination(fd))
+					input.resume(queue);
+				continue;
+			}
 			if (EVFILT_READ != e.filter) 
 				continue;
-			const int fd(static_cast<int>(e.ident));
-			char buf [4096];
-			const ssize_t n(read(fd, buf, sizeof buf));
 			if (output_fds[0] == fd) {
-				if (0 > n) {
-					const int error(errno);
-					if (EINTR == error) continue;
-					std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "read-pipe", std::strerror(error));
-					throw EXIT_FAILURE;
-				}
-				log('>', buf, n);
-				if (0 != n)
-					writeall(STDOUT_FILENO, buf, n);
-				else {
+				const Relay::result r(output.transfer());
+				if (Relay::BLOCKED == r)
+					output.wait_for_room(queue);
+				else
+				if (Relay::ENDED == r) {
 					close(STDOUT_FILENO);
 					EV_SET(&p[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
 					if (0 > kevent(queue, p, 1, 0, 0, 0)) {
@@ -198,16 +350,11 @@ recordio (
 				}
 			}
 			if (STDIN_FILENO == fd) {
-				if (0 > n) {
-					const int error(errno);
-					if (EINTR == error) continue;
-					std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "read-stdin", std::strerror(error));
-					throw EXIT_FAILURE;
-				}
-				log('<', buf, n);
-				if (0 != n)
-					writeall(input_fds[1], buf, n);
-				else {
+				const Relay::result r(input.transfer());
+				if (Relay::BLOCKED == r)
+					input.wait_for_room(queue);
+				else
+				if (Relay::ENDED == r) {
 					close(input_fds[1]); input_fds[1] = -1;
 					EV_SET(&p[0], fd, EVFILT_READ, EV_DELETE, 0, 0, 0);
 					if (0 > kevent(queue, p, 1, 0, 0, 0)) {
@@ -4,12 +4,17 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <vector>
+#include <map>
+#include <set>
+#include <string>
 #include <cstdio>
 #include <cstring>
 #include <csignal>
 #include <cerrno>
+#include <ctime>
 #include <stdint.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #if defined(__LINUX__) || defined(__linux__)
 #include "kqueue_linux.h"
 #else
@@ -28,6 +33,170 @@ For copyright and licensing terms, see the file named COPYING.
 // **************************************************************************
 */
 
+namespace {
+
+typedef std::pair<dev_t, ino_t> bundle_id;
+
+/// \brief The bundles in the scan directory that are known to have been loaded, by their bundle directories and by their current names.
+///
+/// A bundle that could not yet be loaded, usually because it is still being populated, has its bundle and service directories watched until it can be.
+struct bundle_index {
+	typedef std::map<bundle_id, std::string> id_map;
+	typedef std::map<std::string, bundle_id> name_map;
+	typedef std::map<std::string, std::pair<int, int> > pending_map;
+	bundle_index(int q) : queue(q) {}
+	~bundle_index();
+	id_map by_id;
+	name_map by_name;
+	pending_map pending;	///< the watched bundle and service directories of not yet loaded bundles, by name
+
+	void add(const std::string & name, const bundle_id & id) { forget(name); by_id[id] = name; by_name[name] = id; }
+	void forget(const std::string & name);
+	void clear() { by_id.clear(); by_name.clear(); }
+	void watch(int scan_dir_fd, const std::string & name);
+	void unwatch(const std::string & name);
+	const char * pending_name(int fd) const;
+protected:
+	const int queue;
+	void unwatch(pending_map::iterator);
+	int add_watch(int fd);
+	void delete_watch(int fd);
+};
+
+bundle_index::~bundle_index()
+{
+	while (!pending.empty())
+		unwatch(pending.begin());
+}
+
+void
+bundle_index::forget (
+	const std::string & name
+) {
+	const name_map::iterator i(by_name.find(name));
+	if (by_name.end() == i) return;
+	by_id.erase(i->second);
+	by_name.erase(i);
+}
+
+/// \returns fd, now watched, or -1 having closed it
+int
+bundle_index::add_watch (
+	const int fd
+) {
+	if (0 > fd) return -1;
+	struct kevent e[1];
+	EV_SET(&e[0], fd, EVFILT_VNODE, EV_ADD|EV_CLEAR, NOTE_WRITE|NOTE_EXTEND, 0, 0);
+	if (0 > kevent(queue, e, sizeof e/sizeof *e, 0, 0, 0)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+void
+bundle_index::delete_watch (
+	const int fd
+) {
+	if (0 > fd) return;
+	struct kevent e[1];
+	EV_SET(&e[0], fd, EVFILT_VNODE, EV_DELETE, 0, 0, 0);
+	kevent(queue, e, sizeof e/sizeof *e, 0, 0, 0);
+	close(fd);
+}
+
+/// The service directory may not exist yet, in which case the bundle directory will change when it is made.
+void
+bundle_index::watch (
+	const int scan_dir_fd,
+	const std::string & name
+) {
+	unwatch(name);
+	const int bundle_dir_fd(add_watch(open_dir_at(scan_dir_fd, name.c_str())));
+	if (0 > bundle_dir_fd) return;
+	const int service_dir_fd(add_watch(open_service_dir(bundle_dir_fd)));
+	pending[name] = std::make_pair(bundle_dir_fd, service_dir_fd);
+}
+
+void
+bundle_index::unwatch (
+	pending_map::iterator i
+) {
+	delete_watch(i->second.second);
+	delete_watch(i->second.first);
+	pending.erase(i);
+}
+
+void
+bundle_index::unwatch (
+	const std::string & name
+) {
+	const pending_map::iterator i(pending.find(name));
+	if (pending.end() != i) unwatch(i);
+}
+
+/// \returns the name of the pending bundle whose bundle or service directory is watched by fd, or a null pointer
+const char *
+bundle_index::pending_name (
+	const int fd
+) const {
+	for (pending_map::const_iterator i(pending.begin()), e(pending.end()); e != i; ++i)
+		if (fd == i->second.first || fd == i->second.second)
+			return i->first.c_str();
+	return 0;
+}
+
+inline
+bool
+is_bundle_name (
+	const char * name
+) {
+	return '.' != name[0];
+}
+
+}
+
+/// Bring the index up to date for one changed name in the scan directory, loading a bundle that has newly appeared there.
+/// A bundle that cannot be loaded yet is watched, and this is called again for it when its bundle directory changes.
+static 
+void
+scan_entry (
+	const char * prog,
+	const int socket_fd,
+	const int scan_dir_fd,
+	const char * name,
+	const bool input_activation,
+	bundle_index & index
+) {
+	if (!is_bundle_name(name)) return;
+	struct stat s;
+	if (0 > fstatat(scan_dir_fd, name, &s, 0) || !S_ISDIR(s.st_mode)) {
+		index.forget(name);
+		index.unwatch(name);
+		return;
+	}
+	const bundle_id id(s.st_dev, s.st_ino);
+	const bundle_index::id_map::const_iterator i(index.by_id.find(id));
+	if (index.by_id.end() != i) {
+		index.unwatch(name);
+		// A renamed bundle is already loaded, under its old name.
+		if (i->second != name) {
+			const std::string old_name(i->second);
+			index.forget(old_name);
+			index.add(name, id);
+		}
+		return;
+	}
+	index.forget(name);
+	if (load_bundle(prog, socket_fd, scan_dir_fd, name, input_activation, true)) {
+		index.unwatch(name);
+		index.add(name, id);
+	} else
+		index.watch(scan_dir_fd, name);
+}
+
+/// Reconcile the index with the whole scan directory.
+/// A full reconciliation re-checks every bundle with the service manager, as if none had ever been loaded; otherwise only bundles not already in the index are.
 static 
 void
 rescan (
@@ -35,7 +204,9 @@ rescan (
 	const char * name,
 	const int socket_fd,
 	const int retained_scan_dir_fd,
-	const bool input_activation
+	const bool input_activation,
+	const bool full,
+	bundle_index & index
 ) {
 	FileDescriptorOwner scan_dir_fd(dup(retained_scan_dir_fd));
 	if (0 > scan_dir_fd.get()) {
@@ -47,6 +218,8 @@ exit_scan:
 	const DirStar scan_dir(scan_dir_fd);
 	if (!scan_dir) goto exit_scan;
 	rewinddir(scan_dir);	// because the last pass left it at EOF.
+	if (full) index.clear();
+	std::set<std::string> seen;
 	for (;;) {
 		errno = 0;
 		const dirent * entry(readdir(scan_dir));
@@ -58,84 +231,26 @@ exit_scan:
 		if (1 > entry->d_namlen) continue;
 		if (sizeof(service_manager_rpc_message::name) > entry->d_namlen) continue;
 #endif
-		if ('.' == entry->d_name[0]) continue;
+		if (!is_bundle_name(entry->d_name)) continue;
 #if defined(_DIRENT_HAVE_D_TYPE)
 		if (DT_DIR != entry->d_type && DT_LNK != entry->d_type) continue;
 #endif
-
-		const int bundle_dir_fd(open_dir_at(scan_dir.fd(), entry->d_name));
-		if (0 <= bundle_dir_fd) {
-			int service_dir_fd(open_service_dir(bundle_dir_fd));
-			if (0 <= service_dir_fd) {
-				make_supervise(bundle_dir_fd);
-				const int supervise_dir_fd(open_supervise_dir(bundle_dir_fd));
-				if (0 <= supervise_dir_fd) {
-					const bool was_already_loaded(is_ok(supervise_dir_fd));
-					if (!was_already_loaded) {
-						make_supervise_fifos(supervise_dir_fd);
-						load(prog, socket_fd, entry->d_name, supervise_dir_fd, service_dir_fd);
-					}
-					const int log_bundle_dir_fd(open_dir_at(bundle_dir_fd, "log/"));
-					if (0 <= log_bundle_dir_fd) {
-						char log_name[NAME_MAX + sizeof "/log"];
-						std::strncpy(log_name, entry->d_name, sizeof log_name);
-#if defined(_DIRENT_HAVE_D_NAMLEN)
-						std::strncat(log_name, "/log", sizeof log_name - entry->d_namelen);
-#else
-						std::strncat(log_name, "/log", sizeof log_name - std::strlen(entry->d_name));
-#endif
-						int log_service_dir_fd(open_service_dir(log_bundle_dir_fd));
-						if (0 <= log_service_dir_fd) {
-							make_supervise(log_bundle_dir_fd);
-							const int log_supervise_dir_fd(open_supervise_dir(log_bundle_dir_fd));
-							if (0 <= log_supervise_dir_fd) {
-								const bool log_was_already_loaded(is_ok(log_supervise_dir_fd));
-								if (!log_was_already_loaded) {
-									make_supervise_fifos(log_supervise_dir_fd);
-									load(prog, socket_fd, log_name, log_supervise_dir_fd, log_service_dir_fd);
-									make_pipe_connectable(prog, socket_fd, log_supervise_dir_fd);
-								}
-								plumb(prog, socket_fd, supervise_dir_fd, log_supervise_dir_fd);
-								if (!log_was_already_loaded) {
-									if (input_activation) 
-										make_input_activated(prog, socket_fd, log_supervise_dir_fd);
-									else {
-										if (is_initially_up(log_service_dir_fd)) {
-											if (!wait_ok(log_supervise_dir_fd, 5000))
-												std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "log/supervise/ok", "Unable to load service bundle.");
-											else
-												start(log_supervise_dir_fd);
-										} else
-											std::fprintf(stderr, "%s: INFO: %s/%s: %s\n", prog, entry->d_name, "log", "Service is initially down.");
-									}
-								}
-								close(log_supervise_dir_fd);
-							} else
-								std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "log/supervise", std::strerror(errno));
-							close(log_service_dir_fd);
-						} else
-							std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "log/service", std::strerror(errno));
-						close(log_bundle_dir_fd);
-					} else
-						std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "log", std::strerror(errno));
-					if (!was_already_loaded) {
-						if (is_initially_up(service_dir_fd)) {
-							if (!wait_ok(supervise_dir_fd, 5000))
-								std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "supervise/ok", "Unable to load service bundle.");
-							else
-								start(supervise_dir_fd);
-						} else
-							std::fprintf(stderr, "%s: INFO: %s: %s\n", prog, entry->d_name, "Service is initially down.");
-					}
-					close(supervise_dir_fd);
-				} else
-					std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "supervise", std::strerror(errno));
-				close(service_dir_fd);
-			} else
-				std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, entry->d_name, "service", std::strerror(errno));
-			close(bundle_dir_fd);
-		} else
-			std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, entry->d_name, std::strerror(errno));
+		seen.insert(entry->d_name);
+		scan_entry(prog, socket_fd, scan_dir.fd(), entry->d_name, input_activation, index);
+	}
+	// Names that have gone from the directory have gone from the index.
+	for (bundle_index::name_map::iterator i(index.by_name.begin()); index.by_name.end() != i; ) {
+		if (seen.end() != seen.find(i->first)) {
+			++i;
+			continue;
+		}
+		index.by_id.erase(i->second);
+		index.by_name.erase(i++);
+	}
+	for (bundle_index::pending_map::iterator i(index.pending.begin()); index.pending.end() != i; ) {
+		const std::string pending_name((i++)->first);
+		if (seen.end() == seen.find(pending_name))
+			index.unwatch(pending_name);
 	}
 }
 
@@ -143,6 +258,8 @@ exit_scan:
 // **************************************************************************
 */
 
+static const time_t full_scan_interval(15 * 60);
+
 void
 service_dt_scanner [[gnu::noreturn]] (
 	const char * & next_prog,
@@ -193,7 +310,11 @@ service_dt_scanner [[gnu::noreturn]] (
 
 	{
 		struct kevent e[1];
+#if defined(__LINUX__) || defined(__linux__)
+		EV_SET(&e[0], scan_dir_fd.get(), EVFILT_VNODE, EV_ADD|EV_CLEAR, NOTE_WRITE|NOTE_EXTEND|NOTE_NAMES, 0, 0);
+#else
 		EV_SET(&e[0], scan_dir_fd.get(), EVFILT_VNODE, EV_ADD|EV_CLEAR, NOTE_WRITE|NOTE_EXTEND, 0, 0);
+#endif
 		if (0 > kevent(queue, e, sizeof e/sizeof *e, 0, 0, 0)) {
 			const int error(errno);
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
@@ -205,12 +326,26 @@ service_dt_scanner [[gnu::noreturn]] (
 
 	const int socket_fd(connect_service_manager_socket(is_system, prog));
 	if (0 > socket_fd) throw EXIT_FAILURE;
-	rescan(prog, scan_directory, socket_fd, scan_dir_fd.get(), input_activation);
+	bundle_index index(queue);
+	rescan(prog, scan_directory, socket_fd, scan_dir_fd.get(), input_activation, true, index);
+	timespec last_full_scan;
+	clock_gettime(CLOCK_MONOTONIC, &last_full_scan);
 
 	for (;;) {
 		try {
-			struct kevent p[2];
-			const int rc(kevent(queue, 0, 0, p, sizeof p/sizeof *p, 0));
+			// As a safety net against lost events, and bundles unloaded behind our backs, periodically re-check everything.
+			timespec now;
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			const time_t since_full_scan(now.tv_sec - last_full_scan.tv_sec);
+			if (since_full_scan >= full_scan_interval) {
+				rescan(prog, scan_directory, socket_fd, scan_dir_fd.get(), input_activation, true, index);
+				last_full_scan = now;
+				continue;
+			}
+			const struct timespec timeout = { full_scan_interval - since_full_scan, 0 };
+
+			struct kevent p[64];
+			const int rc(kevent(queue, 0, 0, p, sizeof p/sizeof *p, &timeout));
 			if (0 > rc) {
 				const int error(errno);
 				if (EINTR == error) continue;
@@ -221,10 +356,19 @@ service_dt_scanner [[gnu::noreturn]] (
 				const struct kevent & e(p[i]);
 				switch (e.filter) {
 					case EVFILT_VNODE:
-						if (e.ident == static_cast<uintptr_t>(scan_dir_fd.get()))
-							rescan(prog, scan_directory, socket_fd, scan_dir_fd.get(), input_activation);
-						else
-							std::fprintf(stderr, "%s: DEBUG: vnode event ident %lu fflags %x\n", prog, e.ident, e.fflags);
+						if (e.ident == static_cast<uintptr_t>(scan_dir_fd.get())) {
+							// Only changed names need to be looked at, if we are told them.
+							if (e.udata)
+								scan_entry(prog, socket_fd, scan_dir_fd.get(), static_cast<const char *>(e.udata), input_activation, index);
+							else
+								rescan(prog, scan_directory, socket_fd, scan_dir_fd.get(), input_activation, false, index);
+						} else
+						if (const char * name = index.pending_name(static_cast<int>(e.ident))) {
+							// A bundle that is still being populated has changed, so try loading it again.
+							const std::string pending_name(name);
+							scan_entry(prog, socket_fd, scan_dir_fd.get(), pending_name.c_str(), input_activation, index);
+						}
+						// Otherwise it is a stale event, from earlier in this batch, for a bundle that has since been loaded or gone.
 						break;
 					default:
 						std::fprintf(stderr, "%s: DEBUG: event filter %hd ident %lu fflags %x\n", prog, e.filter, e.ident, e.fflags);
@@ -7,6 +7,7 @@ For copyright and licensing terms, see the file named COPYING.
 #include <csignal>
 #include <cstdio>
 #include <cerrno>
+#include <climits>
 #include <vector>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -160,6 +161,13 @@ start (
 	return send_control_command(supervise_dir_fd, 'u');
 }
 
+int
+run_once (
+	int supervise_dir_fd
+) {
+	return send_control_command(supervise_dir_fd, 'o');
+}
+
 int
 stop (
 	int supervise_dir_fd
@@ -469,3 +477,93 @@ is_use_kill_signal (
 ) {
 	return no_flag_file(service_dir_fd, "no_kill_signal");
 }
+
+/* Loading bundles **********************************************************
+// **************************************************************************
+*/
+
+/// \brief Load a bundle, and its log bundle if it has one, into the service manager, starting whichever of them are initially up.
+/// The bundle's own service is left stopped, even if initially up, unless start_main is set.
+/// \returns whether the bundle's service is now known to the service manager
+bool
+load_bundle (
+	const char * prog,
+	const int socket_fd,
+	const int scan_dir_fd,
+	const char * name,
+	const bool input_activation,
+	const bool start_main
+) {
+	bool loaded(false);
+	const int bundle_dir_fd(open_dir_at(scan_dir_fd, name));
+	if (0 <= bundle_dir_fd) {
+		int service_dir_fd(open_service_dir(bundle_dir_fd));
+		if (0 <= service_dir_fd) {
+			make_supervise(bundle_dir_fd);
+			const int supervise_dir_fd(open_supervise_dir(bundle_dir_fd));
+			if (0 <= supervise_dir_fd) {
+				const bool was_already_loaded(is_ok(supervise_dir_fd));
+				if (!was_already_loaded) {
+					make_supervise_fifos(supervise_dir_fd);
+					load(prog, socket_fd, name, supervise_dir_fd, service_dir_fd);
+				}
+				const int log_bundle_dir_fd(open_dir_at(bundle_dir_fd, "log/"));
+				if (0 <= log_bundle_dir_fd) {
+					char log_name[NAME_MAX + sizeof "/log"];
+					std::strncpy(log_name, name, sizeof log_name);
+					std::strncat(log_name, "/log", sizeof log_name - std::strlen(name) - 1U);
+					int log_service_dir_fd(open_service_dir(log_bundle_dir_fd));
+					if (0 <= log_service_dir_fd) {
+						make_supervise(log_bundle_dir_fd);
+						const int log_supervise_dir_fd(open_supervise_dir(log_bundle_dir_fd));
+						if (0 <= log_supervise_dir_fd) {
+							const bool log_was_already_loaded(is_ok(log_supervise_dir_fd));
+							if (!log_was_already_loaded) {
+								make_supervise_fifos(log_supervise_dir_fd);
+								load(prog, socket_fd, log_name, log_supervise_dir_fd, log_service_dir_fd);
+								make_pipe_connectable(prog, socket_fd, log_supervise_dir_fd);
+							}
+							plumb(prog, socket_fd, supervise_dir_fd, log_supervise_dir_fd);
+							if (!log_was_already_loaded) {
+								if (input_activation) 
+									make_input_activated(prog, socket_fd, log_supervise_dir_fd);
+								else {
+									if (is_initially_up(log_service_dir_fd)) {
+										if (!wait_ok(log_supervise_dir_fd, 5000))
+											std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "log/supervise/ok", "Unable to load service bundle.");
+										else
+											start(log_supervise_dir_fd);
+									} else
+										std::fprintf(stderr, "%s: INFO: %s/%s: %s\n", prog, name, "log", "Service is initially down.");
+								}
+							}
+							close(log_supervise_dir_fd);
+						} else
+							std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "log/supervise", std::strerror(errno));
+						close(log_service_dir_fd);
+					} else
+						std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "log/service", std::strerror(errno));
+					close(log_bundle_dir_fd);
+				} else
+					std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "log", std::strerror(errno));
+				if (!was_already_loaded && start_main) {
+					if (is_initially_up(service_dir_fd)) {
+						if (!wait_ok(supervise_dir_fd, 5000))
+							std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "supervise/ok", "Unable to load service bundle.");
+						else
+							start(supervise_dir_fd);
+					} else
+						std::fprintf(stderr, "%s: INFO: %s: %s\n", prog, name, "Service is initially down.");
+				}
+				loaded = was_already_loaded || is_ok(supervise_dir_fd);
+				close(supervise_dir_fd);
+			} else
+				std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "supervise", std::strerror(errno));
+			close(service_dir_fd);
+		} else
+			std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, name, "service", std::strerror(errno));
+		close(bundle_dir_fd);
+	} else
+		std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, name, std::strerror(errno));
+	return loaded;
+}
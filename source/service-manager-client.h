@@ -58,6 +58,10 @@ start (
 	int supervise_dir_fd
 );
 int
+run_once (
+	int supervise_dir_fd
+);
+int
 stop (
 	int supervise_dir_fd
 );
@@ -199,5 +203,14 @@ connect_service_manager_socket (
 	const bool is_system, 
 	const char * prog
 ) ;
+bool
+load_bundle (
+	const char * prog,
+	const int socket_fd,
+	const int scan_dir_fd,
+	const char * name,
+	const bool input_activation,
+	const bool start_main
+) ;
 
 #endif
@@ -0,0 +1,531 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <map>
+#include <queue>
+#include <string>
+#include <functional>
+#include <cstdio>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <csignal>
+#include <cerrno>
+#include <ctime>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#if defined(__LINUX__) || defined(__linux__)
+#include "kqueue_linux.h"
+#else
+#include <sys/event.h>
+#endif
+#include <dirent.h>
+#include <unistd.h>
+#include "popt.h"
+#include "utils.h"
+#include "fdutils.h"
+#include "service-manager-client.h"
+#include "FileDescriptorOwner.h"
+#include "FileStar.h"
+#include "DirStar.h"
+#include "SignalManagement.h"
+
+/* Time spans ***************************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+/// Deadlines are kept in nanoseconds on a clock that counts from boot, and so is not stepped along with the wall clock.
+/// Whether that includes time spent suspended depends from the platform; see since_boot().
+typedef uint_least64_t nanoseconds;
+
+const nanoseconds NSEC(1U), USEC(1000U * NSEC), MSEC(1000U * USEC), SEC(1000U * MSEC), MIN(60U * SEC), HRS(60U * MIN), DAY(24U * HRS);
+
+/// On Linux and OpenBSD, CLOCK_BOOTTIME includes time spent suspended, so a deadline that falls during a suspension is due on resumption.
+/// On FreeBSD, CLOCK_BOOTTIME is merely another name for CLOCK_UPTIME, and neither it nor CLOCK_MONOTONIC (the fallback on NetBSD and others) advances whilst suspended; so there deadlines are pushed back by however long the system was suspended.
+inline
+nanoseconds
+since_boot ()
+{
+	timespec t;
+#if defined(CLOCK_BOOTTIME)
+	clock_gettime(CLOCK_BOOTTIME, &t);
+#elif defined(CLOCK_UPTIME)
+	clock_gettime(CLOCK_UPTIME, &t);
+#else
+	clock_gettime(CLOCK_MONOTONIC, &t);
+#endif
+	return t.tv_sec * SEC + t.tv_nsec;
+}
+
+// Longer names come before any shorter names that are their prefixes.
+const struct unit {
+	const char * name;
+	nanoseconds length;
+} units[] = {
+	{	"nsec",		NSEC			},
+	{	"ns",		NSEC			},
+	{	"usec",		USEC			},
+	{	"us",		USEC			},
+	{	"\xCE\xBCs",	USEC			},	// U+003BC Greek Letter mu
+	{	"msec",		MSEC			},
+	{	"ms",		MSEC			},
+	{	"seconds",	SEC			},
+	{	"second",	SEC			},
+	{	"sec",		SEC			},
+	{	"s",		SEC			},
+	{	"minutes",	MIN			},
+	{	"minute",	MIN			},
+	{	"min",		MIN			},
+	{	"months",	2629800U * SEC		},
+	{	"month",	2629800U * SEC		},
+	{	"m",		MIN			},
+	{	"hours",	HRS			},
+	{	"hour",		HRS			},
+	{	"hr",		HRS			},
+	{	"h",		HRS			},
+	{	"days",		DAY			},
+	{	"day",		DAY			},
+	{	"d",		DAY			},
+	{	"weeks",	7U * DAY		},
+	{	"week",		7U * DAY		},
+	{	"w",		7U * DAY		},
+	{	"fortnights",	14U * DAY		},
+	{	"fortnight",	14U * DAY		},
+	{	"M",		2629800U * SEC		},
+	{	"years",	31557600U * SEC		},
+	{	"year",		31557600U * SEC		},
+	{	"yr",		31557600U * SEC		},
+	{	"y",		31557600U * SEC		},
+};
+
+/// \brief Parse a time span, such as "1h 30min", with the fixed unit lengths that systemd uses.
+/// A number with no unit is in seconds.
+bool
+parse_span (
+	const char * s,
+	nanoseconds & r
+) {
+	r = 0U;
+	bool any(false);
+	for (;;) {
+		while (std::isspace(*s)) ++s;
+		if (!*s) return any;
+		if (!std::isdigit(*s)) return false;
+		const char * end(s);
+		const unsigned long long n(std::strtoull(s, const_cast<char **>(&end), 10));
+		s = end;
+		while (std::isspace(*s)) ++s;
+		nanoseconds length(SEC);
+		for (std::size_t i(0U); i < sizeof units/sizeof *units; ++i) {
+			const std::size_t l(std::strlen(units[i].name));
+			if (0 == std::strncmp(s, units[i].name, l) && !std::isalpha(s[l])) {
+				length = units[i].length;
+				s += l;
+				break;
+			}
+		}
+		if (std::isalpha(*s)) return false;
+		r += n * length;
+		any = true;
+	}
+}
+
+}
+
+/* Timers *******************************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+struct timer {
+	enum base { BOOT, ACTIVE, UNIT_ACTIVE };
+	typedef std::vector<std::pair<base, nanoseconds> > span_list;
+
+	timer(const std::string & n, nanoseconds a) : name(n), activated(a), last_fired(0U), fired(false) {}
+	bool next(nanoseconds &) const;
+
+	std::string name, service;
+	span_list spans;
+	nanoseconds activated, last_fired;
+	bool fired;
+};
+
+/// \brief Calculate the earliest deadline still to come.
+/// Until the timer has first fired, a deadline that had already passed when it was activated is due at once, as with systemd; so an on-boot timer activated late still fires.
+/// After that, deadlines at or before the last firing are ignored; as is the last activation of the service if there has not been one.
+/// \returns false if there is no such deadline, and the timer will never fire again
+bool
+timer::next (
+	nanoseconds & when
+) const {
+	bool any(false);
+	for (span_list::const_iterator i(spans.begin()), e(spans.end()); i != e; ++i) {
+		nanoseconds from;
+		switch (i->first) {
+			case BOOT:		from = 0U; break;
+			case ACTIVE:		from = activated; break;
+			case UNIT_ACTIVE:	if (!fired) continue; from = last_fired; break;
+			default:		continue;
+		}
+		const nanoseconds d(from + i->second);
+		if (fired && d <= last_fired) continue;
+		if (!any || d < when) when = d;
+		any = true;
+	}
+	return any;
+}
+
+struct deadline {
+	deadline(nanoseconds w, std::size_t i) : when(w), index(i) {}
+	bool operator > (const deadline & o) const { return when > o.when; }
+	nanoseconds when;
+	std::size_t index;
+};
+
+typedef std::vector<timer> timer_list;
+typedef std::priority_queue<deadline, std::vector<deadline>, std::greater<deadline> > deadline_heap;
+
+/// \brief Read one declarative timer file, which is either the directory entry itself or the timer file in a bundle directory.
+/// \returns false if the file does not define a usable timer
+bool
+load_timer (
+	const char * prog,
+	const char * directory,
+	int dir_fd,
+	timer & t
+) {
+	struct stat s;
+	const bool is_bundle(0 <= fstatat(dir_fd, t.name.c_str(), &s, 0) && S_ISDIR(s.st_mode));
+	const std::string file_name(is_bundle ? t.name + "/timer" : t.name);
+	// A bundle's own timer file need not name the service; it is the bundle.
+	t.service = is_bundle ? t.name : std::string();
+	t.spans.clear();
+	FileDescriptorOwner file_fd(open_read_at(dir_fd, file_name.c_str()));
+	if (0 > file_fd.get()) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, directory, file_name.c_str(), std::strerror(error));
+		return false;
+	}
+	const FileStar f(fdopen(file_fd.get(), "r"));
+	if (!f) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, directory, file_name.c_str(), std::strerror(error));
+		return false;
+	}
+	file_fd.release();
+	std::string line;
+	for (unsigned long n(1UL); read_line(f, line); ++n) {
+		line = ltrim(rtrim(line));
+		if (line.empty() || '#' == line[0]) continue;
+		std::string::size_type sp(0U);
+		while (sp < line.length() && !std::isspace(line[sp])) ++sp;
+		const std::string key(line.substr(0, sp)), val(ltrim(line.substr(sp)));
+		if ("service" == key) {
+			t.service = val;
+			continue;
+		}
+		timer::base b;
+		if ("on-boot" == key || "on-startup" == key)
+			b = timer::BOOT;
+		else
+		if ("on-active" == key)
+			b = timer::ACTIVE;
+		else
+		if ("on-unit-active" == key)
+			b = timer::UNIT_ACTIVE;
+		else
+		{
+			std::fprintf(stderr, "%s: WARNING: %s/%s:%lu: %s: %s\n", prog, directory, file_name.c_str(), n, key.c_str(), "Unsupported setting ignored.");
+			continue;
+		}
+		nanoseconds span;
+		if (!parse_span(val.c_str(), span)) {
+			std::fprintf(stderr, "%s: WARNING: %s/%s:%lu: %s: %s\n", prog, directory, file_name.c_str(), n, val.c_str(), "Invalid time span ignored.");
+			continue;
+		}
+		t.spans.push_back(timer::span_list::value_type(b, span));
+	}
+	if (std::ferror(f)) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, directory, file_name.c_str(), std::strerror(error));
+		return false;
+	}
+	if (t.service.empty()) {
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s\n", prog, directory, file_name.c_str(), "No service.");
+		return false;
+	}
+	return true;
+}
+
+/// \brief Ensure that the service manager knows about a timer's service, without starting it.
+/// Its log service, if it has one, is started as usual.
+inline
+void
+load_service (
+	const char * prog,
+	int socket_fd,
+	int dir_fd,
+	const timer & t
+) {
+	load_bundle(prog, socket_fd, dir_fd, t.service.c_str(), false, false);
+}
+
+/// \brief Re-read the whole timer directory, carrying over the activation and firing history of timers that are still there.
+/// The services of new timers are loaded into the service manager.
+void
+load_timers (
+	const char * prog,
+	const char * directory,
+	int socket_fd,
+	int dir_fd,
+	timer_list & timers,
+	deadline_heap & heap
+) {
+	std::map<std::string, timer> old;
+	for (timer_list::const_iterator i(timers.begin()), e(timers.end()); i != e; ++i)
+		old.insert(std::map<std::string, timer>::value_type(i->name, *i));
+	timers.clear();
+	heap = deadline_heap();
+
+	const int scan_dir_fd(dup(dir_fd));
+	if (0 > scan_dir_fd) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, directory, std::strerror(error));
+		return;
+	}
+	const DirStar dir(fdopendir(scan_dir_fd));
+	if (!dir) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, directory, std::strerror(error));
+		close(scan_dir_fd);
+		return;
+	}
+	rewinddir(dir);
+	const nanoseconds now(since_boot());
+	for (;;) {
+		errno = 0;
+		const dirent * entry(readdir(dir));
+		if (!entry) {
+			const int error(errno);
+			if (error)
+				std::fprintf(stderr, "%s: ERROR: %s: %s\n", prog, directory, std::strerror(error));
+			break;
+		}
+#if defined(_DIRENT_HAVE_D_NAMLEN)
+		if (1 > entry->d_namlen) continue;
+#endif
+		if ('.' == entry->d_name[0]) continue;
+#if defined(_DIRENT_HAVE_D_TYPE)
+		if (DT_REG != entry->d_type && DT_DIR != entry->d_type && DT_LNK != entry->d_type && DT_UNKNOWN != entry->d_type) continue;
+#endif
+		timer t(entry->d_name, now);
+		const std::map<std::string, timer>::const_iterator o(old.find(t.name));
+		if (old.end() != o) {
+			t.activated = o->second.activated;
+			t.last_fired = o->second.last_fired;
+			t.fired = o->second.fired;
+		}
+		if (!load_timer(prog, directory, dir_fd, t)) continue;
+		if (old.end() == o || o->second.service != t.service)
+			load_service(prog, socket_fd, dir_fd, t);
+		timers.push_back(t);
+	}
+	for (std::size_t i(0U); i < timers.size(); ++i) {
+		nanoseconds when;
+		if (timers[i].next(when))
+			heap.push(deadline(when, i));
+	}
+}
+
+/// A disabled service, one that is not initially up, is skipped.
+/// A service that the service manager has lost track of, since it was loaded, is loaded again and retried.
+void
+fire (
+	const char * prog,
+	bool verbose,
+	const char * directory,
+	int socket_fd,
+	int dir_fd,
+	const timer & t
+) {
+	if (verbose)
+		std::fprintf(stderr, "%s: INFO: %s: %s\n", prog, t.name.c_str(), t.service.c_str());
+	const FileDescriptorOwner bundle_dir_fd(open_dir_at(dir_fd, t.service.c_str()));
+	if (0 > bundle_dir_fd.get()) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s: %s\n", prog, directory, t.name.c_str(), t.service.c_str(), std::strerror(error));
+		return;
+	}
+	const FileDescriptorOwner service_dir_fd(open_service_dir(bundle_dir_fd.get()));
+	if (0 <= service_dir_fd.get() && !is_initially_up(service_dir_fd.get())) {
+		if (verbose)
+			std::fprintf(stderr, "%s: INFO: %s: %s: %s\n", prog, t.name.c_str(), t.service.c_str(), "Service is disabled.");
+		return;
+	}
+	const FileDescriptorOwner supervise_dir_fd(open_supervise_dir(bundle_dir_fd.get()));
+	if (0 <= supervise_dir_fd.get() && 0 <= run_once(supervise_dir_fd.get()))
+		return;
+	if (ENXIO == errno || ENOENT == errno) {
+		load_service(prog, socket_fd, dir_fd, t);
+		const FileDescriptorOwner reloaded_supervise_dir_fd(open_supervise_dir(bundle_dir_fd.get()));
+		if (0 <= reloaded_supervise_dir_fd.get() && 0 <= run_once(reloaded_supervise_dir_fd.get()))
+			return;
+	}
+	{
+		const int error(errno);
+		std::fprintf(stderr, "%s: ERROR: %s/%s: %s: %s\n", prog, directory, t.name.c_str(), t.service.c_str(), ENXIO == error ? "No supervisor is running" : std::strerror(error));
+		return;
+	}
+}
+
+}
+
+/* Main function ************************************************************
+// **************************************************************************
+*/
+
+void
+service_timer_scheduler [[gnu::noreturn]] (
+	const char * & next_prog,
+	std::vector<const char *> & args,
+	ProcessEnvironment & /*envs*/
+) {
+	const char * prog(basename_of(args[0]));
+	bool verbose(false);
+	try {
+		popt::bool_definition verbose_option('v', "verbose", "Log each timer as it fires.", verbose);
+		popt::definition * top_table[] = {
+			&verbose_option
+		};
+		popt::top_table_definition main_option(sizeof top_table/sizeof *top_table, top_table, "Main options", "{directory}");
+
+		std::vector<const char *> new_args;
+		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
+		p.process(true /* strictly options before arguments */);
+		args = new_args;
+		next_prog = arg0_of(args);
+		if (p.stopped()) throw EXIT_SUCCESS;
+	} catch (const popt::error & e) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+	if (1 != args.size()) {
+		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "One directory name is required.");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+	const char * const directory(args[0]);
+
+	const FileDescriptorOwner dir_fd(open_dir_at(AT_FDCWD, directory));
+	if (0 > dir_fd.get()) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, directory, std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+
+	ReserveSignalsForKQueue kqueue_reservation(SIGTERM, SIGINT, SIGHUP, SIGPIPE, 0);
+	PreventDefaultForFatalSignals ignored_signals(SIGTERM, SIGINT, SIGHUP, SIGPIPE, 0);
+
+	const int queue(kqueue());
+	if (0 > queue) {
+		const int error(errno);
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kqueue", std::strerror(error));
+		throw EXIT_FAILURE;
+	}
+
+	{
+		struct kevent e[5];
+		EV_SET(&e[0], dir_fd.get(), EVFILT_VNODE, EV_ADD|EV_CLEAR, NOTE_WRITE|NOTE_EXTEND, 0, 0);
+		EV_SET(&e[1], SIGHUP, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+		EV_SET(&e[2], SIGTERM, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+		EV_SET(&e[3], SIGINT, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+		EV_SET(&e[4], SIGPIPE, EVFILT_SIGNAL, EV_ADD, 0, 0, 0);
+		if (0 > kevent(queue, e, sizeof e/sizeof *e, 0, 0, 0)) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+	}
+
+	const int socket_fd(connect_service_manager_socket(!per_user_mode, prog));
+	if (0 > socket_fd) throw EXIT_FAILURE;
+
+	timer_list timers;
+	deadline_heap heap;
+	load_timers(prog, directory, socket_fd, dir_fd.get(), timers, heap);
+
+	for (bool in_shutdown(false); !in_shutdown; ) {
+		try {
+			// Fire everything that is due, rescheduling each timer as it fires.
+			nanoseconds now(since_boot());
+			while (!heap.empty() && heap.top().when <= now) {
+				const std::size_t i(heap.top().index);
+				heap.pop();
+				timer & t(timers[i]);
+				fire(prog, verbose, directory, socket_fd, dir_fd.get(), t);
+				t.last_fired = now;
+				t.fired = true;
+				nanoseconds when;
+				if (t.next(when))
+					heap.push(deadline(when, i));
+				now = since_boot();
+			}
+
+			// A single wakeup for the earliest deadline of all timers, or none at all if no timer is pending.
+			timespec timeout;
+			if (!heap.empty()) {
+				const nanoseconds wait(heap.top().when - now);
+				timeout.tv_sec = wait / SEC;
+				timeout.tv_nsec = wait % SEC;
+			}
+
+			struct kevent p[8];
+			const int rc(kevent(queue, 0, 0, p, sizeof p/sizeof *p, heap.empty() ? 0 : &timeout));
+			if (0 > rc) {
+				const int error(errno);
+				if (EINTR == error) continue;
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
+				throw EXIT_FAILURE;
+			}
+			bool reload(false);
+			for (size_t i(0); i < static_cast<std::size_t>(rc); ++i) {
+				const struct kevent & e(p[i]);
+				switch (e.filter) {
+					case EVFILT_VNODE:
+						reload = true;
+						break;
+					case EVFILT_SIGNAL:
+						switch (e.ident) {
+							case SIGHUP:
+								reload = true;
+								break;
+							case SIGTERM:
+							case SIGINT:
+							case SIGPIPE:
+								in_shutdown = true;
+								break;
+							default:
+								std::fprintf(stderr, "%s: DEBUG: signal event ident %lu fflags %x\n", prog, e.ident, e.fflags);
+								break;
+						}
+						break;
+					default:
+						std::fprintf(stderr, "%s: DEBUG: event filter %hd ident %lu fflags %x\n", prog, e.filter, e.ident, e.fflags);
+						break;
+				}
+			}
+			if (reload && !in_shutdown)
+				load_timers(prog, directory, socket_fd, dir_fd.get(), timers, heap);
+		} catch (const std::exception & e) {
+			std::fprintf(stderr, "%s: ERROR: exception: %s\n", prog, e.what());
+		}
+	}
+	throw EXIT_SUCCESS;
+}
@@ -6,15 +6,21 @@ For copyright and licensing terms, see the file named COPYING.
 #include <vector>
 #include <map>
 #include <set>
+#include <string>
 #include <utility>
+#include <algorithm>
+#include <cstddef>
+#include <cstdio>
 #include <cstdlib>
 #include <csignal>
 #include <cstring>
 #include <cerrno>
-#include <iostream>
+#include <climits>
+#include <stdint.h>
 #include <sys/types.h>
 #include "kqueue_common.h"
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <arpa/inet.h>
 #include <sys/un.h>
 #include <netinet/ip.h>
@@ -29,51 +35,222 @@ For copyright and licensing terms, see the file named COPYING.
 // **************************************************************************
 */
 
-static inline
-void
-process_message (
-	const char * prog,
-	int socket_fd
+namespace {
+
+const std::size_t MAX_MESSAGE(65536U);	// RFC 5426 maximum legal size
+const std::size_t BATCH_SIZE(16U);
+const std::size_t MAX_BATCHES_PER_EVENT(16U);
+const std::size_t MAX_SENDERS(1024U);
+
+union sender_address {
+	sockaddr_storage s;
+	sockaddr_un u;
+};
+
+std::string
+format_sender (
+	const sender_address & remoteaddr,
+	socklen_t addrlen
 ) {
-	char msg[65536];	// RFC 5426 maximum legal size
-	union {
-		sockaddr_storage s;
-		sockaddr_un u;
-	} remoteaddr;
-	socklen_t addrlen(sizeof remoteaddr);
-	const int rc(recvfrom(socket_fd, &msg, sizeof msg, 0, reinterpret_cast<sockaddr *>(&remoteaddr), &addrlen));
-	if (0 > rc) {
-		const int error(errno);
-		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "recv", std::strerror(error));
-		return;
-	}
 	switch (remoteaddr.s.ss_family) {
 		case AF_INET:
 		{
 			const struct sockaddr_in & remoteaddr4(*reinterpret_cast<const struct sockaddr_in *>(&remoteaddr));
-			char ip[INET_ADDRSTRLEN];
-			if (0 != inet_ntop(remoteaddr4.sin_family, &remoteaddr4.sin_addr, ip, sizeof ip))
-				std::clog << ip << ':' << ntohs(remoteaddr4.sin_port) << ": ";
-			break;
+			char ip[INET_ADDRSTRLEN], port[64];
+			if (0 == inet_ntop(remoteaddr4.sin_family, &remoteaddr4.sin_addr, ip, sizeof ip)) break;
+			snprintf(port, sizeof port, ":%u: ", ntohs(remoteaddr4.sin_port));
+			return std::string(ip) + port;
 		}
 		case AF_INET6:
 		{
 			const struct sockaddr_in6 & remoteaddr6(*reinterpret_cast<const struct sockaddr_in6 *>(&remoteaddr));
-			char ip[INET6_ADDRSTRLEN];
-			if (0 != inet_ntop(remoteaddr6.sin6_family, &remoteaddr6.sin6_addr, ip, sizeof ip))
-				std::clog << ip << ':' << ntohs(remoteaddr6.sin6_port) << ": ";
-			break;
+			char ip[INET6_ADDRSTRLEN], port[64];
+			if (0 == inet_ntop(remoteaddr6.sin6_family, &remoteaddr6.sin6_addr, ip, sizeof ip)) break;
+			snprintf(port, sizeof port, ":%u: ", ntohs(remoteaddr6.sin6_port));
+			return std::string(ip) + port;
 		}
 		case AF_LOCAL:
 		{
 			if (addrlen > offsetof(sockaddr_un, sun_path) && remoteaddr.u.sun_path[0])
-				std::clog << remoteaddr.u.sun_path << ": ";
+				return std::string(remoteaddr.u.sun_path, strnlen(remoteaddr.u.sun_path, addrlen - offsetof(sockaddr_un, sun_path))) + ": ";
 			break;
 		}
 		default:
 			break;
 	}
-	std::clog.write(msg, rc).put('\n');
+	return std::string();
+}
+
+/// Write all of the vector, however many writes that takes; giving up, as std::clog does, upon an error.
+void
+write_all (
+	int fd,
+	struct iovec * v,
+	std::size_t n
+) {
+	while (n) {
+		const ssize_t rc(writev(fd, v, n));
+		if (0 > rc) {
+			if (EINTR == errno) continue;
+			return;
+		}
+		std::size_t l(rc);
+		while (n && l >= v->iov_len) {
+			l -= v->iov_len;
+			++v;
+			--n;
+		}
+		if (n) {
+			v->iov_base = static_cast<char *>(v->iov_base) + l;
+			v->iov_len -= l;
+		}
+	}
+}
+
+/// \brief Receive datagrams in batches, and write each batch out with a single writev().
+///
+/// Senders' formatted addresses are cached, since a few senders usually account for most messages.
+/// The cache is emptied, rather than grown without bound, when datagrams arrive from too many different addresses.
+class Receiver {
+public:
+	Receiver();
+	void drain(const char * prog, int socket_fd);
+	unsigned long long query_received() const { return received; }
+	unsigned long long query_dropped() const;
+protected:
+	typedef std::map<std::string, std::string> sender_map;
+	typedef std::map<int, uint32_t> overflow_map;
+	std::vector<char> buffers;
+	struct mmsghdr headers[BATCH_SIZE];
+	struct iovec inputs[BATCH_SIZE], outputs[BATCH_SIZE * 3U];
+	sender_address addresses[BATCH_SIZE];
+#if defined(SO_RXQ_OVFL)
+	struct alignas(cmsghdr) { char b[CMSG_SPACE(sizeof(uint32_t))]; } controls[BATCH_SIZE];
+#endif
+	sender_map senders;
+	overflow_map overflows;
+	unsigned long long received;
+
+	std::size_t receive(const char * prog, int socket_fd);
+	const std::string & sender(const sender_address &, socklen_t);
+	void note_overflow(int socket_fd, const msghdr &);
+};
+
+Receiver::Receiver() :
+	buffers(BATCH_SIZE * MAX_MESSAGE),
+	received(0U)
+{
+}
+
+unsigned long long
+Receiver::query_dropped() const
+{
+	// The kernel's count of datagrams dropped for lack of buffer space is cumulative per socket.
+	unsigned long long dropped(0U);
+	for (overflow_map::const_iterator i(overflows.begin()), e(overflows.end()); i != e; ++i)
+		dropped += i->second;
+	return dropped;
+}
+
+const std::string &
+Receiver::sender (
+	const sender_address & remoteaddr,
+	socklen_t addrlen
+) {
+	const std::string key(reinterpret_cast<const char *>(&remoteaddr), std::min<std::size_t>(addrlen, sizeof remoteaddr));
+	sender_map::iterator i(senders.find(key));
+	if (senders.end() == i)
+		i = senders.insert(sender_map::value_type(key, format_sender(remoteaddr, addrlen))).first;
+	return i->second;
+}
+
+void
+Receiver::note_overflow (
+	int socket_fd,
+	const msghdr & h
+) {
+#if defined(SO_RXQ_OVFL)
+	for (const cmsghdr * c(CMSG_FIRSTHDR(&h)); c; c = CMSG_NXTHDR(const_cast<msghdr *>(&h), const_cast<cmsghdr *>(c))) {
+		if (SOL_SOCKET != c->cmsg_level || SO_RXQ_OVFL != c->cmsg_type) continue;
+		uint32_t count;
+		std::memcpy(&count, CMSG_DATA(c), sizeof count);
+		overflows[socket_fd] = count;
+	}
+#else
+	static_cast<void>(socket_fd);
+	static_cast<void>(h);
+#endif
+}
+
+std::size_t
+Receiver::receive (
+	const char * prog,
+	int socket_fd
+) {
+	// Senders' strings must stay put whilst the output vector points to them, so only empty the cache between batches.
+	if (senders.size() >= MAX_SENDERS)
+		senders.clear();
+	for (std::size_t i(0U); i < BATCH_SIZE; ++i) {
+		inputs[i].iov_base = buffers.data() + i * MAX_MESSAGE;
+		inputs[i].iov_len = MAX_MESSAGE;
+		msghdr & h(headers[i].msg_hdr);
+		h.msg_name = &addresses[i];
+		h.msg_namelen = sizeof addresses[i];
+		h.msg_iov = &inputs[i];
+		h.msg_iovlen = 1;
+#if defined(SO_RXQ_OVFL)
+		h.msg_control = controls[i].b;
+		h.msg_controllen = sizeof controls[i].b;
+#else
+		h.msg_control = 0;
+		h.msg_controllen = 0;
+#endif
+		h.msg_flags = 0;
+		headers[i].msg_len = 0;
+	}
+	const int rc(recvmmsg(socket_fd, headers, BATCH_SIZE, MSG_DONTWAIT, 0));
+	if (0 > rc) {
+		const int error(errno);
+		if (EAGAIN != error && EWOULDBLOCK != error && EINTR != error)
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "recv", std::strerror(error));
+		return 0U;
+	}
+	const std::size_t count(rc);
+	for (std::size_t i(0U); i < count; ++i) {
+		const msghdr & h(headers[i].msg_hdr);
+		const std::string & prefix(sender(addresses[i], h.msg_namelen));
+		note_overflow(socket_fd, h);
+		outputs[3U * i + 0U].iov_base = const_cast<char *>(prefix.data());
+		outputs[3U * i + 0U].iov_len = prefix.length();
+		outputs[3U * i + 1U].iov_base = inputs[i].iov_base;
+		outputs[3U * i + 1U].iov_len = headers[i].msg_len;
+		outputs[3U * i + 2U].iov_base = const_cast<char *>("\n");
+		outputs[3U * i + 2U].iov_len = 1U;
+	}
+	write_all(STDERR_FILENO, outputs, 3U * count);
+	received += count;
+	return count;
+}
+
+void
+Receiver::drain (
+	const char * prog,
+	int socket_fd
+) {
+	// Stop after a while even under a flood, so that signals and other sockets get a look in.
+	for (std::size_t batches(0U); batches < MAX_BATCHES_PER_EVENT; ++batches)
+		if (receive(prog, socket_fd) < BATCH_SIZE)
+			break;
+}
+
+void
+report (
+	const char * prog,
+	const Receiver & receiver
+) {
+	std::fprintf(stderr, "%s: INFO: %llu messages received, %llu dropped\n", prog, receiver.query_received(), receiver.query_dropped());
+}
+
 }
 
 /* Main function ************************************************************
@@ -87,8 +264,14 @@ syslog_read [[gnu::noreturn]] (
 	ProcessEnvironment & envs
 ) {
 	const char * prog(basename_of(args[0]));
+	unsigned long receive_buffer_size(0U);
+	bool has_rcvbuf(false);
 	try {
-		popt::top_table_definition main_option(0, 0, "Main options", "");
+		popt::unsigned_number_definition receive_buffer_size_option('\0', "receive-buffer-size", "bytes", "Specify the socket receive buffer size.", receive_buffer_size, 0);
+		popt::definition * top_table[] = {
+			&receive_buffer_size_option
+		};
+		popt::top_table_definition main_option(sizeof top_table/sizeof *top_table, top_table, "Main options", "");
 
 		std::vector<const char *> new_args;
 		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
@@ -96,6 +279,7 @@ syslog_read [[gnu::noreturn]] (
 		args = new_args;
 		next_prog = arg0_of(args);
 		if (p.stopped()) throw EXIT_SUCCESS;
+		has_rcvbuf = receive_buffer_size_option.is_set();
 	} catch (const popt::error & e) {
 		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
 		throw static_cast<int>(EXIT_USAGE);
@@ -104,6 +288,10 @@ syslog_read [[gnu::noreturn]] (
 		std::fprintf(stderr, "%s: FATAL: %s\n", prog, "Unexpected argument.");
 		throw static_cast<int>(EXIT_USAGE);
 	}
+	if (has_rcvbuf && receive_buffer_size > static_cast<unsigned long>(INT_MAX)) {
+		std::fprintf(stderr, "%s: FATAL: %lu: %s\n", prog, receive_buffer_size, "The receive buffer size is too large.");
+		throw static_cast<int>(EXIT_USAGE);
+	}
 
 	const unsigned listen_fds(query_listen_fds_or_daemontools(envs));
 	if (1U > listen_fds) {
@@ -112,6 +300,29 @@ syslog_read [[gnu::noreturn]] (
 		throw EXIT_FAILURE;
 	}
 
+	for (unsigned i(0U); i < listen_fds; ++i) {
+		const int socket_fd(LISTEN_SOCKET_FILENO + i);
+#if defined(SO_RCVBUF)
+		if (has_rcvbuf) {
+			const int size(static_cast<int>(receive_buffer_size));
+			if (true
+#if defined(SO_RCVBUFFORCE)
+			&&  0 > setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof size)
+#endif
+			&&  0 > setsockopt(socket_fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof size)
+			) {
+				const int error(errno);
+				std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, "SO_RCVBUF", std::strerror(error));
+			}
+		}
+#endif
+#if defined(SO_RXQ_OVFL)
+		// This is purely informational, so failure is not an error.
+		const int on(1);
+		setsockopt(socket_fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof on);
+#endif
+	}
+
 	ReserveSignalsForKQueue kqueue_reservation(SIGTERM, SIGINT, SIGHUP, SIGTSTP, SIGALRM, SIGPIPE, SIGQUIT, 0);
 	PreventDefaultForFatalSignals ignored_signals(SIGTERM, SIGINT, SIGHUP, SIGTSTP, SIGALRM, SIGPIPE, SIGQUIT, 0);
 
@@ -140,51 +351,59 @@ syslog_read [[gnu::noreturn]] (
 		}
 	}
 
+	Receiver receiver;
+	std::vector<struct kevent> events(listen_fds + 7);
 	bool in_shutdown(false);
 	for (;;) {
 		try {
 			if (in_shutdown) break;
-			struct kevent e;
-			if (0 > kevent(queue, 0, 0, &e, 1, 0)) {
+			const int rc(kevent(queue, 0, 0, events.data(), events.size(), 0));
+			if (0 > rc) {
 				const int error(errno);
 				if (EINTR == error) continue;
 				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "kevent", std::strerror(error));
 				throw EXIT_FAILURE;
 			}
-			switch (e.filter) {
-				case EVFILT_READ:
-					if (LISTEN_SOCKET_FILENO <= static_cast<int>(e.ident) && LISTEN_SOCKET_FILENO + static_cast<int>(listen_fds) > static_cast<int>(e.ident))
-						process_message(prog, e.ident);
-					else
-						std::fprintf(stderr, "%s: DEBUG: read event ident %lu\n", prog, e.ident);
-					break;
-				case EVFILT_SIGNAL:
-					switch (e.ident) {
-						case SIGHUP:
-						case SIGTERM:
-						case SIGINT:
-						case SIGPIPE:
-						case SIGQUIT:
-							in_shutdown = true;
-							break;
-						case SIGTSTP:
-							std::fprintf(stderr, "%s: INFO: %s\n", prog, "Paused.");
-							raise(SIGSTOP);
-							std::fprintf(stderr, "%s: INFO: %s\n", prog, "Continued.");
-							break;
-						case SIGALRM:
-						default:
-							std::fprintf(stderr, "%s: DEBUG: signal event ident %lu fflags %x\n", prog, e.ident, e.fflags);
-							break;
-					}
-					break;
-				default:
-					std::fprintf(stderr, "%s: DEBUG: event filter %hd ident %lu fflags %x\n", prog, e.filter, e.ident, e.fflags);
-					break;
+			for (std::size_t i(0U); i < static_cast<std::size_t>(rc); ++i) {
+				const struct kevent & e(events[i]);
+				switch (e.filter) {
+					case EVFILT_READ:
+						if (LISTEN_SOCKET_FILENO <= static_cast<int>(e.ident) && LISTEN_SOCKET_FILENO + static_cast<int>(listen_fds) > static_cast<int>(e.ident))
+							receiver.drain(prog, e.ident);
+						else
+							std::fprintf(stderr, "%s: DEBUG: read event ident %lu\n", prog, e.ident);
+						break;
+					case EVFILT_SIGNAL:
+						switch (e.ident) {
+							case SIGHUP:
+							case SIGTERM:
+							case SIGINT:
+							case SIGPIPE:
+							case SIGQUIT:
+								in_shutdown = true;
+								break;
+							case SIGTSTP:
+								std::fprintf(stderr, "%s: INFO: %s\n", prog, "Paused.");
+								raise(SIGSTOP);
+								std::fprintf(stderr, "%s: INFO: %s\n", prog, "Continued.");
+								break;
+							case SIGALRM:
+								report(prog, receiver);
+								break;
+							default:
+								std::fprintf(stderr, "%s: DEBUG: signal event ident %lu fflags %x\n", prog, e.ident, e.fflags);
+								break;
+						}
+						break;
+					default:
+						std::fprintf(stderr, "%s: DEBUG: event filter %hd ident %lu fflags %x\n", prog, e.filter, e.ident, e.fflags);
+						break;
+				}
 			}
 		} catch (const std::exception & e) {
 			std::fprintf(stderr, "%s: ERROR: exception: %s\n", prog, e.what());
 		}
 	}
+	report(prog, receiver);
 	throw EXIT_SUCCESS;
 }
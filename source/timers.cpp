@@ -16,10 +16,14 @@ For copyright and licensing terms, see the file named COPYING.
 #include <inttypes.h>
 #include <stdint.h>
 #include <sys/stat.h>
+#if defined(__LINUX__) || defined(__linux__)
+#include <sys/timerfd.h>
+#endif
 #include <unistd.h>
 #include "utils.h"
 //#include "tai64utils.h"
 #include "ProcessEnvironment.h"
+#include "FileDescriptorOwner.h"
 #include "popt.h"
 
 /* Time handling and parsing ************************************************
@@ -860,6 +864,38 @@ time_pause_until (
 		sigpause(0);
 #endif
 	} else
+#if defined(__LINUX__) || defined(__linux__)
+	{
+		// Sleep once, until the absolute time, unless the system clock is stepped; whereupon we re-check against the new clock.
+		const FileDescriptorOwner timer_fd(timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC));
+		if (0 > timer_fd.get()) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "timerfd_create", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		const TimeTAndLeap z(tai64_to_time(envs, t.query_seconds()));
+		itimerspec i = {};
+		i.it_value.tv_sec = z.time;
+		i.it_value.tv_nsec = t.query_nanoseconds();
+		for (;;) {
+			NullableTAI64N n;
+			n.now(envs);
+			if (n.query_seconds() > t.query_seconds()) break;	// The time has passed.
+			if (n.query_seconds() == t.query_seconds() && n.query_nanoseconds() >= t.query_nanoseconds()) break;	// The time has passed.
+			if (0 > timerfd_settime(timer_fd.get(), TFD_TIMER_ABSTIME|TFD_TIMER_CANCEL_ON_SET, &i, 0)) {
+				const int error(errno);
+				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "timerfd_settime", std::strerror(error));
+				throw EXIT_FAILURE;
+			}
+			uint64_t expirations;
+			if (0 <= read(timer_fd.get(), &expirations, sizeof expirations)) break;
+			const int error(errno);
+			if (ECANCELED == error || EINTR == error) continue;
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "read", std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+	}
+#else
 	for (;;) {
 		NullableTAI64N n;
 		n.now(envs);
@@ -889,4 +925,5 @@ time_pause_until (
 			nanosleep(&i, 0);
 		}
 	}
+#endif
 }
@@ -4,6 +4,8 @@ For copyright and licensing terms, see the file named COPYING.
 */
 
 #include <vector>
+#include <string>
+#include <cstddef>
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
@@ -13,11 +15,42 @@ For copyright and licensing terms, see the file named COPYING.
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <unistd.h>
+#include <sys/stat.h>
 #include "popt.h"
 #include "utils.h"
 #include "fdutils.h"
 #include "ProcessEnvironment.h"
 #include "IPAddress.h"
+#include "FileDescriptorOwner.h"
+#include "SocketAccessRules.h"
+
+/* IP address masks *********************************************************
+// **************************************************************************
+*/
+
+namespace {
+
+	inline
+	in_addr 
+	make_mask4 (
+		unsigned prefix_length
+	) {
+		in_addr r;
+		IPAddress::SetPrefix(r, prefix_length);
+		return r;
+	}
+
+	inline
+	in6_addr 
+	make_mask6 (
+		unsigned prefix_length
+	) {
+		in6_addr r;
+		IPAddress::SetPrefix(r, prefix_length);
+		return r;
+	}
+
+}
 
 /* Rules processing *********************************************************
 // **************************************************************************
@@ -27,19 +60,99 @@ namespace {
 
 	bool verbose(false);
 
+	const char compiled_name[] = "compiled";
+
+	/// The directories whose entries are the rule directories, which change when rules are added or removed.
+	const char * const rule_dirs[] = { "ip4", "ip6", "uid", "gid" };
+
+	SocketAccessRules compiled_rules;
+	bool use_compiled(false);
+
+	/// Use the compiled rules database in preference to the rule directories, if there is one that is up to date.
+	void
+	load_compiled (
+		const char * prog
+	) {
+		const FileDescriptorOwner fd(open_read_at(AT_FDCWD, compiled_name));
+		if (0 > fd.get()) return;
+		struct stat c;
+		if (0 > fstat(fd.get(), &c)) return;
+		for (std::size_t i(0U); i < sizeof rule_dirs/sizeof *rule_dirs; ++i) {
+			struct stat s;
+			if (0 <= fstatat(AT_FDCWD, rule_dirs[i], &s, 0)
+			&&  (s.st_mtim.tv_sec > c.st_mtim.tv_sec || (s.st_mtim.tv_sec == c.st_mtim.tv_sec && s.st_mtim.tv_nsec > c.st_mtim.tv_nsec))
+			) {
+				std::fprintf(stderr, "%s: WARNING: %s: %s/: %s\n", prog, compiled_name, rule_dirs[i], "Rules have changed since compilation; ignored.");
+				return;
+			}
+		}
+		if (!compiled_rules.map_compiled(fd.get())) {
+			std::fprintf(stderr, "%s: WARNING: %s: %s\n", prog, compiled_name, "Not a valid compiled rules database; ignored.");
+			return;
+		}
+		use_compiled = true;
+	}
+
+	SocketAccessRules::verdict
+	uid_verdict (
+		const std::string & id
+	) {
+		if (use_compiled) return compiled_rules.query_uid(id);
+		return SocketAccessRules::query_directory(AT_FDCWD, ("uid/" + id + "/").c_str());
+	}
+
+	SocketAccessRules::verdict
+	gid_verdict (
+		const std::string & id
+	) {
+		if (use_compiled) return compiled_rules.query_gid(id);
+		return SocketAccessRules::query_directory(AT_FDCWD, ("gid/" + id + "/").c_str());
+	}
+
+	SocketAccessRules::verdict
+	ip4_verdict (
+		const in_addr & addr4
+	) {
+		if (use_compiled) return compiled_rules.query_ip4(addr4);
+		const std::string dir("ip4/");
+		for (unsigned prefix_length(33); prefix_length > 0; ) {
+			--prefix_length;
+			const in_addr net4(make_mask4(prefix_length) & addr4);
+			char buf[INET_ADDRSTRLEN], suffix[32];
+			inet_ntop(AF_INET, &net4, buf, sizeof buf);
+			snprintf(suffix, sizeof suffix, "_%u", prefix_length);
+			const SocketAccessRules::verdict v(SocketAccessRules::query_directory(AT_FDCWD, ((dir + buf) + suffix).c_str()));
+			if (SocketAccessRules::NONE != v) return v;
+		}
+		return SocketAccessRules::NONE;
+	}
+
+	SocketAccessRules::verdict
+	ip6_verdict (
+		const in6_addr & addr6
+	) {
+		if (use_compiled) return compiled_rules.query_ip6(addr6);
+		const std::string dir("ip6/");
+		for (unsigned prefix_length(129); prefix_length > 0; ) {
+			--prefix_length;
+			const in6_addr net6(make_mask6(prefix_length) & addr6);
+			char buf[INET6_ADDRSTRLEN], suffix[32];
+			inet_ntop(AF_INET6, &net6, buf, sizeof buf);
+			snprintf(suffix, sizeof suffix, "_%u", prefix_length);
+			const SocketAccessRules::verdict v(SocketAccessRules::query_directory(AT_FDCWD, ((dir + buf) + suffix).c_str()));
+			if (SocketAccessRules::NONE != v) return v;
+		}
+		return SocketAccessRules::NONE;
+	}
+
 	bool
 	allowed (
 		const char * prog,
 		const char * name,
-		const std::string & subdir
+		SocketAccessRules::verdict v
 	) {
-		const int dir_fd(open_dir_at(AT_FDCWD, subdir.c_str()));
-		if (0 > dir_fd) return false;
-		const int allowed(faccessat(dir_fd, "allow", F_OK, AT_EACCESS));
-		const int denied(faccessat(dir_fd, "deny", F_OK, AT_EACCESS));
-		close(dir_fd);
-		if (0 <= allowed) return true;
-		if (0 <= denied) {
+		if (SocketAccessRules::ALLOW == v) return true;
+		if (SocketAccessRules::DENY == v) {
 			if (verbose)
 				std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, name, "Access denied.");
 			throw EXIT_FAILURE;
@@ -60,34 +173,6 @@ namespace {
 
 }
 
-/* IP address masks *********************************************************
-// **************************************************************************
-*/
-
-namespace {
-
-	inline
-	in_addr 
-	make_mask4 (
-		unsigned prefix_length
-	) {
-		in_addr r;
-		IPAddress::SetPrefix(r, prefix_length);
-		return r;
-	}
-
-	inline
-	in6_addr 
-	make_mask6 (
-		unsigned prefix_length
-	) {
-		in6_addr r;
-		IPAddress::SetPrefix(r, prefix_length);
-		return r;
-	}
-
-}
-
 /* Main function ************************************************************
 // **************************************************************************
 */
@@ -122,6 +207,8 @@ ucspi_socket_rules_check (
 		throw static_cast<int>(EXIT_USAGE);
 	}
 
+	load_compiled(prog);
+
 	const char * proto(envs.query("PROTO"));
 	if (!proto) {
 		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "PROTO", "Missing environment variable.");
@@ -138,11 +225,11 @@ ucspi_socket_rules_check (
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "UNIXREMOTEEGID", "Missing environment variable.");
 			throw EXIT_FAILURE;
 		}
-		if (is_self(uid, geteuid()) && allowed(prog, uid, "uid/self/")) return;
-		if (is_self(gid, getegid()) && allowed(prog, gid, "gid/self/")) return;
-		if (allowed(prog, uid, "uid/" + std::string(uid) + "/")) return;
-		if (allowed(prog, gid, "gid/" + std::string(gid) + "/")) return;
-		if (allowed(prog, "default", "uid/default/")) return;
+		if (is_self(uid, geteuid()) && allowed(prog, uid, uid_verdict("self"))) return;
+		if (is_self(gid, getegid()) && allowed(prog, gid, gid_verdict("self"))) return;
+		if (allowed(prog, uid, uid_verdict(uid))) return;
+		if (allowed(prog, gid, gid_verdict(gid))) return;
+		if (allowed(prog, "default", uid_verdict("default"))) return;
 		if (verbose)
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, proto, "Access denied.");
 		throw EXIT_FAILURE;
@@ -156,26 +243,10 @@ ucspi_socket_rules_check (
 		struct in_addr addr4;
 		struct in6_addr addr6;
 		if (0 < inet_pton(AF_INET, ip, &addr4)) {
-			const std::string dir("ip4/");
-			for (unsigned prefix_length(33); prefix_length > 0; ) {
-				--prefix_length;
-				const in_addr net4(make_mask4(prefix_length) & addr4);
-				char buf[INET_ADDRSTRLEN], suffix[32];
-				inet_ntop(AF_INET, &net4, buf, sizeof buf);
-				snprintf(suffix, sizeof suffix, "_%u", prefix_length);
-				if (allowed(prog, ip, (dir + buf) + suffix)) return;
-			}
+			if (allowed(prog, ip, ip4_verdict(addr4))) return;
 		} else 
 		if (0 < inet_pton(AF_INET6, ip, &addr6)) {
-			const std::string dir("ip6/");
-			for (unsigned prefix_length(129); prefix_length > 0; ) {
-				--prefix_length;
-				const in6_addr net6(make_mask6(prefix_length) & addr6);
-				char buf[INET6_ADDRSTRLEN], suffix[32];
-				inet_ntop(AF_INET6, &net6, buf, sizeof buf);
-				snprintf(suffix, sizeof suffix, "_%u", prefix_length);
-				if (allowed(prog, ip, (dir + buf) + suffix)) return;
-			}
+			if (allowed(prog, ip, ip6_verdict(addr6))) return;
 		} else 
 		{
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, ip, "Invalid IP address.");
@@ -194,26 +265,10 @@ ucspi_socket_rules_check (
 		struct in_addr addr4;
 		struct in6_addr addr6;
 		if (0 < inet_pton(AF_INET, ip, &addr4)) {
-			const std::string dir("ip4/");
-			for (unsigned prefix_length(33); prefix_length > 0; ) {
-				--prefix_length;
-				const struct in_addr net4(make_mask4(prefix_length) & addr4);
-				char buf[INET_ADDRSTRLEN], suffix[32];
-				inet_ntop(AF_INET, &net4, buf, sizeof buf);
-				snprintf(suffix, sizeof suffix, "_%u", prefix_length);
-				if (allowed(prog, ip, (dir + buf) + suffix)) return;
-			}
+			if (allowed(prog, ip, ip4_verdict(addr4))) return;
 		} else 
 		if (0 < inet_pton(AF_INET6, ip, &addr6)) {
-			const std::string dir("ip6/");
-			for (unsigned prefix_length(129); prefix_length > 0; ) {
-				--prefix_length;
-				const struct in6_addr net6(make_mask6(prefix_length) & addr6);
-				char buf[INET6_ADDRSTRLEN], suffix[32];
-				inet_ntop(AF_INET6, &net6, buf, sizeof buf);
-				snprintf(suffix, sizeof suffix, "_%u", prefix_length);
-				if (allowed(prog, ip, (dir + buf) + suffix)) return;
-			}
+			if (allowed(prog, ip, ip6_verdict(addr6))) return;
 		} else 
 		{
 			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, ip, "Invalid IP address.");
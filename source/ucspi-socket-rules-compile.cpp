@@ -0,0 +1,164 @@
+/* COPYING ******************************************************************
+For copyright and licensing terms, see the file named COPYING.
+// **************************************************************************
+*/
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include "popt.h"
+#include "utils.h"
+#include "fdutils.h"
+#include "ProcessEnvironment.h"
+#include "FileDescriptorOwner.h"
+#include "DirStar.h"
+#include "IPAddress.h"
+#include "SocketAccessRules.h"
+
+/* Reading the rule directories *********************************************
+// **************************************************************************
+*/
+
+namespace {
+
+	/// \brief Split a rule directory name of the form address_prefixlength into its parts.
+	bool
+	split_network (
+		const std::string & name,
+		std::string & address,
+		unsigned long & prefix_length
+	) {
+		const std::string::size_type u(name.rfind('_'));
+		if (std::string::npos == u) return false;
+		address = name.substr(0, u);
+		const char * const s(name.c_str() + u + 1), * end(s);
+		prefix_length = std::strtoul(s, const_cast<char **>(&end), 10);
+		return !*end && end != s;
+	}
+
+	/// Call the function for every rule directory in the subdirectory, and its verdict.
+	template<typename F>
+	void
+	for_each_rule (
+		const char * prog,
+		const char * subdir,
+		F f
+	) {
+		FileDescriptorOwner dir_fd(open_dir_at(AT_FDCWD, subdir));
+		if (0 > dir_fd.get()) {
+			const int error(errno);
+			if (ENOENT == error) return;
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, subdir, std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		const DirStar dir(dir_fd);
+		if (!dir) {
+			const int error(errno);
+			std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, subdir, std::strerror(error));
+			throw EXIT_FAILURE;
+		}
+		for (;;) {
+			errno = 0;
+			const dirent * entry(readdir(dir));
+			if (!entry) {
+				const int error(errno);
+				if (error) {
+					std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, subdir, std::strerror(error));
+					throw EXIT_FAILURE;
+				}
+				break;
+			}
+#if defined(_DIRENT_HAVE_D_NAMLEN)
+			if (1 > entry->d_namlen) continue;
+#endif
+			if ('.' == entry->d_name[0]) continue;
+			const SocketAccessRules::verdict v(SocketAccessRules::query_directory(dir.fd(), entry->d_name));
+			if (SocketAccessRules::NONE != v)
+				f(std::string(entry->d_name), v);
+		}
+	}
+
+	/// Only a directory named for the network exactly as ucspi-socket-rules-check formats it can ever match.
+	template<typename A, int family, unsigned bits, std::size_t buflen>
+	struct add_network {
+		add_network(const char * p, const char * d, SocketAccessRules & r, void (SocketAccessRules::*a)(const A &, unsigned, SocketAccessRules::verdict)) : prog(p), subdir(d), rules(r), add(a) {}
+		void operator() (const std::string & name, SocketAccessRules::verdict v) const {
+			std::string address;
+			unsigned long prefix_length;
+			A a, mask;
+			char buf[buflen];
+			if (split_network(name, address, prefix_length)
+			&&  prefix_length <= bits
+			&&  0 < inet_pton(family, address.c_str(), &a)
+			) {
+				IPAddress::SetPrefix(mask, prefix_length);
+				a = a & mask;
+				if (inet_ntop(family, &a, buf, sizeof buf) && address == buf) {
+					(rules.*add)(a, prefix_length, v);
+					return;
+				}
+			}
+			std::fprintf(stderr, "%s: WARNING: %s%s: %s\n", prog, subdir, name.c_str(), "Not a network address and prefix length in canonical form; ignored.");
+		}
+		const char * prog, * subdir;
+		SocketAccessRules & rules;
+		void (SocketAccessRules::*add)(const A &, unsigned, SocketAccessRules::verdict);
+	};
+
+	struct add_id {
+		add_id(SocketAccessRules & r, void (SocketAccessRules::*a)(const std::string &, SocketAccessRules::verdict)) : rules(r), add(a) {}
+		void operator() (const std::string & name, SocketAccessRules::verdict v) const { (rules.*add)(name, v); }
+		SocketAccessRules & rules;
+		void (SocketAccessRules::*add)(const std::string &, SocketAccessRules::verdict);
+	};
+
+}
+
+/* Main function ************************************************************
+// **************************************************************************
+*/
+
+void
+ucspi_socket_rules_compile [[gnu::noreturn]] (
+	const char * & /*next_prog*/,
+	std::vector<const char *> & args,
+	ProcessEnvironment & /*envs*/
+) {
+	const char * prog(basename_of(args[0]));
+	try {
+		popt::top_table_definition main_option(0, 0, "Main options", "");
+
+		std::vector<const char *> new_args;
+		popt::arg_processor<const char **> p(args.data() + 1, args.data() + args.size(), prog, main_option, new_args);
+		p.process(true /* strictly options before arguments */);
+		args = new_args;
+		if (p.stopped()) throw EXIT_SUCCESS;
+	} catch (const popt::error & e) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, e.arg, e.msg);
+		throw static_cast<int>(EXIT_USAGE);
+	}
+	if (!args.empty()) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, args.front(), "Unexpected argument.");
+		throw static_cast<int>(EXIT_USAGE);
+	}
+
+	SocketAccessRules rules;
+	for_each_rule(prog, "ip4/", add_network<in_addr, AF_INET, 32U, INET_ADDRSTRLEN>(prog, "ip4/", rules, &SocketAccessRules::add_ip4));
+	for_each_rule(prog, "ip6/", add_network<in6_addr, AF_INET6, 128U, INET6_ADDRSTRLEN>(prog, "ip6/", rules, &SocketAccessRules::add_ip6));
+	for_each_rule(prog, "uid/", add_id(rules, &SocketAccessRules::add_uid));
+	for_each_rule(prog, "gid/", add_id(rules, &SocketAccessRules::add_gid));
+	rules.write_compiled(stdout);
+	if (std::ferror(stdout) || 0 != std::fflush(stdout)) {
+		std::fprintf(stderr, "%s: FATAL: %s: %s\n", prog, "<stdout>", "Write error.");
+		throw EXIT_FAILURE;
+	}
+	throw EXIT_SUCCESS;
+}
@@ -29,6 +29,14 @@ struct command {
 } ;
 extern const command commands[], personalities[];
 extern const std::size_t num_commands, num_personalities;
+/// \brief A minimal perfect hash of the names in a table of commands, generated at build time by default.hash.h.do.
+struct command_hash {
+	std::size_t slots;
+	const int * displacements;
+	const unsigned short * indices;
+	const unsigned char * lengths;
+} ;
+extern const command_hash commands_hash, personalities_hash;
 
 extern 
 const char *